@@ -0,0 +1,267 @@
+/*
+ * Copyright 2006-2008 Ondrej Jirman <ondrej.jirman@zonio.net>
+ *
+ * This file is part of libxr.
+ *
+ * Libxr is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * Libxr is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file xr-binary.h
+ *
+ * Schema Binary Encoding
+ *
+ * Primitives used by the marshallers generated by @ref xdlc for the
+ * @ref XR_CALL_BINARY transport. Values are encoded as fields, each field
+ * starts with a key that combines field number and wire type:
+ *
+ *   key = varint(field << 3 | wire type)
+ *
+ * Ints are zigzag varints, booleans are varints 0 or 1, doubles are 8 byte little endian
+ * and strings, times, blobs, structs and arrays are length delimited.
+ * Struct members are fields numbered in XDL, array items are encoded
+ * back to back without keys. Values of @b any type are encoded as
+ * MessagePack inside of the length delimited field.
+ *
+ * Readers skip fields with unknown numbers, so that peers using older and
+ * newer versions of the XDL interface can talk to each other.
+ *
+ * @note You should not need to use this API directly, it is used by the
+ * generated code.
+ */
+
+#ifndef __XR_BINARY_H__
+#define __XR_BINARY_H__
+
+#include "xr-value.h"
+
+/** Wire types.
+ */
+typedef enum {
+  XR_BINARY_VARINT = 0,  /**< Varint (int, boolean). */
+  XR_BINARY_FIXED64 = 1, /**< 8 byte little endian (double). */
+  XR_BINARY_BYTES = 2    /**< Length delimited (everything else). */
+} xr_binary_wire_type;
+
+/** Binary reader, it is just a range of the input buffer.
+ */
+typedef struct _xr_binary_reader xr_binary_reader;
+
+struct _xr_binary_reader
+{
+  const guchar* p;    /**< Current position. */
+  const guchar* end;  /**< End of the range. */
+};
+
+G_BEGIN_DECLS
+
+/** Write field key.
+ *
+ * @param buf Output buffer.
+ * @param field Field number, 0 writes nothing (array items).
+ * @param wt Wire type.
+ */
+void xr_binary_write_key(GString* buf, guint field, xr_binary_wire_type wt);
+
+/** Write unsigned varint.
+ *
+ * @param buf Output buffer.
+ * @param v Value.
+ */
+void xr_binary_write_varint(GString* buf, guint64 v);
+
+/** Start length delimited field. Length is filled in by
+ * @ref xr_binary_end.
+ *
+ * @param buf Output buffer.
+ * @param field Field number, 0 for array items.
+ *
+ * @return Mark that must be passed to @ref xr_binary_end.
+ */
+gsize xr_binary_begin(GString* buf, guint field);
+
+/** Finish length delimited field started by @ref xr_binary_begin.
+ *
+ * @param buf Output buffer.
+ * @param mark Mark returned by @ref xr_binary_begin.
+ */
+void xr_binary_end(GString* buf, gsize mark);
+
+/** Write int field.
+ *
+ * @param buf Output buffer.
+ * @param field Field number, 0 for array items.
+ * @param v Value.
+ *
+ * @return Always TRUE.
+ */
+gboolean xr_binary_write_int(GString* buf, guint field, int v);
+
+/** Write boolean field.
+ *
+ * @param buf Output buffer.
+ * @param field Field number, 0 for array items.
+ * @param v Value.
+ *
+ * @return Always TRUE.
+ */
+gboolean xr_binary_write_bool(GString* buf, guint field, gboolean v);
+
+/** Write double field.
+ *
+ * @param buf Output buffer.
+ * @param field Field number, 0 for array items.
+ * @param v Value.
+ *
+ * @return Always TRUE.
+ */
+gboolean xr_binary_write_double(GString* buf, guint field, double v);
+
+/** Write string or time field. NULL is written as empty string.
+ *
+ * @param buf Output buffer.
+ * @param field Field number, 0 for array items.
+ * @param v Value.
+ *
+ * @return Always TRUE.
+ */
+gboolean xr_binary_write_string(GString* buf, guint field, const char* v);
+
+/** Write blob field.
+ *
+ * @param buf Output buffer.
+ * @param field Field number, 0 for array items.
+ * @param v Value.
+ *
+ * @return FALSE if blob is NULL.
+ */
+gboolean xr_binary_write_blob(GString* buf, guint field, xr_blob* v);
+
+/** Write field of the any type.
+ *
+ * @param buf Output buffer.
+ * @param field Field number, 0 for array items.
+ * @param v Value.
+ *
+ * @return FALSE if value is NULL.
+ */
+gboolean xr_binary_write_value(GString* buf, guint field, xr_value* v);
+
+/** Initialize reader.
+ *
+ * @param r Reader.
+ * @param buf Input buffer.
+ * @param len Length of the buffer.
+ */
+void xr_binary_reader_init(xr_binary_reader* r, const char* buf, gsize len);
+
+/** Read field key.
+ *
+ * @param r Reader.
+ * @param wt Wire type of the field.
+ *
+ * @return Field number, 0 at the end of the input and -1 on error.
+ */
+int xr_binary_read_key(xr_binary_reader* r, xr_binary_wire_type* wt);
+
+/** Skip value of the field with unknown number.
+ *
+ * @param r Reader.
+ * @param wt Wire type of the field.
+ *
+ * @return FALSE on malformed input.
+ */
+gboolean xr_binary_skip(xr_binary_reader* r, xr_binary_wire_type wt);
+
+/** Read unsigned varint.
+ *
+ * @param r Reader.
+ * @param v Value.
+ *
+ * @return FALSE on malformed input.
+ */
+gboolean xr_binary_read_varint(xr_binary_reader* r, guint64* v);
+
+/** Read body of the length delimited field.
+ *
+ * @param r Reader.
+ * @param wt Wire type of the field.
+ * @param body Reader that is set to the field body.
+ *
+ * @return FALSE on malformed input or wire type mismatch.
+ */
+gboolean xr_binary_read_nested(xr_binary_reader* r, xr_binary_wire_type wt, xr_binary_reader* body);
+
+/** Read int field.
+ *
+ * @param r Reader.
+ * @param wt Wire type of the field.
+ * @param v Value.
+ *
+ * @return FALSE on malformed input or wire type mismatch.
+ */
+gboolean xr_binary_read_int(xr_binary_reader* r, xr_binary_wire_type wt, int* v);
+
+/** Read boolean field.
+ *
+ * @param r Reader.
+ * @param wt Wire type of the field.
+ * @param v Value.
+ *
+ * @return FALSE on malformed input or wire type mismatch.
+ */
+gboolean xr_binary_read_bool(xr_binary_reader* r, xr_binary_wire_type wt, gboolean* v);
+
+/** Read double field.
+ *
+ * @param r Reader.
+ * @param wt Wire type of the field.
+ * @param v Value.
+ *
+ * @return FALSE on malformed input or wire type mismatch.
+ */
+gboolean xr_binary_read_double(xr_binary_reader* r, xr_binary_wire_type wt, double* v);
+
+/** Read string or time field. Previous value of @a v is freed.
+ *
+ * @param r Reader.
+ * @param wt Wire type of the field.
+ * @param v Value, free it with g_free.
+ *
+ * @return FALSE on malformed input or wire type mismatch.
+ */
+gboolean xr_binary_read_string(xr_binary_reader* r, xr_binary_wire_type wt, char** v);
+
+/** Read blob field. Previous value of @a v is unrefed.
+ *
+ * @param r Reader.
+ * @param wt Wire type of the field.
+ * @param v Value, free it with xr_blob_unref.
+ *
+ * @return FALSE on malformed input or wire type mismatch.
+ */
+gboolean xr_binary_read_blob(xr_binary_reader* r, xr_binary_wire_type wt, xr_blob** v);
+
+/** Read field of the any type. Previous value of @a v is unrefed.
+ *
+ * @param r Reader.
+ * @param wt Wire type of the field.
+ * @param v Value, free it with xr_value_unref.
+ *
+ * @return FALSE on malformed input or wire type mismatch.
+ */
+gboolean xr_binary_read_value(xr_binary_reader* r, xr_binary_wire_type wt, xr_value** v);
+
+G_END_DECLS
+
+#endif
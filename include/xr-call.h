@@ -40,6 +40,8 @@ typedef enum {
 #ifdef XR_JSON_ENABLED
   XR_CALL_JSON_RPC,
 #endif
+  XR_CALL_MSGPACK,
+  XR_CALL_BINARY, /* schema binary encoding, generated code only */
   XR_CALL_TRANSPORT_COUNT /* must be last, not a real transport */
 } xr_call_transport;
 
@@ -48,6 +50,11 @@ typedef enum {
  */
 typedef struct _xr_call xr_call;
 
+/** Name of the method that carries batch of calls (XML-RPC
+ * system.multicall).
+ */
+#define XR_CALL_MULTICALL "system.multicall"
+
 G_BEGIN_DECLS
 
 /** Create new call obejct.
@@ -71,6 +78,14 @@ void xr_call_free(xr_call* call);
  */
 void xr_call_set_transport(xr_call* call, xr_call_transport transport);
 
+/** Get transport type.
+ *
+ * @param call Call object.
+ *
+ * @return Transport type.
+ */
+xr_call_transport xr_call_get_transport(xr_call* call);
+
 /** Get method name  (second part if in Servlet.Method format).
  *
  * @param call Call obejct.
@@ -119,6 +134,31 @@ void xr_call_add_param(xr_call* call, xr_value* val);
  */
 xr_value* xr_call_get_param(xr_call* call, unsigned int pos);
 
+/** Set parameters already encoded in the format of the call transport.
+ * This is used by the generated code for @ref XR_CALL_BINARY transport.
+ * @param call Call obejct.
+ * @param buf Encoded parameters. Call object takes ownership of the buffer.
+ */
+void xr_call_set_raw_params(xr_call* call, GString* buf);
+
+/** Get encoded parameters (see @ref xr_call_set_raw_params).
+ * @param call Call obejct.
+ * @param len Pointer to the variable to store length to.
+ * @return Encoded parameters or NULL if not set.
+ * @warning Returned value is still owned by the call object. Don't free it!
+ */
+const char* xr_call_get_raw_params(xr_call* call, int* len);
+
+/** Keep params of the XML-RPC and JSON-RPC request as text, so that
+ * generated code can read them directly (see xr-wire.h). Params are
+ * converted to @ref xr_value nodes when @ref xr_call_get_param is called.
+ * Generated code also writes return value of such calls as text.
+ * Must be called before @ref xr_call_unserialize_request.
+ * @param call Call obejct.
+ * @param defer TRUE to keep params as text.
+ */
+void xr_call_set_defer_params(xr_call* call, gboolean defer);
+
 /** Set return value of the XML-RPC call.
  *
  * @param call Call obejct.
@@ -137,6 +177,22 @@ void xr_call_set_retval(xr_call* call, xr_value* val);
  */
 xr_value* xr_call_get_retval(xr_call* call);
 
+/** Set return value already encoded in the format of the call transport.
+ * This is used by the generated code for @ref XR_CALL_BINARY transport.
+ * @param call Call obejct.
+ * @param buf Encoded return value. Call object takes ownership of the
+ *   buffer.
+ */
+void xr_call_set_raw_retval(xr_call* call, GString* buf);
+
+/** Get encoded return value (see @ref xr_call_set_raw_retval).
+ * @param call Call obejct.
+ * @param len Pointer to the variable to store length to.
+ * @return Encoded return value or NULL if not set.
+ * @warning Returned value is still owned by the call object. Don't free it!
+ */
+const char* xr_call_get_raw_retval(xr_call* call, int* len);
+
 /** Set retval to be stadard XML-RPC error structure. If error is set
  * and retval is set too, error gets preference on serialize response.
  *
@@ -172,6 +228,9 @@ const char* xr_call_get_error_message(xr_call* call);
 void xr_call_serialize_request(xr_call* call, char** buf, int* len);
 
 /** Serialize call object into XML-RPC response.
+ *
+ * Response to JSON-RPC 2.0 notification (request without id) is empty,
+ * notifications are left out of batch responses.
  *
  * @param call Call obejct.
  * @param buf Pointer to the variable to store buffer pointer to.
@@ -209,6 +268,39 @@ gboolean xr_call_unserialize_response(xr_call* call, const char* buf, int len);
  */
 void xr_call_free_buffer(xr_call* call, char* buf);
 
+/** Pack calls into one system.multicall call.
+ *
+ * Multicall has single parameter, array of structs with methodName and
+ * params members. JSON-RPC transport sends it as a batch (array of
+ * request objects).
+ *
+ * @param calls Array of call objects.
+ * @param count Number of calls.
+ *
+ * @return Newly created call object.
+ */
+xr_call* xr_call_multicall_new(xr_call** calls, int count);
+
+/** Check if call is a system.multicall.
+ *
+ * @param call Call obejct.
+ *
+ * @return TRUE if call is a multicall.
+ */
+gboolean xr_call_is_multicall(xr_call* call);
+
+/** Store results of the multicall to the packed calls. Each call gets
+ * its return value or error.
+ *
+ * @param call Multicall obejct.
+ * @param calls Array of call objects passed to @ref xr_call_multicall_new().
+ * @param count Number of calls.
+ *
+ * @return FALSE if multicall failed as a whole, error is set on all calls
+ *   in that case.
+ */
+gboolean xr_call_multicall_get_results(xr_call* call, xr_call** calls, int count);
+
 /** Debugging function that dumps call object to the string.
  *
  * @param call Call obejct.
@@ -53,6 +53,10 @@ G_BEGIN_DECLS
  */
 typedef struct _xr_client_conn xr_client_conn;
 
+/** Opaque data structrure that represents pool of client connections.
+ */
+typedef struct _xr_client_pool xr_client_pool;
+
 /** Create new connection object.
  *
  * @param err Error object.
@@ -70,8 +74,9 @@ void xr_client_free(xr_client_conn* conn);
 
 /** Set transport type.
  *
- * Currently supported types are XR_CALL_XML_RPC and XR_CALL_JSON_RPC (not all
- * xr_value types).
+ * Currently supported types are XR_CALL_XML_RPC, XR_CALL_JSON_RPC (not all
+ * xr_value types), XR_CALL_MSGPACK and XR_CALL_BINARY (only calls made
+ * using the client stubs generated by @ref xdlc).
  * 
  * @param conn Connection object.
  * @param transport Transport type.
@@ -80,6 +85,14 @@ void xr_client_free(xr_client_conn* conn);
  */
 gboolean xr_client_set_transport(xr_client_conn* conn, xr_call_transport transport);
 
+/** Get transport type.
+ *
+ * @param conn Connection object.
+ *
+ * @return Transport type.
+ */
+xr_call_transport xr_client_get_transport(xr_client_conn* conn);
+
 /** Set HTTP header to be used in RPCs.
  *
  * This setting persists until you remove header by passing NULL value or by
@@ -141,6 +154,169 @@ void xr_client_close(xr_client_conn* conn);
  */
 gboolean xr_client_call(xr_client_conn* conn, xr_call* call, GError** err);
 
+/** Perform call asynchronously.
+ *
+ * Request is written and response read by non-blocking operations, the
+ * callback is called from the thread-default main context of the caller.
+ * Call @ref xr_client_call_finish() from the callback to get the result.
+ *
+ * Connection must be open and it can't be used for other calls until the
+ * callback is called. Use multiple connections (@ref xr_client_pool_get())
+ * to perform calls concurrently. If the operation is cancelled, connection
+ * is closed.
+ *
+ * @param conn Connection object.
+ * @param call Call object, must stay valid until the callback is called.
+ * @param cancellable Optional cancellable object.
+ * @param callback Callback to call when the call is done.
+ * @param user_data Data passed to the callback.
+ */
+void xr_client_call_async(xr_client_conn* conn, xr_call* call, GCancellable* cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/** Finish asynchronous call.
+ *
+ * @param conn Connection object.
+ * @param result Result passed to the callback.
+ * @param call Returns call object passed to @ref xr_client_call_async()
+ *   (may be NULL). Generated _async() stubs report parameter marchalization
+ *   failure without call object.
+ * @param err Error object.
+ *
+ * @return Same as @ref xr_client_call().
+ */
+gboolean xr_client_call_finish(xr_client_conn* conn, GAsyncResult* result, xr_call** call, GError** err);
+
+/** Send call without waiting for the response (HTTP pipelining).
+ *
+ * Multiple calls may be sent over one connection before their responses are
+ * received by @ref xr_client_call_receive(). Requests are coalesced and
+ * sent at once when the first response is awaited, by
+ * @ref xr_client_call_flush() or when too much data accumulates. The server
+ * executes pipelined calls one after another.
+ *
+ * Call object must stay valid until it is returned by
+ * @ref xr_client_call_receive(). @ref xr_client_call() can't be used while
+ * some responses are not received. Sending many large calls without
+ * receiving responses may deadlock when both sides fill their socket
+ * buffers, so keep the number of outstanding calls bounded.
+ *
+ * @param conn Connection object.
+ * @param call Call object.
+ * @param err Error object.
+ *
+ * @return Function returns FALSE if the request could not be sent.
+ */
+gboolean xr_client_call_send(xr_client_conn* conn, xr_call* call, GError** err);
+
+/** Receive response to the oldest call sent by @ref xr_client_call_send().
+ *
+ * @param conn Connection object.
+ * @param call Returns call object the response belongs to.
+ * @param err Error object.
+ *
+ * @return Same as @ref xr_client_call(). If connection fails, all remaining
+ *   calls fail with XR_CLIENT_ERROR_CLOSED.
+ */
+gboolean xr_client_call_receive(xr_client_conn* conn, xr_call** call, GError** err);
+
+/** Send calls held back by @ref xr_client_call_send() immediately.
+ *
+ * @param conn Connection object.
+ * @param err Error object.
+ *
+ * @return Function returns FALSE on failure and TRUE on success.
+ */
+gboolean xr_client_call_flush(xr_client_conn* conn, GError** err);
+
+/** Perform multiple calls in one request.
+ *
+ * Calls are packed into system.multicall (JSON-RPC batch) and executed by
+ * the server in one round trip. Each call gets its own return value or
+ * error, use @ref xr_call_get_retval() and @ref xr_call_get_error_code()
+ * to check the results.
+ *
+ * @param conn Connection object.
+ * @param calls Array of call objects.
+ * @param count Number of calls.
+ * @param err Error object.
+ *
+ * @return Function returns FALSE if the batch as a whole failed, errors
+ *   are set on all calls in that case.
+ */
+gboolean xr_client_call_batch(xr_client_conn* conn, xr_call** calls, int count, GError** err);
+
+/** Create pool of keep-alive connections.
+ *
+ * Pool is thread-safe. It keeps connections to each URI opened after use,
+ * so that calls from multiple threads do not have to connect (and do TLS
+ * handshake) every time.
+ *
+ * @param max_idle Maximum number of idle connections kept per URI.
+ * @param max_total Maximum number of connections per URI (both idle and
+ *   checked out), @ref xr_client_pool_get() waits when it is reached.
+ *   Zero means no limit.
+ * @param idle_timeout Idle connections are closed after this number of
+ *   seconds. Zero means no timeout.
+ *
+ * @return New pool object.
+ */
+xr_client_pool* xr_client_pool_new(int max_idle, int max_total, int idle_timeout);
+
+/** Set transport used by pooled connections (XML-RPC by default).
+ *
+ * @param pool Pool object.
+ * @param transport Transport type.
+ */
+void xr_client_pool_set_transport(xr_client_pool* pool, xr_call_transport transport);
+
+/** Check out connection to the URI from the pool.
+ *
+ * Idle connection is reused if the server did not close it in the meantime,
+ * otherwise new connection is opened. Connection must be returned by
+ * @ref xr_client_pool_put(). HTTP headers set on the connection stay set
+ * when it is reused.
+ *
+ * @param pool Pool object.
+ * @param uri URI of the servlet (http[s]://host[:port]/Servlet).
+ * @param err Error object.
+ *
+ * @return Open connection or NULL on failure.
+ */
+xr_client_conn* xr_client_pool_get(xr_client_pool* pool, const char* uri, GError** err);
+
+/** Return connection to the pool.
+ *
+ * Connection is kept for reuse if it is still open and ready for the next
+ * call, otherwise it is freed.
+ *
+ * @param pool Pool object.
+ * @param conn Connection checked out from the pool.
+ */
+void xr_client_pool_put(xr_client_pool* pool, xr_client_conn* conn);
+
+/** Perform call over pooled connection.
+ *
+ * If sending the request over a reused connection failed, or the server
+ * closed or reset it before any byte of the response arrived, the call is
+ * repeated once over new connection.
+ *
+ * @param pool Pool object.
+ * @param uri URI of the servlet (http[s]://host[:port]/Servlet).
+ * @param call Call object.
+ * @param err Error object.
+ *
+ * @return Same as @ref xr_client_call().
+ */
+gboolean xr_client_pool_call(xr_client_pool* pool, const char* uri, xr_call* call, GError** err);
+
+/** Free pool and close its idle connections.
+ *
+ * All checked out connections must be returned first.
+ *
+ * @param pool Pool object.
+ */
+void xr_client_pool_free(xr_client_pool* pool);
+
 GQuark xr_client_error_quark();
 
 G_END_DECLS
@@ -163,7 +163,8 @@ xr_http_message_type xr_http_get_message_type(xr_http* http);
 
 /** Get length of the message body (Content-Length header value).
  *
- * This function may return -1 if Content-Length was not specified.
+ * This function may return -1 if Content-Length was not specified or
+ * if the body is sent using chunked transfer encoding.
  * 
  * @param http HTTP transport object.
  * 
@@ -172,6 +173,8 @@ xr_http_message_type xr_http_get_message_type(xr_http* http);
 gssize xr_http_get_message_length(xr_http* http);
 
 /** Read HTTP message body.
+ *
+ * Chunked message bodies are decoded transparently.
  * 
  * @param http HTTP transport object.
  * @param buffer Target buffer.
@@ -182,7 +185,32 @@ gssize xr_http_get_message_length(xr_http* http);
  */
 gssize xr_http_read(xr_http* http, char* buffer, gsize length, GError** err);
 
+/** Read input that is available without blocking into the read buffer.
+ * 
+ * Lets the caller collect the next message before it is read by
+ * @ref xr_http_read_header(). Read buffer grows as needed, check the amount
+ * of buffered input using @ref xr_http_get_buffered_input().
+ * 
+ * @param http HTTP transport object.
+ * @param err Error object, G_IO_ERROR_WOULD_BLOCK if no input is available.
+ * 
+ * @return Number of bytes read, 0 on EOF or -1 on error.
+ */
+gssize xr_http_read_nonblocking(xr_http* http, GError** err);
+
+/** Get buffered input that was not read yet.
+ * 
+ * @param http HTTP transport object.
+ * @param length Length of the buffered input.
+ * 
+ * @return Buffered input, valid until the next read.
+ */
+const char* xr_http_get_buffered_input(xr_http* http, gsize* length);
+
 /** Read whole message body into a GString object.
+ * 
+ * Message without body gives an empty string, response body without length
+ * is read until the connection is closed.
  * 
  * @param http HTTP transport object.
  * @param err Error object.
@@ -201,6 +229,15 @@ GString* xr_http_read_all(xr_http* http, GError** err);
  */
 void xr_http_set_header(xr_http* http, const char* name, const char* value);
 
+/** Set HTTP header for outgoing message without copying name and value.
+ * 
+ * @param http HTTP transport object.
+ * @param name Case insensitive header name (e.g. Content-Type). Must stay
+ *   valid until the header is written.
+ * @param value Header value. Must stay valid until the header is written.
+ */
+void xr_http_set_header_static(xr_http* http, const char* name, const char* value);
+
 /** Set outgoing message type.
  * 
  * @param http HTTP transport object.
@@ -234,7 +271,10 @@ void xr_http_setup_response(xr_http* http, int code);
 /** Write outgoing message header.
  *
  * You should call xr_http_setup_*() and xr_http_set_message_length() functions
- * before calling this.
+ * before calling this. If message length is not set, body will be sent
+ * using chunked transfer encoding (for requests other than GET and for
+ * responses to HTTP/1.1 requests), so it can be written by
+ * xr_http_write() while it is being produced.
  * 
  * @param http HTTP transport object.
  * @param err Error object.
@@ -282,6 +322,85 @@ gboolean xr_http_write_complete(xr_http* http, GError** err);
  */
 gboolean xr_http_write_all(xr_http* http, const char* buffer, gssize length, GError** err);
 
+/** Hold back messages written by xr_http_write_all() and send them together
+ * later. Used to coalesce pipelined requests or responses into one write.
+ *
+ * Held back messages are sent by xr_http_uncork(), before the transport
+ * blocks on reading from the peer, before a streamed message is started or
+ * when too much data accumulates.
+ * 
+ * @param http HTTP transport object. 
+ */
+void xr_http_cork(xr_http* http);
+
+/** Send messages held back since xr_http_cork() and stop holding them back.
+ * 
+ * @param http HTTP transport object. 
+ * @param err Error object.
+ * 
+ * @return TRUE on success, FALSE on error.
+ */
+gboolean xr_http_uncork(xr_http* http, GError** err);
+
+/** Write whole message asynchronously.
+ *
+ * Same as @ref xr_http_write_all(), but the message is written by
+ * non-blocking operations dispatched from the thread-default main context.
+ * Transport object must not be used until the callback is called.
+ * 
+ * @param http HTTP transport object. 
+ * @param buffer Source buffer (copied).
+ * @param length Data length. (It may be -1 if buffer contains zero-terminated string.)
+ * @param cancellable Optional cancellable object.
+ * @param callback Callback to call when the message is written.
+ * @param user_data Data passed to the callback.
+ */
+void xr_http_write_all_async(xr_http* http, const char* buffer, gssize length, GCancellable* cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/** Finish asynchronous write.
+ * 
+ * @param http HTTP transport object. 
+ * @param result Result passed to the callback.
+ * @param err Error object.
+ * 
+ * @return TRUE on success, FALSE on error.
+ */
+gboolean xr_http_write_all_finish(xr_http* http, GAsyncResult* result, GError** err);
+
+/** Read whole message (header and body) asynchronously.
+ *
+ * Input is read by non-blocking operations until the whole message is
+ * buffered, then the header is parsed as by @ref xr_http_read_header(). Use
+ * xr_http_get_*() functions to inspect the header after the operation
+ * finishes. Transport object must not be used until the callback is called.
+ * 
+ * @param http HTTP transport object. 
+ * @param cancellable Optional cancellable object.
+ * @param callback Callback to call when the message is read.
+ * @param user_data Data passed to the callback.
+ */
+void xr_http_read_message_async(xr_http* http, GCancellable* cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/** Finish asynchronous read.
+ * 
+ * @param http HTTP transport object. 
+ * @param result Result passed to the callback.
+ * @param err Error object.
+ * 
+ * @return Message body or NULL on error.
+ */
+GString* xr_http_read_message_finish(xr_http* http, GAsyncResult* result, GError** err);
+
+/** Check if some part of the next incomming message is already buffered
+ * in userspace (read-ahead or decrypted TLS data), so that waiting for the
+ * socket to become readable would stall.
+ * 
+ * @param http HTTP transport object. 
+ * 
+ * @return TRUE if buffered input is available.
+ */
+gboolean xr_http_has_pending_input(xr_http* http);
+
 /** Check if object is ready to receive or send message.
  * 
  * @param http HTTP transport object. 
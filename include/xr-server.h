@@ -40,6 +40,11 @@ typedef struct _xr_server xr_server;
  */
 typedef struct _xr_servlet xr_servlet;
 
+/** Opaque data structrure that represents call deferred by the servlet
+ * method.
+ */
+typedef struct _xr_pending_call xr_pending_call;
+
 /** Servlet method callback type.
  */
 typedef gboolean (*servlet_method_t)(xr_servlet* servlet, xr_call* call);
@@ -60,6 +65,11 @@ typedef gboolean (*servlet_download_t)(xr_servlet* servlet);
  */
 typedef gboolean (*servlet_upload_t)(xr_servlet* servlet);
 
+/** Servlet reset callback type. Returns FALSE if the servlet can't be
+ * reused.
+ */
+typedef gboolean (*servlet_reset_t)(xr_servlet* servlet);
+
 /** Servlet method description structure.
  */
 typedef struct _xr_servlet_method_def xr_servlet_method_def;
@@ -68,6 +78,10 @@ typedef struct _xr_servlet_method_def xr_servlet_method_def;
  */
 typedef struct _xr_servlet_def xr_servlet_def;
 
+/** Servlet method lookup callback type.
+ */
+typedef xr_servlet_method_def* (*servlet_method_lookup_t)(const char* name);
+
 /** Servlet method description structure.
  */
 struct _xr_servlet_method_def
@@ -92,7 +106,12 @@ struct _xr_servlet_def
   int methods_count;                /**< Count of the methods implemented by the server. */
   xr_servlet_method_def* methods;   /**< Methods descriptions. */
   servlet_method_t fallback;        /**< Fallback (undefined method) hook. */
-  void* padding1[10];
+  int session_ttl;                  /**< Idle session timeout in seconds, 0 to use the server default. */
+  gboolean stateless;               /**< Servlet keeps no per-connection state, one instance per thread serves all connections. Its calls can't be deferred. */
+  servlet_method_lookup_t method_lookup; /**< Find method by name (generated by xdl-compiler), NULL to search methods. */
+  servlet_reset_t reset;            /**< Reset hook. If set, released instances are reset and reused instead of calling fini, and a few instances are initialized when the servlet is registered. */
+  gboolean direct_params;           /**< Methods read params directly from the request text (generated by xdl-compiler), see xr-wire.h. */
+  void* padding1[6];
 };
 
 #define XR_SERVER_ERROR xr_server_error_quark()
@@ -115,6 +134,28 @@ G_BEGIN_DECLS
  */
 xr_server* xr_server_new(const char* cert, int threads, GError** err);
 
+/** Create new event driven server object.
+ *
+ * Connections are not bound to threads. Instead @a reactors threads wait
+ * for incomming data on all connections using epoll and hand connections
+ * with a complete request to the pool of @a workers threads. Idle
+ * keep-alive connections thus cost no thread, and the server can hold
+ * many thousands of them. Servlets are called the same way as in the
+ * threaded server.
+ *
+ * On platforms without epoll this falls back to @ref xr_server_new() with
+ * @a workers threads.
+ *
+ * @param cert Combined PEM file with server certificate and private
+ *   key. Use NULL to create non-secure server.
+ * @param reactors Number of the event loop threads (1 is usually enough).
+ * @param workers Number of the threads that run servlet methods.
+ * @param err Pointer to the variable to store error to on error.
+ *
+ * @return New server object on success.
+ */
+xr_server* xr_server_new_evented(const char* cert, int reactors, int workers, GError** err);
+
 /** Bind to the specified host/port.
  *
  * @param server Server object.
@@ -159,6 +200,40 @@ void xr_server_free(xr_server* server);
  */
 gboolean xr_server_register_servlet(xr_server* server, xr_servlet_def* servlet);
 
+/** Set idle timeout of the sessions.
+ *
+ * Servlets created in session mode (X-SESSION-USE header) are destroyed
+ * when there was no call for @a ttl seconds. Servlet types may override
+ * this using session_ttl field of the @ref xr_servlet_def.
+ *
+ * @param server Server object.
+ * @param ttl Timeout in seconds (60 by default).
+ */
+void xr_server_set_session_ttl(xr_server* server, int ttl);
+
+/** Set time limit for receiving the whole request.
+ *
+ * Evented server closes plaintext connections that started to send a
+ * request and did not complete it within @a timeout seconds.
+ *
+ * @param server Server object.
+ * @param timeout Timeout in seconds (30 by default).
+ */
+void xr_server_set_request_timeout(xr_server* server, int timeout);
+
+/** Allocate values of the calls from per-thread arenas.
+ *
+ * Values created while the request is parsed, the method is run and the
+ * response is generated are allocated from an @ref xr_arena and released
+ * together once the response is sent. Servlets that keep values received
+ * or created during the call must take them using @ref xr_value_ref() or
+ * @ref xr_value_promote(), which copy arena values.
+ *
+ * @param server Server object.
+ * @param enabled TRUE to enable arenas (disabled by default).
+ */
+void xr_server_set_request_arena(xr_server* server, gboolean enabled);
+
 /** Get private data for the servlet.
  *
  * @param servlet Servlet object.
@@ -171,7 +246,8 @@ void* xr_servlet_get_priv(xr_servlet* servlet);
  *
  * @param servlet Servlet object.
  *
- * @return Returns HTTP object that can be used to upload/download data.
+ * @return Returns HTTP object that can be used to upload/download data,
+ *   NULL if the client disconnected during a deferred call.
  */
 xr_http* xr_servlet_get_http(xr_servlet* servlet);
 
@@ -179,10 +255,57 @@ xr_http* xr_servlet_get_http(xr_servlet* servlet);
  * 
  * @param servlet Servlet object.
  * 
- * @return IP address string in the xxx.xxx.xxx.xxx format or NULL.
+ * @return IP address string in the xxx.xxx.xxx.xxx format or NULL (also
+ *   if the client disconnected during a deferred call).
  */
 char* xr_servlet_get_client_ip(xr_servlet* servlet);
 
+/** Defer response to the call that is being handled by the servlet.
+ *
+ * Servlet method may call this function to finish the call later, from
+ * any thread, without blocking the server. The method returns as usual
+ * and the response is sent when @ref xr_pending_call_complete() is
+ * called. Evented server (@ref xr_server_new_evented()) frees the worker
+ * thread in the meantime, threaded server keeps the connection thread
+ * waiting. Session servlet stays locked for the call until it is
+ * completed.
+ *
+ * The call, its params and the servlet stay valid until the call is
+ * completed, even if the client disconnects in the meantime. Async methods
+ * generated by xdl-compiler take ownership of the demarchalized params,
+ * the implementation must free them.
+ *
+ * Calls made through system.multicall are not detached: the thread that
+ * runs the deferred sub-call waits until it is completed, because the
+ * multicall response is sent only after all sub-calls finished.
+ *
+ * Calls of stateless servlets can't be deferred, because their instance
+ * serves other connections in the meantime.
+ *
+ * @param servlet Servlet object.
+ *
+ * @return Completion handle of the current call, NULL for stateless
+ *   servlets.
+ */
+xr_pending_call* xr_servlet_defer_call(xr_servlet* servlet);
+
+/** Get the call object of the deferred call. Set return value or error
+ * on it before completing the call.
+ *
+ * @param pending Completion handle.
+ *
+ * @return Call object.
+ */
+xr_call* xr_pending_call_get_call(xr_pending_call* pending);
+
+/** Complete deferred call and send the response. Handle is invalid after
+ * this call. All deferred calls must be completed before the server is
+ * freed.
+ *
+ * @param pending Completion handle.
+ */
+void xr_pending_call_complete(xr_pending_call* pending);
+
 /** Use this function as a simple way to quickly start a server.
  *
  * @param cert Combined PEM file with server certificate and private.
@@ -61,6 +61,10 @@ typedef struct _xr_value xr_value;
  */
 typedef struct _xr_blob xr_blob;
 
+/** Opaque bump allocator for @ref xr_value trees.
+ */
+typedef struct _xr_arena xr_arena;
+
 /** Type used to pass blobs around in the user code.
  */
 struct _xr_blob
@@ -101,10 +105,13 @@ void xr_blob_unref(xr_blob* blob);
 xr_blob* xr_blob_ref(xr_blob* blob);
 
 /** Take reference to the node.
+ *
+ * Nodes allocated from an arena can't outlive it, for them a copy is
+ * returned (see @ref xr_value_promote()). Always use the returned node.
  *
  * @param val Node to be refed.
  *
- * @return Same node.
+ * @return Same node or its copy.
  */
 xr_value* xr_value_ref(xr_value* val);
 
@@ -116,6 +123,21 @@ xr_value* xr_value_ref(xr_value* val);
  */
 void xr_value_unref(xr_value* val);
 
+/** Get a node that outlives the arena @a val was allocated from.
+ *
+ * Nodes allocated from an arena (see @ref xr_arena_bind()) are released
+ * together when the arena is reset, @ref xr_value_unref() has no effect on
+ * them. Use this function or @ref xr_value_ref() to keep such nodes, e.g. in
+ * the servlet private data.
+ *
+ * @param val Node (may be NULL).
+ *
+ * @return Deep copy of the tree allocated with g_slice if @a val belongs
+ *   to an arena, new reference to @a val otherwise. Free it using
+ *   @ref xr_value_unref().
+ */
+xr_value* xr_value_promote(xr_value* val);
+
 /** Create new @ref xr_value node of type @ref XRV_STRING.
  *
  * @param val Value to be contained in the node.
@@ -251,7 +273,7 @@ gboolean xr_value_to_time(xr_value* val, char** nval);
  */
 gboolean xr_value_to_blob(xr_value* val, xr_blob** nval);
 
-/** Just a convenience interface to xr_value_ref.
+/** Just a convenience interface to xr_value_promote.
  *
  * @param val Value node. May be NULL, see below.
  * @param nval Pointer to the variable where value should be extracted.
@@ -284,14 +306,37 @@ xr_value* xr_value_array_new();
 void xr_value_array_append(xr_value* arr, xr_value* val);
 
 /** Get list of items from the array node.
+ *
+ * Items are stored in a vector, the list is built on the first call after
+ * the array was modified. Use @ref xr_value_array_length() and
+ * @ref xr_value_array_get() in new code.
  *
  * @param arr Array node.
  *
  * @return List of items (@ref xr_value nodes) in the array. Returned list and
- *   values are owned by the arr. Don't free them!
+ *   values are owned by the arr. Don't free them! List is valid until the
+ *   array is modified.
  */
 GSList* xr_value_get_items(xr_value* arr);
 
+/** Get number of items in the array node.
+ *
+ * @param arr Array node.
+ *
+ * @return Number of items.
+ */
+guint xr_value_array_length(xr_value* arr);
+
+/** Get item from the array node.
+ *
+ * @param arr Array node.
+ * @param index Item index.
+ *
+ * @return Item (@ref xr_value node) or NULL if @a index is out of range.
+ *   Returned value is owned by the arr. Don't free it!
+ */
+xr_value* xr_value_array_get(xr_value* arr, guint index);
+
 /** Create new struct @ref xr_value node.
  *
  * @return New @ref xr_value node.
@@ -317,15 +362,64 @@ void xr_value_struct_set_member(xr_value* str, const char* name, xr_value* val);
  */
 xr_value* xr_value_get_member(xr_value* str, const char* name);
 
+/** Set struct member value using interned member name.
+ *
+ * Members created this way share the name with the quark table and are
+ * found by @ref xr_value_get_member_quark() without comparing strings.
+ *
+ * @param str Struct node.
+ * @param key Member name registered with g_quark_from_static_string() or
+ *   g_quark_from_string().
+ * @param val Member value node. Ownership of the val is transferred to str.
+ */
+void xr_value_struct_set_member_quark(xr_value* str, GQuark key, xr_value* val);
+
+/** Get member value from the struct node using interned member name.
+ *
+ * Structs with more than 8 members are indexed by a hash table, smaller
+ * ones are searched linearly.
+ *
+ * @param str Struct node.
+ * @param key Member name quark.
+ *
+ * @return Member value or NULL if struct does not have member
+ *   with specified name. Returned value is owned by the str.
+ *   Don't free it!
+ */
+xr_value* xr_value_get_member_quark(xr_value* str, GQuark key);
+
 /** Get list of @ref XRV_MEMBER nodes from the struct node.
+ *
+ * Members are stored in a vector, the list is built on the first call after
+ * the struct was modified. Use @ref xr_value_struct_length() and
+ * @ref xr_value_struct_get_nth() in new code.
  *
  * @param str Struct node.
  *
  * @return List of members (@ref xr_value nodes) in the array. Returned list and
- *   values are owned by the str. Don't free them!
+ *   values are owned by the str. Don't free them! List is valid until the
+ *   struct is modified.
  */
 GSList* xr_value_get_members(xr_value* str);
 
+/** Get number of members in the struct node.
+ *
+ * @param str Struct node.
+ *
+ * @return Number of members.
+ */
+guint xr_value_struct_length(xr_value* str);
+
+/** Get @ref XRV_MEMBER node from the struct node by position.
+ *
+ * @param str Struct node.
+ * @param index Member index (members are kept in insertion order).
+ *
+ * @return Member node or NULL if @a index is out of range. Returned value
+ *   is owned by the str. Don't free it!
+ */
+xr_value* xr_value_struct_get_nth(xr_value* str, guint index);
+
 /** Get name of the struct member from the @ref XRV_MEMBER node.
  *
  * @param mem Member node.
@@ -363,6 +457,75 @@ gboolean xr_value_is_error_retval(xr_value* val, int* errcode, char** errmsg);
  */
 void xr_value_dump(xr_value* v, GString* string, int indent);
 
+/** Create new arena.
+ *
+ * Arena hands out memory from big chunks and releases it all at once
+ * when it is reset. It is not thread safe, it is meant to be used by one
+ * thread at a time for short lived value trees, like the ones created
+ * while a request is served.
+ *
+ * @param chunk_size Size of the memory chunks, 0 for the default (16kB).
+ *
+ * @return New arena.
+ */
+xr_arena* xr_arena_new(gsize chunk_size);
+
+/** Allocate zeroed memory from the arena.
+ *
+ * @param arena Arena.
+ * @param size Size of the memory block.
+ *
+ * @return Memory block, valid until the arena is reset.
+ */
+gpointer xr_arena_alloc0(xr_arena* arena, gsize size);
+
+/** Copy string to the arena.
+ *
+ * @param arena Arena.
+ * @param str String (may be NULL).
+ *
+ * @return Copy of the string, valid until the arena is reset.
+ */
+char* xr_arena_strdup(xr_arena* arena, const char* str);
+
+/** Call function when the arena is reset or freed.
+ *
+ * Functions are called in the reverse order of registration.
+ *
+ * @param arena Arena.
+ * @param func Function.
+ * @param data Argument for the @a func.
+ */
+void xr_arena_add_cleanup(xr_arena* arena, GDestroyNotify func, gpointer data);
+
+/** Release everything allocated from the arena.
+ *
+ * One chunk is kept for reuse. All nodes allocated from the arena become
+ * invalid.
+ *
+ * @param arena Arena.
+ */
+void xr_arena_reset(xr_arena* arena);
+
+/** Free arena and everything allocated from it.
+ *
+ * @param arena Arena (may be NULL).
+ */
+void xr_arena_free(xr_arena* arena);
+
+/** Bind arena to the calling thread.
+ *
+ * While the arena is bound, @ref xr_value nodes created by the thread are
+ * allocated from it. Nodes added to arena structs and arrays from
+ * elsewhere are kept alive until the arena is reset, arena nodes added to
+ * other containers are copied using @ref xr_value_promote().
+ *
+ * @param arena Arena or NULL to allocate nodes with g_slice again.
+ *
+ * @return Previously bound arena.
+ */
+xr_arena* xr_arena_bind(xr_arena* arena);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,369 @@
+/*
+ * Copyright 2006-2008 Ondrej Jirman <ondrej.jirman@zonio.net>
+ *
+ * This file is part of libxr.
+ *
+ * Libxr is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * Libxr is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file xr-wire.h
+ *
+ * Direct XML-RPC and JSON-RPC Access
+ *
+ * Readers used by the demarshallers generated by @ref xdlc to fill
+ * native structs and arrays straight from the request text, without
+ * building @ref xr_value nodes first, and writers that do the opposite.
+ *
+ * Params are kept as text only for requests received by the servlets that
+ * set @ref xr_servlet_def::direct_params and only if the request uses the
+ * common subset of the transport format. Otherwise
+ * @ref xr_wire_reader_init_params returns FALSE and params must be read
+ * using @ref xr_call_get_param.
+ *
+ * Readers accept the same values as the @ref xr_value demarshallers do,
+ * if reading fails, generated code falls back to the @ref xr_value params
+ * to report the error.
+ *
+ * Writers are used by the marshallers generated by @ref xdlc to write
+ * params of the client calls and return values of the servlet methods
+ * straight from native structs and arrays. Output is the same as the
+ * @ref xr_value serializers produce. Text is converted to @ref xr_value
+ * nodes only when @ref xr_call_get_param or @ref xr_call_get_retval is
+ * called.
+ *
+ * @note You should not need to use this API directly, it is used by the
+ * generated code.
+ */
+
+#ifndef __XR_WIRE_H__
+#define __XR_WIRE_H__
+
+#include "xr-call.h"
+
+/** Reader of the request text.
+ */
+typedef struct _xr_wire_reader xr_wire_reader;
+
+struct _xr_wire_reader
+{
+  /*< private >*/
+  xr_call_transport transport;
+  const char* p;
+  const char* end;
+  int depth;
+  gboolean empty;       /* XML-RPC: container was closed by its start tag */
+  gboolean first;       /* XML-RPC: no item of the container was read yet */
+  const char* text;     /* XML-RPC: text of the scalar value */
+  gsize text_len;
+  gboolean text_plain;  /* XML-RPC: text needs no decoding */
+  const char* name;     /* name of the current member */
+  gsize name_len;
+  char name_buf[64];
+};
+
+/** Writer of the params or return value text.
+ */
+typedef struct _xr_wire_writer xr_wire_writer;
+
+struct _xr_wire_writer
+{
+  /*< private >*/
+  xr_call_transport transport;
+  GString* buf;
+  gboolean first;       /* no param was written yet */
+};
+
+G_BEGIN_DECLS
+
+/** Initialize reader with the params of the call.
+ *
+ * @param r Reader.
+ * @param call Call object.
+ *
+ * @return FALSE if params of the call are not kept as text.
+ */
+gboolean xr_wire_reader_init_params(xr_wire_reader* r, xr_call* call);
+
+/** Move to the next param or array item.
+ *
+ * @param r Reader.
+ *
+ * @return 1 if item follows, 0 at the end of the list and -1 on error.
+ */
+int xr_wire_next_item(xr_wire_reader* r);
+
+/** Start reading array items.
+ *
+ * @param r Reader.
+ *
+ * @return FALSE if value is not an array.
+ */
+gboolean xr_wire_begin_array(xr_wire_reader* r);
+
+/** Start reading struct members.
+ *
+ * @param r Reader.
+ *
+ * @return FALSE if value is not a struct.
+ */
+gboolean xr_wire_begin_struct(xr_wire_reader* r);
+
+/** Move to the next struct member.
+ *
+ * @param r Reader.
+ *
+ * @return 1 if member follows, 0 at the end of the struct and -1 on
+ *   error.
+ */
+int xr_wire_next_member(xr_wire_reader* r);
+
+/** Check name of the current member.
+ *
+ * @param r Reader.
+ * @param name Member name.
+ * @param len Length of the name.
+ *
+ * @return TRUE if name of the current member is @a name.
+ */
+gboolean xr_wire_member_is(xr_wire_reader* r, const char* name, gsize len);
+
+/** Skip value.
+ *
+ * @param r Reader.
+ *
+ * @return FALSE on malformed input.
+ */
+gboolean xr_wire_skip(xr_wire_reader* r);
+
+/** Read int value.
+ *
+ * @param r Reader.
+ * @param v Value.
+ *
+ * @return FALSE on malformed input or type mismatch.
+ */
+gboolean xr_wire_read_int(xr_wire_reader* r, int* v);
+
+/** Read boolean value.
+ *
+ * @param r Reader.
+ * @param v Value.
+ *
+ * @return FALSE on malformed input or type mismatch.
+ */
+gboolean xr_wire_read_bool(xr_wire_reader* r, gboolean* v);
+
+/** Read double value.
+ *
+ * @param r Reader.
+ * @param v Value.
+ *
+ * @return FALSE on malformed input or type mismatch.
+ */
+gboolean xr_wire_read_double(xr_wire_reader* r, double* v);
+
+/** Read string value. Previous value of @a v is freed.
+ *
+ * @param r Reader.
+ * @param v Value, free it with g_free.
+ *
+ * @return FALSE on malformed input or type mismatch.
+ */
+gboolean xr_wire_read_string(xr_wire_reader* r, char** v);
+
+/** Read time value. Previous value of @a v is freed.
+ *
+ * @param r Reader.
+ * @param v Value, free it with g_free.
+ *
+ * @return FALSE on malformed input or type mismatch.
+ */
+gboolean xr_wire_read_time(xr_wire_reader* r, char** v);
+
+/** Read blob value. Previous value of @a v is unrefed.
+ *
+ * @param r Reader.
+ * @param v Value, free it with xr_blob_unref.
+ *
+ * @return FALSE on malformed input or type mismatch.
+ */
+gboolean xr_wire_read_blob(xr_wire_reader* r, xr_blob** v);
+
+/** Read value of the any type. Previous value of @a v is unrefed.
+ *
+ * @param r Reader.
+ * @param v Value, free it with xr_value_unref.
+ *
+ * @return FALSE on malformed input.
+ */
+gboolean xr_wire_read_value(xr_wire_reader* r, xr_value** v);
+
+/** Initialize writer of the call params.
+ *
+ * @param w Writer.
+ * @param transport Transport the call will be sent with.
+ *
+ * @return FALSE if params can't be written as text for the transport.
+ */
+gboolean xr_wire_writer_init_params(xr_wire_writer* w, xr_call_transport transport);
+
+/** Initialize writer of the return value of the received call.
+ *
+ * @param w Writer.
+ * @param call Call object.
+ *
+ * @return FALSE if return value of the call can't be written as text.
+ */
+gboolean xr_wire_writer_init_retval(xr_wire_writer* w, xr_call* call);
+
+/** Pass params to the call. Call must not have any params yet, its
+ * transport is set to the transport of the writer.
+ *
+ * @param w Writer.
+ * @param call Call object.
+ */
+void xr_wire_writer_finish_params(xr_wire_writer* w, xr_call* call);
+
+/** Pass return value to the call, this replaces return value set using
+ * @ref xr_call_set_retval.
+ *
+ * @param w Writer.
+ * @param call Call object.
+ */
+void xr_wire_writer_finish_retval(xr_wire_writer* w, xr_call* call);
+
+/** Free text of the writer that was not passed to the call.
+ *
+ * @param w Writer.
+ */
+void xr_wire_writer_free(xr_wire_writer* w);
+
+/** Start next param.
+ *
+ * @param w Writer.
+ *
+ * @return Always TRUE.
+ */
+gboolean xr_wire_write_param(xr_wire_writer* w);
+
+/** Start struct.
+ *
+ * @param w Writer.
+ */
+void xr_wire_write_struct_begin(xr_wire_writer* w);
+
+/** Start struct member. Tags are precomputed by the generated code and
+ * include separator from the previous member.
+ *
+ * @param w Writer.
+ * @param xml_tag XML-RPC tag, "<member><name>NAME</name>" for the first
+ *   member, "</member><member><name>NAME</name>" for the others.
+ * @param xml_len Length of the XML-RPC tag.
+ * @param json_tag JSON-RPC tag, "\"NAME\":" for the first member,
+ *   ",\"NAME\":" for the others.
+ * @param json_len Length of the JSON-RPC tag.
+ */
+void xr_wire_write_member(xr_wire_writer* w, const char* xml_tag, gsize xml_len, const char* json_tag, gsize json_len);
+
+/** Finish struct.
+ *
+ * @param w Writer.
+ */
+void xr_wire_write_struct_end(xr_wire_writer* w);
+
+/** Start array.
+ *
+ * @param w Writer.
+ */
+void xr_wire_write_array_begin(xr_wire_writer* w);
+
+/** Start array item.
+ *
+ * @param w Writer.
+ * @param index Index of the item.
+ */
+void xr_wire_write_item(xr_wire_writer* w, guint index);
+
+/** Finish array.
+ *
+ * @param w Writer.
+ */
+void xr_wire_write_array_end(xr_wire_writer* w);
+
+/** Write int value.
+ *
+ * @param w Writer.
+ * @param v Value.
+ *
+ * @return Always TRUE.
+ */
+gboolean xr_wire_write_int(xr_wire_writer* w, int v);
+
+/** Write boolean value.
+ *
+ * @param w Writer.
+ * @param v Value.
+ *
+ * @return Always TRUE.
+ */
+gboolean xr_wire_write_bool(xr_wire_writer* w, gboolean v);
+
+/** Write double value.
+ *
+ * @param w Writer.
+ * @param v Value.
+ *
+ * @return Always TRUE.
+ */
+gboolean xr_wire_write_double(xr_wire_writer* w, double v);
+
+/** Write string value. NULL is written as empty string.
+ *
+ * @param w Writer.
+ * @param v Value.
+ *
+ * @return Always TRUE.
+ */
+gboolean xr_wire_write_string(xr_wire_writer* w, const char* v);
+
+/** Write time value. NULL is written as empty string.
+ *
+ * @param w Writer.
+ * @param v Value.
+ *
+ * @return Always TRUE.
+ */
+gboolean xr_wire_write_time(xr_wire_writer* w, const char* v);
+
+/** Write blob value.
+ *
+ * @param w Writer.
+ * @param v Value.
+ *
+ * @return FALSE if blob is NULL.
+ */
+gboolean xr_wire_write_blob(xr_wire_writer* w, xr_blob* v);
+
+/** Write value of the any type.
+ *
+ * @param w Writer.
+ * @param v Value.
+ *
+ * @return FALSE if value is NULL.
+ */
+gboolean xr_wire_write_value(xr_wire_writer* w, xr_value* v);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,402 @@
+/*
+ * Copyright 2006-2008 Ondrej Jirman <ondrej.jirman@zonio.net>
+ *
+ * This file is part of libxr.
+ *
+ * Libxr is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * Libxr is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+
+#include "xr-base64.h"
+
+#if defined(HAVE_IMMINTRIN_H) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define XR_BASE64_X86 1
+#include <immintrin.h>
+#endif
+
+static const char enc_table[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* 0xff for characters outside of the alphabet, 0x40 for '=' (decodes as 0) */
+static const guchar dec_table[256] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+  0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0x40, 0xff, 0xff,
+  0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+  0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+/* scalar codec */
+
+static gsize _encode_scalar(const guchar* in, gsize len, char* out)
+{
+  char* o = out;
+
+  for (; len >= 3; len -= 3, in += 3)
+  {
+    guint32 v = (in[0] << 16) | (in[1] << 8) | in[2];
+    o[0] = enc_table[v >> 18];
+    o[1] = enc_table[(v >> 12) & 0x3f];
+    o[2] = enc_table[(v >> 6) & 0x3f];
+    o[3] = enc_table[v & 0x3f];
+    o += 4;
+  }
+
+  if (len > 0)
+  {
+    guint32 v = (in[0] << 16) | (len > 1 ? in[1] << 8 : 0);
+    o[0] = enc_table[v >> 18];
+    o[1] = enc_table[(v >> 12) & 0x3f];
+    o[2] = len > 1 ? enc_table[(v >> 6) & 0x3f] : '=';
+    o[3] = '=';
+    o += 4;
+  }
+
+  return o - out;
+}
+
+struct dec_state
+{
+  guint32 v;
+  int n;              /* characters in v */
+  char last[2];       /* last two alphabet characters, to detect padding */
+};
+
+/* decoding rules are the same as in g_base64_decode_step() */
+static guchar* _decode_scalar(const guchar* in, const guchar* end, guchar* o, struct dec_state* s)
+{
+  for (; in < end; in++)
+  {
+    guchar r;
+
+    /* whole quantum without padding or junk */
+    while (s->n == 0 && end - in >= 4)
+    {
+      guint32 a = dec_table[in[0]], b = dec_table[in[1]], c = dec_table[in[2]], d = dec_table[in[3]];
+
+      if ((a | b | c | d) & 0xc0)
+        break;
+
+      a = (a << 18) | (b << 12) | (c << 6) | d;
+      o[0] = a >> 16;
+      o[1] = a >> 8;
+      o[2] = a;
+      o += 3;
+      in += 4;
+    }
+
+    if (in == end)
+      break;
+
+    r = dec_table[*in];
+    if (r == 0xff)
+      continue;
+
+    s->last[1] = s->last[0];
+    s->last[0] = *in;
+    s->v = (s->v << 6) | (r & 0x3f);
+
+    if (++s->n == 4)
+    {
+      *o++ = s->v >> 16;
+      if (s->last[1] != '=')
+        *o++ = s->v >> 8;
+      if (s->last[0] != '=')
+        *o++ = s->v;
+      s->n = 0;
+    }
+  }
+
+  return o;
+}
+
+#ifdef XR_BASE64_X86
+
+/* vector codecs, based on the algorithms by Wojciech Mula and Daniel Lemire
+ * (http://0x80.pl/articles/index.html#base64-algorithm-new) */
+
+__attribute__((target("ssse3")))
+static __inline__ __m128i _enc_reshuffle_ssse3(__m128i in)
+{
+  __m128i t0, t1, t2, t3;
+
+  in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+
+  return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3")))
+static __inline__ __m128i _enc_translate_ssse3(__m128i in)
+{
+  const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+  __m128i idx = _mm_subs_epu8(in, _mm_set1_epi8(51));
+
+  idx = _mm_sub_epi8(idx, _mm_cmpgt_epi8(in, _mm_set1_epi8(25)));
+
+  return _mm_add_epi8(in, _mm_shuffle_epi8(lut, idx));
+}
+
+__attribute__((target("ssse3")))
+static gsize _encode_ssse3(const guchar* in, gsize len, char* out)
+{
+  char* o = out;
+
+  /* 12 bytes are used from each 16 byte load */
+  for (; len >= 16; len -= 12, in += 12, o += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)in);
+    _mm_storeu_si128((__m128i*)o, _enc_translate_ssse3(_enc_reshuffle_ssse3(v)));
+  }
+
+  return (o - out) + _encode_scalar(in, len, o);
+}
+
+__attribute__((target("ssse3")))
+static __inline__ gboolean _dec_block_ssse3(__m128i* v)
+{
+  const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                       0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                       0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8(0x2f);
+  __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(*v, 4), mask_2f);
+  __m128i lo_nibbles = _mm_and_si128(*v, mask_2f);
+  __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+  __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+  __m128i roll;
+
+  /* any character outside of the alphabet (including '=') */
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xffff)
+    return FALSE;
+
+  roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(*v, mask_2f), hi_nibbles));
+  *v = _mm_add_epi8(*v, roll);
+
+  /* pack 16 6-bit values into 12 bytes */
+  *v = _mm_maddubs_epi16(*v, _mm_set1_epi32(0x01400140));
+  *v = _mm_madd_epi16(*v, _mm_set1_epi32(0x00011000));
+  *v = _mm_shuffle_epi8(*v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+  return TRUE;
+}
+
+__attribute__((target("ssse3")))
+static gsize _decode_ssse3(const char* in, gsize len, guchar* out)
+{
+  const guchar* i = (const guchar*)in;
+  const guchar* end = i + len;
+  guchar* o = out;
+  struct dec_state s = { 0, 0, { 0, 0 } };
+
+  while (i < end)
+  {
+    /* 16 bytes are stored for each 12 decoded, keep 32 characters of input
+     * so that the store stays within XR_BASE64_DECODED_SIZE */
+    while (s.n == 0 && end - i >= 32)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)i);
+      if (!_dec_block_ssse3(&v))
+        break;
+      _mm_storeu_si128((__m128i*)o, v);
+      i += 16;
+      o += 12;
+    }
+
+    /* decode one quantum (or the tail) using the scalar code */
+    do
+      o = _decode_scalar(i, i + 1, o, &s);
+    while (++i < end && s.n != 0);
+  }
+
+  return o - out;
+}
+
+__attribute__((target("avx2")))
+static gsize _encode_avx2(const guchar* in, gsize len, char* out)
+{
+  const __m256i lut = _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+                                       65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+  const __m256i shuf = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  char* o = out;
+
+  /* 24 bytes are used from two 16 byte loads */
+  for (; len >= 28; len -= 24, in += 24, o += 32)
+  {
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)in)),
+                                        _mm_loadu_si128((const __m128i*)(in + 12)), 1);
+    __m256i t0, t1, t2, t3, idx;
+
+    v = _mm256_shuffle_epi8(v, shuf);
+    t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+    t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+    t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    v = _mm256_or_si256(t1, t3);
+
+    idx = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+    idx = _mm256_sub_epi8(idx, _mm256_cmpgt_epi8(v, _mm256_set1_epi8(25)));
+    v = _mm256_add_epi8(v, _mm256_shuffle_epi8(lut, idx));
+
+    _mm256_storeu_si256((__m256i*)o, v);
+  }
+
+  return (o - out) + _encode_scalar(in, len, o);
+}
+
+__attribute__((target("avx2")))
+static __inline__ gboolean _dec_block_avx2(__m256i* v)
+{
+  const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                          0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                                          0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                          0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                          0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                          0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                          0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                            0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+  __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(*v, 4), mask_2f);
+  __m256i lo_nibbles = _mm256_and_si256(*v, mask_2f);
+  __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+  __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+  __m256i roll;
+
+  if (!_mm256_testz_si256(lo, hi))
+    return FALSE;
+
+  roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(*v, mask_2f), hi_nibbles));
+  *v = _mm256_add_epi8(*v, roll);
+
+  /* pack 32 6-bit values into 24 bytes */
+  *v = _mm256_maddubs_epi16(*v, _mm256_set1_epi32(0x01400140));
+  *v = _mm256_madd_epi16(*v, _mm256_set1_epi32(0x00011000));
+  *v = _mm256_shuffle_epi8(*v, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  *v = _mm256_permutevar8x32_epi32(*v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+  return TRUE;
+}
+
+__attribute__((target("avx2")))
+static gsize _decode_avx2(const char* in, gsize len, guchar* out)
+{
+  const guchar* i = (const guchar*)in;
+  const guchar* end = i + len;
+  guchar* o = out;
+  struct dec_state s = { 0, 0, { 0, 0 } };
+
+  while (i < end)
+  {
+    /* 32 bytes are stored for each 24 decoded, keep 64 characters of input
+     * so that the store stays within XR_BASE64_DECODED_SIZE */
+    while (s.n == 0 && end - i >= 64)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i*)i);
+      if (!_dec_block_avx2(&v))
+        break;
+      _mm256_storeu_si256((__m256i*)o, v);
+      i += 32;
+      o += 24;
+    }
+
+    do
+      o = _decode_scalar(i, i + 1, o, &s);
+    while (++i < end && s.n != 0);
+  }
+
+  return o - out;
+}
+
+#endif
+
+static gsize _decode_plain(const char* in, gsize len, guchar* out)
+{
+  struct dec_state s = { 0, 0, { 0, 0 } };
+
+  return _decode_scalar((const guchar*)in, (const guchar*)in + len, out, &s) - out;
+}
+
+static gsize (*encode_impl)(const guchar* in, gsize len, char* out) = _encode_scalar;
+static gsize (*decode_impl)(const char* in, gsize len, guchar* out) = _decode_plain;
+
+gboolean xr_base64_init(xr_base64_impl impl)
+{
+#ifdef XR_BASE64_X86
+  __builtin_cpu_init();
+
+  if (impl == XR_BASE64_AUTO)
+    impl = __builtin_cpu_supports("avx2") ? XR_BASE64_AVX2 :
+           __builtin_cpu_supports("ssse3") ? XR_BASE64_SSSE3 : XR_BASE64_SCALAR;
+
+  if (impl == XR_BASE64_AVX2 && __builtin_cpu_supports("avx2"))
+  {
+    encode_impl = _encode_avx2;
+    decode_impl = _decode_avx2;
+    return TRUE;
+  }
+
+  if (impl == XR_BASE64_SSSE3 && __builtin_cpu_supports("ssse3"))
+  {
+    encode_impl = _encode_ssse3;
+    decode_impl = _decode_ssse3;
+    return TRUE;
+  }
+#endif
+
+  if (impl == XR_BASE64_AUTO || impl == XR_BASE64_SCALAR)
+  {
+    encode_impl = _encode_scalar;
+    decode_impl = _decode_plain;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+gsize xr_base64_encode(const guchar* in, gsize len, char* out)
+{
+  g_return_val_if_fail(in != NULL || len == 0, 0);
+  g_return_val_if_fail(out != NULL, 0);
+
+  return encode_impl(in, len, out);
+}
+
+gsize xr_base64_decode(const char* in, gsize len, guchar* out)
+{
+  g_return_val_if_fail(in != NULL || len == 0, 0);
+  g_return_val_if_fail(out != NULL, 0);
+
+  return decode_impl(in, len, out);
+}
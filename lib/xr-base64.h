@@ -0,0 +1,79 @@
+/*
+ * Copyright 2006-2008 Ondrej Jirman <ondrej.jirman@zonio.net>
+ *
+ * This file is part of libxr.
+ *
+ * Libxr is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * Libxr is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __XR_BASE64_H__
+#define __XR_BASE64_H__
+
+#include <glib.h>
+
+/** @file xr_base64 Header
+ *
+ * Base64 codec used for blobs. Uses SSSE3 or AVX2 when the CPU supports
+ * it, the implementation is selected by @ref xr_base64_init().
+ */
+
+/** Size of the buffer needed to encode @a len bytes (without NUL).
+ */
+#define XR_BASE64_ENCODED_SIZE(len) (((len) + 2) / 3 * 4)
+
+/** Size of the buffer needed to decode @a len characters.
+ */
+#define XR_BASE64_DECODED_SIZE(len) ((len) / 4 * 3 + 3)
+
+/** Implementation names for @ref xr_base64_init().
+ */
+typedef enum
+{
+  XR_BASE64_AUTO,    /**< Best implementation supported by the CPU. */
+  XR_BASE64_SCALAR,
+  XR_BASE64_SSSE3,
+  XR_BASE64_AVX2
+} xr_base64_impl;
+
+/** Select implementation of the codec. Called from xr_init().
+ *
+ * @param impl Implementation to use.
+ *
+ * @return FALSE if @a impl is not supported by this CPU or build.
+ */
+gboolean xr_base64_init(xr_base64_impl impl);
+
+/** Encode data into base64 without line breaks.
+ *
+ * @param in Data.
+ * @param len Length of the data.
+ * @param out Output buffer of XR_BASE64_ENCODED_SIZE(len) bytes. Output is
+ *   not NUL terminated.
+ *
+ * @return Number of characters written.
+ */
+gsize xr_base64_encode(const guchar* in, gsize len, char* out);
+
+/** Decode base64 text. Characters outside of the base64 alphabet
+ * (whitespace, line breaks) are skipped, like g_base64_decode() does.
+ *
+ * @param in Base64 text.
+ * @param len Length of the text.
+ * @param out Output buffer of XR_BASE64_DECODED_SIZE(len) bytes.
+ *
+ * @return Number of bytes written.
+ */
+gsize xr_base64_decode(const char* in, gsize len, guchar* out);
+
+#endif
@@ -0,0 +1,405 @@
+#include "xr-binary.h"
+
+/* schema binary codec
+ *
+ * Params and return values are encoded by the marshallers generated from
+ * XDL, see xr-binary.h. The transport only frames them:
+ *
+ *   request:  varint(length) method, params
+ *   response: varint(0) retval
+ *             varint(1) zigzag(code) varint(length) message
+ *
+ * Params are fields numbered by their position (from 1) and return value
+ * is field 1. Payload can't be decoded without the schema, so it is kept
+ * in the call object as is (see xr_call_get_raw_params()) and only
+ * generated client stubs and servlet methods can use this transport.
+ */
+
+#define BINARY_RESPONSE_OK 0
+#define BINARY_RESPONSE_ERROR 1
+
+/* writer */
+
+static __inline__ guint64 _binary_zigzag(gint64 v)
+{
+  return ((guint64)v << 1) ^ (guint64)(v >> 63);
+}
+
+static int _binary_format_varint(guchar* tmp, guint64 v)
+{
+  int n = 0;
+
+  while (v >= 0x80)
+  {
+    tmp[n++] = v | 0x80;
+    v >>= 7;
+  }
+  tmp[n++] = v;
+
+  return n;
+}
+
+void xr_binary_write_varint(GString* buf, guint64 v)
+{
+  guchar tmp[10];
+
+  g_string_append_len(buf, (char*)tmp, _binary_format_varint(tmp, v));
+}
+
+void xr_binary_write_key(GString* buf, guint field, xr_binary_wire_type wt)
+{
+  if (field)
+    xr_binary_write_varint(buf, (guint64)field << 3 | wt);
+}
+
+gsize xr_binary_begin(GString* buf, guint field)
+{
+  xr_binary_write_key(buf, field, XR_BINARY_BYTES);
+  /* most bodies are short, so one byte is reserved for the length */
+  g_string_append_c(buf, 0);
+  return buf->len;
+}
+
+void xr_binary_end(GString* buf, gsize mark)
+{
+  gsize len = buf->len - mark;
+  guchar tmp[10];
+  int n;
+
+  if (len < 0x80)
+  {
+    buf->str[mark - 1] = len;
+    return;
+  }
+
+  n = _binary_format_varint(tmp, len);
+  g_string_set_size(buf, buf->len + n - 1);
+  memmove(buf->str + mark - 1 + n, buf->str + mark, len);
+  memcpy(buf->str + mark - 1, tmp, n);
+}
+
+static void _binary_write_bytes(GString* buf, guint field, const char* data, gsize len)
+{
+  xr_binary_write_key(buf, field, XR_BINARY_BYTES);
+  xr_binary_write_varint(buf, len);
+  g_string_append_len(buf, data, len);
+}
+
+gboolean xr_binary_write_int(GString* buf, guint field, int v)
+{
+  xr_binary_write_key(buf, field, XR_BINARY_VARINT);
+  xr_binary_write_varint(buf, _binary_zigzag(v));
+  return TRUE;
+}
+
+gboolean xr_binary_write_bool(GString* buf, guint field, gboolean v)
+{
+  xr_binary_write_key(buf, field, XR_BINARY_VARINT);
+  g_string_append_c(buf, v ? 1 : 0);
+  return TRUE;
+}
+
+gboolean xr_binary_write_double(GString* buf, guint field, double v)
+{
+  union { double d; guint64 u; } tmp = { .d = v };
+
+  xr_binary_write_key(buf, field, XR_BINARY_FIXED64);
+  tmp.u = GUINT64_TO_LE(tmp.u);
+  g_string_append_len(buf, (char*)&tmp.u, 8);
+  return TRUE;
+}
+
+gboolean xr_binary_write_string(GString* buf, guint field, const char* v)
+{
+  _binary_write_bytes(buf, field, v ? v : "", v ? strlen(v) : 0);
+  return TRUE;
+}
+
+gboolean xr_binary_write_blob(GString* buf, guint field, xr_blob* v)
+{
+  if (v == NULL)
+    return FALSE;
+
+  _binary_write_bytes(buf, field, v->buf, v->len);
+  return TRUE;
+}
+
+gboolean xr_binary_write_value(GString* buf, guint field, xr_value* v)
+{
+  gsize mark;
+
+  if (v == NULL)
+    return FALSE;
+
+  mark = xr_binary_begin(buf, field);
+  _xr_value_serialize_msgpack(buf, v);
+  xr_binary_end(buf, mark);
+  return TRUE;
+}
+
+/* reader */
+
+void xr_binary_reader_init(xr_binary_reader* r, const char* buf, gsize len)
+{
+  r->p = (const guchar*)buf;
+  r->end = r->p + len;
+}
+
+gboolean xr_binary_read_varint(xr_binary_reader* r, guint64* v)
+{
+  guint64 x = 0;
+  int shift;
+
+  for (shift = 0; shift < 64 && r->p < r->end; shift += 7)
+  {
+    guchar c = *r->p++;
+
+    x |= (guint64)(c & 0x7f) << shift;
+    if (!(c & 0x80))
+    {
+      *v = x;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+int xr_binary_read_key(xr_binary_reader* r, xr_binary_wire_type* wt)
+{
+  guint64 key;
+
+  if (r->p == r->end)
+    return 0;
+
+  if (!xr_binary_read_varint(r, &key) || (key >> 3) == 0 || (key >> 3) > G_MAXINT || (key & 7) > XR_BINARY_BYTES)
+    return -1;
+
+  *wt = key & 7;
+  return key >> 3;
+}
+
+gboolean xr_binary_read_nested(xr_binary_reader* r, xr_binary_wire_type wt, xr_binary_reader* body)
+{
+  guint64 len;
+
+  if (wt != XR_BINARY_BYTES || !xr_binary_read_varint(r, &len) || len > (guint64)(r->end - r->p))
+    return FALSE;
+
+  body->p = r->p;
+  body->end = r->p + len;
+  r->p = body->end;
+  return TRUE;
+}
+
+gboolean xr_binary_skip(xr_binary_reader* r, xr_binary_wire_type wt)
+{
+  xr_binary_reader body;
+  guint64 v;
+
+  switch (wt)
+  {
+    case XR_BINARY_VARINT:
+      return xr_binary_read_varint(r, &v);
+    case XR_BINARY_FIXED64:
+      if (r->end - r->p < 8)
+        return FALSE;
+      r->p += 8;
+      return TRUE;
+    case XR_BINARY_BYTES:
+      return xr_binary_read_nested(r, wt, &body);
+  }
+
+  return FALSE;
+}
+
+gboolean xr_binary_read_int(xr_binary_reader* r, xr_binary_wire_type wt, int* v)
+{
+  guint64 u;
+  gint64 x;
+
+  if (wt != XR_BINARY_VARINT || !xr_binary_read_varint(r, &u))
+    return FALSE;
+
+  x = (gint64)(u >> 1) ^ -(gint64)(u & 1);
+  if (x < G_MININT || x > G_MAXINT)
+    return FALSE;
+
+  *v = x;
+  return TRUE;
+}
+
+gboolean xr_binary_read_bool(xr_binary_reader* r, xr_binary_wire_type wt, gboolean* v)
+{
+  guint64 u;
+
+  if (wt != XR_BINARY_VARINT || !xr_binary_read_varint(r, &u) || u > 1)
+    return FALSE;
+
+  *v = u;
+  return TRUE;
+}
+
+gboolean xr_binary_read_double(xr_binary_reader* r, xr_binary_wire_type wt, double* v)
+{
+  union { double d; guint64 u; } tmp;
+
+  if (wt != XR_BINARY_FIXED64 || r->end - r->p < 8)
+    return FALSE;
+
+  memcpy(&tmp.u, r->p, 8);
+  tmp.u = GUINT64_FROM_LE(tmp.u);
+  r->p += 8;
+
+  *v = tmp.d;
+  return TRUE;
+}
+
+gboolean xr_binary_read_string(xr_binary_reader* r, xr_binary_wire_type wt, char** v)
+{
+  xr_binary_reader body;
+
+  if (!xr_binary_read_nested(r, wt, &body))
+    return FALSE;
+
+  g_free(*v);
+  *v = g_strndup((const char*)body.p, body.end - body.p);
+  return TRUE;
+}
+
+gboolean xr_binary_read_blob(xr_binary_reader* r, xr_binary_wire_type wt, xr_blob** v)
+{
+  xr_binary_reader body;
+  gsize len;
+  char* buf;
+
+  if (!xr_binary_read_nested(r, wt, &body) || body.end - body.p > G_MAXINT)
+    return FALSE;
+
+  len = body.end - body.p;
+  buf = g_malloc(len + 1);
+  memcpy(buf, body.p, len);
+  buf[len] = '\0';
+
+  xr_blob_unref(*v);
+  *v = xr_blob_new(buf, len);
+  return TRUE;
+}
+
+gboolean xr_binary_read_value(xr_binary_reader* r, xr_binary_wire_type wt, xr_value** v)
+{
+  xr_binary_reader body;
+  struct msgpack_parser p;
+  xr_value* value;
+
+  if (!xr_binary_read_nested(r, wt, &body))
+    return FALSE;
+
+  _msgpack_parser_init(&p, (const char*)body.p, body.end - body.p);
+  value = _msgpack_parse_value(&p);
+  if (value && p.p != p.end)
+  {
+    xr_value_unref(value);
+    value = NULL;
+  }
+  _msgpack_parser_free(&p);
+
+  if (value == NULL)
+    return FALSE;
+
+  xr_value_unref(*v);
+  *v = value;
+  return TRUE;
+}
+
+/* call framing */
+
+static void xr_call_serialize_request_binary(xr_call* call, char** buf, int* len)
+{
+  gsize method_len = strlen(call->method);
+  GString* w = g_string_sized_new(method_len + 16 + (call->raw_params ? call->raw_params->len : 0));
+
+  _binary_write_bytes(w, 0, call->method, method_len);
+  if (call->raw_params)
+    g_string_append_len(w, call->raw_params->str, call->raw_params->len);
+  else if (call->params->len > 0)
+  {
+    /* invalid key, server rejects the params */
+    g_warning("Call params must be set using xr_call_set_raw_params() for binary transport (method %s).", call->method);
+    g_string_append_c(w, 0);
+  }
+
+  *len = w->len;
+  *buf = g_string_free(w, FALSE);
+}
+
+static void xr_call_serialize_response_binary(xr_call* call, char** buf, int* len)
+{
+  GString* w = g_string_sized_new(16 + (call->raw_retval ? call->raw_retval->len : 0));
+
+  if (call->error_set || call->raw_retval == NULL)
+  {
+    const char* msg = call->error_set ? call->errmsg : "Return value can't be sent using binary transport.";
+
+    xr_binary_write_varint(w, BINARY_RESPONSE_ERROR);
+    xr_binary_write_int(w, 0, call->error_set ? call->errcode : -1);
+    xr_binary_write_string(w, 0, msg);
+  }
+  else
+  {
+    xr_binary_write_varint(w, BINARY_RESPONSE_OK);
+    g_string_append_len(w, call->raw_retval->str, call->raw_retval->len);
+  }
+
+  *len = w->len;
+  *buf = g_string_free(w, FALSE);
+}
+
+static gboolean xr_call_unserialize_request_binary(xr_call* call, const char* buf, int len)
+{
+  xr_binary_reader r;
+  xr_binary_reader method;
+
+  xr_binary_reader_init(&r, buf, len);
+
+  if (!xr_binary_read_nested(&r, XR_BINARY_BYTES, &method) || method.p == method.end)
+  {
+    xr_call_set_error(call, -1, "Can't parse binary request. Missing method.");
+    return FALSE;
+  }
+
+  g_free(call->method);
+  call->method = g_strndup((const char*)method.p, method.end - method.p);
+
+  xr_call_set_raw_params(call, g_string_new_len((const char*)r.p, r.end - r.p));
+  return TRUE;
+}
+
+static gboolean xr_call_unserialize_response_binary(xr_call* call, const char* buf, int len)
+{
+  xr_binary_reader r;
+  guint64 status;
+  int errcode;
+  char* errmsg = NULL;
+
+  xr_binary_reader_init(&r, buf, len);
+
+  if (!xr_binary_read_varint(&r, &status))
+    xr_call_set_error(call, -1, "Can't parse binary response. Invalid message.");
+  else if (status == BINARY_RESPONSE_OK)
+    xr_call_set_raw_retval(call, g_string_new_len((const char*)r.p, r.end - r.p));
+  else if (status == BINARY_RESPONSE_ERROR &&
+           xr_binary_read_int(&r, XR_BINARY_VARINT, &errcode) &&
+           xr_binary_read_string(&r, XR_BINARY_BYTES, &errmsg))
+    xr_call_set_error(call, errcode, "%s", errmsg);
+  else
+    xr_call_set_error(call, -1, "Can't parse binary response. Invalid error.");
+
+  g_free(errmsg);
+  return !call->error_set;
+}
+
+static void xr_call_free_buffer_binary(xr_call* call, char* buf)
+{
+  g_free(buf);
+}
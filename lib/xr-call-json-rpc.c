@@ -1,273 +1,1537 @@
-#define __STRICT_ANSI__
-#include <json.h>
-#undef __STRICT_ANSI__
+#include <math.h>
 
-static struct json_object* _xr_value_serialize_json(xr_value* val)
+#include "xr-base64.h"
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define XR_JSON_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/* streaming JSON-RPC codec
+ *
+ * Values are written straight into a GString and parsed directly from the
+ * message into xr_value nodes, no JSON object tree is built. Request ids
+ * are kept as JSON text and echoed in the responses.
+ */
+
+/* maximum nesting of arrays and objects */
+#define JSON_MAX_DEPTH 512
+
+/* size of the last message, used as an initial buffer size for the next one */
+static volatile gint json_size_hint = 1024;
+
+/* id of the next request sent by the client */
+static volatile gint json_next_id = 1;
+
+/* find first character that must be escaped in the string */
+static const char* _json_scan_escape(const char* p, const char* end)
+{
+#ifdef XR_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i bslash = _mm_set1_epi8('\\');
+  const __m128i ctl = _mm_set1_epi8(0x1f);
+
+  for (; end - p >= 16; p += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    /* control characters are the bytes where max(v, 0x1f) == 0x1f */
+    __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+                             _mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl));
+    int mask = _mm_movemask_epi8(m);
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+#endif
+
+  for (; p < end; p++)
+    if ((guchar)*p < 0x20 || *p == '"' || *p == '\\')
+      return p;
+
+  return end;
+}
+
+/* find end of the string or an escape sequence */
+static const char* _json_scan_string(const char* p, const char* end)
+{
+#ifdef XR_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i bslash = _mm_set1_epi8('\\');
+
+  for (; end - p >= 16; p += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)));
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+#endif
+
+  for (; p < end; p++)
+    if (*p == '"' || *p == '\\')
+      return p;
+
+  return end;
+}
+
+/* writer */
+
+static void _json_write_string(GString* buf, const char* str)
 {
-  GSList* i;
+  const char* end = str + strlen(str);
+  const char* p;
+
+  g_string_append_c(buf, '"');
+
+  /* bytes >= 0x80 are copied unchanged, so UTF-8 sequences stay intact */
+  while ((p = _json_scan_escape(str, end)) < end)
+  {
+    g_string_append_len(buf, str, p - str);
+
+    switch (*p)
+    {
+      case '"': g_string_append_len(buf, "\\\"", 2); break;
+      case '\\': g_string_append_len(buf, "\\\\", 2); break;
+      case '\n': g_string_append_len(buf, "\\n", 2); break;
+      case '\r': g_string_append_len(buf, "\\r", 2); break;
+      case '\t': g_string_append_len(buf, "\\t", 2); break;
+      case '\b': g_string_append_len(buf, "\\b", 2); break;
+      case '\f': g_string_append_len(buf, "\\f", 2); break;
+      default: g_string_append_printf(buf, "\\u%04x", (guchar)*p); break;
+    }
+
+    str = p + 1;
+  }
+
+  g_string_append_len(buf, str, end - str);
+  g_string_append_c(buf, '"');
+}
+
+static void _json_write_int(GString* buf, int v)
+{
+  char tmp[16];
+
+  g_string_append_len(buf, tmp, _xmlrpc_format_int(tmp, v));
+}
+
+static void _json_write_double(GString* buf, double v)
+{
+  char tmp[G_ASCII_DTOSTR_BUF_SIZE];
+
+  /* JSON has no representation for them, encoded as JSON.stringify() does */
+  if (isnan(v) || isinf(v))
+  {
+    g_string_append_len(buf, "null", 4);
+    return;
+  }
+
+  /* shortest form that reads back as the same value, %.17g always does */
+  g_ascii_formatd(tmp, sizeof(tmp), "%.15g", v);
+  if (g_ascii_strtod(tmp, NULL) != v)
+  {
+    g_ascii_formatd(tmp, sizeof(tmp), "%.16g", v);
+    if (g_ascii_strtod(tmp, NULL) != v)
+      g_ascii_formatd(tmp, sizeof(tmp), "%.17g", v);
+  }
+  g_string_append(buf, tmp);
+
+  /* integral values would be read back as int */
+  if (strpbrk(tmp, ".eE") == NULL)
+    g_string_append_len(buf, ".0", 2);
+}
+
+static void _json_write_base64(GString* buf, xr_blob* b)
+{
+  gsize start;
+
+  g_string_append_c(buf, '"');
+
+  if (b && b->len > 0)
+  {
+    /* encode directly into the output buffer */
+    start = buf->len;
+    g_string_set_size(buf, start + XR_BASE64_ENCODED_SIZE(b->len));
+    xr_base64_encode((guchar*)b->buf, b->len, buf->str + start);
+  }
+
+  g_string_append_c(buf, '"');
+}
+
+static void _xr_value_serialize_json(GString* buf, xr_value* val)
+{
+  guint i;
 
   switch (xr_value_get_type(val))
   {
     case XRV_ARRAY:
     {
-      struct json_object* array = json_object_new_array();
-      for (i = xr_value_get_items(val); i; i = i->next)
-        json_object_array_add(array, _xr_value_serialize_json(i->data));
-      return array;
+      g_string_append_c(buf, '[');
+      for (i = 0; i < xr_value_array_length(val); i++)
+      {
+        if (i > 0)
+          g_string_append_c(buf, ',');
+        _xr_value_serialize_json(buf, xr_value_array_get(val, i));
+      }
+      g_string_append_c(buf, ']');
+      break;
     }
     case XRV_STRUCT:
     {
-      struct json_object* obj = json_object_new_object();
-      for (i = xr_value_get_members(val); i; i = i->next)
-        json_object_object_add(obj, (char*)xr_value_get_member_name(i->data), _xr_value_serialize_json(xr_value_get_member_value(i->data)));
-      return obj;
+      g_string_append_c(buf, '{');
+      for (i = 0; i < xr_value_struct_length(val); i++)
+      {
+        xr_value* m = xr_value_struct_get_nth(val, i);
+        if (i > 0)
+          g_string_append_c(buf, ',');
+        _json_write_string(buf, xr_value_get_member_name(m));
+        g_string_append_c(buf, ':');
+        _xr_value_serialize_json(buf, xr_value_get_member_value(m));
+      }
+      g_string_append_c(buf, '}');
+      break;
     }
     case XRV_INT:
     {
       int int_val = -1;
       xr_value_to_int(val, &int_val);
-      return json_object_new_int(int_val);
+      _json_write_int(buf, int_val);
+      break;
     }
     case XRV_STRING:
+    case XRV_TIME:
     {
-      char* str_val = NULL;
-      xr_value_to_string(val, &str_val);
-      struct json_object* tmp = json_object_new_string(str_val);
-      g_free(str_val);
-      return tmp;
+      const char* str_val = __xr_value_get_str(val);
+      _json_write_string(buf, str_val ? str_val : "");
+      break;
     }
     case XRV_BOOLEAN:
     {
-      int bool_val = -1;
+      int bool_val = 0;
       xr_value_to_bool(val, &bool_val);
-      return json_object_new_boolean(bool_val);
+      if (bool_val)
+        g_string_append_len(buf, "true", 4);
+      else
+        g_string_append_len(buf, "false", 5);
+      break;
     }
     case XRV_DOUBLE:
     {
-      double dbl_val = -1;
+      double dbl_val = 0.0;
       xr_value_to_double(val, &dbl_val);
-      return json_object_new_double(dbl_val);
-    }
-    case XRV_TIME:
-    {
-      char* str_val = NULL;
-      xr_value_to_time(val, &str_val);
-      struct json_object* tmp = json_object_new_string(str_val);
-      g_free(str_val);
-      return tmp;
+      _json_write_double(buf, dbl_val);
+      break;
     }
     case XRV_BLOB:
     {
-      char* data = NULL;
       xr_blob* b = NULL;
       xr_value_to_blob(val, &b);
-      data = g_base64_encode(b->buf, b->len);
+      _json_write_base64(buf, b);
       xr_blob_unref(b);
-      struct json_object* tmp = json_object_new_string(data);
-      g_free(data);
-      return tmp;
+      break;
     }
   }
+}
 
-  return NULL;
+/* request is written as head, params and tail */
+static void _json_write_request_head(GString* buf, const char* method)
+{
+  g_string_append(buf, "{\"jsonrpc\":\"2.0\",\"method\":");
+  _json_write_string(buf, method ? method : "");
+  g_string_append(buf, ",\"params\":[");
 }
 
-static xr_value* _xr_value_unserialize_json(struct json_object* obj)
+static void _json_write_request_tail(GString* buf, guint id)
 {
-  switch (json_object_get_type(obj))
+  char tmp[16];
+  char* p = _xmlrpc_format_uint(tmp + sizeof(tmp), id);
+
+  g_string_append(buf, "],\"id\":");
+  g_string_append_len(buf, p, tmp + sizeof(tmp) - p);
+  g_string_append_c(buf, '}');
+}
+
+/* JSON-RPC 1.0 responses have both result and error, 2.0 only one of them */
+static void _json_write_response(GString* buf, gboolean v2, xr_value* result, GString* raw_result, int errcode, const char* errmsg, const char* id)
+{
+  g_string_append_c(buf, '{');
+
+  if (v2)
+    g_string_append(buf, "\"jsonrpc\":\"2.0\",");
+
+  if (result || raw_result)
+  {
+    g_string_append(buf, "\"result\":");
+    if (result)
+      _xr_value_serialize_json(buf, result);
+    else
+      g_string_append_len(buf, raw_result->str, raw_result->len);
+    if (!v2)
+      g_string_append(buf, ",\"error\":null");
+  }
+  else
   {
-    case json_type_null:
-      g_return_val_if_reached(NULL);
+    if (!v2)
+      g_string_append(buf, "\"result\":null,");
+    g_string_append(buf, "\"error\":{\"code\":");
+    _json_write_int(buf, errcode);
+    g_string_append(buf, ",\"message\":");
+    _json_write_string(buf, errmsg ? errmsg : "");
+    g_string_append_c(buf, '}');
+  }
+
+  g_string_append(buf, ",\"id\":");
+  g_string_append(buf, id ? id : "null");
+  g_string_append_c(buf, '}');
+}
 
-    case json_type_boolean:
-      return xr_value_bool_new(json_object_get_boolean(obj));
+static GString* _json_writer_new()
+{
+  return g_string_sized_new(g_atomic_int_get(&json_size_hint));
+}
 
-    case json_type_double:
-      return xr_value_double_new(json_object_get_double(obj));
+static void _json_writer_finish(GString* w, char** buf, int* len)
+{
+  /* round up, so that similar messages fit */
+  g_atomic_int_set(&json_size_hint, MAX(1024, w->len + w->len / 8));
 
-    case json_type_int:
-      return xr_value_int_new(json_object_get_int(obj));
+  *len = w->len;
+  *buf = g_string_free(w, FALSE);
+}
 
-    case json_type_object:
+static void xr_call_serialize_request_json(xr_call* call, char** buf, int* len)
+{
+  GString* w = _json_writer_new();
+  guint i, j;
+
+  if (call->batch)
+  {
+    xr_value* calls = xr_call_get_param(call, 0);
+    guint count = xr_value_array_length(calls);
+
+    /* multicall is sent as array of requests with consecutive ids */
+    call->json_id = g_atomic_int_add(&json_next_id, MAX(count, 1));
+
+    g_string_append_c(w, '[');
+    for (i = 0; i < count; i++)
     {
-      xr_value* str = xr_value_struct_new();
-      json_object_object_foreach(obj, key, val)
-        xr_value_struct_set_member(str, key, _xr_value_unserialize_json(val));
-      return str;
+      xr_value* desc = xr_value_array_get(calls, i);
+      xr_value* desc_params = xr_value_get_member(desc, "params");
+
+      if (i > 0)
+        g_string_append_c(w, ',');
+
+      _json_write_request_head(w, __xr_value_get_str(xr_value_get_member(desc, "methodName")));
+      for (j = 0; j < xr_value_array_length(desc_params); j++)
+      {
+        if (j > 0)
+          g_string_append_c(w, ',');
+        _xr_value_serialize_json(w, xr_value_array_get(desc_params, j));
+      }
+      _json_write_request_tail(w, call->json_id + i);
     }
+    g_string_append_c(w, ']');
+  }
+  else
+  {
+    call->json_id = g_atomic_int_add(&json_next_id, 1);
 
-    case json_type_array:
+    _json_write_request_head(w, call->method);
+    if (call->wire)
     {
-      int i;
-      xr_value* arr = xr_value_array_new();
-      const int arr_len = json_object_array_length(obj);
-      for (i = 0; i < arr_len; i++) 
-        xr_value_array_append(arr, _xr_value_unserialize_json(json_object_array_get_idx(obj, i)));
-      return arr;
+      /* params written by the generated code, see xr-wire.h, text is
+         enclosed in [] */
+      g_string_append_len(w, call->wire->str + 1, call->wire->len - 2);
     }
-
-    case json_type_string:
-      return xr_value_string_new(json_object_get_string(obj));
+    else
+    {
+      for (i = 0; i < call->params->len; i++)
+      {
+        if (i > 0)
+          g_string_append_c(w, ',');
+        _xr_value_serialize_json(w, g_ptr_array_index(call->params, i));
+      }
+    }
+    _json_write_request_tail(w, call->json_id);
   }
 
-  g_return_val_if_reached(NULL);
+  _json_writer_finish(w, buf, len);
 }
 
-static void xr_call_serialize_request_json(xr_call* call, char** buf, int* len)
+static const char* _json_request_id(xr_call* call, guint i)
 {
-  GSList* i;
-  struct json_object *r, *params;
-
-  r = json_object_new_object();
-  json_object_object_add(r, "method", json_object_new_string(call->method));
-  json_object_object_add(r, "params", params = json_object_new_array());
-  json_object_object_add(r, "id", json_object_new_string("1"));
-
-  for (i = call->params; i; i = i->next)
-    json_object_array_add(params, _xr_value_serialize_json(i->data));
-
-  *buf = g_strdup(json_object_to_json_string(r));
-  *len = strlen(*buf);
+  return call->json_ids && i < call->json_ids->len ? g_ptr_array_index(call->json_ids, i) : NULL;
+}
 
-  json_object_put(r);
+/* JSON-RPC 2.0 request without id is a notification, that gets no response
+ * (requests that failed to parse have "null" id) */
+static gboolean _json_is_notification(xr_call* call, guint i)
+{
+  return call->json_ids && i < call->json_ids->len && g_ptr_array_index(call->json_ids, i) == NULL;
 }
 
 static void xr_call_serialize_response_json(xr_call* call, char** buf, int* len)
 {
-  GSList* i;
-  struct json_object *r, *error;
+  GString* w;
+  guint i;
+  gboolean first = TRUE;
 
-  if (call->error_set)
+  g_return_if_fail(call->error_set || call->retval || call->wire_retval);
+
+  w = _json_writer_new();
+
+  if (call->batch && !call->error_set && xr_value_get_type(call->retval) == XRV_ARRAY)
   {
-    r = json_object_new_object();
-    json_object_object_add(r, "result", NULL);
-    json_object_object_add(r, "error", error = json_object_new_object());
-    json_object_object_add(r, "id", json_object_new_string("1"));
-    json_object_object_add(error, "code", json_object_new_int(call->errcode));
-    json_object_object_add(error, "message", json_object_new_string(call->errmsg));
+    /* multicall results are sent as array of responses, batch of
+       notifications gets empty response instead of empty array */
+    for (i = 0; i < xr_value_array_length(call->retval); i++)
+    {
+      xr_value* result = xr_value_array_get(call->retval, i);
+      const char* id = _json_request_id(call, i);
+      int errcode;
+      char* errmsg;
+
+      if (_json_is_notification(call, i))
+        continue;
+
+      g_string_append_c(w, first ? '[' : ',');
+      first = FALSE;
+
+      if (xr_value_get_type(result) == XRV_ARRAY && xr_value_array_length(result) == 1)
+        _json_write_response(w, TRUE, xr_value_array_get(result, 0), NULL, 0, NULL, id);
+      else if (xr_value_is_error_retval(result, &errcode, &errmsg))
+      {
+        _json_write_response(w, TRUE, NULL, NULL, errcode, errmsg, id);
+        g_free(errmsg);
+      }
+      else
+        _json_write_response(w, TRUE, NULL, NULL, -1, "Invalid multicall result.", id);
+    }
+
+    if (!first)
+      g_string_append_c(w, ']');
   }
-  else if (call->retval)
+  else if (call->json_v2 && !call->batch && _json_is_notification(call, 0))
   {
-    r = json_object_new_object();
-    json_object_object_add(r, "result", _xr_value_serialize_json(call->retval));
-    json_object_object_add(r, "error", NULL);
-    json_object_object_add(r, "id", json_object_new_string("1"));
+    /* body of the HTTP response is empty */
   }
+  else if (call->error_set)
+    _json_write_response(w, call->json_v2, NULL, NULL, call->errcode, call->errmsg, _json_request_id(call, 0));
   else
-    g_return_if_reached();
+    _json_write_response(w, call->json_v2, call->retval, call->wire_retval, 0, NULL, _json_request_id(call, 0));
+
+  _json_writer_finish(w, buf, len);
+}
+
+/* parser */
+
+struct json_parser
+{
+  const char* p;
+  const char* end;
+  GString* text;         /* last parsed string */
+  int depth;
+};
 
-  *buf = g_strdup(json_object_to_json_string(r));
-  *len = strlen(*buf);
+static void _json_parser_init(struct json_parser* p, const char* buf, int len)
+{
+  p->p = buf;
+  p->end = buf + len;
+  p->text = g_string_sized_new(128);
+  p->depth = 0;
+}
 
-  json_object_put(r);
+static void _json_parser_free(struct json_parser* p)
+{
+  g_string_free(p->text, TRUE);
 }
 
-static gboolean xr_call_unserialize_request_json(xr_call* call, const char* buf, int len)
+/* next non-whitespace character or -1 at the end of input */
+static __inline__ int _json_peek(struct json_parser* p)
+{
+  while (p->p < p->end && (*p->p == ' ' || *p->p == '\n' || *p->p == '\r' || *p->p == '\t'))
+    p->p++;
+
+  return p->p < p->end ? (guchar)*p->p : -1;
+}
+
+static __inline__ gboolean _json_accept(struct json_parser* p, char c)
+{
+  if (_json_peek(p) != (guchar)c)
+    return FALSE;
+
+  p->p++;
+  return TRUE;
+}
+
+static gboolean _json_parse_literal(struct json_parser* p, const char* lit, gsize len)
+{
+  if (p->end - p->p < len || memcmp(p->p, lit, len))
+    return FALSE;
+
+  p->p += len;
+  return TRUE;
+}
+
+/* only the whitespace may follow the message */
+static gboolean _json_parse_finish(struct json_parser* p)
 {
-  struct json_tokener* t;
-  struct json_object* r;
-  int i;
+  return _json_peek(p) < 0;
+}
 
-  t = json_tokener_new();
-  r = json_tokener_parse_ex(t, (char*)buf, len);
-  json_tokener_free(t);
+static gboolean _json_parse_hex4(struct json_parser* p, gunichar* u)
+{
+  int i, d;
 
-  if (r == NULL)
+  if (p->end - p->p < 4)
+    return FALSE;
+
+  for (*u = 0, i = 0; i < 4; i++)
   {
-    xr_call_set_error(call, -1, "Can't parse JSON-RPC request. Invalid JSON object.");
+    if ((d = g_ascii_xdigit_value(p->p[i])) < 0)
+      return FALSE;
+    *u = (*u << 4) | d;
+  }
+
+  p->p += 4;
+  return TRUE;
+}
+
+/* parse string into p->text */
+static gboolean _json_parse_string(struct json_parser* p)
+{
+  const char* s;
+
+  if (!_json_accept(p, '"'))
     return FALSE;
+
+  g_string_truncate(p->text, 0);
+
+  while (TRUE)
+  {
+    s = _json_scan_string(p->p, p->end);
+    g_string_append_len(p->text, p->p, s - p->p);
+    if (s == p->end)
+      return FALSE;
+
+    p->p = s + 1;
+    if (*s == '"')
+      return TRUE;
+
+    if (p->p == p->end)
+      return FALSE;
+
+    switch (*p->p++)
+    {
+      case '"': g_string_append_c(p->text, '"'); break;
+      case '\\': g_string_append_c(p->text, '\\'); break;
+      case '/': g_string_append_c(p->text, '/'); break;
+      case 'b': g_string_append_c(p->text, '\b'); break;
+      case 'f': g_string_append_c(p->text, '\f'); break;
+      case 'n': g_string_append_c(p->text, '\n'); break;
+      case 'r': g_string_append_c(p->text, '\r'); break;
+      case 't': g_string_append_c(p->text, '\t'); break;
+      case 'u':
+      {
+        gunichar u, lo;
+
+        if (!_json_parse_hex4(p, &u))
+          return FALSE;
+
+        /* characters outside of the BMP are encoded as surrogate pairs */
+        if (u >= 0xd800 && u < 0xdc00)
+        {
+          if (!_json_parse_literal(p, "\\u", 2) || !_json_parse_hex4(p, &lo) || lo < 0xdc00 || lo >= 0xe000)
+            return FALSE;
+          u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+        }
+        else if (u >= 0xdc00 && u < 0xe000)
+          return FALSE;
+
+        g_string_append_unichar(p->text, u);
+        break;
+      }
+      default:
+        return FALSE;
+    }
   }
+}
+
+/* parse number, returns XRV_INT or XRV_DOUBLE and stores the value into iv
+ * or dv if not NULL, -1 on error */
+static int _json_parse_number_raw(struct json_parser* p, int* iv, double* dv)
+{
+  const char* s = p->p;
+  gboolean neg = FALSE, is_double = FALSE;
+  gint64 v = 0;
+  char tmp[64];
+  char* str;
+  double d;
 
-  call->method = g_strdup(json_object_get_string(json_object_object_get(r, "method")));
-  if (call->method == NULL)
+  if (s < p->end && *s == '-')
   {
-    xr_call_set_error(call, -1, "Can't parse JSON-RPC request. Missing method.");
-    json_object_put(r);
-    return FALSE;
+    neg = TRUE;
+    s++;
+  }
+
+  if (s == p->end || !g_ascii_isdigit(*s))
+    return -1;
+
+  for (; s < p->end && g_ascii_isdigit(*s); s++)
+  {
+    v = v * 10 + (*s - '0');
+    /* does not fit into int */
+    if (v > (gint64)G_MAXINT + 1)
+      is_double = TRUE, v = 0;
   }
 
-  struct json_object* params = json_object_object_get(r, "params");
-  if (params == NULL || !json_object_is_type(params, json_type_array))
+  if (s < p->end && *s == '.')
   {
-    xr_call_set_error(call, -1, "Can't parse JSON-RPC request. Invalid params.");
-    json_object_put(r);
-    return FALSE;
+    is_double = TRUE;
+    if (++s == p->end || !g_ascii_isdigit(*s))
+      return -1;
+    while (s < p->end && g_ascii_isdigit(*s))
+      s++;
+  }
+
+  if (s < p->end && (*s == 'e' || *s == 'E'))
+  {
+    is_double = TRUE;
+    if (++s < p->end && (*s == '+' || *s == '-'))
+      s++;
+    if (s == p->end || !g_ascii_isdigit(*s))
+      return -1;
+    while (s < p->end && g_ascii_isdigit(*s))
+      s++;
+  }
+
+  if (!is_double && (neg || v <= G_MAXINT))
+  {
+    p->p = s;
+    if (iv)
+      *iv = neg ? -v : v;
+    return XRV_INT;
+  }
+
+  if (dv == NULL)
+  {
+    p->p = s;
+    return XRV_DOUBLE;
+  }
+
+  /* input is not terminated */
+  str = s - p->p < sizeof(tmp) ? tmp : g_malloc(s - p->p + 1);
+  memcpy(str, p->p, s - p->p);
+  str[s - p->p] = '\0';
+  d = g_ascii_strtod(str, NULL);
+  if (str != tmp)
+    g_free(str);
+
+  p->p = s;
+  *dv = d;
+  return XRV_DOUBLE;
+}
+
+static xr_value* _json_parse_number(struct json_parser* p)
+{
+  int iv;
+  double dv;
+
+  switch (_json_parse_number_raw(p, &iv, &dv))
+  {
+    case XRV_INT:
+      return xr_value_int_new(iv);
+    case XRV_DOUBLE:
+      return xr_value_double_new(dv);
   }
 
-  const int params_count = json_object_array_length(params);
-  for (i = 0; i < params_count; i++) 
+  return NULL;
+}
+
+/* parse value, null is not supported by xr_value */
+static xr_value* _json_parse_value(struct json_parser* p)
+{
+  xr_value* v = NULL;
+
+  switch (_json_peek(p))
   {
-    xr_value* v = _xr_value_unserialize_json(json_object_array_get_idx(params, i));
-    if (v == NULL)
+    case '{':
     {
-      xr_call_set_error(call, -1, "Can't parse JSON-RPC request. Failed to unserialize parameter %d.", i);
-      json_object_put(r);
-      return FALSE;
+      if (++p->depth > JSON_MAX_DEPTH)
+        return NULL;
+
+      p->p++;
+      v = xr_value_struct_new();
+      if (!_json_accept(p, '}'))
+      {
+        do
+        {
+          char tmp[64];
+          char* name;
+          xr_value* m;
+
+          if (!_json_parse_string(p) || !_json_accept(p, ':'))
+            goto err;
+
+          /* p->text is reused by the member value */
+          name = p->text->len < sizeof(tmp) ? memcpy(tmp, p->text->str, p->text->len + 1) : g_strndup(p->text->str, p->text->len);
+          m = _json_parse_value(p);
+          if (m)
+            xr_value_struct_set_member(v, name, m);
+          if (name != tmp)
+            g_free(name);
+          if (m == NULL)
+            goto err;
+        }
+        while (_json_accept(p, ','));
+
+        if (!_json_accept(p, '}'))
+          goto err;
+      }
+
+      p->depth--;
+      return v;
     }
 
-    xr_call_add_param(call, v);
+    case '[':
+    {
+      if (++p->depth > JSON_MAX_DEPTH)
+        return NULL;
+
+      p->p++;
+      v = xr_value_array_new();
+      if (!_json_accept(p, ']'))
+      {
+        do
+        {
+          xr_value* item = _json_parse_value(p);
+          if (item == NULL)
+            goto err;
+          xr_value_array_append(v, item);
+        }
+        while (_json_accept(p, ','));
+
+        if (!_json_accept(p, ']'))
+          goto err;
+      }
+
+      p->depth--;
+      return v;
+    }
+
+    case '"':
+      if (!_json_parse_string(p))
+        return NULL;
+      return xr_value_string_new(p->text->str);
+
+    case 't':
+      return _json_parse_literal(p, "true", 4) ? xr_value_bool_new(1) : NULL;
+
+    case 'f':
+      return _json_parse_literal(p, "false", 5) ? xr_value_bool_new(0) : NULL;
+
+    case 'N':
+      return _json_parse_literal(p, "NaN", 3) ? xr_value_double_new(NAN) : NULL;
+
+    case 'I':
+      return _json_parse_literal(p, "Infinity", 8) ? xr_value_double_new(INFINITY) : NULL;
+
+    case '-':
+      if (p->end - p->p > 1 && p->p[1] == 'I')
+        return _json_parse_literal(p, "-Infinity", 9) ? xr_value_double_new(-INFINITY) : NULL;
+      return _json_parse_number(p);
+
+    default:
+      return _json_parse_number(p);
   }
 
-  json_object_put(r);
+err:
+  xr_value_unref(v);
+  return NULL;
+}
+
+/* skip any value, null is accepted only if null_ok is set */
+static gboolean _json_skip_value(struct json_parser* p, gboolean null_ok)
+{
+  switch (_json_peek(p))
+  {
+    case 'n':
+      return null_ok && _json_parse_literal(p, "null", 4);
+
+    case '"':
+      return _json_parse_string(p);
+
+    case '{':
+    case '[':
+    {
+      char close = *p->p == '{' ? '}' : ']';
+
+      if (++p->depth > JSON_MAX_DEPTH)
+        return FALSE;
+
+      p->p++;
+      if (!_json_accept(p, close))
+      {
+        do
+        {
+          if (close == '}' && (!_json_parse_string(p) || !_json_accept(p, ':')))
+            return FALSE;
+          if (!_json_skip_value(p, null_ok))
+            return FALSE;
+        }
+        while (_json_accept(p, ','));
+
+        if (!_json_accept(p, close))
+          return FALSE;
+      }
+
+      p->depth--;
+      return TRUE;
+    }
+
+    case 't':
+      return _json_parse_literal(p, "true", 4);
+
+    case 'f':
+      return _json_parse_literal(p, "false", 5);
+
+    case 'N':
+      return _json_parse_literal(p, "NaN", 3);
+
+    case 'I':
+      return _json_parse_literal(p, "Infinity", 8);
+
+    case '-':
+      if (p->end - p->p > 1 && p->p[1] == 'I')
+        return _json_parse_literal(p, "-Infinity", 9);
+      /* fall through */
+
+    default:
+      return _json_parse_number_raw(p, NULL, NULL) >= 0;
+  }
+}
+
+/* id is kept as JSON text */
+static gboolean _json_parse_id(struct json_parser* p, char** id)
+{
+  const char* start;
+
+  _json_peek(p);
+  start = p->p;
+  if (!_json_skip_value(p, TRUE))
+    return FALSE;
+
+  g_free(*id);
+  *id = g_strndup(start, p->p - start);
   return TRUE;
 }
 
-static gboolean xr_call_unserialize_response_json(xr_call* call, const char* buf, int len)
+/* direct reader, see xr-wire.h
+ *
+ * Params are validated by _json_skip_value() when the request is received,
+ * so the reader only has to tell the values apart.
+ */
+
+static __inline__ void _jw_load(xr_wire_reader* r, struct json_parser* p)
 {
-  struct json_tokener* t;
-  struct json_object* r;
-  int i;
+  p->p = r->p;
+  p->end = r->end;
+  p->text = NULL;
+  p->depth = r->depth;
+}
 
-  t = json_tokener_new();
-  r = json_tokener_parse_ex(t, (char*)buf, len);
-  json_tokener_free(t);
+static __inline__ void _jw_store(xr_wire_reader* r, struct json_parser* p)
+{
+  r->p = p->p;
+  r->depth = p->depth;
+}
 
-  if (r == NULL)
+static int _jw_next_item(xr_wire_reader* r)
+{
+  struct json_parser p;
+  int rs = 1;
+
+  _jw_load(r, &p);
+  switch (_json_peek(&p))
   {
-    xr_call_set_error(call, -1, "Can't parse JSON-RPC response. Invalid JSON object.");
+    case ']':
+      p.p++;
+      p.depth--;
+      rs = 0;
+      break;
+    case ',':
+      p.p++;
+      break;
+    case -1:
+      rs = -1;
+      break;
+  }
+
+  _jw_store(r, &p);
+  return rs;
+}
+
+static gboolean _jw_begin(xr_wire_reader* r, char open)
+{
+  struct json_parser p;
+
+  _jw_load(r, &p);
+  if (_json_peek(&p) != (guchar)open || ++p.depth > JSON_MAX_DEPTH)
     return FALSE;
+
+  p.p++;
+  _jw_store(r, &p);
+  return TRUE;
+}
+
+/* read string at r->p, strings without escapes are copied directly */
+static char* _jw_string_dup(xr_wire_reader* r)
+{
+  struct json_parser p;
+  const char* s;
+  char* str = NULL;
+
+  _jw_load(r, &p);
+  if (_json_peek(&p) != '"')
+    return NULL;
+
+  s = _json_scan_string(p.p + 1, p.end);
+  if (s < p.end && *s == '"')
+  {
+    str = g_strndup(p.p + 1, s - p.p - 1);
+    p.p = s + 1;
   }
+  else
+  {
+    p.text = g_string_sized_new(128);
+    if (_json_parse_string(&p))
+      str = g_strndup(p.text->str, p.text->len);
+    g_string_free(p.text, TRUE);
+  }
+
+  _jw_store(r, &p);
+  return str;
+}
 
-  struct json_object* error = json_object_object_get(r, "error");
-  if (error && !json_object_is_type(error, json_type_null))
+static int _jw_next_member(xr_wire_reader* r)
+{
+  struct json_parser p;
+  const char* s;
+  int c;
+
+  _jw_load(r, &p);
+  c = _json_peek(&p);
+  if (c == '}')
   {
-    if (json_object_is_type(error, json_type_object))
+    p.p++;
+    p.depth--;
+    _jw_store(r, &p);
+    return 0;
+  }
+
+  if (c == ',')
+    p.p++;
+  if (_json_peek(&p) != '"')
+    return -1;
+
+  /* names are compared as C strings, like xr_value member names */
+  r->text = p.p;
+  s = _json_scan_string(p.p + 1, p.end);
+  if (s < p.end && *s == '"')
+  {
+    r->name = p.p + 1;
+    r->name_len = strnlen(r->name, s - r->name);
+    p.p = s + 1;
+  }
+  else
+  {
+    p.text = g_string_sized_new(128);
+    if (!_json_parse_string(&p))
     {
-      struct json_object* code = json_object_object_get(error, "code");
-      struct json_object* message = json_object_object_get(error, "message");
-      if (code && message && json_object_is_type(code, json_type_int) && json_object_is_type(message, json_type_string))
-        xr_call_set_error(call, json_object_get_int(code), "%s", json_object_get_string(message));
-      else
-        xr_call_set_error(call, -1, "Can't parse JSON-RPC response. Invalid error object.");
+      g_string_free(p.text, TRUE);
+      return -1;
+    }
+    r->name_len = strlen(p.text->str);
+    if (r->name_len < sizeof(r->name_buf))
+    {
+      memcpy(r->name_buf, p.text->str, r->name_len + 1);
+      r->name = r->name_buf;
     }
     else
-      xr_call_set_error(call, -1, "Can't parse JSON-RPC response. Invalid error object.");
+      r->name = NULL; /* long name, parsed again on demand */
+    g_string_free(p.text, TRUE);
+  }
+
+  if (!_json_accept(&p, ':'))
+    return -1;
+
+  _jw_store(r, &p);
+  return 1;
+}
+
+static char* _jw_name_dup(xr_wire_reader* r)
+{
+  xr_wire_reader tmp = *r;
+
+  if (r->name)
+    return g_strndup(r->name, r->name_len);
+
+  tmp.p = r->text;
+  return _jw_string_dup(&tmp);
+}
+
+static gboolean _jw_skip(xr_wire_reader* r)
+{
+  struct json_parser p;
+  gboolean rs;
+
+  _jw_load(r, &p);
+  p.text = g_string_sized_new(128);
+  rs = _json_skip_value(&p, TRUE);
+  g_string_free(p.text, TRUE);
+  _jw_store(r, &p);
+
+  return rs;
+}
+
+static xr_value* _jw_build_value(xr_wire_reader* r)
+{
+  struct json_parser p;
+  xr_value* v;
+
+  _jw_load(r, &p);
+  p.text = g_string_sized_new(128);
+  v = _json_parse_value(&p);
+  g_string_free(p.text, TRUE);
+  _jw_store(r, &p);
+
+  return v;
+}
+
+static gboolean _jw_read_int(xr_wire_reader* r, int* v)
+{
+  struct json_parser p;
 
-    json_object_put(r);
+  _jw_load(r, &p);
+  _json_peek(&p);
+  if (_json_parse_number_raw(&p, v, NULL) != XRV_INT)
     return FALSE;
+
+  _jw_store(r, &p);
+  return TRUE;
+}
+
+static gboolean _jw_read_bool(xr_wire_reader* r, gboolean* v)
+{
+  struct json_parser p;
+
+  _jw_load(r, &p);
+  switch (_json_peek(&p))
+  {
+    case 't':
+      if (!_json_parse_literal(&p, "true", 4))
+        return FALSE;
+      *v = 1;
+      break;
+    case 'f':
+      if (!_json_parse_literal(&p, "false", 5))
+        return FALSE;
+      *v = 0;
+      break;
+    default:
+      return FALSE;
   }
 
-  struct json_object* result = json_object_object_get(r, "result");
-  if (result == NULL || json_object_is_type(result, json_type_null))
+  _jw_store(r, &p);
+  return TRUE;
+}
+
+static gboolean _jw_read_double(xr_wire_reader* r, double* v)
+{
+  struct json_parser p;
+
+  _jw_load(r, &p);
+  switch (_json_peek(&p))
   {
-    xr_call_set_error(call, -1, "Can't parse JSON-RPC response. Null result.");
-    json_object_put(r);
+    case 'N':
+      if (!_json_parse_literal(&p, "NaN", 3))
+        return FALSE;
+      *v = NAN;
+      break;
+    case 'I':
+      if (!_json_parse_literal(&p, "Infinity", 8))
+        return FALSE;
+      *v = INFINITY;
+      break;
+    default:
+      if (_json_parse_literal(&p, "-Infinity", 9))
+        *v = -INFINITY;
+      else if (_json_parse_number_raw(&p, NULL, v) != XRV_DOUBLE)
+        return FALSE;
+  }
+
+  _jw_store(r, &p);
+  return TRUE;
+}
+
+static gboolean _jw_read_string(xr_wire_reader* r, char** v)
+{
+  char* str = _jw_string_dup(r);
+
+  if (str == NULL)
     return FALSE;
+
+  g_free(*v);
+  *v = str;
+  return TRUE;
+}
+
+/* parse params array */
+static gboolean _json_parse_params(struct json_parser* p, xr_call* call)
+{
+  int i = 0;
+
+  p->p++;
+  if (!_json_accept(p, ']'))
+  {
+    do
+    {
+      xr_value* v;
+
+      /* null can't be passed to the servlet, but the id should still
+         be echoed in the fault response */
+      if (_json_peek(p) == 'n')
+      {
+        if (!call->error_set)
+          xr_call_set_error(call, -1, "Can't parse JSON-RPC request. Failed to unserialize parameter %d.", i);
+        if (!_json_skip_value(p, TRUE))
+          return FALSE;
+        i++;
+        continue;
+      }
+
+      if ((v = _json_parse_value(p)) == NULL)
+        return FALSE;
+
+      xr_call_add_param(call, v);
+      i++;
+    }
+    while (_json_accept(p, ','));
+
+    if (!_json_accept(p, ']'))
+      return FALSE;
   }
 
-  xr_value* v = _xr_value_unserialize_json(result);
-  if (v == NULL)
+  return TRUE;
+}
+
+/* Parse request object. Returns FALSE if the message is not valid JSON,
+ * invalid requests are reported by setting error on the call. */
+static gboolean _json_parse_request(struct json_parser* p, xr_call* call, char** id)
+{
+  gboolean have_params = FALSE;
+
+  if (_json_peek(p) != '{')
   {
-    xr_call_set_error(call, -1, "Can't parse JSON-RPC response. Invalid result.");
-    json_object_put(r);
-    return FALSE;
+    xr_call_set_error(call, -1, "Can't parse JSON-RPC request. Invalid JSON object.");
+    return _json_skip_value(p, TRUE);
+  }
+
+  p->p++;
+  if (!_json_accept(p, '}'))
+  {
+    do
+    {
+      if (!_json_parse_string(p) || !_json_accept(p, ':'))
+        return FALSE;
+
+      if (!strcmp(p->text->str, "method") && _json_peek(p) == '"')
+      {
+        if (!_json_parse_string(p))
+          return FALSE;
+        g_free(call->method);
+        call->method = g_strndup(p->text->str, p->text->len);
+      }
+      else if (!strcmp(p->text->str, "params") && _json_peek(p) == '[')
+      {
+        const char* start = p->p;
+        int depth = p->depth;
+
+        /* params are read by the generated code, unless they contain null */
+        if (call->defer_params && !have_params && _json_skip_value(p, FALSE))
+          call->wire = g_string_new_len(start, p->p - start);
+        else
+        {
+          p->p = start;
+          p->depth = depth;
+          /* keep order of the repeated params */
+          if (call->wire)
+            _xr_call_parse_wire(call);
+          if (!_json_parse_params(p, call))
+            return FALSE;
+        }
+        have_params = TRUE;
+      }
+      else if (!strcmp(p->text->str, "id"))
+      {
+        if (!_json_parse_id(p, id))
+          return FALSE;
+      }
+      else if (!strcmp(p->text->str, "jsonrpc") && _json_peek(p) == '"')
+      {
+        if (!_json_parse_string(p))
+          return FALSE;
+        call->json_v2 = !strcmp(p->text->str, "2.0");
+      }
+      else if (!_json_skip_value(p, TRUE))
+        return FALSE;
+    }
+    while (_json_accept(p, ','));
+
+    if (!_json_accept(p, '}'))
+      return FALSE;
   }
 
-  xr_call_set_retval(call, v);
-  json_object_put(r);
+  if (call->method == NULL && !call->error_set)
+    xr_call_set_error(call, -1, "Can't parse JSON-RPC request. Missing method.");
+  else if (!have_params && !call->error_set)
+    xr_call_set_error(call, -1, "Can't parse JSON-RPC request. Invalid params.");
+
   return TRUE;
 }
 
+static gboolean _json_parse_batch_request(struct json_parser* p, xr_call* call)
+{
+  GPtrArray* calls = g_ptr_array_new();
+  xr_call* multicall;
+  gboolean rs = TRUE;
+  guint i;
+
+  /* batch is handled as a multicall, invalid requests are passed without
+     method name and fail individually */
+  p->p++;
+  if (!_json_accept(p, ']'))
+  {
+    do
+    {
+      xr_call* sub = xr_call_new(NULL);
+      char* id = NULL;
+
+      g_ptr_array_add(calls, sub);
+      if (!_json_parse_request(p, sub, &id))
+      {
+        g_free(id);
+        rs = FALSE;
+        break;
+      }
+
+      /* invalid request is answered even without id */
+      if (sub->error_set && id == NULL)
+        id = g_strdup("null");
+
+      g_ptr_array_add(call->json_ids, id);
+      if (sub->error_set)
+      {
+        g_free(sub->method);
+        sub->method = NULL;
+      }
+    }
+    while (_json_accept(p, ','));
+
+    rs = rs && _json_accept(p, ']');
+  }
+
+  /* empty batch is an invalid request */
+  if (rs && calls->len > 0 && _json_parse_finish(p))
+  {
+    multicall = xr_call_multicall_new((xr_call**)calls->pdata, calls->len);
+    g_free(call->method);
+    call->method = g_strdup(XR_CALL_MULTICALL);
+    call->batch = TRUE;
+    call->json_v2 = TRUE;
+    xr_call_add_param(call, _xr_value_share(xr_call_get_param(multicall, 0)));
+    xr_call_free(multicall);
+  }
+  else
+  {
+    /* response to the unparsable batch has null id */
+    g_ptr_array_set_size(call->json_ids, 0);
+    call->json_v2 = TRUE;
+    xr_call_set_error(call, -1, "Can't parse JSON-RPC request. Invalid JSON object.");
+    rs = FALSE;
+  }
+
+  for (i = 0; i < calls->len; i++)
+    xr_call_free(g_ptr_array_index(calls, i));
+  g_ptr_array_free(calls, TRUE);
+
+  return rs;
+}
+
+static gboolean xr_call_unserialize_request_json(xr_call* call, const char* buf, int len)
+{
+  struct json_parser p;
+  char* id = NULL;
+  gboolean rs;
+
+  if (call->json_ids == NULL)
+    call->json_ids = g_ptr_array_new_with_free_func(g_free);
+
+  _json_parser_init(&p, buf, len);
+
+  if (_json_peek(&p) == '[')
+    rs = _json_parse_batch_request(&p, call);
+  else
+  {
+    rs = _json_parse_request(&p, call, &id) && _json_parse_finish(&p);
+
+    if (!rs && !call->error_set)
+      xr_call_set_error(call, -1, "Can't parse JSON-RPC request. Invalid JSON object.");
+    rs = rs && !call->error_set;
+
+    /* invalid request is answered even without id */
+    if (!rs && id == NULL)
+      id = g_strdup("null");
+    g_ptr_array_add(call->json_ids, id);
+  }
+
+  _json_parser_free(&p);
+  return rs;
+}
+
+static gboolean _json_parse_error(struct json_parser* p, xr_call* call)
+{
+  xr_value* code = NULL;
+  char* message = NULL;
+  gboolean rs = FALSE;
+  int errcode;
+
+  if (_json_peek(p) != '{')
+  {
+    xr_call_set_error(call, -1, "Can't parse JSON-RPC response. Invalid error object.");
+    return _json_skip_value(p, TRUE);
+  }
+
+  p->p++;
+  if (!_json_accept(p, '}'))
+  {
+    do
+    {
+      if (!_json_parse_string(p) || !_json_accept(p, ':'))
+        goto out;
+
+      if (!strcmp(p->text->str, "code") && code == NULL && _json_peek(p) != 'n')
+      {
+        if ((code = _json_parse_value(p)) == NULL)
+          goto out;
+      }
+      else if (!strcmp(p->text->str, "message") && message == NULL && _json_peek(p) == '"')
+      {
+        if (!_json_parse_string(p))
+          goto out;
+        message = g_strndup(p->text->str, p->text->len);
+      }
+      else if (!_json_skip_value(p, TRUE))
+        goto out;
+    }
+    while (_json_accept(p, ','));
+
+    if (!_json_accept(p, '}'))
+      goto out;
+  }
+
+  if (xr_value_to_int(code, &errcode) && message)
+    xr_call_set_error(call, errcode, "%s", message);
+  else
+    xr_call_set_error(call, -1, "Can't parse JSON-RPC response. Invalid error object.");
+  rs = TRUE;
+
+out:
+  xr_value_unref(code);
+  g_free(message);
+  return rs;
+}
+
+/* Parse response object. Returns FALSE if the message is not valid JSON,
+ * errors and invalid responses are set on the call. */
+static gboolean _json_parse_response(struct json_parser* p, xr_call* call, char** id)
+{
+  xr_value* result = NULL;
+
+  if (_json_peek(p) != '{')
+  {
+    xr_call_set_error(call, -1, "Can't parse JSON-RPC response. Invalid JSON object.");
+    return _json_skip_value(p, TRUE);
+  }
+
+  p->p++;
+  if (!_json_accept(p, '}'))
+  {
+    do
+    {
+      if (!_json_parse_string(p) || !_json_accept(p, ':'))
+        goto err;
+
+      if (!strcmp(p->text->str, "result") && _json_peek(p) != 'n')
+      {
+        xr_value_unref(result);
+        if ((result = _json_parse_value(p)) == NULL)
+          goto err;
+      }
+      else if (!strcmp(p->text->str, "error") && _json_peek(p) != 'n')
+      {
+        if (!_json_parse_error(p, call))
+          goto err;
+      }
+      else if (!strcmp(p->text->str, "id") && id)
+      {
+        if (!_json_parse_id(p, id))
+          goto err;
+      }
+      else if (!_json_skip_value(p, TRUE))
+        goto err;
+    }
+    while (_json_accept(p, ','));
+
+    if (!_json_accept(p, '}'))
+      goto err;
+  }
+
+  if (call->error_set)
+    xr_value_unref(result);
+  else if (result == NULL)
+    xr_call_set_error(call, -1, "Can't parse JSON-RPC response. Null result.");
+  else
+    xr_call_set_retval(call, result);
+
+  return TRUE;
+
+err:
+  xr_value_unref(result);
+  return FALSE;
+}
+
+/* position of the response in the batch sent with ids starting at base, -1
+ * if the id was not assigned by us */
+static int _json_batch_index(const char* id, guint base, guint count)
+{
+  guint v = 0;
+  const char* s;
+
+  if (id == NULL || *id == '\0')
+    return -1;
+
+  for (s = id; *s; s++)
+  {
+    if (!g_ascii_isdigit(*s))
+      return -1;
+    v = v * 10 + (*s - '0');
+  }
+
+  return v - base < count ? (int)(v - base) : -1;
+}
+
+static gboolean _json_parse_batch_response(struct json_parser* p, xr_call* call)
+{
+  guint count = xr_value_array_length(xr_call_get_param(call, 0));
+  xr_value** slots = g_new0(xr_value*, count);
+  xr_value* results;
+  gboolean rs = TRUE;
+  guint i = 0;
+
+  /* responses may come in any order, they are matched to the requests by id,
+     or by position if the server does not echo our ids */
+  p->p++;
+  if (!_json_accept(p, ']'))
+  {
+    do
+    {
+      xr_call* tmp = xr_call_new(NULL);
+      char* id = NULL;
+      int pos;
+
+      if (!_json_parse_response(p, tmp, &id))
+      {
+        xr_call_free(tmp);
+        g_free(id);
+        rs = FALSE;
+        break;
+      }
+
+      pos = _json_batch_index(id, call->json_id, count);
+      if (pos < 0 || slots[pos])
+        pos = i;
+
+      if (pos < count && slots[pos] == NULL)
+      {
+        if (tmp->error_set)
+        {
+          slots[pos] = xr_value_struct_new();
+          xr_value_struct_set_member(slots[pos], "faultCode", xr_value_int_new(tmp->errcode));
+          xr_value_struct_set_member(slots[pos], "faultString", xr_value_string_new(tmp->errmsg));
+        }
+        else
+        {
+          slots[pos] = xr_value_array_new();
+          xr_value_array_append(slots[pos], _xr_value_share(tmp->retval));
+        }
+      }
+
+      xr_call_free(tmp);
+      g_free(id);
+      i++;
+    }
+    while (_json_accept(p, ','));
+
+    rs = rs && _json_accept(p, ']');
+  }
+
+  /* convert array of responses to multicall results */
+  results = xr_value_array_new();
+  for (i = 0; i < count; i++)
+  {
+    if (slots[i] == NULL)
+    {
+      slots[i] = xr_value_struct_new();
+      xr_value_struct_set_member(slots[i], "faultCode", xr_value_int_new(-1));
+      xr_value_struct_set_member(slots[i], "faultString", xr_value_string_new("Missing response in JSON-RPC batch."));
+    }
+    xr_value_array_append(results, slots[i]);
+  }
+  g_free(slots);
+
+  if (rs && _json_parse_finish(p))
+    xr_call_set_retval(call, results);
+  else
+  {
+    xr_value_unref(results);
+    xr_call_set_error(call, -1, "Can't parse JSON-RPC response. Invalid JSON object.");
+    rs = FALSE;
+  }
+
+  return rs;
+}
+
+static gboolean xr_call_unserialize_response_json(xr_call* call, const char* buf, int len)
+{
+  struct json_parser p;
+  gboolean rs;
+
+  _json_parser_init(&p, buf, len);
+
+  if (call->batch && _json_peek(&p) == '[')
+    rs = _json_parse_batch_response(&p, call);
+  else
+  {
+    rs = _json_parse_response(&p, call, NULL) && _json_parse_finish(&p);
+
+    if (!rs)
+      xr_call_set_error(call, -1, "Can't parse JSON-RPC response. Invalid JSON object.");
+    rs = rs && !call->error_set;
+  }
+
+  _json_parser_free(&p);
+  return rs;
+}
+
 static void xr_call_free_buffer_json(xr_call* call, char* buf)
 {
   g_free(buf);
@@ -0,0 +1,746 @@
+/* MessagePack-RPC codec
+ *
+ * Messages follow the MessagePack-RPC framing:
+ *
+ *   request:  [0, msgid, method, [params...]]
+ *   response: [1, msgid, error, result]
+ *
+ * Error is nil on success, otherwise a map with code and message members.
+ * Ints and doubles use the native encodings, blobs are sent as raw bin and
+ * time values as ext type 1 holding the ISO 8601 string. Multicall is sent
+ * as an ordinary system.multicall request.
+ */
+
+#define MSGPACK_MAX_DEPTH 512
+
+/* ext type of the time values */
+#define MSGPACK_EXT_TIME 1
+
+#define MSGPACK_REQUEST 0
+#define MSGPACK_RESPONSE 1
+
+/* size of the last message, used as an initial buffer size for the next one */
+static volatile gint msgpack_size_hint = 1024;
+
+/* id of the next request sent by the client */
+static volatile gint msgpack_next_id = 1;
+
+/* writer */
+
+static __inline__ void _msgpack_put_u8(GString* buf, guint8 tag, guint8 v)
+{
+  char tmp[2] = { tag, v };
+
+  g_string_append_len(buf, tmp, 2);
+}
+
+static __inline__ void _msgpack_put_u16(GString* buf, guint8 tag, guint16 v)
+{
+  char tmp[3] = { tag, v >> 8, v };
+
+  g_string_append_len(buf, tmp, 3);
+}
+
+static __inline__ void _msgpack_put_u32(GString* buf, guint8 tag, guint32 v)
+{
+  char tmp[5] = { tag, v >> 24, v >> 16, v >> 8, v };
+
+  g_string_append_len(buf, tmp, 5);
+}
+
+/* write header of the str, bin, array or map, tags are for the 8, 16 and 32
+ * bit length variants */
+static void _msgpack_write_len(GString* buf, guint8 tag8, guint8 tag16, guint8 tag32, guint32 len)
+{
+  if (len < 0x100 && tag8)
+    _msgpack_put_u8(buf, tag8, len);
+  else if (len < 0x10000)
+    _msgpack_put_u16(buf, tag16, len);
+  else
+    _msgpack_put_u32(buf, tag32, len);
+}
+
+static void _msgpack_write_int(GString* buf, int v)
+{
+  if (v >= 0)
+  {
+    if (v < 0x80)
+      g_string_append_c(buf, v);
+    else if (v < 0x100)
+      _msgpack_put_u8(buf, 0xcc, v);
+    else if (v < 0x10000)
+      _msgpack_put_u16(buf, 0xcd, v);
+    else
+      _msgpack_put_u32(buf, 0xce, v);
+  }
+  else
+  {
+    if (v >= -32)
+      g_string_append_c(buf, v);
+    else if (v >= -128)
+      _msgpack_put_u8(buf, 0xd0, v);
+    else if (v >= -32768)
+      _msgpack_put_u16(buf, 0xd1, v);
+    else
+      _msgpack_put_u32(buf, 0xd2, v);
+  }
+}
+
+static void _msgpack_write_double(GString* buf, double v)
+{
+  union { double d; guint64 u; } conv;
+  guint64 be;
+
+  conv.d = v;
+  be = GUINT64_TO_BE(conv.u);
+  g_string_append_c(buf, 0xcb);
+  g_string_append_len(buf, (char*)&be, 8);
+}
+
+static void _msgpack_write_str(GString* buf, const char* str, gsize len)
+{
+  if (len < 32)
+    g_string_append_c(buf, 0xa0 | len);
+  else
+    _msgpack_write_len(buf, 0xd9, 0xda, 0xdb, len);
+
+  g_string_append_len(buf, str, len);
+}
+
+static void _msgpack_write_array_header(GString* buf, guint len)
+{
+  if (len < 16)
+    g_string_append_c(buf, 0x90 | len);
+  else
+    _msgpack_write_len(buf, 0, 0xdc, 0xdd, len);
+}
+
+static void _msgpack_write_map_header(GString* buf, guint len)
+{
+  if (len < 16)
+    g_string_append_c(buf, 0x80 | len);
+  else
+    _msgpack_write_len(buf, 0, 0xde, 0xdf, len);
+}
+
+static void _msgpack_write_time(GString* buf, const char* str)
+{
+  gsize len = strlen(str);
+
+  _msgpack_write_len(buf, 0xc7, 0xc8, 0xc9, len);
+  g_string_append_c(buf, MSGPACK_EXT_TIME);
+  g_string_append_len(buf, str, len);
+}
+
+static void _xr_value_serialize_msgpack(GString* buf, xr_value* val)
+{
+  guint i, len;
+
+  switch (xr_value_get_type(val))
+  {
+    case XRV_ARRAY:
+    {
+      len = xr_value_array_length(val);
+      _msgpack_write_array_header(buf, len);
+      for (i = 0; i < len; i++)
+        _xr_value_serialize_msgpack(buf, xr_value_array_get(val, i));
+      break;
+    }
+    case XRV_STRUCT:
+    {
+      len = xr_value_struct_length(val);
+      _msgpack_write_map_header(buf, len);
+      for (i = 0; i < len; i++)
+      {
+        xr_value* m = xr_value_struct_get_nth(val, i);
+        const char* name = xr_value_get_member_name(m);
+        _msgpack_write_str(buf, name, strlen(name));
+        _xr_value_serialize_msgpack(buf, xr_value_get_member_value(m));
+      }
+      break;
+    }
+    case XRV_INT:
+    {
+      int int_val = -1;
+      xr_value_to_int(val, &int_val);
+      _msgpack_write_int(buf, int_val);
+      break;
+    }
+    case XRV_STRING:
+    {
+      const char* str_val = __xr_value_get_str(val);
+      _msgpack_write_str(buf, str_val ? str_val : "", str_val ? strlen(str_val) : 0);
+      break;
+    }
+    case XRV_TIME:
+    {
+      const char* str_val = __xr_value_get_str(val);
+      _msgpack_write_time(buf, str_val ? str_val : "");
+      break;
+    }
+    case XRV_BOOLEAN:
+    {
+      int bool_val = 0;
+      xr_value_to_bool(val, &bool_val);
+      g_string_append_c(buf, bool_val ? 0xc3 : 0xc2);
+      break;
+    }
+    case XRV_DOUBLE:
+    {
+      double dbl_val = 0.0;
+      xr_value_to_double(val, &dbl_val);
+      _msgpack_write_double(buf, dbl_val);
+      break;
+    }
+    case XRV_BLOB:
+    {
+      xr_blob* b = NULL;
+      xr_value_to_blob(val, &b);
+      _msgpack_write_len(buf, 0xc4, 0xc5, 0xc6, b ? b->len : 0);
+      if (b)
+        g_string_append_len(buf, b->buf, b->len);
+      xr_blob_unref(b);
+      break;
+    }
+  }
+}
+
+static GString* _msgpack_writer_new()
+{
+  return g_string_sized_new(g_atomic_int_get(&msgpack_size_hint));
+}
+
+static void _msgpack_writer_finish(GString* w, char** buf, int* len)
+{
+  /* round up, so that similar messages fit */
+  g_atomic_int_set(&msgpack_size_hint, MAX(1024, w->len + w->len / 8));
+
+  *len = w->len;
+  *buf = g_string_free(w, FALSE);
+}
+
+static void xr_call_serialize_request_msgpack(xr_call* call, char** buf, int* len)
+{
+  GString* w = _msgpack_writer_new();
+  guint i;
+
+  call->msgpack_id = (guint)g_atomic_int_add(&msgpack_next_id, 1) & G_MAXINT;
+
+  _msgpack_write_array_header(w, 4);
+  _msgpack_write_int(w, MSGPACK_REQUEST);
+  _msgpack_write_int(w, call->msgpack_id);
+  _msgpack_write_str(w, call->method, strlen(call->method));
+  _msgpack_write_array_header(w, call->params->len);
+  for (i = 0; i < call->params->len; i++)
+    _xr_value_serialize_msgpack(w, g_ptr_array_index(call->params, i));
+
+  _msgpack_writer_finish(w, buf, len);
+}
+
+static void xr_call_serialize_response_msgpack(xr_call* call, char** buf, int* len)
+{
+  GString* w;
+
+  g_return_if_fail(call->error_set || call->retval);
+
+  w = _msgpack_writer_new();
+
+  _msgpack_write_array_header(w, 4);
+  _msgpack_write_int(w, MSGPACK_RESPONSE);
+  _msgpack_write_int(w, call->msgpack_id);
+  if (call->error_set)
+  {
+    _msgpack_write_map_header(w, 2);
+    _msgpack_write_str(w, "code", 4);
+    _msgpack_write_int(w, call->errcode);
+    _msgpack_write_str(w, "message", 7);
+    _msgpack_write_str(w, call->errmsg ? call->errmsg : "", call->errmsg ? strlen(call->errmsg) : 0);
+    g_string_append_c(w, 0xc0);
+  }
+  else
+  {
+    g_string_append_c(w, 0xc0);
+    _xr_value_serialize_msgpack(w, call->retval);
+  }
+
+  _msgpack_writer_finish(w, buf, len);
+}
+
+/* parser */
+
+struct msgpack_parser
+{
+  const guchar* p;
+  const guchar* end;
+  GString* text;         /* last parsed str */
+  int depth;
+};
+
+static void _msgpack_parser_init(struct msgpack_parser* p, const char* buf, int len)
+{
+  p->p = (const guchar*)buf;
+  p->end = p->p + len;
+  p->text = g_string_sized_new(128);
+  p->depth = 0;
+}
+
+static void _msgpack_parser_free(struct msgpack_parser* p)
+{
+  g_string_free(p->text, TRUE);
+}
+
+static __inline__ gboolean _msgpack_need(struct msgpack_parser* p, gsize len)
+{
+  return p->end - p->p >= len;
+}
+
+static guint32 _msgpack_get_be(struct msgpack_parser* p, int size)
+{
+  guint32 v = 0;
+
+  while (size--)
+    v = (v << 8) | *p->p++;
+
+  return v;
+}
+
+/* read length of the 8, 16 or 32 bit length variant selected by size */
+static gboolean _msgpack_get_len(struct msgpack_parser* p, int size, guint32* len)
+{
+  if (!_msgpack_need(p, size))
+    return FALSE;
+
+  *len = _msgpack_get_be(p, size);
+  return TRUE;
+}
+
+/* parse str into p->text */
+static gboolean _msgpack_parse_str(struct msgpack_parser* p)
+{
+  guint32 len;
+  guchar c;
+
+  if (!_msgpack_need(p, 1))
+    return FALSE;
+
+  c = *p->p++;
+  if ((c & 0xe0) == 0xa0)
+    len = c & 0x1f;
+  else if (c < 0xd9 || c > 0xdb || !_msgpack_get_len(p, 1 << (c - 0xd9), &len))
+    return FALSE;
+
+  if (!_msgpack_need(p, len))
+    return FALSE;
+
+  g_string_truncate(p->text, 0);
+  g_string_append_len(p->text, (const char*)p->p, len);
+  p->p += len;
+  return TRUE;
+}
+
+static gboolean _msgpack_parse_array_header(struct msgpack_parser* p, guint32* len)
+{
+  guchar c;
+
+  if (!_msgpack_need(p, 1))
+    return FALSE;
+
+  c = *p->p++;
+  if ((c & 0xf0) == 0x90)
+  {
+    *len = c & 0x0f;
+    return TRUE;
+  }
+  else if (c == 0xdc || c == 0xdd)
+    return _msgpack_get_len(p, c == 0xdc ? 2 : 4, len);
+
+  return FALSE;
+}
+
+static gboolean _msgpack_parse_uint(struct msgpack_parser* p, guint32* v)
+{
+  guchar c;
+
+  if (!_msgpack_need(p, 1))
+    return FALSE;
+
+  c = *p->p++;
+  if (c < 0x80)
+  {
+    *v = c;
+    return TRUE;
+  }
+  else if (c >= 0xcc && c <= 0xce)
+    return _msgpack_get_len(p, 1 << (c - 0xcc), v);
+
+  return FALSE;
+}
+
+static __inline__ gboolean _msgpack_accept_nil(struct msgpack_parser* p)
+{
+  if (!_msgpack_need(p, 1) || *p->p != 0xc0)
+    return FALSE;
+
+  p->p++;
+  return TRUE;
+}
+
+static xr_value* _msgpack_parse_value(struct msgpack_parser* p);
+
+static xr_value* _msgpack_parse_array(struct msgpack_parser* p, guint32 len)
+{
+  xr_value* arr;
+
+  /* every item takes at least one byte */
+  if (!_msgpack_need(p, len) || ++p->depth > MSGPACK_MAX_DEPTH)
+    return NULL;
+
+  arr = xr_value_array_new();
+  while (len--)
+  {
+    xr_value* item = _msgpack_parse_value(p);
+    if (item == NULL)
+    {
+      xr_value_unref(arr);
+      return NULL;
+    }
+    xr_value_array_append(arr, item);
+  }
+
+  p->depth--;
+  return arr;
+}
+
+static xr_value* _msgpack_parse_map(struct msgpack_parser* p, guint32 len)
+{
+  xr_value* str;
+
+  if (!_msgpack_need(p, len) || ++p->depth > MSGPACK_MAX_DEPTH)
+    return NULL;
+
+  str = xr_value_struct_new();
+  while (len--)
+  {
+    char tmp[64];
+    char* name;
+    xr_value* m;
+
+    if (!_msgpack_parse_str(p))
+      goto err;
+
+    /* p->text is reused by the member value */
+    name = p->text->len < sizeof(tmp) ? memcpy(tmp, p->text->str, p->text->len + 1) : g_strndup(p->text->str, p->text->len);
+    m = _msgpack_parse_value(p);
+    if (m)
+      xr_value_struct_set_member(str, name, m);
+    if (name != tmp)
+      g_free(name);
+    if (m == NULL)
+      goto err;
+  }
+
+  p->depth--;
+  return str;
+
+err:
+  xr_value_unref(str);
+  return NULL;
+}
+
+static xr_value* _msgpack_parse_bin(struct msgpack_parser* p, guint32 len)
+{
+  xr_blob* b;
+  xr_value* bv;
+  char* buf;
+
+  if (!_msgpack_need(p, len))
+    return NULL;
+
+  /* raw bytes are copied, no decoding is necessary */
+  buf = g_malloc(len + 1);
+  memcpy(buf, p->p, len);
+  buf[len] = '\0';
+  p->p += len;
+
+  b = xr_blob_new(buf, len);
+  bv = xr_value_blob_new(b);
+  xr_blob_unref(b);
+  return bv;
+}
+
+static xr_value* _msgpack_parse_ext(struct msgpack_parser* p, guint32 len)
+{
+  /* type byte precedes the data, compute in gsize so that ext32 length of
+   * 0xffffffff can't wrap around */
+  if (!_msgpack_need(p, (gsize)len + 1) || *p->p != MSGPACK_EXT_TIME)
+    return NULL;
+
+  g_string_truncate(p->text, 0);
+  g_string_append_len(p->text, (const char*)p->p + 1, len);
+  p->p += (gsize)len + 1;
+
+  return xr_value_time_new(p->text->str);
+}
+
+/* parse value, nil is not supported by xr_value */
+static xr_value* _msgpack_parse_value(struct msgpack_parser* p)
+{
+  union { guint32 u; float f; } conv32;
+  union { guint64 u; double d; } conv64;
+  guint32 len;
+  guchar c;
+
+  if (!_msgpack_need(p, 1))
+    return NULL;
+
+  c = *p->p;
+
+  if (c < 0x80)
+  {
+    p->p++;
+    return xr_value_int_new(c);
+  }
+  else if (c >= 0xe0)
+  {
+    p->p++;
+    return xr_value_int_new((gint8)c);
+  }
+  else if ((c & 0xe0) == 0xa0 || (c >= 0xd9 && c <= 0xdb))
+  {
+    if (!_msgpack_parse_str(p))
+      return NULL;
+    return xr_value_string_new(p->text->str);
+  }
+  else if ((c & 0xf0) == 0x90)
+  {
+    p->p++;
+    return _msgpack_parse_array(p, c & 0x0f);
+  }
+  else if ((c & 0xf0) == 0x80)
+  {
+    p->p++;
+    return _msgpack_parse_map(p, c & 0x0f);
+  }
+
+  p->p++;
+  switch (c)
+  {
+    case 0xc2:
+      return xr_value_bool_new(0);
+    case 0xc3:
+      return xr_value_bool_new(1);
+
+    case 0xcc:
+    case 0xcd:
+    case 0xce:
+    {
+      int size = 1 << (c - 0xcc);
+      if (!_msgpack_need(p, size))
+        return NULL;
+      len = _msgpack_get_be(p, size);
+      return len <= G_MAXINT ? xr_value_int_new(len) : xr_value_double_new(len);
+    }
+
+    case 0xd0:
+      return _msgpack_need(p, 1) ? xr_value_int_new((gint8)_msgpack_get_be(p, 1)) : NULL;
+    case 0xd1:
+      return _msgpack_need(p, 2) ? xr_value_int_new((gint16)_msgpack_get_be(p, 2)) : NULL;
+    case 0xd2:
+      return _msgpack_need(p, 4) ? xr_value_int_new((gint32)_msgpack_get_be(p, 4)) : NULL;
+
+    case 0xcf:
+    case 0xd3:
+    {
+      /* 64 bit ints that do not fit into int are converted to double */
+      if (!_msgpack_need(p, 8))
+        return NULL;
+      conv64.u = (guint64)_msgpack_get_be(p, 4) << 32;
+      conv64.u |= _msgpack_get_be(p, 4);
+      if (c == 0xcf)
+        return conv64.u <= G_MAXINT ? xr_value_int_new(conv64.u) : xr_value_double_new(conv64.u);
+      if ((gint64)conv64.u >= G_MININT && (gint64)conv64.u <= G_MAXINT)
+        return xr_value_int_new((gint64)conv64.u);
+      return xr_value_double_new((gint64)conv64.u);
+    }
+
+    case 0xca:
+      if (!_msgpack_need(p, 4))
+        return NULL;
+      conv32.u = _msgpack_get_be(p, 4);
+      return xr_value_double_new(conv32.f);
+    case 0xcb:
+      if (!_msgpack_need(p, 8))
+        return NULL;
+      conv64.u = (guint64)_msgpack_get_be(p, 4) << 32;
+      conv64.u |= _msgpack_get_be(p, 4);
+      return xr_value_double_new(conv64.d);
+
+    case 0xc4:
+    case 0xc5:
+    case 0xc6:
+      if (!_msgpack_get_len(p, 1 << (c - 0xc4), &len))
+        return NULL;
+      return _msgpack_parse_bin(p, len);
+
+    case 0xd4:
+    case 0xd5:
+    case 0xd6:
+    case 0xd7:
+    case 0xd8:
+      return _msgpack_parse_ext(p, 1 << (c - 0xd4));
+    case 0xc7:
+    case 0xc8:
+    case 0xc9:
+      if (!_msgpack_get_len(p, 1 << (c - 0xc7), &len))
+        return NULL;
+      return _msgpack_parse_ext(p, len);
+
+    case 0xdc:
+    case 0xdd:
+      if (!_msgpack_get_len(p, c == 0xdc ? 2 : 4, &len))
+        return NULL;
+      return _msgpack_parse_array(p, len);
+
+    case 0xde:
+    case 0xdf:
+      if (!_msgpack_get_len(p, c == 0xde ? 2 : 4, &len))
+        return NULL;
+      return _msgpack_parse_map(p, len);
+
+    default:
+      /* nil and reserved bytes */
+      p->p--;
+      return NULL;
+  }
+}
+
+/* message header: [type, msgid, ...] */
+static gboolean _msgpack_parse_header(struct msgpack_parser* p, guint32 type, guint32* msgid)
+{
+  guint32 len, v;
+
+  return _msgpack_parse_array_header(p, &len) && len == 4 &&
+         _msgpack_parse_uint(p, &v) && v == type &&
+         _msgpack_parse_uint(p, msgid);
+}
+
+static gboolean xr_call_unserialize_request_msgpack(xr_call* call, const char* buf, int len)
+{
+  struct msgpack_parser p;
+  guint32 msgid, count, i;
+
+  _msgpack_parser_init(&p, buf, len);
+
+  if (!_msgpack_parse_header(&p, MSGPACK_REQUEST, &msgid))
+  {
+    xr_call_set_error(call, -1, "Can't parse MessagePack-RPC request. Invalid message.");
+    goto out;
+  }
+
+  call->msgpack_id = msgid;
+
+  if (!_msgpack_parse_str(&p))
+  {
+    xr_call_set_error(call, -1, "Can't parse MessagePack-RPC request. Missing method.");
+    goto out;
+  }
+
+  g_free(call->method);
+  call->method = g_strndup(p.text->str, p.text->len);
+
+  if (!_msgpack_parse_array_header(&p, &count))
+  {
+    xr_call_set_error(call, -1, "Can't parse MessagePack-RPC request. Invalid params.");
+    goto out;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    xr_value* v = _msgpack_parse_value(&p);
+    if (v == NULL)
+    {
+      xr_call_set_error(call, -1, "Can't parse MessagePack-RPC request. Failed to unserialize parameter %d.", i);
+      goto out;
+    }
+
+    xr_call_add_param(call, v);
+  }
+
+  if (p.p != p.end)
+    xr_call_set_error(call, -1, "Can't parse MessagePack-RPC request. Trailing data.");
+
+out:
+  _msgpack_parser_free(&p);
+  return !call->error_set;
+}
+
+static gboolean _msgpack_parse_error(struct msgpack_parser* p, xr_call* call)
+{
+  xr_value* error = _msgpack_parse_value(p);
+  int errcode;
+  char* errmsg = NULL;
+
+  if (error && xr_value_get_type(error) == XRV_STRUCT &&
+      xr_value_to_int(xr_value_get_member(error, "code"), &errcode) &&
+      xr_value_to_string(xr_value_get_member(error, "message"), &errmsg))
+    xr_call_set_error(call, errcode, "%s", errmsg);
+  else if (xr_value_to_string(error, &errmsg))
+    xr_call_set_error(call, -1, "%s", errmsg);
+  else
+    xr_call_set_error(call, -1, "Can't parse MessagePack-RPC response. Invalid error object.");
+
+  g_free(errmsg);
+  xr_value_unref(error);
+  return error != NULL;
+}
+
+static gboolean xr_call_unserialize_response_msgpack(xr_call* call, const char* buf, int len)
+{
+  struct msgpack_parser p;
+  guint32 msgid;
+  xr_value* result;
+
+  _msgpack_parser_init(&p, buf, len);
+
+  if (!_msgpack_parse_header(&p, MSGPACK_RESPONSE, &msgid))
+  {
+    xr_call_set_error(call, -1, "Can't parse MessagePack-RPC response. Invalid message.");
+    goto out;
+  }
+
+  if (msgid != call->msgpack_id)
+  {
+    xr_call_set_error(call, -1, "Can't parse MessagePack-RPC response. Response id does not match the request.");
+    goto out;
+  }
+
+  if (!_msgpack_accept_nil(&p))
+  {
+    if (!_msgpack_parse_error(&p, call))
+      goto out;
+    /* result is ignored */
+    if (!_msgpack_accept_nil(&p))
+      xr_value_unref(_msgpack_parse_value(&p));
+    goto out;
+  }
+
+  result = _msgpack_parse_value(&p);
+  if (result == NULL)
+    xr_call_set_error(call, -1, "Can't parse MessagePack-RPC response. Invalid result.");
+  else if (p.p != p.end)
+  {
+    xr_value_unref(result);
+    xr_call_set_error(call, -1, "Can't parse MessagePack-RPC response. Trailing data.");
+  }
+  else
+    xr_call_set_retval(call, result);
+
+out:
+  _msgpack_parser_free(&p);
+  return !call->error_set;
+}
+
+static void xr_call_free_buffer_msgpack(xr_call* call, char* buf)
+{
+  g_free(buf);
+}
@@ -0,0 +1,492 @@
+/* direct access to the params and retval, see xr-wire.h
+ *
+ * Params of the XML-RPC and JSON-RPC requests are kept as text if
+ * xr_call_set_defer_params() was called before the request was
+ * unserialized. Generated code reads them using the transport specific
+ * readers, xr_value params are built only when something asks for them.
+ *
+ * The other way around, generated code writes params of the client calls
+ * and retval of such requests as text that is copied to the message as is.
+ */
+
+#ifdef XR_JSON_ENABLED
+#define WIRE_IS_JSON(r) ((r)->transport == XR_CALL_JSON_RPC)
+#else
+#define WIRE_IS_JSON(r) FALSE
+/* JSON-RPC readers are never called */
+#define _jw_next_item(r) -1
+#define _jw_begin(r, open) FALSE
+#define _jw_next_member(r) -1
+#define _jw_name_dup(r) NULL
+#define _jw_skip(r) FALSE
+#define _jw_read_int(r, v) FALSE
+#define _jw_read_bool(r, v) FALSE
+#define _jw_read_double(r, v) FALSE
+#define _jw_read_string(r, v) FALSE
+#define _jw_build_value(r) NULL
+#endif
+
+gboolean xr_wire_reader_init_params(xr_wire_reader* r, xr_call* call)
+{
+  g_return_val_if_fail(r != NULL, FALSE);
+  g_return_val_if_fail(call != NULL, FALSE);
+
+  if (call->wire == NULL)
+    return FALSE;
+
+  memset(r, 0, sizeof(*r));
+  r->transport = call->transport;
+  r->p = call->wire->str;
+  r->end = r->p + call->wire->len;
+  r->first = TRUE;
+
+  /* JSON-RPC params are kept with the enclosing array */
+  if (WIRE_IS_JSON(r))
+  {
+    r->p++;
+    r->depth = 1;
+  }
+
+  return TRUE;
+}
+
+int xr_wire_next_item(xr_wire_reader* r)
+{
+  return WIRE_IS_JSON(r) ? _jw_next_item(r) : _xw_next_item(r);
+}
+
+gboolean xr_wire_begin_array(xr_wire_reader* r)
+{
+  if (WIRE_IS_JSON(r))
+    return _jw_begin(r, '[');
+
+  return _xw_value_begin(r) == XRV_ARRAY;
+}
+
+gboolean xr_wire_begin_struct(xr_wire_reader* r)
+{
+  if (WIRE_IS_JSON(r))
+    return _jw_begin(r, '{');
+
+  return _xw_value_begin(r) == XRV_STRUCT;
+}
+
+int xr_wire_next_member(xr_wire_reader* r)
+{
+  return WIRE_IS_JSON(r) ? _jw_next_member(r) : _xw_next_member(r);
+}
+
+static char* _xr_wire_name_dup(xr_wire_reader* r)
+{
+  return WIRE_IS_JSON(r) ? _jw_name_dup(r) : _xw_name_dup(r);
+}
+
+gboolean xr_wire_member_is(xr_wire_reader* r, const char* name, gsize len)
+{
+  char* str;
+  gboolean rs;
+
+  if (r->name)
+    return r->name_len == len && !memcmp(r->name, name, len);
+
+  str = _xr_wire_name_dup(r);
+  rs = str && strlen(str) == len && !memcmp(str, name, len);
+  g_free(str);
+
+  return rs;
+}
+
+gboolean xr_wire_skip(xr_wire_reader* r)
+{
+  return WIRE_IS_JSON(r) ? _jw_skip(r) : _xw_skip(r);
+}
+
+gboolean xr_wire_read_int(xr_wire_reader* r, int* v)
+{
+  return WIRE_IS_JSON(r) ? _jw_read_int(r, v) : _xw_read_int(r, v);
+}
+
+gboolean xr_wire_read_bool(xr_wire_reader* r, gboolean* v)
+{
+  return WIRE_IS_JSON(r) ? _jw_read_bool(r, v) : _xw_read_bool(r, v);
+}
+
+gboolean xr_wire_read_double(xr_wire_reader* r, double* v)
+{
+  return WIRE_IS_JSON(r) ? _jw_read_double(r, v) : _xw_read_double(r, v);
+}
+
+gboolean xr_wire_read_string(xr_wire_reader* r, char** v)
+{
+  return WIRE_IS_JSON(r) ? _jw_read_string(r, v) : _xw_read_string(r, XRV_STRING, v);
+}
+
+/* JSON-RPC has no time and blob values, they are received as strings */
+
+gboolean xr_wire_read_time(xr_wire_reader* r, char** v)
+{
+  return WIRE_IS_JSON(r) ? FALSE : _xw_read_string(r, XRV_TIME, v);
+}
+
+gboolean xr_wire_read_blob(xr_wire_reader* r, xr_blob** v)
+{
+  return WIRE_IS_JSON(r) ? FALSE : _xw_read_blob(r, v);
+}
+
+static xr_value* _xr_wire_build_value(xr_wire_reader* r)
+{
+  return WIRE_IS_JSON(r) ? _jw_build_value(r) : _xw_build_value(r);
+}
+
+gboolean xr_wire_read_value(xr_wire_reader* r, xr_value** v)
+{
+  xr_value* value = _xr_wire_build_value(r);
+
+  if (value == NULL)
+    return FALSE;
+
+  xr_value_unref(*v);
+  *v = xr_value_promote(value);
+  xr_value_unref(value);
+  return TRUE;
+}
+
+/* build xr_value params from the text */
+static void _xr_call_parse_wire(xr_call* call)
+{
+  xr_wire_reader r;
+  xr_value* v;
+  int rs;
+
+  if (!xr_wire_reader_init_params(&r, call))
+    return;
+
+  while ((rs = xr_wire_next_item(&r)) > 0)
+  {
+    if ((v = _xr_wire_build_value(&r)) == NULL)
+      break;
+    g_ptr_array_add(call->params, v);
+  }
+
+  /* params were validated when the request was received */
+  if (rs != 0 && !call->error_set)
+    xr_call_set_error(call, -1, "Failed to unserialize parameter %u.", call->params->len);
+
+  g_string_free(call->wire, TRUE);
+  call->wire = NULL;
+}
+
+/* build xr_value retval from the text */
+static void _xr_call_parse_wire_retval(xr_call* call)
+{
+  xr_wire_reader r;
+
+  memset(&r, 0, sizeof(r));
+  r.transport = call->transport;
+  r.p = call->wire_retval->str;
+  r.end = r.p + call->wire_retval->len;
+
+  xr_value_unref(call->retval);
+  call->retval = _xr_wire_build_value(&r);
+
+  g_string_free(call->wire_retval, TRUE);
+  call->wire_retval = NULL;
+}
+
+/* writers, output is the same as the xr_value serializers produce */
+
+static gboolean _xr_wire_writer_init(xr_wire_writer* w, xr_call_transport transport)
+{
+  memset(w, 0, sizeof(*w));
+  w->transport = transport;
+  w->first = TRUE;
+
+#ifdef XR_JSON_ENABLED
+  if (transport == XR_CALL_JSON_RPC)
+  {
+    w->buf = g_string_sized_new(g_atomic_int_get(&json_size_hint));
+    return TRUE;
+  }
+#endif
+
+  /* indented messages are written from xr_value nodes */
+  if (transport != XR_CALL_XML_RPC || (xr_debug_enabled & XR_DEBUG_HTTP))
+    return FALSE;
+
+  w->buf = g_string_sized_new(g_atomic_int_get(&xmlrpc_size_hint));
+  return TRUE;
+}
+
+gboolean xr_wire_writer_init_params(xr_wire_writer* w, xr_call_transport transport)
+{
+  g_return_val_if_fail(w != NULL, FALSE);
+
+  if (!_xr_wire_writer_init(w, transport))
+    return FALSE;
+
+  if (WIRE_IS_JSON(w))
+    g_string_append_c(w->buf, '[');
+
+  return TRUE;
+}
+
+gboolean xr_wire_writer_init_retval(xr_wire_writer* w, xr_call* call)
+{
+  g_return_val_if_fail(w != NULL, FALSE);
+  g_return_val_if_fail(call != NULL, FALSE);
+
+  /* sub-calls of the multicall are merged into the xr_value retval of the
+   * multicall, text would have to be parsed again */
+  if (!call->defer_params)
+    return FALSE;
+
+  return _xr_wire_writer_init(w, call->transport);
+}
+
+void xr_wire_writer_finish_params(xr_wire_writer* w, xr_call* call)
+{
+  g_return_if_fail(w != NULL);
+  g_return_if_fail(call != NULL);
+  g_return_if_fail(call->params->len == 0);
+
+  if (WIRE_IS_JSON(w))
+    g_string_append_c(w->buf, ']');
+  else if (!w->first)
+    g_string_append_len(w->buf, "</param>", 8);
+
+  xr_call_set_transport(call, w->transport);
+  if (call->wire)
+    g_string_free(call->wire, TRUE);
+  call->wire = w->buf;
+  w->buf = NULL;
+}
+
+void xr_wire_writer_finish_retval(xr_wire_writer* w, xr_call* call)
+{
+  g_return_if_fail(w != NULL);
+  g_return_if_fail(call != NULL);
+  g_return_if_fail(w->transport == call->transport);
+
+  xr_value_unref(call->retval);
+  call->retval = NULL;
+  if (call->wire_retval)
+    g_string_free(call->wire_retval, TRUE);
+  call->wire_retval = w->buf;
+  w->buf = NULL;
+}
+
+void xr_wire_writer_free(xr_wire_writer* w)
+{
+  g_return_if_fail(w != NULL);
+
+  if (w->buf)
+    g_string_free(w->buf, TRUE);
+  w->buf = NULL;
+}
+
+gboolean xr_wire_write_param(xr_wire_writer* w)
+{
+  if (WIRE_IS_JSON(w))
+  {
+    if (!w->first)
+      g_string_append_c(w->buf, ',');
+  }
+  else
+  {
+    if (!w->first)
+      g_string_append_len(w->buf, "</param>", 8);
+    g_string_append_len(w->buf, "<param>", 7);
+  }
+
+  w->first = FALSE;
+  return TRUE;
+}
+
+void xr_wire_write_struct_begin(xr_wire_writer* w)
+{
+  if (WIRE_IS_JSON(w))
+    g_string_append_c(w->buf, '{');
+  else
+    g_string_append_len(w->buf, "<value><struct>", 15);
+}
+
+void xr_wire_write_member(xr_wire_writer* w, const char* xml_tag, gsize xml_len, const char* json_tag, gsize json_len)
+{
+  if (WIRE_IS_JSON(w))
+    g_string_append_len(w->buf, json_tag, json_len);
+  else
+    g_string_append_len(w->buf, xml_tag, xml_len);
+}
+
+/* nothing was written after the start tag of the empty struct or array */
+static gboolean _xr_wire_ends_with(xr_wire_writer* w, const char* tag, gsize len)
+{
+  return w->buf->len >= len && !memcmp(w->buf->str + w->buf->len - len, tag, len);
+}
+
+void xr_wire_write_struct_end(xr_wire_writer* w)
+{
+  if (WIRE_IS_JSON(w))
+    g_string_append_c(w->buf, '}');
+  else if (_xr_wire_ends_with(w, "<struct>", 8))
+  {
+    g_string_truncate(w->buf, w->buf->len - 8);
+    g_string_append_len(w->buf, "<struct/></value>", 17);
+  }
+  else
+    g_string_append_len(w->buf, "</member></struct></value>", 26);
+}
+
+void xr_wire_write_array_begin(xr_wire_writer* w)
+{
+  if (WIRE_IS_JSON(w))
+    g_string_append_c(w->buf, '[');
+  else
+    g_string_append_len(w->buf, "<value><array><data>", 20);
+}
+
+void xr_wire_write_item(xr_wire_writer* w, guint index)
+{
+  if (WIRE_IS_JSON(w) && index > 0)
+    g_string_append_c(w->buf, ',');
+}
+
+void xr_wire_write_array_end(xr_wire_writer* w)
+{
+  if (WIRE_IS_JSON(w))
+    g_string_append_c(w->buf, ']');
+  else if (_xr_wire_ends_with(w, "<data>", 6))
+  {
+    g_string_truncate(w->buf, w->buf->len - 6);
+    g_string_append_len(w->buf, "<data/></array></value>", 23);
+  }
+  else
+    g_string_append_len(w->buf, "</data></array></value>", 23);
+}
+
+gboolean xr_wire_write_int(xr_wire_writer* w, int v)
+{
+  char tmp[16];
+
+#ifdef XR_JSON_ENABLED
+  if (WIRE_IS_JSON(w))
+  {
+    _json_write_int(w->buf, v);
+    return TRUE;
+  }
+#endif
+
+  g_string_append_len(w->buf, "<value><int>", 12);
+  g_string_append_len(w->buf, tmp, _xmlrpc_format_int(tmp, v));
+  g_string_append_len(w->buf, "</int></value>", 14);
+  return TRUE;
+}
+
+gboolean xr_wire_write_bool(xr_wire_writer* w, gboolean v)
+{
+  if (WIRE_IS_JSON(w))
+  {
+    if (v)
+      g_string_append_len(w->buf, "true", 4);
+    else
+      g_string_append_len(w->buf, "false", 5);
+  }
+  else if (v)
+    g_string_append_len(w->buf, "<value><boolean>1</boolean></value>", 35);
+  else
+    g_string_append_len(w->buf, "<value><boolean>0</boolean></value>", 35);
+
+  return TRUE;
+}
+
+gboolean xr_wire_write_double(xr_wire_writer* w, double v)
+{
+  char tmp[G_ASCII_DTOSTR_BUF_SIZE];
+
+#ifdef XR_JSON_ENABLED
+  if (WIRE_IS_JSON(w))
+  {
+    _json_write_double(w->buf, v);
+    return TRUE;
+  }
+#endif
+
+  g_string_append_len(w->buf, "<value><double>", 15);
+  g_string_append_len(w->buf, tmp, _xmlrpc_format_double(tmp, sizeof(tmp), v));
+  g_string_append_len(w->buf, "</double></value>", 17);
+  return TRUE;
+}
+
+gboolean xr_wire_write_string(xr_wire_writer* w, const char* v)
+{
+#ifdef XR_JSON_ENABLED
+  if (WIRE_IS_JSON(w))
+  {
+    _json_write_string(w->buf, v ? v : "");
+    return TRUE;
+  }
+#endif
+
+  g_string_append_len(w->buf, "<value>", 7);
+  if (v)
+    _xmlrpc_escape(w->buf, v, -1);
+  g_string_append_len(w->buf, "</value>", 8);
+  return TRUE;
+}
+
+gboolean xr_wire_write_time(xr_wire_writer* w, const char* v)
+{
+  if (WIRE_IS_JSON(w))
+    return xr_wire_write_string(w, v);
+
+  if (v == NULL || *v == '\0')
+  {
+    g_string_append_len(w->buf, "<value><dateTime.iso8601/></value>", 34);
+    return TRUE;
+  }
+
+  g_string_append_len(w->buf, "<value><dateTime.iso8601>", 25);
+  _xmlrpc_escape(w->buf, v, -1);
+  g_string_append_len(w->buf, "</dateTime.iso8601></value>", 27);
+  return TRUE;
+}
+
+gboolean xr_wire_write_blob(xr_wire_writer* w, xr_blob* v)
+{
+  struct xmlrpc_writer xw = { w->buf, FALSE, 0 };
+
+  if (v == NULL)
+    return FALSE;
+
+#ifdef XR_JSON_ENABLED
+  if (WIRE_IS_JSON(w))
+  {
+    _json_write_base64(w->buf, v);
+    return TRUE;
+  }
+#endif
+
+  g_string_append_len(w->buf, "<value>", 7);
+  _xmlrpc_write_base64(&xw, v);
+  g_string_append_len(w->buf, "</value>", 8);
+  return TRUE;
+}
+
+gboolean xr_wire_write_value(xr_wire_writer* w, xr_value* v)
+{
+  struct xmlrpc_writer xw = { w->buf, FALSE, 0 };
+
+  if (v == NULL)
+    return FALSE;
+
+#ifdef XR_JSON_ENABLED
+  if (WIRE_IS_JSON(w))
+  {
+    _xr_value_serialize_json(w->buf, v);
+    return TRUE;
+  }
+#endif
+
+  _xr_value_serialize_xmlrpc(&xw, v);
+  return TRUE;
+}
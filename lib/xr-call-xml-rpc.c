@@ -1,397 +1,1580 @@
 #include "xml-priv.h"
+#include "xr-base64.h"
 
-static void _xr_value_serialize_xmlrpc(xmlNode* node, xr_value* val)
+/* direct XML-RPC encoder
+ *
+ * Values are written straight into a GString as escaped XML, output matches
+ * what xmlDocDumpMemoryEnc() produced from the equivalent tree.
+ */
+
+struct xmlrpc_writer
 {
-  xmlNode* value;
-  char buf[50];
-  GSList* i;
+  GString* buf;
+  gboolean format;       /* indent output (for debugging) */
+  int depth;
+};
+
+/* size of the last message, used as an initial buffer size for the next one */
+static volatile gint xmlrpc_size_hint = 1024;
+
+static void _xmlrpc_escape(GString* buf, const char* str, gssize len)
+{
+  const char* end = str + (len < 0 ? strlen(str) : len);
+  const char* span = str;
+
+  /* bytes >= 0x80 are copied unchanged, so UTF-8 sequences stay intact */
+  for (; str < end; str++)
+  {
+    const char* ent;
+
+    switch (*str)
+    {
+      case '<': ent = "&lt;"; break;
+      case '>': ent = "&gt;"; break;
+      case '&': ent = "&amp;"; break;
+      case '\r': ent = "&#13;"; break;
+      default: continue;
+    }
+
+    g_string_append_len(buf, span, str - span);
+    g_string_append(buf, ent);
+    span = str + 1;
+  }
+
+  g_string_append_len(buf, span, str - span);
+}
+
+static __inline__ void _xmlrpc_indent(struct xmlrpc_writer* w)
+{
+  int i;
+
+  if (w->format)
+    for (i = 0; i < w->depth; i++)
+      g_string_append_len(w->buf, "  ", 2);
+}
+
+static __inline__ void _xmlrpc_newline(struct xmlrpc_writer* w)
+{
+  if (w->format)
+    g_string_append_c(w->buf, '\n');
+}
+
+/* open element that contains other elements */
+static void _xmlrpc_open(struct xmlrpc_writer* w, const char* tag)
+{
+  _xmlrpc_indent(w);
+  g_string_append_c(w->buf, '<');
+  g_string_append(w->buf, tag);
+  g_string_append_c(w->buf, '>');
+  _xmlrpc_newline(w);
+  w->depth++;
+}
+
+static void _xmlrpc_close(struct xmlrpc_writer* w, const char* tag)
+{
+  w->depth--;
+  _xmlrpc_indent(w);
+  g_string_append_len(w->buf, "</", 2);
+  g_string_append(w->buf, tag);
+  g_string_append_c(w->buf, '>');
+  _xmlrpc_newline(w);
+}
+
+/* element with text content, text is escaped unless raw is set */
+static void _xmlrpc_leaf(struct xmlrpc_writer* w, const char* tag, const char* text, gssize len, gboolean raw)
+{
+  if (text && len < 0)
+    len = strlen(text);
+
+  _xmlrpc_indent(w);
+  g_string_append_c(w->buf, '<');
+  g_string_append(w->buf, tag);
+
+  if (text == NULL || len == 0)
+    g_string_append_len(w->buf, "/>", 2);
+  else
+  {
+    g_string_append_c(w->buf, '>');
+    if (raw)
+      g_string_append_len(w->buf, text, len);
+    else
+      _xmlrpc_escape(w->buf, text, len);
+    g_string_append_len(w->buf, "</", 2);
+    g_string_append(w->buf, tag);
+    g_string_append_c(w->buf, '>');
+  }
+
+  _xmlrpc_newline(w);
+}
+
+/* format integer into the end of buf, returns pointer to the first digit */
+static char* _xmlrpc_format_uint(char* end, guint64 v)
+{
+  do
+  {
+    *--end = '0' + v % 10;
+    v /= 10;
+  }
+  while (v);
+
+  return end;
+}
+
+static int _xmlrpc_format_int(char* buf, int v)
+{
+  char tmp[16];
+  char* p = _xmlrpc_format_uint(tmp + sizeof(tmp), v < 0 ? -(gint64)v : v);
+  int len = tmp + sizeof(tmp) - p;
+
+  if (v < 0)
+    *buf++ = '-';
+  memcpy(buf, p, len);
+
+  return len + (v < 0);
+}
+
+/* same output as "%f" for values below 2^52, huge values are written in
+ * exponent form */
+static int _xmlrpc_format_double(char* buf, gsize size, double v)
+{
+  double a = v < 0 ? -v : v;
+  double frac;
+  guint64 ip, f;
+  char tmp[32];
+  char* p;
+  char* e = buf;
+
+  if (!(a < 4503599627370496.0)) /* 2^52, also catches NaN */
+  {
+    g_ascii_dtostr(buf, size, v);
+    return strlen(buf);
+  }
+
+  ip = (guint64)a;
+  frac = (a - ip) * 1000000.0;
+  f = (guint64)frac;
+  frac -= f;
+  if (frac > 0.4999 && frac < 0.5001)
+  {
+    /* let printf decide the rounding */
+    g_ascii_formatd(buf, size, "%f", v);
+    return strlen(buf);
+  }
+  if (frac > 0.5)
+    f++;
+  if (f == 1000000)
+  {
+    f = 0;
+    ip++;
+  }
+
+  if (v < 0 || (v == 0 && 1 / v < 0))
+    *e++ = '-';
+  p = _xmlrpc_format_uint(tmp + sizeof(tmp), ip);
+  memcpy(e, p, tmp + sizeof(tmp) - p);
+  e += tmp + sizeof(tmp) - p;
+  *e++ = '.';
+  p = _xmlrpc_format_uint(tmp + sizeof(tmp), f);
+  memset(e, '0', 6 - (tmp + sizeof(tmp) - p));
+  memcpy(e + 6 - (tmp + sizeof(tmp) - p), p, tmp + sizeof(tmp) - p);
+  e += 6;
+
+  return e - buf;
+}
 
-  if (xr_value_get_type(val) != XRV_MEMBER)
-    node = xmlNewChild(node, NULL, BAD_CAST "value", NULL);
+static void _xmlrpc_write_base64(struct xmlrpc_writer* w, xr_blob* b)
+{
+  gsize start;
+
+  if (b == NULL || b->len == 0)
+  {
+    _xmlrpc_leaf(w, "base64", NULL, 0, TRUE);
+    return;
+  }
+
+  _xmlrpc_indent(w);
+  g_string_append_len(w->buf, "<base64>", 8);
+
+  /* encode directly into the output buffer */
+  start = w->buf->len;
+  g_string_set_size(w->buf, start + XR_BASE64_ENCODED_SIZE(b->len));
+  xr_base64_encode((guchar*)b->buf, b->len, w->buf->str + start);
+
+  g_string_append_len(w->buf, "</base64>", 9);
+  _xmlrpc_newline(w);
+}
+
+static void _xr_value_serialize_xmlrpc(struct xmlrpc_writer* w, xr_value* val)
+{
+  char buf[G_ASCII_DTOSTR_BUF_SIZE];
+  guint i;
 
   switch (xr_value_get_type(val))
   {
     case XRV_ARRAY:
     {
-      value = xmlNewChild(node, NULL, BAD_CAST "array", NULL);
-      value = xmlNewChild(value, NULL, BAD_CAST "data", NULL);
-      for (i = xr_value_get_items(val); i; i = i->next)
-        _xr_value_serialize_xmlrpc(value, i->data);
+      _xmlrpc_open(w, "value");
+      if (xr_value_array_length(val) == 0)
+      {
+        _xmlrpc_open(w, "array");
+        _xmlrpc_leaf(w, "data", NULL, 0, TRUE);
+        _xmlrpc_close(w, "array");
+      }
+      else
+      {
+        _xmlrpc_open(w, "array");
+        _xmlrpc_open(w, "data");
+        for (i = 0; i < xr_value_array_length(val); i++)
+          _xr_value_serialize_xmlrpc(w, xr_value_array_get(val, i));
+        _xmlrpc_close(w, "data");
+        _xmlrpc_close(w, "array");
+      }
+      _xmlrpc_close(w, "value");
       break;
     }
     case XRV_STRUCT:
     {
-      value = xmlNewChild(node, NULL, BAD_CAST "struct", NULL);
-      for (i = xr_value_get_members(val); i; i = i->next)
-        _xr_value_serialize_xmlrpc(value, i->data);
+      _xmlrpc_open(w, "value");
+      if (xr_value_struct_length(val) == 0)
+        _xmlrpc_leaf(w, "struct", NULL, 0, TRUE);
+      else
+      {
+        _xmlrpc_open(w, "struct");
+        for (i = 0; i < xr_value_struct_length(val); i++)
+          _xr_value_serialize_xmlrpc(w, xr_value_struct_get_nth(val, i));
+        _xmlrpc_close(w, "struct");
+      }
+      _xmlrpc_close(w, "value");
       break;
     }
     case XRV_MEMBER:
     {
-      value = xmlNewChild(node, NULL, BAD_CAST "member", NULL);
-      xmlNewChild(value, NULL, BAD_CAST "name", BAD_CAST xr_value_get_member_name(val));
-      _xr_value_serialize_xmlrpc(value, xr_value_get_member_value(val));
+      _xmlrpc_open(w, "member");
+      _xmlrpc_leaf(w, "name", xr_value_get_member_name(val), -1, FALSE);
+      _xr_value_serialize_xmlrpc(w, xr_value_get_member_value(val));
+      _xmlrpc_close(w, "member");
       break;
     }
     case XRV_INT:
     {
       int int_val = -1;
       xr_value_to_int(val, &int_val);
-      snprintf(buf, sizeof(buf), "%d", int_val);
-      xmlNewChild(node, NULL, BAD_CAST "int", BAD_CAST buf);
+      _xmlrpc_open(w, "value");
+      _xmlrpc_leaf(w, "int", buf, _xmlrpc_format_int(buf, int_val), TRUE);
+      _xmlrpc_close(w, "value");
       break;
     }
     case XRV_STRING:
     {
-      char* str_val = NULL;
-      xr_value_to_string(val, &str_val);
-      xmlAddChild(node, xmlNewText(BAD_CAST str_val));
-      g_free(str_val);
+      const char* str_val = __xr_value_get_str(val);
+      _xmlrpc_indent(w);
+      g_string_append_len(w->buf, "<value>", 7);
+      if (str_val)
+        _xmlrpc_escape(w->buf, str_val, -1);
+      g_string_append_len(w->buf, "</value>", 8);
+      _xmlrpc_newline(w);
       break;
     }
     case XRV_BOOLEAN:
     {
       int bool_val = 0;
       xr_value_to_bool(val, &bool_val);
-      xmlNewChild(node, NULL, BAD_CAST "boolean", BAD_CAST (bool_val ? "1" : "0"));
+      _xmlrpc_open(w, "value");
+      _xmlrpc_leaf(w, "boolean", bool_val ? "1" : "0", 1, TRUE);
+      _xmlrpc_close(w, "value");
       break;
     }
     case XRV_DOUBLE:
     {
       double dbl_val = 0.0;
       xr_value_to_double(val, &dbl_val);
-      snprintf(buf, sizeof(buf), "%lf", dbl_val);
-      xmlNewChild(node, NULL, BAD_CAST "double", BAD_CAST buf);
+      _xmlrpc_open(w, "value");
+      _xmlrpc_leaf(w, "double", buf, _xmlrpc_format_double(buf, sizeof(buf), dbl_val), TRUE);
+      _xmlrpc_close(w, "value");
       break;
     }
     case XRV_TIME:
     {
-      char* str_val = NULL;
-      xr_value_to_time(val, &str_val);
-      xmlNewChild(node, NULL, BAD_CAST "dateTime.iso8601", BAD_CAST str_val);
-      g_free(str_val);
+      _xmlrpc_open(w, "value");
+      _xmlrpc_leaf(w, "dateTime.iso8601", __xr_value_get_str(val), -1, FALSE);
+      _xmlrpc_close(w, "value");
       break;
     }
     case XRV_BLOB:
     {
-      char* data = NULL;
       xr_blob* b = NULL;
       xr_value_to_blob(val, &b);
-      data = g_base64_encode(b->buf, b->len);
+      _xmlrpc_open(w, "value");
+      _xmlrpc_write_base64(w, b);
+      _xmlrpc_close(w, "value");
       xr_blob_unref(b);
-      xmlNewChild(node, NULL, BAD_CAST "base64", BAD_CAST data);
-      g_free(data);
       break;
     }
   }
 }
 
-static xr_value* _xr_value_unserialize_xmlrpc(xmlNode* node)
+static void _xmlrpc_writer_init(struct xmlrpc_writer* w)
 {
-  gboolean is_string_without_element = TRUE;
-  for_each_node(node, tn)
-    /* check if node contains only text and entity reference nodes */
-    if (tn->type != XML_TEXT_NODE && tn->type != XML_ENTITY_REF_NODE)
-      is_string_without_element = FALSE;
+  w->buf = g_string_sized_new(g_atomic_int_get(&xmlrpc_size_hint));
+  w->format = !!(xr_debug_enabled & XR_DEBUG_HTTP);
+  w->depth = 0;
+  g_string_append(w->buf, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+}
 
-    if (match_node(tn, "int") || match_node(tn, "i4"))
-      return xr_value_int_new(xml_get_cont_int(tn));
-    else if (match_node(tn, "string"))
-    {
-      char* str = xml_get_cont_str(tn);
-      xr_value* val = xr_value_string_new(str);
-      g_free(str);
-      return val;
-    }
-    else if (match_node(tn, "boolean"))
-      return xr_value_bool_new(xml_get_cont_bool(tn));
-    else if (match_node(tn, "double"))
-      return xr_value_double_new(xml_get_cont_double(tn));
-    else if (match_node(tn, "dateTime.iso8601"))
-    {
-      char* str = xml_get_cont_str(tn);
-      xr_value* val = xr_value_time_new(str);
-      g_free(str);
-      return val;
-    }
-    else if (match_node(tn, "base64"))
-    {
-      xr_blob* b;
-      xr_value* bv;
-      char* base64 = xml_get_cont_str(tn);
-      gsize len = 0;
-      char* buf = g_base64_decode(base64, &len);
-      g_free(base64);
-      b = xr_blob_new(buf, len);
-      bv = xr_value_blob_new(b);
-      xr_blob_unref(b);
-      return bv;
-    }
-    else if (match_node(tn, "array"))
-    {
-      xr_value* arr = xr_value_array_new();
-      for_each_node(tn, d)
-        if (match_node(d, "data"))
-        {
-          for_each_node(d, v)
-            if (match_node(v, "value"))
-            {
-              xr_value* elem = _xr_value_unserialize_xmlrpc(v);
-              if (elem == NULL)
-              {
-                xr_value_unref(arr);
-                return NULL;
-              }
-              xr_value_array_append(arr, elem);
-            }
-          for_each_node_end()
-          return arr;
-        }
-      for_each_node_end()
-      return arr;
-    }
-    else if (match_node(tn, "struct"))
-    {
-      xr_value* str = xr_value_struct_new();
-      for_each_node(tn, m)
-        if (match_node(m, "member"))
-        {
-          char* name = NULL;
-          xr_value* val = NULL;
-          int names = 0, values = 0;
-
-          for_each_node(m, me)
-            if (match_node(me, "name"))
-            {
-              if (names++ == 0)
-                name = xml_get_cont_str(me);
-            }
-            else if (match_node(me, "value"))
-            {
-              if (values++ == 0)
-                val = _xr_value_unserialize_xmlrpc(me);
-            }
-          for_each_node_end()
-
-          if (values != 1 || names != 1)
-          {
-            g_free(name);
-            xr_value_unref(val);
-            xr_value_unref(str);
-            return NULL;
-          }
-          xr_value_struct_set_member(str, name, val);
-          g_free(name);
-        }
-      for_each_node_end()
-      return str;
-    }
-  for_each_node_end()
+static void _xmlrpc_writer_finish(struct xmlrpc_writer* w, char** buf, int* len)
+{
+  if (!w->format)
+    g_string_append_c(w->buf, '\n');
 
-  if (is_string_without_element)
-  {
-    xmlChar* str = xmlNodeGetContent(node);
-    xr_value* val = xr_value_string_new(str);
-    xmlFree(str);
-    return val;
-  }
+  /* round up, so that similar messages fit */
+  g_atomic_int_set(&xmlrpc_size_hint, MAX(1024, w->buf->len + w->buf->len / 8));
 
-  return NULL;
+  *len = w->buf->len;
+  *buf = g_string_free(w->buf, FALSE);
 }
 
 static void xr_call_serialize_request_xmlrpc(xr_call* call, char** buf, int* len)
 {
-  xmlDoc* doc = xmlNewDoc(BAD_CAST "1.0");
-  xmlNode* root = xmlNewNode(NULL, BAD_CAST "methodCall");
-  xmlDocSetRootElement(doc, root);
-  xmlNewChild(root, NULL, BAD_CAST "methodName", call->method);
-  xmlNode* params = xmlNewChild(root, NULL, BAD_CAST "params", NULL);
+  struct xmlrpc_writer w;
+  guint i;
 
-  GSList* i;
-  for (i = call->params; i; i = i->next)
+  _xmlrpc_writer_init(&w);
+  _xmlrpc_open(&w, "methodCall");
+  _xmlrpc_leaf(&w, "methodName", call->method, -1, FALSE);
+
+  if (call->wire)
   {
-    xmlNode* param = xmlNewChild(params, NULL, BAD_CAST "param", NULL);
-    _xr_value_serialize_xmlrpc(param, i->data);
+    /* params written by the generated code, see xr-wire.h */
+    _xmlrpc_open(&w, "params");
+    g_string_append_len(w.buf, call->wire->str, call->wire->len);
+    _xmlrpc_newline(&w);
+    _xmlrpc_close(&w, "params");
   }
-
-  if (xr_debug_enabled & XR_DEBUG_HTTP)
-    xmlDocDumpFormatMemoryEnc(doc, (xmlChar**)buf, len, "UTF-8", 1);
+  else if (call->params->len == 0)
+    _xmlrpc_leaf(&w, "params", NULL, 0, TRUE);
   else
-    xmlDocDumpMemoryEnc(doc, (xmlChar**)buf, len, "UTF-8");
+  {
+    _xmlrpc_open(&w, "params");
+    for (i = 0; i < call->params->len; i++)
+    {
+      _xmlrpc_open(&w, "param");
+      _xr_value_serialize_xmlrpc(&w, g_ptr_array_index(call->params, i));
+      _xmlrpc_close(&w, "param");
+    }
+    _xmlrpc_close(&w, "params");
+  }
 
-  xmlFreeDoc(doc);
+  _xmlrpc_close(&w, "methodCall");
+  _xmlrpc_writer_finish(&w, buf, len);
 }
 
 static void xr_call_serialize_response_xmlrpc(xr_call* call, char** buf, int* len)
 {
-  xmlDoc* doc = xmlNewDoc(BAD_CAST "1.0");
-  xmlNode* root = xmlNewNode(NULL, BAD_CAST "methodResponse");
-  xmlDocSetRootElement(doc, root);
+  struct xmlrpc_writer w;
+
+  _xmlrpc_writer_init(&w);
 
   if (call->error_set)
   {
-    xmlNode* fault = xmlNewChild(root, NULL, BAD_CAST "fault", NULL);
     xr_value* v = xr_value_struct_new();
     xr_value_struct_set_member(v, "faultCode", xr_value_int_new(call->errcode));
     xr_value_struct_set_member(v, "faultString", xr_value_string_new(call->errmsg));
-    _xr_value_serialize_xmlrpc(fault, v);
+    _xmlrpc_open(&w, "methodResponse");
+    _xmlrpc_open(&w, "fault");
+    _xr_value_serialize_xmlrpc(&w, v);
+    _xmlrpc_close(&w, "fault");
+    _xmlrpc_close(&w, "methodResponse");
     xr_value_unref(v);
   }
   else if (call->retval)
   {
-    xmlNode* params = xmlNewChild(root, NULL, BAD_CAST "params", NULL);
-    xmlNode* param = xmlNewChild(params, NULL, BAD_CAST "param", NULL);
-    _xr_value_serialize_xmlrpc(param, call->retval);
+    _xmlrpc_open(&w, "methodResponse");
+    _xmlrpc_open(&w, "params");
+    _xmlrpc_open(&w, "param");
+    _xr_value_serialize_xmlrpc(&w, call->retval);
+    _xmlrpc_close(&w, "param");
+    _xmlrpc_close(&w, "params");
+    _xmlrpc_close(&w, "methodResponse");
+  }
+  else if (call->wire_retval)
+  {
+    _xmlrpc_open(&w, "methodResponse");
+    _xmlrpc_open(&w, "params");
+    _xmlrpc_open(&w, "param");
+    g_string_append_len(w.buf, call->wire_retval->str, call->wire_retval->len);
+    _xmlrpc_newline(&w);
+    _xmlrpc_close(&w, "param");
+    _xmlrpc_close(&w, "params");
+    _xmlrpc_close(&w, "methodResponse");
   }
-
-  if (xr_debug_enabled & XR_DEBUG_HTTP)
-    xmlDocDumpFormatMemoryEnc(doc, (xmlChar**)buf, len, "UTF-8", 1);
   else
-    xmlDocDumpMemoryEnc(doc, (xmlChar**)buf, len, "UTF-8");
+    _xmlrpc_leaf(&w, "methodResponse", NULL, 0, TRUE);
 
-  xmlFreeDoc(doc);
+  _xmlrpc_writer_finish(&w, buf, len);
 }
 
-static gboolean xr_call_unserialize_request_xmlrpc(xr_call* call, const char* buf, int len)
+/* streaming XML-RPC decoder
+ *
+ * SAX2 callbacks keep a stack of open elements and build xr_value objects as
+ * elements are closed, so no document tree is built. Only elements on the
+ * XML-RPC paths are interpreted, everything else is skipped.
+ */
+
+enum xmlrpc_elem
+{
+  XE_ROOT,
+  XE_METHOD_NAME,
+  XE_PARAMS,
+  XE_PARAM,
+  XE_FAULT,
+  XE_VALUE,
+  XE_SCALAR,
+  XE_ARRAY,
+  XE_DATA,
+  XE_STRUCT,
+  XE_MEMBER,
+  XE_NAME
+};
+
+struct xmlrpc_frame
+{
+  int elem;
+  int type;              /* XE_SCALAR: value type */
+  xr_value* value;       /* XE_VALUE: decoded value, XE_ARRAY/XE_STRUCT: container */
+  gboolean has_element;  /* XE_VALUE: not an implicit string */
+  gboolean data_seen;    /* XE_ARRAY: first <data> was processed */
+  char* name;            /* XE_MEMBER */
+  int names;             /* XE_MEMBER */
+  int values;            /* XE_MEMBER */
+};
+
+struct xmlrpc_parser
+{
+  xmlParserCtxtPtr ctxt;
+  gboolean response;
+  GArray* stack;
+  int ignore_depth;      /* depth inside of skipped element */
+  GString* text;
+  gboolean failed;
+
+  char* method;
+  GSList* params;
+  int params_count;
+  GSList* faults;
+  gboolean fault_failed;
+};
+
+static __inline__ struct xmlrpc_frame* _xmlrpc_top(struct xmlrpc_parser* p)
+{
+  return p->stack->len ? &g_array_index(p->stack, struct xmlrpc_frame, p->stack->len - 1) : NULL;
+}
+
+static void _xmlrpc_push(struct xmlrpc_parser* p, int elem)
+{
+  struct xmlrpc_frame f;
+
+  memset(&f, 0, sizeof(f));
+  f.elem = elem;
+  g_array_append_val(p->stack, f);
+  g_string_truncate(p->text, 0);
+}
+
+static void _xmlrpc_fail(struct xmlrpc_parser* p)
 {
-  xmlDoc* doc = xmlReadMemory(buf, len, 0, 0, XML_PARSE_NOWARNING|XML_PARSE_NOERROR|XML_PARSE_NONET);
-  if (doc == NULL)
+  /* stack is ROOT, PARAMS or FAULT, ... */
+  if (p->stack->len > 1 && g_array_index(p->stack, struct xmlrpc_frame, 1).elem == XE_FAULT)
+    p->fault_failed = TRUE;
+  p->failed = TRUE;
+  xmlStopParser(p->ctxt);
+}
+
+static xr_value* _xmlrpc_scalar_value(int type, GString* text)
+{
+  switch (type)
   {
-    xr_call_set_error(call, -1, "Can't parse XML-RPC XML request. Invalid XML document.");
-    goto err_0;
+    case XRV_INT:
+      return xr_value_int_new(atoi(text->str));
+    case XRV_STRING:
+      return xr_value_string_new(text->str);
+    case XRV_BOOLEAN:
+      if (text->len == 0 || !strcmp(text->str, "0"))
+        return xr_value_bool_new(0);
+      return xr_value_bool_new(!strcmp(text->str, "1") ? 1 : -1);
+    case XRV_DOUBLE:
+      return xr_value_double_new(atof(text->str));
+    case XRV_TIME:
+      return xr_value_time_new(text->str);
+    case XRV_BLOB:
+    {
+      /* decode straight from the collected text into the blob buffer */
+      char* buf = g_malloc(XR_BASE64_DECODED_SIZE(text->len));
+      gsize len = xr_base64_decode(text->str, text->len, (guchar*)buf);
+      xr_blob* b = xr_blob_new(buf, len);
+      xr_value* bv = xr_value_blob_new(b);
+      xr_blob_unref(b);
+      return bv;
+    }
   }
 
-  xmlNode* root = xmlDocGetRootElement(doc);
-  if (root == NULL)
+  return NULL;
+}
+
+static int _xmlrpc_scalar_type(const char* name)
+{
+  switch (name[0])
   {
-    xr_call_set_error(call, -1, "Can't parse XML-RPC XML request. Root element is missing.");
-    goto err_1;
+    case 'i':
+      if (!strcmp(name, "int") || !strcmp(name, "i4"))
+        return XRV_INT;
+      break;
+    case 's':
+      if (!strcmp(name, "string"))
+        return XRV_STRING;
+      break;
+    case 'b':
+      if (!strcmp(name, "boolean"))
+        return XRV_BOOLEAN;
+      if (!strcmp(name, "base64"))
+        return XRV_BLOB;
+      break;
+    case 'd':
+      if (!strcmp(name, "double"))
+        return XRV_DOUBLE;
+      if (!strcmp(name, "dateTime.iso8601"))
+        return XRV_TIME;
+      break;
   }
 
-  xmlXPathContext* ctx = xmlXPathNewContext(doc);
+  return -1;
+}
+
+static void _xmlrpc_start_element(void* ctx, const xmlChar* localname, const xmlChar* prefix, const xmlChar* URI,
+  int nb_namespaces, const xmlChar** namespaces, int nb_attributes, int nb_defaulted, const xmlChar** attributes)
+{
+  struct xmlrpc_parser* p = ctx;
+  struct xmlrpc_frame* top = _xmlrpc_top(p);
+  const char* name = (const char*)localname;
+  int elem = -1;
 
-  call->method = xp_eval_cont_str(ctx, "/methodCall/methodName");
-  if (call->method == NULL)
+  if (p->ignore_depth > 0)
   {
-    xr_call_set_error(call, -1, "Can't parse XML-RPC XML request. Missing methodName.");
-    goto err_2;
+    p->ignore_depth++;
+    return;
+  }
+
+  if (top == NULL)
+  {
+    if (!strcmp(name, p->response ? "methodResponse" : "methodCall"))
+      elem = XE_ROOT;
+  }
+  else switch (top->elem)
+  {
+    case XE_ROOT:
+      if (!p->response && !strcmp(name, "methodName") && p->method == NULL)
+        elem = XE_METHOD_NAME;
+      else if (!strcmp(name, "params"))
+        elem = XE_PARAMS;
+      else if (p->response && !strcmp(name, "fault"))
+        elem = XE_FAULT;
+      break;
+    case XE_PARAMS:
+      if (!strcmp(name, "param"))
+        elem = XE_PARAM;
+      break;
+    case XE_PARAM:
+    case XE_FAULT:
+    case XE_DATA:
+      if (!strcmp(name, "value"))
+        elem = XE_VALUE;
+      break;
+    case XE_MEMBER:
+      if (!strcmp(name, "name"))
+      {
+        if (top->names++ == 0)
+          elem = XE_NAME;
+      }
+      else if (!strcmp(name, "value"))
+      {
+        if (top->values++ == 0)
+          elem = XE_VALUE;
+      }
+      break;
+    case XE_VALUE:
+      top->has_element = TRUE;
+      if (top->value)
+        break;
+      if (!strcmp(name, "array"))
+        elem = XE_ARRAY;
+      else if (!strcmp(name, "struct"))
+        elem = XE_STRUCT;
+      else if (_xmlrpc_scalar_type(name) >= 0)
+        elem = XE_SCALAR;
+      break;
+    case XE_ARRAY:
+      if (!top->data_seen && !strcmp(name, "data"))
+      {
+        top->data_seen = TRUE;
+        elem = XE_DATA;
+      }
+      break;
+    case XE_STRUCT:
+      if (!strcmp(name, "member"))
+        elem = XE_MEMBER;
+      break;
+  }
+
+  if (elem < 0)
+  {
+    p->ignore_depth = 1;
+    return;
+  }
+
+  _xmlrpc_push(p, elem);
+  top = _xmlrpc_top(p);
+
+  if (elem == XE_SCALAR)
+    top->type = _xmlrpc_scalar_type(name);
+  else if (elem == XE_ARRAY)
+    top->value = xr_value_array_new();
+  else if (elem == XE_STRUCT)
+    top->value = xr_value_struct_new();
+}
+
+/* pass decoded value to the parent element */
+static void _xmlrpc_add_value(struct xmlrpc_parser* p, xr_value* v)
+{
+  struct xmlrpc_frame* top = _xmlrpc_top(p);
+
+  switch (top->elem)
+  {
+    case XE_VALUE:
+      top->value = v;
+      break;
+    case XE_PARAM:
+      p->params = g_slist_prepend(p->params, v);
+      p->params_count++;
+      break;
+    case XE_FAULT:
+      p->faults = g_slist_prepend(p->faults, v);
+      break;
+    case XE_DATA:
+      /* XE_DATA is always directly inside XE_ARRAY */
+      xr_value_array_append(g_array_index(p->stack, struct xmlrpc_frame, p->stack->len - 2).value, v);
+      break;
+    case XE_MEMBER:
+      top->value = v;
+      break;
+    default:
+      xr_value_unref(v);
+  }
+}
+
+static void _xmlrpc_end_element(void* ctx, const xmlChar* localname, const xmlChar* prefix, const xmlChar* URI)
+{
+  struct xmlrpc_parser* p = ctx;
+  struct xmlrpc_frame f;
+
+  if (p->ignore_depth > 0)
+  {
+    p->ignore_depth--;
+    return;
   }
 
+  f = *_xmlrpc_top(p);
+  g_array_set_size(p->stack, p->stack->len - 1);
+
+  switch (f.elem)
+  {
+    case XE_METHOD_NAME:
+      if (p->text->len > 0)
+        p->method = g_strdup(p->text->str);
+      break;
+    case XE_NAME:
+      _xmlrpc_top(p)->name = g_strdup(p->text->str);
+      break;
+    case XE_SCALAR:
+      _xmlrpc_add_value(p, _xmlrpc_scalar_value(f.type, p->text));
+      break;
+    case XE_ARRAY:
+    case XE_STRUCT:
+      _xmlrpc_add_value(p, f.value);
+      break;
+    case XE_VALUE:
+      if (f.value == NULL && !f.has_element)
+        f.value = xr_value_string_new(p->text->str);
+      if (f.value == NULL)
+      {
+        _xmlrpc_fail(p);
+        return;
+      }
+      _xmlrpc_add_value(p, f.value);
+      break;
+    case XE_MEMBER:
+      if (f.names != 1 || f.values != 1 || f.value == NULL)
+      {
+        g_free(f.name);
+        if (f.value)
+          xr_value_unref(f.value);
+        _xmlrpc_fail(p);
+        return;
+      }
+      xr_value_struct_set_member(_xmlrpc_top(p)->value, f.name, f.value);
+      g_free(f.name);
+      break;
+  }
+
+  g_string_truncate(p->text, 0);
+}
+
+static void _xmlrpc_characters(void* ctx, const xmlChar* ch, int len)
+{
+  struct xmlrpc_parser* p = ctx;
+  struct xmlrpc_frame* top = _xmlrpc_top(p);
+
+  if (p->ignore_depth > 0 || top == NULL)
+    return;
+
+  if (top->elem == XE_SCALAR || top->elem == XE_NAME || top->elem == XE_METHOD_NAME ||
+      (top->elem == XE_VALUE && !top->has_element))
+    g_string_append_len(p->text, (const char*)ch, len);
+}
+
+static void _xmlrpc_error(void* ctx, xmlErrorPtr error)
+{
+}
+
+static gboolean _xmlrpc_parse(struct xmlrpc_parser* p, const char* buf, int len)
+{
+  xmlSAXHandler sax;
+  gboolean well_formed;
   int i;
-  struct nodeset* ns = xp_eval_nodes(ctx, "/methodCall/params/param/value");
-  for (i = 0; i < ns->count; i++)
+
+  memset(&sax, 0, sizeof(sax));
+  sax.initialized = XML_SAX2_MAGIC;
+  sax.startElementNs = _xmlrpc_start_element;
+  sax.endElementNs = _xmlrpc_end_element;
+  sax.characters = _xmlrpc_characters;
+  sax.cdataBlock = _xmlrpc_characters;
+  sax.serror = (xmlStructuredErrorFunc)_xmlrpc_error;
+
+  p->stack = g_array_sized_new(FALSE, FALSE, sizeof(struct xmlrpc_frame), 16);
+  p->text = g_string_sized_new(64);
+
+  p->ctxt = xmlCreatePushParserCtxt(&sax, p, NULL, 0, NULL);
+  xmlCtxtUseOptions(p->ctxt, XML_PARSE_NOWARNING|XML_PARSE_NOERROR|XML_PARSE_NONET);
+  xmlParseChunk(p->ctxt, buf, len, 1);
+  well_formed = p->ctxt->wellFormed;
+  xmlFreeParserCtxt(p->ctxt);
+
+  /* release values of unclosed elements */
+  for (i = 0; i < p->stack->len; i++)
+  {
+    struct xmlrpc_frame* f = &g_array_index(p->stack, struct xmlrpc_frame, i);
+    if (f->value)
+      xr_value_unref(f->value);
+    g_free(f->name);
+  }
+
+  g_array_free(p->stack, TRUE);
+  g_string_free(p->text, TRUE);
+  p->params = g_slist_reverse(p->params);
+  p->faults = g_slist_reverse(p->faults);
+
+  return well_formed && !p->failed;
+}
+
+static void _xmlrpc_parser_free(struct xmlrpc_parser* p)
+{
+  g_free(p->method);
+  g_slist_foreach(p->params, (GFunc)xr_value_unref, NULL);
+  g_slist_free(p->params);
+  g_slist_foreach(p->faults, (GFunc)xr_value_unref, NULL);
+  g_slist_free(p->faults);
+}
+
+/* direct reader, see xr-wire.h
+ *
+ * Reads the common subset of XML-RPC: UTF-8 documents without DOCTYPE,
+ * comments, CDATA sections, processing instructions and attributes, where
+ * each element is one of those the eager decoder interprets. Requests that
+ * use anything else are left to the eager decoder.
+ */
+
+#define XMLRPC_WIRE_MAX_DEPTH 64
+
+#define XW_IS_WS(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+#define XW_IS(name, len, tag) ((len) == sizeof(tag) - 1 && !memcmp(name, tag, len))
+#define XW_OPEN(r, tag, empty) _xw_open(r, tag, sizeof(tag) - 1, empty)
+#define XW_CLOSE(r, tag) _xw_close(r, tag, sizeof(tag) - 1)
+
+static __inline__ void _xw_skip_ws(xr_wire_reader* r)
+{
+  while (r->p < r->end && XW_IS_WS(*r->p))
+    r->p++;
+}
+
+/* parse start tag without attributes, empty is set for <tag/> */
+static gboolean _xw_start(xr_wire_reader* r, const char** name, gsize* len, gboolean* empty)
+{
+  const char* s;
+
+  _xw_skip_ws(r);
+  s = r->p;
+  if (s == r->end || *s != '<')
+    return FALSE;
+
+  *name = ++s;
+  while (s < r->end && *s != '>' && *s != '/' && !XW_IS_WS(*s))
+    s++;
+  *len = s - *name;
+  while (s < r->end && XW_IS_WS(*s))
+    s++;
+
+  *empty = s < r->end && *s == '/';
+  if (*empty)
+    s++;
+  if (*len == 0 || s == r->end || *s != '>')
+    return FALSE;
+
+  r->p = s + 1;
+  return TRUE;
+}
+
+/* open element, empty element is accepted only if empty is not NULL, reader
+ * is not moved on failure */
+static gboolean _xw_open(xr_wire_reader* r, const char* tag, gsize len, gboolean* empty)
+{
+  const char* save = r->p;
+  const char* name;
+  gsize name_len;
+  gboolean is_empty;
+
+  if (!_xw_start(r, &name, &name_len, &is_empty) || name_len != len || memcmp(name, tag, len) || (is_empty && !empty))
   {
-    xr_value* v = _xr_value_unserialize_xmlrpc(ns->nodes[i]);
-    if (v == NULL)
+    r->p = save;
+    return FALSE;
+  }
+
+  if (empty)
+    *empty = is_empty;
+  return TRUE;
+}
+
+static gboolean _xw_close(xr_wire_reader* r, const char* tag, gsize len)
+{
+  const char* s;
+
+  _xw_skip_ws(r);
+  s = r->p;
+  if ((gsize)(r->end - s) < len + 3 || s[0] != '<' || s[1] != '/' || memcmp(s + 2, tag, len))
+    return FALSE;
+
+  s += len + 2;
+  while (s < r->end && XW_IS_WS(*s))
+    s++;
+  if (s == r->end || *s != '>')
+    return FALSE;
+
+  r->p = s + 1;
+  return TRUE;
+}
+
+/* parse predefined entity or character reference, returns position of ';' */
+static const char* _xw_entity(const char* s, const char* end, gunichar* c)
+{
+  const char* semi = memchr(s, ';', MIN(end - s, 12));
+  const char* name = s + 1;
+  gsize len;
+  guint32 u = 0;
+
+  if (semi == NULL)
+    return NULL;
+
+  len = semi - name;
+  if (XW_IS(name, len, "lt"))
+    u = '<';
+  else if (XW_IS(name, len, "gt"))
+    u = '>';
+  else if (XW_IS(name, len, "amp"))
+    u = '&';
+  else if (XW_IS(name, len, "quot"))
+    u = '"';
+  else if (XW_IS(name, len, "apos"))
+    u = '\'';
+  else if (len >= 2 && name[0] == '#')
+  {
+    gboolean hex = name[1] == 'x';
+    const char* d = name + 1 + hex;
+
+    if (d == semi)
+      return NULL;
+
+    for (; d < semi; d++)
     {
-      xr_call_set_error(call, -1, "Can't parse XML-RPC XML request. Failed to unserialize parameter %d.", i);
-      goto err_3;
+      if (*d >= '0' && *d <= '9')
+        u = u * (hex ? 16 : 10) + (*d - '0');
+      else if (hex && g_ascii_isxdigit(*d))
+        u = u * 16 + g_ascii_xdigit_value(*d);
+      else
+        return NULL;
     }
-    xr_call_add_param(call, v);
+
+    /* only characters allowed in XML documents */
+    if (!(u == 0x9 || u == 0xA || u == 0xD || (u >= 0x20 && u <= 0xD7FF) ||
+          (u >= 0xE000 && u <= 0xFFFD) || (u >= 0x10000 && u <= 0x10FFFF)))
+      return NULL;
   }
-  xp_free_nodes(ns);
+  else
+    return NULL;
+
+  if (c)
+    *c = u;
+  return semi;
+}
 
-  xmlXPathFreeContext(ctx);
-  xmlFreeDoc(doc);
+/* scan text content up to the next tag */
+static gboolean _xw_text(xr_wire_reader* r)
+{
+  const char* s;
+  gboolean plain = TRUE;
+  gboolean ascii = TRUE;
+
+  for (s = r->p; s < r->end && *s != '<'; s++)
+  {
+    guchar c = *s;
+
+    if (c == '&')
+    {
+      if (!(s = _xw_entity(s, r->end, NULL)))
+        return FALSE;
+      plain = FALSE;
+    }
+    else if (c == '\r')
+      plain = FALSE;
+    else if (c < 0x20 && c != '\t' && c != '\n')
+      return FALSE;
+    else if (c == '>' && s - r->p >= 2 && s[-1] == ']' && s[-2] == ']')
+      return FALSE;
+    else if (c >= 0x80)
+      ascii = FALSE;
+  }
+
+  if (s == r->end)
+    return FALSE;
+
+  if (!ascii)
+  {
+    const char* u;
+
+    if (!g_utf8_validate(r->p, s - r->p, NULL))
+      return FALSE;
+    /* U+FFFE and U+FFFF are not XML characters */
+    for (u = r->p; u + 2 < s; u++)
+      if ((guchar)u[0] == 0xEF && (guchar)u[1] == 0xBF && ((guchar)u[2] == 0xBE || (guchar)u[2] == 0xBF))
+        return FALSE;
+  }
+
+  r->text = r->p;
+  r->text_len = s - r->p;
+  r->text_plain = plain;
+  r->p = s;
   return TRUE;
+}
 
- err_3:
-  xp_free_nodes(ns);
- err_2:
-  xmlXPathFreeContext(ctx);
- err_1:
-  xmlFreeDoc(doc);
- err_0:
-  return FALSE;
+static __inline__ void _xw_text_empty(xr_wire_reader* r)
+{
+  r->text = "";
+  r->text_len = 0;
+  r->text_plain = TRUE;
 }
 
-static gboolean xr_call_unserialize_response_xmlrpc(xr_call* call, const char* buf, int len)
+/* expand entities and normalize line ends like XML parser does, decoded
+ * text is never longer than the input, out must have room for len + 1
+ * bytes */
+static gsize _xw_decode(const char* s, gsize len, char* out)
 {
-  xmlDoc* doc = xmlReadMemory(buf, len, 0, 0, XML_PARSE_NOWARNING|XML_PARSE_NOERROR|XML_PARSE_NONET);
-  if (doc == NULL)
+  const char* end = s + len;
+  char* o = out;
+  gunichar c;
+
+  while (s < end)
   {
-    xr_call_set_error(call, -1, "Can't parse XML-RPC XML response. Invalid XML document.");
-    goto err_0;
+    if (*s == '&')
+    {
+      s = _xw_entity(s, end, &c) + 1;
+      o += g_unichar_to_utf8(c, o);
+    }
+    else if (*s == '\r')
+    {
+      *o++ = '\n';
+      if (++s < end && *s == '\n')
+        s++;
+    }
+    else
+      *o++ = *s++;
   }
 
-  xmlNode* root = xmlDocGetRootElement(doc);
-  if (root == NULL)
+  *o = '\0';
+  return o - out;
+}
+
+static char* _xw_text_dup(xr_wire_reader* r)
+{
+  char* str;
+
+  if (r->text_plain)
+    return g_strndup(r->text, r->text_len);
+
+  str = g_malloc(r->text_len + 1);
+  _xw_decode(r->text, r->text_len, str);
+  return str;
+}
+
+/* finish container, empty or not */
+static int _xw_end(xr_wire_reader* r)
+{
+  r->empty = FALSE;
+  r->first = FALSE;
+  r->depth--;
+  return XW_CLOSE(r, "value") ? 0 : -1;
+}
+
+/* read value up to its content, returns type of the value, text of the
+ * scalar values is kept in the reader and the value is closed */
+static int _xw_value_begin(xr_wire_reader* r)
+{
+  const char* name;
+  gsize len;
+  gboolean empty;
+  char type_name[20];
+  int type;
+  const char* s;
+
+  if (!XW_OPEN(r, "value", &empty))
+    return -1;
+
+  if (empty)
   {
-    xr_call_set_error(call, -1, "Can't parse XML-RPC XML response. Root element is missing.");
-    goto err_1;
+    _xw_text_empty(r);
+    return XRV_STRING;
   }
 
-  xmlXPathContext* ctx = xmlXPathNewContext(doc);
+  /* implicit string */
+  if (!_xw_text(r))
+    return -1;
+  if (XW_CLOSE(r, "value"))
+    return XRV_STRING;
 
-  struct nodeset* ns = xp_eval_nodes(ctx, "/methodResponse/params/param/value");
-  if (ns->count == 1)
+  for (s = r->text; s < r->text + r->text_len; s++)
+    if (!XW_IS_WS(*s))
+      return -1;
+
+  if (!_xw_start(r, &name, &len, &empty))
+    return -1;
+
+  if (XW_IS(name, len, "array") || XW_IS(name, len, "struct"))
   {
-    call->retval = _xr_value_unserialize_xmlrpc(ns->nodes[0]);
-    if (call->retval == NULL)
+    if (++r->depth > XMLRPC_WIRE_MAX_DEPTH)
+      return -1;
+
+    r->first = TRUE;
+    if (name[0] == 's')
+      r->empty = empty;
+    else if (!empty)
     {
-      xr_call_set_error(call, -1, "Can't parse XML-RPC XML response. Failed to unserialize retval.");
-      goto err_2;
+      /* <array></array>, <array><data/></array> or <array><data> */
+      if (XW_CLOSE(r, "array"))
+        r->empty = TRUE;
+      else if (!XW_OPEN(r, "data", &r->empty) || (r->empty && !XW_CLOSE(r, "array")))
+        return -1;
     }
-    goto done;
+    else
+      r->empty = TRUE;
+
+    return name[0] == 's' ? XRV_STRUCT : XRV_ARRAY;
+  }
+
+  if (len >= sizeof(type_name))
+    return -1;
+  memcpy(type_name, name, len);
+  type_name[len] = '\0';
+  if ((type = _xmlrpc_scalar_type(type_name)) < 0)
+    return -1;
+
+  if (empty)
+    _xw_text_empty(r);
+  else if (!_xw_text(r) || !_xw_close(r, name, len))
+    return -1;
+
+  return XW_CLOSE(r, "value") ? type : -1;
+}
+
+static int _xw_next_item(xr_wire_reader* r)
+{
+  if (r->empty)
+    return _xw_end(r);
+
+  if (r->depth == 0)
+  {
+    /* params */
+    if (!r->first && !XW_CLOSE(r, "param"))
+      return -1;
+    r->first = FALSE;
+    _xw_skip_ws(r);
+    if (r->p == r->end)
+      return 0;
+    return XW_OPEN(r, "param", NULL) ? 1 : -1;
   }
-  else if (ns->count > 1) // more than one param is bad
+
+  _xw_skip_ws(r);
+  if (r->end - r->p > 6 && !memcmp(r->p, "<value", 6))
+    return 1;
+
+  if (!XW_CLOSE(r, "data") || !XW_CLOSE(r, "array"))
+    return -1;
+  return _xw_end(r);
+}
+
+static int _xw_next_member(xr_wire_reader* r)
+{
+  gboolean empty;
+
+  if (r->empty)
+    return _xw_end(r);
+
+  if (!r->first && !XW_CLOSE(r, "member"))
+    return -1;
+  r->first = FALSE;
+
+  if (XW_CLOSE(r, "struct"))
+    return _xw_end(r);
+
+  if (!XW_OPEN(r, "member", NULL) || !XW_OPEN(r, "name", &empty))
+    return -1;
+
+  if (empty)
+    _xw_text_empty(r);
+  else if (!_xw_text(r) || !XW_CLOSE(r, "name"))
+    return -1;
+
+  if (r->text_plain)
   {
-    xr_call_set_error(call, -1, "Can't parse XML-RPC XML response. Too many return values.");
-    goto err_2;
+    r->name = r->text;
+    r->name_len = r->text_len;
+  }
+  else if (r->text_len < sizeof(r->name_buf))
+  {
+    r->name = r->name_buf;
+    r->name_len = _xw_decode(r->text, r->text_len, r->name_buf);
   }
-  xp_free_nodes(ns);
+  else
+    r->name = NULL; /* long name, decoded on demand */
 
-  // ok no params/param, check for fault
-  ns = xp_eval_nodes(ctx, "/methodResponse/fault/value");
-  if (ns->count == 1)
+  return 1;
+}
+
+static char* _xw_name_dup(xr_wire_reader* r)
+{
+  return r->name ? g_strndup(r->name, r->name_len) : _xw_text_dup(r);
+}
+
+static gboolean _xw_skip(xr_wire_reader* r)
+{
+  int type = _xw_value_begin(r);
+  int rs;
+
+  if (type == XRV_ARRAY)
+  {
+    while ((rs = _xw_next_item(r)) > 0)
+      if (!_xw_skip(r))
+        return FALSE;
+    return rs == 0;
+  }
+  else if (type == XRV_STRUCT)
   {
-    call->retval = _xr_value_unserialize_xmlrpc(ns->nodes[0]);
-    if (call->retval == NULL)
+    while ((rs = _xw_next_member(r)) > 0)
+      if (!_xw_skip(r))
+        return FALSE;
+    return rs == 0;
+  }
+
+  return type >= 0;
+}
+
+/* build value the same way the eager decoder does */
+static xr_value* _xw_build_value(xr_wire_reader* r)
+{
+  int type = _xw_value_begin(r);
+  xr_value* v = NULL;
+  xr_value* item;
+  int rs;
+
+  if (type == XRV_ARRAY)
+  {
+    v = xr_value_array_new();
+    while ((rs = _xw_next_item(r)) > 0)
     {
-      xr_call_set_error(call, -1, "Can't parse XML-RPC XML response. Failed to unserialize fault response.");
-      goto err_2;
+      if (!(item = _xw_build_value(r)))
+        goto err;
+      xr_value_array_append(v, item);
     }
-    // check if client returned standard XML-RPC error message, we want to process
-    // it differently than normal retval
-    int errcode = 0;
-    char* errmsg = NULL;
-    if (xr_value_is_error_retval(call->retval, &errcode, &errmsg))
+    if (rs < 0)
+      goto err;
+  }
+  else if (type == XRV_STRUCT)
+  {
+    v = xr_value_struct_new();
+    while ((rs = _xw_next_member(r)) > 0)
     {
-      xr_call_set_error(call, errcode, "%s", errmsg);
-      g_free(errmsg);
-      goto err_3;
+      char* name = _xw_name_dup(r);
+
+      if (!(item = _xw_build_value(r)))
+      {
+        g_free(name);
+        goto err;
+      }
+      xr_value_struct_set_member(v, name, item);
+      g_free(name);
     }
-    else
+    if (rs < 0)
+      goto err;
+  }
+  else if (type >= 0)
+  {
+    GString text;
+
+    text.str = _xw_text_dup(r);
+    text.len = strlen(text.str);
+    text.allocated_len = text.len + 1;
+    v = _xmlrpc_scalar_value(type, &text);
+    g_free(text.str);
+  }
+
+  return v;
+
+err:
+  xr_value_unref(v);
+  return NULL;
+}
+
+/* text of the scalar value, free it with g_free if it differs from
+ * r->text */
+static const char* _xw_scalar_text(xr_wire_reader* r, int type, gsize* len)
+{
+  char* str;
+
+  if (_xw_value_begin(r) != type)
+    return NULL;
+
+  if (r->text_plain)
+  {
+    *len = r->text_len;
+    return r->text;
+  }
+
+  str = _xw_text_dup(r);
+  *len = strlen(str);
+  return str;
+}
+
+static __inline__ void _xw_scalar_text_free(xr_wire_reader* r, const char* text)
+{
+  if (text != r->text)
+    g_free((char*)text);
+}
+
+static gboolean _xw_read_int(xr_wire_reader* r, int* v)
+{
+  gsize len;
+  const char* text = _xw_scalar_text(r, XRV_INT, &len);
+
+  if (text == NULL)
+    return FALSE;
+
+  /* plain text is followed by a tag */
+  *v = atoi(text);
+  _xw_scalar_text_free(r, text);
+  return TRUE;
+}
+
+static gboolean _xw_read_bool(xr_wire_reader* r, gboolean* v)
+{
+  gsize len;
+  const char* text = _xw_scalar_text(r, XRV_BOOLEAN, &len);
+
+  if (text == NULL)
+    return FALSE;
+
+  if (len == 0 || (len == 1 && text[0] == '0'))
+    *v = 0;
+  else
+    *v = len == 1 && text[0] == '1' ? 1 : -1;
+  _xw_scalar_text_free(r, text);
+  return TRUE;
+}
+
+static gboolean _xw_read_double(xr_wire_reader* r, double* v)
+{
+  gsize len;
+  const char* text = _xw_scalar_text(r, XRV_DOUBLE, &len);
+
+  if (text == NULL)
+    return FALSE;
+
+  *v = atof(text);
+  _xw_scalar_text_free(r, text);
+  return TRUE;
+}
+
+static gboolean _xw_read_string(xr_wire_reader* r, int type, char** v)
+{
+  if (_xw_value_begin(r) != type)
+    return FALSE;
+
+  g_free(*v);
+  *v = _xw_text_dup(r);
+  return TRUE;
+}
+
+static gboolean _xw_read_blob(xr_wire_reader* r, xr_blob** v)
+{
+  gsize len;
+  const char* text = _xw_scalar_text(r, XRV_BLOB, &len);
+  char* buf;
+
+  if (text == NULL)
+    return FALSE;
+
+  buf = g_malloc(XR_BASE64_DECODED_SIZE(len));
+  len = xr_base64_decode(text, len, (guchar*)buf);
+  _xw_scalar_text_free(r, text);
+
+  xr_blob_unref(*v);
+  *v = xr_blob_new(buf, len);
+  return TRUE;
+}
+
+/* check XML declaration, encoding must be UTF-8 */
+static gboolean _xw_decl(xr_wire_reader* r)
+{
+  static const char* names[] = { "version", "encoding", "standalone" };
+  int i;
+
+  r->p += 5;
+  for (i = 0; i < G_N_ELEMENTS(names); i++)
+  {
+    const char* s = r->p;
+    gsize len = strlen(names[i]);
+    const char* value;
+    char quote;
+
+    while (s < r->end && XW_IS_WS(*s))
+      s++;
+    if (s == r->p || (gsize)(r->end - s) < len || memcmp(s, names[i], len))
     {
-      xr_call_set_error(call, -1, "Can't parse XML-RPC XML response. Invalid fault response.");
-      goto err_3;
+      if (i == 0)
+        return FALSE;
+      continue;
     }
+
+    s += len;
+    while (s < r->end && XW_IS_WS(*s))
+      s++;
+    if (s == r->end || *s++ != '=')
+      return FALSE;
+    while (s < r->end && XW_IS_WS(*s))
+      s++;
+    if (s == r->end || (*s != '"' && *s != '\''))
+      return FALSE;
+    quote = *s++;
+    value = s;
+    while (s < r->end && *s != quote)
+      s++;
+    if (s == r->end)
+      return FALSE;
+
+    if (i == 0)
+    {
+      const char* d;
+
+      if (s - value < 3 || memcmp(value, "1.", 2))
+        return FALSE;
+      for (d = value + 2; d < s; d++)
+        if (!g_ascii_isdigit(*d))
+          return FALSE;
+    }
+    if (i == 1 && !(s - value == 5 && !g_ascii_strncasecmp(value, "UTF-8", 5)))
+      return FALSE;
+    if (i == 2 && !XW_IS(value, (gsize)(s - value), "yes") && !XW_IS(value, (gsize)(s - value), "no"))
+      return FALSE;
+
+    r->p = s + 1;
   }
-  else // no fault either
+
+  _xw_skip_ws(r);
+  if (r->end - r->p < 2 || memcmp(r->p, "?>", 2))
+    return FALSE;
+
+  r->p += 2;
+  return TRUE;
+}
+
+/* check that request can be read by the direct reader, returns method name
+ * and the range of the params content */
+static gboolean _xmlrpc_wire_scan_request(const char* buf, int len, char** method, gsize* params, gsize* params_end)
+{
+  xr_wire_reader r;
+  gboolean empty;
+
+  memset(&r, 0, sizeof(r));
+  r.transport = XR_CALL_XML_RPC;
+  r.p = buf;
+  r.end = buf + len;
+  *method = NULL;
+
+  if (len >= 5 && !memcmp(buf, "<?xml", 5) && !_xw_decl(&r))
+    return FALSE;
+
+  if (!XW_OPEN(&r, "methodCall", NULL) || !XW_OPEN(&r, "methodName", NULL) || !_xw_text(&r) ||
+      r.text_len == 0 || !XW_CLOSE(&r, "methodName"))
+    return FALSE;
+
+  *method = _xw_text_dup(&r);
+  *params = *params_end = r.p - buf;
+
+  if (XW_OPEN(&r, "params", &empty) && !empty)
   {
-    xr_call_set_error(call, -1, "Can't parse XML-RPC XML response. Failed to unserialize retval.");
-    goto err_2;
+    *params = r.p - buf;
+    while (TRUE)
+    {
+      _xw_skip_ws(&r);
+      if (r.end - r.p > 2 && !memcmp(r.p, "</", 2))
+        break;
+      if (!XW_OPEN(&r, "param", NULL) || !_xw_skip(&r) || !XW_CLOSE(&r, "param"))
+        goto err;
+    }
+    *params_end = r.p - buf;
+    if (!XW_CLOSE(&r, "params"))
+      goto err;
+  }
+
+  if (!XW_CLOSE(&r, "methodCall"))
+    goto err;
+
+  _xw_skip_ws(&r);
+  if (r.p == r.end)
+    return TRUE;
+
+err:
+  g_free(*method);
+  *method = NULL;
+  return FALSE;
+}
+
+static gboolean xr_call_unserialize_request_xmlrpc(xr_call* call, const char* buf, int len)
+{
+  struct xmlrpc_parser p;
+  GSList* i;
+
+  if (call->defer_params)
+  {
+    char* method;
+    gsize params, params_end;
+
+    /* params are read by the generated code */
+    if (_xmlrpc_wire_scan_request(buf, len, &method, &params, &params_end))
+    {
+      call->method = method;
+      call->wire = g_string_new_len(buf + params, params_end - params);
+      return TRUE;
+    }
+  }
+
+  memset(&p, 0, sizeof(p));
+
+  if (!_xmlrpc_parse(&p, buf, len))
+  {
+    if (p.failed)
+      xr_call_set_error(call, -1, "Can't parse XML-RPC XML request. Failed to unserialize parameter %d.", p.params_count);
+    else
+      xr_call_set_error(call, -1, "Can't parse XML-RPC XML request. Invalid XML document.");
+    goto err;
+  }
+
+  if (p.method == NULL)
+  {
+    xr_call_set_error(call, -1, "Can't parse XML-RPC XML request. Missing methodName.");
+    goto err;
   }
 
-done:
-  xp_free_nodes(ns);
-  xmlXPathFreeContext(ctx);
-  xmlFreeDoc(doc);
+  call->method = p.method;
+  for (i = p.params; i; i = i->next)
+    g_ptr_array_add(call->params, i->data);
+  g_slist_free(p.params);
   return TRUE;
 
- err_3:
-  xr_value_unref(call->retval);
-  call->retval = NULL;
- err_2:
-  xp_free_nodes(ns);
-  xmlXPathFreeContext(ctx);
- err_1:
-  xmlFreeDoc(doc);
- err_0:
+err:
+  _xmlrpc_parser_free(&p);
+  return FALSE;
+}
+
+static gboolean xr_call_unserialize_response_xmlrpc(xr_call* call, const char* buf, int len)
+{
+  struct xmlrpc_parser p;
+  int errcode = 0;
+  char* errmsg = NULL;
+
+  memset(&p, 0, sizeof(p));
+  p.response = TRUE;
+
+  if (!_xmlrpc_parse(&p, buf, len))
+  {
+    if (p.fault_failed)
+      xr_call_set_error(call, -1, "Can't parse XML-RPC XML response. Failed to unserialize fault response.");
+    else if (p.failed)
+      xr_call_set_error(call, -1, "Can't parse XML-RPC XML response. Failed to unserialize retval.");
+    else
+      xr_call_set_error(call, -1, "Can't parse XML-RPC XML response. Invalid XML document.");
+    goto err;
+  }
+
+  if (p.params_count == 1)
+  {
+    call->retval = p.params->data;
+    g_slist_free(p.params);
+    p.params = NULL;
+    _xmlrpc_parser_free(&p);
+    return TRUE;
+  }
+  else if (p.params_count > 1) // more than one param is bad
+  {
+    xr_call_set_error(call, -1, "Can't parse XML-RPC XML response. Too many return values.");
+    goto err;
+  }
+
+  // ok no params/param, check for fault
+  if (g_slist_length(p.faults) != 1)
+  {
+    xr_call_set_error(call, -1, "Can't parse XML-RPC XML response. Failed to unserialize retval.");
+    goto err;
+  }
+
+  // check if client returned standard XML-RPC error message, we want to process
+  // it differently than normal retval
+  if (xr_value_is_error_retval(p.faults->data, &errcode, &errmsg))
+  {
+    xr_call_set_error(call, errcode, "%s", errmsg);
+    g_free(errmsg);
+  }
+  else
+    xr_call_set_error(call, -1, "Can't parse XML-RPC XML response. Invalid fault response.");
+
+err:
+  _xmlrpc_parser_free(&p);
   return FALSE;
 }
 
 static void xr_call_free_buffer_xmlrpc(xr_call* call, char* buf)
 {
-  xmlFree(buf);
+  g_free(buf);
 }
@@ -21,25 +21,46 @@
 #include <stdio.h>
 
 #include "xr-call.h"
+#include "xr-wire.h"
+#include "xr-value-priv.h"
 
 struct _xr_call
 {
   xr_call_transport transport;
   char* method;
-  GSList* params;
+  GPtrArray* params;
   xr_value* retval;
 
   gboolean error_set;
   int errcode;    /* this must be > 0 for errors */
   char* errmsg;   /* Non-NULL on error. */
+
+  gboolean batch; /* multicall is sent as JSON-RPC batch */
+
+  guint json_id;       /* id of the (first) JSON-RPC request sent */
+  GPtrArray* json_ids; /* JSON text of the received request ids */
+  gboolean json_v2;    /* received request was JSON-RPC 2.0 */
+
+  guint msgpack_id;    /* MessagePack-RPC message id */
+
+  GString* raw_params; /* params encoded by generated code */
+  GString* raw_retval; /* retval encoded by generated code */
+
+  gboolean defer_params; /* keep params of the received request as text */
+  GString* wire;         /* params text, see xr-call-wire.c */
+  GString* wire_retval;  /* retval text written by generated code */
 };
 
+static void _xr_call_parse_wire(xr_call* call);
+static void _xr_call_parse_wire_retval(xr_call* call);
+
 /* construct/destruct */
 
 xr_call* xr_call_new(const char* method)
 {
   xr_call* c = g_new0(xr_call, 1);
   c->method = g_strdup(method);
+  c->params = g_ptr_array_new_with_free_func((GDestroyNotify)xr_value_unref);
   c->transport = XR_CALL_XML_RPC;
 
   xr_trace(XR_DEBUG_CALL_TRACE, "(method=%s) = %p", method, c);
@@ -55,10 +76,19 @@ void xr_call_free(xr_call* call)
     return;
 
   g_free(call->method);
-  g_slist_foreach(call->params, (GFunc)xr_value_unref, NULL);
-  g_slist_free(call->params);
+  g_ptr_array_free(call->params, TRUE);
   xr_value_unref(call->retval);
   g_free(call->errmsg);
+  if (call->json_ids)
+    g_ptr_array_free(call->json_ids, TRUE);
+  if (call->raw_params)
+    g_string_free(call->raw_params, TRUE);
+  if (call->raw_retval)
+    g_string_free(call->raw_retval, TRUE);
+  if (call->wire)
+    g_string_free(call->wire, TRUE);
+  if (call->wire_retval)
+    g_string_free(call->wire_retval, TRUE);
   g_free(call);
 }
 
@@ -69,9 +99,25 @@ void xr_call_set_transport(xr_call* call, xr_call_transport transport)
   g_return_if_fail(call != NULL);
   g_return_if_fail(transport < XR_CALL_TRANSPORT_COUNT);
 
+  /* text is in the format of the current transport */
+  if (transport != call->transport)
+  {
+    if (call->wire)
+      _xr_call_parse_wire(call);
+    if (call->wire_retval)
+      _xr_call_parse_wire_retval(call);
+  }
+
   call->transport = transport;
 }
 
+xr_call_transport xr_call_get_transport(xr_call* call)
+{
+  g_return_val_if_fail(call != NULL, XR_CALL_XML_RPC);
+
+  return call->transport;
+}
+
 const char* xr_call_get_method_full(xr_call* call)
 {
   xr_trace(XR_DEBUG_CALL_TRACE, "(call=%p)", call);
@@ -122,7 +168,10 @@ void xr_call_add_param(xr_call* call, xr_value* val)
   g_return_if_fail(call != NULL);
   g_return_if_fail(val != NULL);
 
-  call->params = g_slist_append(call->params, val);
+  if (G_UNLIKELY(call->wire != NULL))
+    _xr_call_parse_wire(call);
+
+  g_ptr_array_add(call->params, val);
 }
 
 xr_value* xr_call_get_param(xr_call* call, unsigned int pos)
@@ -131,7 +180,48 @@ xr_value* xr_call_get_param(xr_call* call, unsigned int pos)
 
   g_return_val_if_fail(call != NULL, NULL);
 
-  return g_slist_nth_data(call->params, pos);
+  if (G_UNLIKELY(call->wire != NULL))
+    _xr_call_parse_wire(call);
+
+  if (pos >= call->params->len)
+    return NULL;
+
+  return g_ptr_array_index(call->params, pos);
+}
+
+void xr_call_set_raw_params(xr_call* call, GString* buf)
+{
+  xr_trace(XR_DEBUG_CALL_TRACE, "(call=%p, buf=%p)", call, buf);
+
+  g_return_if_fail(call != NULL);
+  g_return_if_fail(buf != NULL);
+
+  if (call->raw_params)
+    g_string_free(call->raw_params, TRUE);
+  call->raw_params = buf;
+}
+
+void xr_call_set_defer_params(xr_call* call, gboolean defer)
+{
+  xr_trace(XR_DEBUG_CALL_TRACE, "(call=%p, defer=%d)", call, defer);
+
+  g_return_if_fail(call != NULL);
+
+  call->defer_params = defer;
+}
+
+const char* xr_call_get_raw_params(xr_call* call, int* len)
+{
+  xr_trace(XR_DEBUG_CALL_TRACE, "(call=%p)", call);
+
+  g_return_val_if_fail(call != NULL, NULL);
+  g_return_val_if_fail(len != NULL, NULL);
+
+  if (call->raw_params == NULL)
+    return NULL;
+
+  *len = call->raw_params->len;
+  return call->raw_params->str;
 }
 
 /* retval manipulation */
@@ -145,6 +235,12 @@ void xr_call_set_retval(xr_call* call, xr_value* val)
 
   xr_value_unref(call->retval);
   call->retval = val;
+
+  if (call->wire_retval)
+  {
+    g_string_free(call->wire_retval, TRUE);
+    call->wire_retval = NULL;
+  }
 }
 
 xr_value* xr_call_get_retval(xr_call* call)
@@ -153,9 +249,38 @@ xr_value* xr_call_get_retval(xr_call* call)
 
   g_return_val_if_fail(call != NULL, NULL);
 
+  if (G_UNLIKELY(call->wire_retval != NULL))
+    _xr_call_parse_wire_retval(call);
+
   return call->retval;
 }
 
+void xr_call_set_raw_retval(xr_call* call, GString* buf)
+{
+  xr_trace(XR_DEBUG_CALL_TRACE, "(call=%p, buf=%p)", call, buf);
+
+  g_return_if_fail(call != NULL);
+  g_return_if_fail(buf != NULL);
+
+  if (call->raw_retval)
+    g_string_free(call->raw_retval, TRUE);
+  call->raw_retval = buf;
+}
+
+const char* xr_call_get_raw_retval(xr_call* call, int* len)
+{
+  xr_trace(XR_DEBUG_CALL_TRACE, "(call=%p)", call);
+
+  g_return_val_if_fail(call != NULL, NULL);
+  g_return_val_if_fail(len != NULL, NULL);
+
+  if (call->raw_retval == NULL)
+    return NULL;
+
+  *len = call->raw_retval->len;
+  return call->raw_retval->str;
+}
+
 /* error manipulation */
 
 void xr_call_set_error(xr_call* call, int code, const char* msg, ...)
@@ -193,12 +318,103 @@ const char* xr_call_get_error_message(xr_call* call)
   return call->errmsg;
 }
 
+/* multicall */
+
+xr_call* xr_call_multicall_new(xr_call** calls, int count)
+{
+  xr_call* multicall;
+  xr_value* array;
+  int i;
+  guint j;
+
+  xr_trace(XR_DEBUG_CALL_TRACE, "(calls=%p, count=%d)", calls, count);
+
+  g_return_val_if_fail(calls != NULL || count == 0, NULL);
+
+  array = xr_value_array_new();
+  for (i = 0; i < count; i++)
+  {
+    xr_value* desc = xr_value_struct_new();
+    xr_value* params = xr_value_array_new();
+
+    if (calls[i]->wire)
+      _xr_call_parse_wire(calls[i]);
+    for (j = 0; j < calls[i]->params->len; j++)
+      xr_value_array_append(params, _xr_value_share(g_ptr_array_index(calls[i]->params, j)));
+
+    if (calls[i]->method)
+      xr_value_struct_set_member(desc, "methodName", xr_value_string_new(calls[i]->method));
+    xr_value_struct_set_member(desc, "params", params);
+    xr_value_array_append(array, desc);
+  }
+
+  multicall = xr_call_new(XR_CALL_MULTICALL);
+  xr_call_add_param(multicall, array);
+  multicall->batch = TRUE;
+
+  return multicall;
+}
+
+gboolean xr_call_is_multicall(xr_call* call)
+{
+  g_return_val_if_fail(call != NULL, FALSE);
+
+  return call->method && !strcmp(call->method, XR_CALL_MULTICALL);
+}
+
+gboolean xr_call_multicall_get_results(xr_call* call, xr_call** calls, int count)
+{
+  xr_value* results = call->retval;
+  int i;
+
+  xr_trace(XR_DEBUG_CALL_TRACE, "(call=%p, calls=%p, count=%d)", call, calls, count);
+
+  g_return_val_if_fail(call != NULL, FALSE);
+  g_return_val_if_fail(calls != NULL || count == 0, FALSE);
+
+  if (!call->error_set && (results == NULL || xr_value_get_type(results) != XRV_ARRAY || xr_value_array_length(results) != count))
+    xr_call_set_error(call, -1, "Invalid multicall response.");
+
+  if (call->error_set)
+  {
+    for (i = 0; i < count; i++)
+      xr_call_set_error(calls[i], call->errcode, "%s", call->errmsg);
+    return FALSE;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    xr_value* result = xr_value_array_get(results, i);
+    int errcode;
+    char* errmsg;
+
+    if (xr_value_get_type(result) == XRV_ARRAY && xr_value_array_length(result) == 1)
+      xr_call_set_retval(calls[i], _xr_value_share(xr_value_array_get(result, 0)));
+    else if (xr_value_is_error_retval(result, &errcode, &errmsg))
+    {
+      xr_call_set_error(calls[i], errcode, "%s", errmsg);
+      g_free(errmsg);
+    }
+    else
+      xr_call_set_error(calls[i], -1, "Invalid multicall result.");
+  }
+
+  return TRUE;
+}
+
+/* internal use only */
+gboolean __xr_value_is_complicated(xr_value* v, int max_strlen);
+const char* __xr_value_get_str(xr_value* v);
+
 /* transport specific API */
 
 #include "xr-call-xml-rpc.c"
 #ifdef XR_JSON_ENABLED
 #include "xr-call-json-rpc.c"
 #endif
+#include "xr-call-msgpack.c"
+#include "xr-call-binary.c"
+#include "xr-call-wire.c"
 
 struct transport_module
 {
@@ -226,6 +442,20 @@ static const struct transport_module transports[XR_CALL_TRANSPORT_COUNT] = {
     .unserialize_response = xr_call_unserialize_response_json,
   },
 #endif
+  { /* XR_CALL_MSGPACK */
+    .serialize_request = xr_call_serialize_request_msgpack,
+    .serialize_response = xr_call_serialize_response_msgpack,
+    .free_buffer = xr_call_free_buffer_msgpack,
+    .unserialize_request = xr_call_unserialize_request_msgpack,
+    .unserialize_response = xr_call_unserialize_response_msgpack,
+  },
+  { /* XR_CALL_BINARY */
+    .serialize_request = xr_call_serialize_request_binary,
+    .serialize_response = xr_call_serialize_response_binary,
+    .free_buffer = xr_call_free_buffer_binary,
+    .unserialize_request = xr_call_unserialize_request_binary,
+    .unserialize_response = xr_call_unserialize_response_binary,
+  },
 };
 
 void xr_call_serialize_request(xr_call* call, char** buf, int* len)
@@ -284,12 +514,9 @@ gboolean xr_call_unserialize_response(xr_call* call, const char* buf, int len)
   return transports[call->transport].unserialize_response(call, buf, len);
 }
 
-/* internal use only */
-gboolean __xr_value_is_complicated(xr_value* v, int max_strlen);
-
 char* xr_call_dump_string(xr_call* call, int indent)
 {
-  GSList* i;
+  guint i, len;
   GString* string;
   char buf[256];
   gboolean single_line = TRUE;
@@ -299,32 +526,37 @@ char* xr_call_dump_string(xr_call* call, int indent)
   memset(buf, 0, sizeof(buf));
   memset(buf, ' ', MIN(indent * 2, sizeof(buf) - 1));
   string = g_string_sized_new(1024);
+  if (call->wire)
+    _xr_call_parse_wire(call);
+  if (call->wire_retval)
+    _xr_call_parse_wire_retval(call);
+  len = call->params->len;
 
   // split parameters on spearate lines?
-  if (g_slist_length(call->params) > 6)
+  if (len > 6)
     single_line = FALSE;
   else
-    for (i = call->params; i; i = i->next)
-      if (__xr_value_is_complicated(i->data, 25))
+    for (i = 0; i < len; i++)
+      if (__xr_value_is_complicated(g_ptr_array_index(call->params, i), 25))
         single_line = FALSE;
 
   g_string_append_printf(string, "%s%s(", buf, call->method ? call->method : "<anonymous>");
   if (single_line)
   {
-    for (i = call->params; i; i = i->next)
+    for (i = 0; i < len; i++)
     {
-      xr_value_dump(i->data, string, indent);
-      if (i->next)
+      xr_value_dump(g_ptr_array_index(call->params, i), string, indent);
+      if (i + 1 < len)
         g_string_append(string, ", ");
     }
   }
   else
   {
-    for (i = call->params; i; i = i->next)
+    for (i = 0; i < len; i++)
     {
       g_string_append_printf(string, "\n%s  ", buf);
-      xr_value_dump(i->data, string, indent + 1);
-      if (i->next)
+      xr_value_dump(g_ptr_array_index(call->params, i), string, indent + 1);
+      if (i + 1 < len)
         g_string_append(string, ",");
     }
     g_string_append_printf(string, "\n%s", buf);
@@ -336,6 +568,8 @@ char* xr_call_dump_string(xr_call* call, int indent)
     g_string_append(string, " = ");
     xr_value_dump(call->retval, string, indent);
   }
+  else if (call->raw_retval)
+    g_string_append_printf(string, " = <%u bytes>", (guint)call->raw_retval->len);
   if (call->errcode || call->errmsg)
   {
     g_string_append_printf(string, " = { faultCode: %d, faultString: \"%s\" }", call->errcode, call->errmsg ? call->errmsg : "");
@@ -39,6 +39,28 @@ struct _xr_client_conn
   gboolean is_open;
   GHashTable* headers;
   xr_call_transport transport;
+  GQueue* pipeline;       /* calls sent by xr_client_call_send() waiting for responses */
+  char* uri;
+  gint64 idle_since;      /* seconds of monotonic time while idle in a pool */
+};
+
+struct _xr_client_endpoint
+{
+  GQueue idle;            /* idle connections, most recently used first */
+  int total;              /* idle and checked out connections */
+};
+
+typedef struct _xr_client_endpoint xr_client_endpoint;
+
+struct _xr_client_pool
+{
+  GMutex* lock;
+  GCond* cond;            /* signalled when connection count drops */
+  GHashTable* endpoints;  /* uri -> xr_client_endpoint */
+  int max_idle;
+  int max_total;
+  int idle_timeout;
+  xr_call_transport transport;
 };
 
 xr_client_conn* xr_client_new(GError** err)
@@ -54,6 +76,7 @@ xr_client_conn* xr_client_new(GError** err)
 
   conn->headers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
   conn->transport = XR_CALL_XML_RPC;
+  conn->pipeline = g_queue_new();
 
   return conn;
 }
@@ -145,6 +168,9 @@ gboolean xr_client_open(xr_client_conn* conn, const char* uri, GError** err)
   xr_set_nodelay(g_socket_connection_get_socket(conn->conn));
 
   conn->http = xr_http_new(G_IO_STREAM(conn->conn));
+  g_queue_clear(conn->pipeline);
+  g_free(conn->uri);
+  conn->uri = g_strdup(uri);
   g_free(conn->session_id);
   conn->session_id = g_strdup_printf("%08x%08x%08x%08x", g_random_int(), g_random_int(), g_random_int(), g_random_int());
   conn->is_open = 1;
@@ -205,18 +231,15 @@ void xr_client_close(xr_client_conn* conn)
 
   xr_http_free(conn->http);
   conn->http = NULL;
-  if (conn->client)
-    g_object_unref(conn->client);
   if (conn->conn)
     g_object_unref(conn->conn);
-  conn->client = NULL;
   conn->conn = NULL;
   conn->is_open = FALSE;
 }
 
 static void _add_http_header(const char* name, const char* value, xr_http* http)
 {
-  xr_http_set_header(http, name, value);
+  xr_http_set_header_static(http, name, value);
 }
 
 gboolean xr_client_set_transport(xr_client_conn* conn, xr_call_transport transport)
@@ -229,19 +252,38 @@ gboolean xr_client_set_transport(xr_client_conn* conn, xr_call_transport transpo
   return TRUE;
 }
 
-gboolean xr_client_call(xr_client_conn* conn, xr_call* call, GError** err)
+xr_call_transport xr_client_get_transport(xr_client_conn* conn)
+{
+  g_return_val_if_fail(conn != NULL, XR_CALL_XML_RPC);
+
+  return conn->transport;
+}
+
+/* serialize request and setup HTTP header */
+static void _xr_client_prepare_request(xr_client_conn* conn, xr_call* call, char** buffer, int* length)
+{
+  xr_call_set_transport(call, conn->transport);
+  xr_call_serialize_request(call, buffer, length);
+  xr_http_setup_request(conn->http, "POST", conn->resource, conn->host);
+  g_hash_table_foreach(conn->headers, (GHFunc)_add_http_header, conn->http);
+  if (conn->transport == XR_CALL_XML_RPC)
+    xr_http_set_header_static(conn->http, "Content-Type", "text/xml");
+#ifdef XR_JSON_ENABLED
+  else if (conn->transport == XR_CALL_JSON_RPC)
+    xr_http_set_header_static(conn->http, "Content-Type", "text/json");
+#endif
+  else if (conn->transport == XR_CALL_MSGPACK)
+    xr_http_set_header_static(conn->http, "Content-Type", "application/x-msgpack");
+  else if (conn->transport == XR_CALL_BINARY)
+    xr_http_set_header_static(conn->http, "Content-Type", "application/x-xr-binary");
+  xr_http_set_message_length(conn->http, *length);
+}
+
+static gboolean _xr_client_send_request(xr_client_conn* conn, xr_call* call, GError** err)
 {
   char* buffer;
   int length;
-  gboolean rs;
   gboolean write_success;
-  GString* response;
-
-  xr_trace(XR_DEBUG_CLIENT_TRACE, "(conn=%p, call=%p)", conn, call);
-
-  g_return_val_if_fail(conn != NULL, FALSE);
-  g_return_val_if_fail(call != NULL, FALSE);
-  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
 
   if (!conn->is_open)
   {
@@ -250,17 +292,7 @@ gboolean xr_client_call(xr_client_conn* conn, xr_call* call, GError** err)
   }
 
   /* serialize nad send XML-RPC request */
-  xr_call_set_transport(call, conn->transport);
-  xr_call_serialize_request(call, &buffer, &length);
-  xr_http_setup_request(conn->http, "POST", conn->resource, conn->host);
-  g_hash_table_foreach(conn->headers, (GHFunc)_add_http_header, conn->http);
-  if (conn->transport == XR_CALL_XML_RPC)
-    xr_http_set_header(conn->http, "Content-Type", "text/xml");
-#ifdef XR_JSON_ENABLED
-  else if (conn->transport == XR_CALL_JSON_RPC)
-    xr_http_set_header(conn->http, "Content-Type", "text/json");
-#endif
-  xr_http_set_message_length(conn->http, length);
+  _xr_client_prepare_request(conn, call, &buffer, &length);
   write_success = xr_http_write_all(conn->http, buffer, length, err);
   xr_call_free_buffer(call, buffer);
   if (!write_success)
@@ -269,13 +301,48 @@ gboolean xr_client_call(xr_client_conn* conn, xr_call* call, GError** err)
     return FALSE;
   }
 
+  return TRUE;
+}
+
+static gboolean _xr_client_parse_response(xr_call* call, GString* response, GError** err);
+
+/* receive response to the call, @retry is set if the connection failed
+ * before any byte of the response arrived */
+static gboolean _xr_client_receive_response(xr_client_conn* conn, xr_call* call, gboolean* retry, GError** err)
+{
+  GError* local_err = NULL;
+  GString* response;
+
+  if (!conn->is_open)
+  {
+    g_set_error(err, XR_CLIENT_ERROR, XR_CLIENT_ERROR_CLOSED, "Can't perform RPC on closed connection.");
+    return FALSE;
+  }
+
   /* receive HTTP response header */
-  if (!xr_http_read_header(conn->http, err))
+  if (!xr_http_read_header(conn->http, &local_err))
+  {
+    if (local_err)
+    {
+      gsize len;
+
+      xr_http_get_buffered_input(conn->http, &len);
+      if (retry)
+        *retry = len == 0 && local_err->domain == G_IO_ERROR;
+      g_propagate_error(err, local_err);
+    }
+    else
+      g_set_error(err, XR_CLIENT_ERROR, XR_CLIENT_ERROR_CLOSED, "Connection closed by server.");
+    xr_client_close(conn);
     return FALSE;
+  }
 
   /* check if some dumb bunny sent us wrong message type */
   if (xr_http_get_message_type(conn->http) != XR_HTTP_RESPONSE)
+  {
+    xr_client_close(conn);
     return FALSE;
+  }
 
   response = xr_http_read_all(conn->http, err);
   if (response == NULL)
@@ -284,6 +351,14 @@ gboolean xr_client_call(xr_client_conn* conn, xr_call* call, GError** err)
     return FALSE;
   }
 
+  return _xr_client_parse_response(call, response, err);
+}
+
+/* unserialize response and free it */
+static gboolean _xr_client_parse_response(xr_call* call, GString* response, GError** err)
+{
+  gboolean rs;
+
   rs = xr_call_unserialize_response(call, response->str, response->len);
   g_string_free(response, TRUE);
   if (!rs)
@@ -302,6 +377,242 @@ gboolean xr_client_call(xr_client_conn* conn, xr_call* call, GError** err)
   return TRUE;
 }
 
+/* perform the call, @retry is set if the server could not have processed
+ * the request */
+static gboolean _xr_client_call(xr_client_conn* conn, xr_call* call, gboolean* retry, GError** err)
+{
+  gboolean was_open = conn->is_open;
+
+  /* request was not sent completely */
+  if (!_xr_client_send_request(conn, call, err))
+  {
+    if (retry)
+      *retry = was_open;
+    return FALSE;
+  }
+
+  return _xr_client_receive_response(conn, call, retry, err);
+}
+
+gboolean xr_client_call(xr_client_conn* conn, xr_call* call, GError** err)
+{
+  xr_trace(XR_DEBUG_CLIENT_TRACE, "(conn=%p, call=%p)", conn, call);
+
+  g_return_val_if_fail(conn != NULL, FALSE);
+  g_return_val_if_fail(call != NULL, FALSE);
+  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+  g_return_val_if_fail(g_queue_is_empty(conn->pipeline), FALSE);
+
+  return _xr_client_call(conn, call, NULL, err);
+}
+
+gboolean xr_client_call_send(xr_client_conn* conn, xr_call* call, GError** err)
+{
+  xr_trace(XR_DEBUG_CLIENT_TRACE, "(conn=%p, call=%p)", conn, call);
+
+  g_return_val_if_fail(conn != NULL, FALSE);
+  g_return_val_if_fail(call != NULL, FALSE);
+  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+  /* requests are coalesced until the first response is awaited */
+  if (conn->is_open)
+    xr_http_cork(conn->http);
+
+  if (!_xr_client_send_request(conn, call, err))
+    return FALSE;
+
+  g_queue_push_tail(conn->pipeline, call);
+  return TRUE;
+}
+
+gboolean xr_client_call_receive(xr_client_conn* conn, xr_call** call, GError** err)
+{
+  xr_trace(XR_DEBUG_CLIENT_TRACE, "(conn=%p, call=%p)", conn, call);
+
+  g_return_val_if_fail(conn != NULL, FALSE);
+  g_return_val_if_fail(call != NULL, FALSE);
+  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+  g_return_val_if_fail(!g_queue_is_empty(conn->pipeline), FALSE);
+
+  /* responses come in the order of requests */
+  *call = g_queue_pop_head(conn->pipeline);
+
+  /* last one, following xr_client_call() should not be held back */
+  if (g_queue_is_empty(conn->pipeline) && conn->is_open && !xr_http_uncork(conn->http, err))
+  {
+    xr_client_close(conn);
+    return FALSE;
+  }
+
+  return _xr_client_receive_response(conn, *call, NULL, err);
+}
+
+/* asynchronous call */
+
+struct _xr_client_async
+{
+  xr_client_conn* conn;
+  xr_call* call;
+  GCancellable* cancellable;
+  GSimpleAsyncResult* result;
+};
+
+typedef struct _xr_client_async xr_client_async;
+
+static void _xr_client_async_done(xr_client_async* op, GError* err)
+{
+  if (err)
+    g_simple_async_result_take_error(op->result, err);
+
+  g_simple_async_result_complete(op->result);
+  g_object_unref(op->result);
+  if (op->cancellable)
+    g_object_unref(op->cancellable);
+  g_free(op);
+}
+
+static void _xr_client_async_read_cb(GObject* source, GAsyncResult* res, xr_client_async* op)
+{
+  xr_client_conn* conn = op->conn;
+  GError* err = NULL;
+  GString* response;
+
+  response = xr_http_read_message_finish(conn->http, res, &err);
+  if (response == NULL)
+  {
+    xr_client_close(conn);
+    _xr_client_async_done(op, err);
+    return;
+  }
+
+  /* check if some dumb bunny sent us wrong message type */
+  if (xr_http_get_message_type(conn->http) != XR_HTTP_RESPONSE)
+  {
+    g_string_free(response, TRUE);
+    g_set_error(&err, XR_CLIENT_ERROR, XR_CLIENT_ERROR_IO, "Unexpected HTTP message.");
+    xr_client_close(conn);
+    _xr_client_async_done(op, err);
+    return;
+  }
+
+  _xr_client_parse_response(op->call, response, &err);
+  _xr_client_async_done(op, err);
+}
+
+static void _xr_client_async_write_cb(GObject* source, GAsyncResult* res, xr_client_async* op)
+{
+  xr_client_conn* conn = op->conn;
+  GError* err = NULL;
+
+  if (!xr_http_write_all_finish(conn->http, res, &err))
+  {
+    xr_client_close(conn);
+    _xr_client_async_done(op, err);
+    return;
+  }
+
+  xr_http_read_message_async(conn->http, op->cancellable, (GAsyncReadyCallback)_xr_client_async_read_cb, op);
+}
+
+void xr_client_call_async(xr_client_conn* conn, xr_call* call, GCancellable* cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+  xr_client_async* op;
+  char* buffer;
+  int length;
+
+  xr_trace(XR_DEBUG_CLIENT_TRACE, "(conn=%p, call=%p)", conn, call);
+
+  g_return_if_fail(conn != NULL);
+  g_return_if_fail(call != NULL);
+  g_return_if_fail(g_queue_is_empty(conn->pipeline));
+
+  op = g_new0(xr_client_async, 1);
+  op->conn = conn;
+  op->call = call;
+  op->cancellable = cancellable ? g_object_ref(cancellable) : NULL;
+  op->result = g_simple_async_result_new(NULL, callback, user_data, xr_client_call_async);
+  g_simple_async_result_set_op_res_gpointer(op->result, call, NULL);
+
+  if (!conn->is_open)
+  {
+    g_simple_async_result_set_error(op->result, XR_CLIENT_ERROR, XR_CLIENT_ERROR_CLOSED, "Can't perform RPC on closed connection.");
+    g_simple_async_result_complete_in_idle(op->result);
+    g_object_unref(op->result);
+    if (op->cancellable)
+      g_object_unref(op->cancellable);
+    g_free(op);
+    return;
+  }
+
+  _xr_client_prepare_request(conn, call, &buffer, &length);
+  xr_http_write_all_async(conn->http, buffer, length, cancellable, (GAsyncReadyCallback)_xr_client_async_write_cb, op);
+  xr_call_free_buffer(call, buffer);
+}
+
+gboolean xr_client_call_finish(xr_client_conn* conn, GAsyncResult* result, xr_call** call, GError** err)
+{
+  GSimpleAsyncResult* simple = G_SIMPLE_ASYNC_RESULT(result);
+
+  g_return_val_if_fail(conn != NULL, FALSE);
+  g_return_val_if_fail(g_simple_async_result_is_valid(result, NULL, xr_client_call_async), FALSE);
+  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+  /* call is NULL if the call was not started */
+  if (call)
+    *call = g_simple_async_result_get_op_res_gpointer(simple);
+
+  return !g_simple_async_result_propagate_error(simple, err);
+}
+
+gboolean xr_client_call_flush(xr_client_conn* conn, GError** err)
+{
+  xr_trace(XR_DEBUG_CLIENT_TRACE, "(conn=%p)", conn);
+
+  g_return_val_if_fail(conn != NULL, FALSE);
+  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+  if (!conn->is_open)
+  {
+    g_set_error(err, XR_CLIENT_ERROR, XR_CLIENT_ERROR_CLOSED, "Can't perform RPC on closed connection.");
+    return FALSE;
+  }
+
+  if (!xr_http_uncork(conn->http, err))
+  {
+    xr_client_close(conn);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+gboolean xr_client_call_batch(xr_client_conn* conn, xr_call** calls, int count, GError** err)
+{
+  xr_call* multicall;
+  gboolean rs;
+
+  xr_trace(XR_DEBUG_CLIENT_TRACE, "(conn=%p, calls=%p, count=%d)", conn, calls, count);
+
+  g_return_val_if_fail(conn != NULL, FALSE);
+  g_return_val_if_fail(calls != NULL || count == 0, FALSE);
+  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+  multicall = xr_call_multicall_new(calls, count);
+
+  rs = xr_client_call(conn, multicall, err);
+  if (!rs && xr_call_get_error_message(multicall) == NULL)
+    xr_call_set_error(multicall, -1, "%s", err && *err ? (*err)->message : "Multicall failed.");
+
+  if (!xr_call_multicall_get_results(multicall, calls, count) && rs)
+  {
+    g_set_error(err, 0, xr_call_get_error_code(multicall), "%s", xr_call_get_error_message(multicall));
+    rs = FALSE;
+  }
+
+  xr_call_free(multicall);
+  return rs;
+}
+
 void xr_client_free(xr_client_conn* conn)
 {
   xr_trace(XR_DEBUG_CLIENT_TRACE, "(conn=%p)", conn);
@@ -310,13 +621,294 @@ void xr_client_free(xr_client_conn* conn)
     return;
 
   xr_client_close(conn);
+  if (conn->client)
+    g_object_unref(conn->client);
   g_free(conn->host);
   g_free(conn->resource);
   g_free(conn->session_id);
+  g_free(conn->uri);
   g_hash_table_destroy(conn->headers);
+  g_queue_free(conn->pipeline);
   g_free(conn);
 }
 
+/* connection pool */
+
+static gint64 _xr_client_pool_now()
+{
+  return g_get_monotonic_time() / G_USEC_PER_SEC;
+}
+
+/* Idle connection is usable if the server did not close it. Anything
+ * readable between responses is EOF or garbage. */
+static gboolean _xr_client_conn_is_alive(xr_client_conn* conn)
+{
+  GSocket* socket;
+
+  if (!conn->is_open || !xr_http_is_ready(conn->http) || xr_http_has_pending_input(conn->http))
+    return FALSE;
+
+  socket = g_socket_connection_get_socket(conn->conn);
+  return g_socket_condition_check(socket, G_IO_IN | G_IO_HUP | G_IO_ERR) == 0;
+}
+
+static void _xr_client_endpoint_free(xr_client_endpoint* ep)
+{
+  xr_client_conn* conn;
+
+  while ((conn = g_queue_pop_head(&ep->idle)))
+    xr_client_free(conn);
+
+  g_free(ep);
+}
+
+/* unlink connections idle for too long, oldest are at the tail; they are
+ * added to @dead and closed by the caller after the pool lock is released */
+static void _xr_client_endpoint_expire(xr_client_pool* pool, xr_client_endpoint* ep, GSList** dead)
+{
+  gint64 now = _xr_client_pool_now();
+  xr_client_conn* conn;
+
+  if (pool->idle_timeout <= 0)
+    return;
+
+  while ((conn = g_queue_peek_tail(&ep->idle)) && now - conn->idle_since >= pool->idle_timeout)
+  {
+    g_queue_pop_tail(&ep->idle);
+    ep->total--;
+    *dead = g_slist_prepend(*dead, conn);
+  }
+}
+
+/* closing TLS connection may block, never do it under the pool lock */
+static void _xr_client_free_dead(GSList* dead)
+{
+  g_slist_foreach(dead, (GFunc)xr_client_free, NULL);
+  g_slist_free(dead);
+}
+
+/* take idle connection to @uri or open a new one, @fresh skips idle
+ * connections */
+static xr_client_conn* _xr_client_pool_checkout(xr_client_pool* pool, const char* uri, gboolean fresh, gboolean* reused, GError** err)
+{
+  xr_client_endpoint* ep;
+  xr_client_conn* conn;
+  GSList* dead = NULL;
+
+  g_mutex_lock(pool->lock);
+
+  ep = g_hash_table_lookup(pool->endpoints, uri);
+  if (ep == NULL)
+  {
+    ep = g_new0(xr_client_endpoint, 1);
+    g_queue_init(&ep->idle);
+    g_hash_table_insert(pool->endpoints, g_strdup(uri), ep);
+  }
+
+  while (TRUE)
+  {
+    _xr_client_endpoint_expire(pool, ep, &dead);
+
+    /* new connection takes the slot of an idle one if there is no free
+       slot */
+    if (fresh)
+    {
+      if (pool->max_total <= 0 || ep->total < pool->max_total)
+        break;
+
+      conn = g_queue_pop_head(&ep->idle);
+      if (conn)
+      {
+        ep->total--;
+        dead = g_slist_prepend(dead, conn);
+      }
+      else
+        g_cond_wait(pool->cond, pool->lock);
+      continue;
+    }
+
+    conn = g_queue_pop_head(&ep->idle);
+    if (conn)
+    {
+      if (_xr_client_conn_is_alive(conn))
+      {
+        g_mutex_unlock(pool->lock);
+        _xr_client_free_dead(dead);
+        xr_client_set_transport(conn, pool->transport);
+        *reused = TRUE;
+        return conn;
+      }
+
+      ep->total--;
+      dead = g_slist_prepend(dead, conn);
+      continue;
+    }
+
+    if (pool->max_total <= 0 || ep->total < pool->max_total)
+      break;
+
+    g_cond_wait(pool->cond, pool->lock);
+  }
+
+  /* reserve slot for the new connection */
+  ep->total++;
+  g_mutex_unlock(pool->lock);
+  _xr_client_free_dead(dead);
+
+  conn = xr_client_new(err);
+  xr_client_set_transport(conn, pool->transport);
+  if (!xr_client_open(conn, uri, err))
+  {
+    xr_client_free(conn);
+
+    g_mutex_lock(pool->lock);
+    ep->total--;
+    g_cond_signal(pool->cond);
+    g_mutex_unlock(pool->lock);
+    return NULL;
+  }
+
+  *reused = FALSE;
+  return conn;
+}
+
+xr_client_pool* xr_client_pool_new(int max_idle, int max_total, int idle_timeout)
+{
+  xr_client_pool* pool;
+
+  xr_trace(XR_DEBUG_CLIENT_TRACE, "(max_idle=%d, max_total=%d, idle_timeout=%d)", max_idle, max_total, idle_timeout);
+
+  xr_init();
+
+  pool = g_new0(xr_client_pool, 1);
+  pool->lock = g_mutex_new();
+  pool->cond = g_cond_new();
+  pool->endpoints = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_xr_client_endpoint_free);
+  pool->max_idle = max_idle;
+  pool->max_total = max_total;
+  pool->idle_timeout = idle_timeout;
+  pool->transport = XR_CALL_XML_RPC;
+
+  return pool;
+}
+
+void xr_client_pool_set_transport(xr_client_pool* pool, xr_call_transport transport)
+{
+  g_return_if_fail(pool != NULL);
+  g_return_if_fail(transport < XR_CALL_TRANSPORT_COUNT);
+
+  pool->transport = transport;
+}
+
+xr_client_conn* xr_client_pool_get(xr_client_pool* pool, const char* uri, GError** err)
+{
+  gboolean reused;
+
+  xr_trace(XR_DEBUG_CLIENT_TRACE, "(pool=%p, uri=%s)", pool, uri);
+
+  g_return_val_if_fail(pool != NULL, NULL);
+  g_return_val_if_fail(uri != NULL, NULL);
+  g_return_val_if_fail(err == NULL || *err == NULL, NULL);
+
+  return _xr_client_pool_checkout(pool, uri, FALSE, &reused, err);
+}
+
+void xr_client_pool_put(xr_client_pool* pool, xr_client_conn* conn)
+{
+  xr_client_endpoint* ep;
+  GSList* dead = NULL;
+
+  xr_trace(XR_DEBUG_CLIENT_TRACE, "(pool=%p, conn=%p)", pool, conn);
+
+  g_return_if_fail(pool != NULL);
+  g_return_if_fail(conn != NULL);
+
+  g_mutex_lock(pool->lock);
+
+  ep = conn->uri ? g_hash_table_lookup(pool->endpoints, conn->uri) : NULL;
+  if (ep == NULL)
+  {
+    g_mutex_unlock(pool->lock);
+    g_warning("Connection does not belong to the pool.");
+    xr_client_free(conn);
+    return;
+  }
+
+  /* keep only connections ready for the next call */
+  if (conn->is_open && xr_http_is_ready(conn->http) && g_queue_is_empty(conn->pipeline) && ep->idle.length < pool->max_idle)
+  {
+    conn->idle_since = _xr_client_pool_now();
+    g_queue_push_head(&ep->idle, conn);
+    conn = NULL;
+  }
+  else
+    ep->total--;
+
+  _xr_client_endpoint_expire(pool, ep, &dead);
+  g_cond_signal(pool->cond);
+  g_mutex_unlock(pool->lock);
+
+  if (conn)
+    xr_client_free(conn);
+  _xr_client_free_dead(dead);
+}
+
+gboolean xr_client_pool_call(xr_client_pool* pool, const char* uri, xr_call* call, GError** err)
+{
+  GError* local_err = NULL;
+  xr_client_conn* conn;
+  gboolean reused;
+  gboolean retry = FALSE;
+  gboolean rs;
+
+  xr_trace(XR_DEBUG_CLIENT_TRACE, "(pool=%p, uri=%s, call=%p)", pool, uri, call);
+
+  g_return_val_if_fail(pool != NULL, FALSE);
+  g_return_val_if_fail(uri != NULL, FALSE);
+  g_return_val_if_fail(call != NULL, FALSE);
+  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+  conn = _xr_client_pool_checkout(pool, uri, FALSE, &reused, err);
+  if (conn == NULL)
+    return FALSE;
+
+  rs = _xr_client_call(conn, call, &retry, &local_err);
+  xr_client_pool_put(pool, conn);
+
+  /* server closed the idle connection before it received the request or
+     without answering it, the request was not processed so it is repeated
+     once on a new connection */
+  if (!rs && reused && (retry || g_error_matches(local_err, XR_CLIENT_ERROR, XR_CLIENT_ERROR_CLOSED)))
+  {
+    g_clear_error(&local_err);
+
+    conn = _xr_client_pool_checkout(pool, uri, TRUE, &reused, err);
+    if (conn == NULL)
+      return FALSE;
+
+    rs = _xr_client_call(conn, call, NULL, &local_err);
+    xr_client_pool_put(pool, conn);
+  }
+
+  if (local_err)
+    g_propagate_error(err, local_err);
+
+  return rs;
+}
+
+void xr_client_pool_free(xr_client_pool* pool)
+{
+  xr_trace(XR_DEBUG_CLIENT_TRACE, "(pool=%p)", pool);
+
+  if (pool == NULL)
+    return;
+
+  g_hash_table_destroy(pool->endpoints);
+  g_mutex_free(pool->lock);
+  g_cond_free(pool->cond);
+  g_free(pool);
+}
+
 GQuark xr_client_error_quark()
 {
   static GQuark quark;
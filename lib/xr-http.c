@@ -32,80 +32,594 @@ enum state
   STATE_READING_BODY,    /* body should be read */
   STATE_HEADER_WRITTEN,  /* body should be written now */
   STATE_WRITING_BODY,    /* body should be written */
+  STATE_ASYNC,           /* asynchronous read or write is in progress */
   STATE_ERROR            /* fatal error, connection should be closed */
 };
 
+#define HTTP_READ_BUFFER_SIZE (8*1024)
+#define HTTP_WRITE_BUFFER_SIZE (16*1024)
+#define HTTP_CORK_LIMIT (64*1024)
+#define HTTP_MAX_HEADER_SIZE (64*1024)
+#define HTTP_MAX_HEADERS 64
+
+/* headers that are looked up on every request get fixed slots */
+enum known_header
+{
+  HDR_CONTENT_LENGTH = 0,
+  HDR_CONTENT_TYPE,
+  HDR_CONNECTION,
+  HDR_HOST,
+  HDR_AUTHORIZATION,
+  HDR_X_SESSION_ID,
+  HDR_X_SESSION_USE,
+  HDR_TRANSFER_ENCODING,
+  HDR_KNOWN_COUNT
+};
+
+static const char* known_header_names[HDR_KNOWN_COUNT] =
+{
+  "Content-Length",
+  "Content-Type",
+  "Connection",
+  "Host",
+  "Authorization",
+  "X-SESSION-ID",
+  "X-SESSION-USE",
+  "Transfer-Encoding"
+};
+
+/* header slice in the read buffer, both name and value are NUL terminated
+ * in place */
+struct header_slice
+{
+  guint32 name;
+  guint32 name_len;
+  guint32 value;
+  guint hash;
+};
+
+/* outgoing header, copy holds name and value if they are not static */
+struct out_header
+{
+  const char* name;
+  const char* value;
+  char* copy;
+};
+
 struct _xr_http
 {
-  GDataInputStream* in;
+  GInputStream* in;
   GOutputStream* out;
+  GSocket* socket;       /* plain socket for vectored writes (NULL for TLS) */
+  gboolean tls;
+
+  /* read buffer: [rbuf_pos, rbuf_len) is unconsumed input, incomming header
+   * strings point into [0, rbuf_pos) until the next xr_http_read_header() */
+  char* rbuf;
+  gsize rbuf_size;
+  gsize rbuf_pos;
+  gsize rbuf_len;
+  gsize body_start;
+  const char* in_known[HDR_KNOWN_COUNT];
+  struct header_slice in_headers[HTTP_MAX_HEADERS];
+  int in_headers_count;
 
   gsize bytes_read;
   int state;
 
   int msg_type;
-  char* req_method;
-  char* req_resource;
-  char* req_version;
+  const char* req_method;
+  const char* req_resource;
+  const char* req_version;
   int res_code;
-  char* res_reason;
-  GHashTable* headers;
+  const char* res_reason;
+  char* out_method;
+  char* out_resource;
+  GArray* out_headers;
+  int out_known[HDR_KNOWN_COUNT];   /* index into out_headers or -1 */
+  char out_content_length[24];
+  gssize out_length;
   gssize content_length;
+
+  /* chunked transfer encoding */
+  gboolean chunked_in;
+  gboolean chunk_started;
+  guint64 chunk_remaining;
+  gboolean chunked_out;
+
+  /* complete messages held back by xr_http_cork() */
+  GString* wbuf;
+  gboolean corked;
+
+  gboolean eof;          /* asynchronous read hit end of stream */
+};
+
+/* asynchronous operation */
+struct http_async
+{
+  xr_http* http;
+  GCancellable* cancellable;
+  GSimpleAsyncResult* result;
+  gsize written;
+  gboolean header_read;
+  int header_state;      /* state of the connection after the header was read */
 };
 
 /* private methods */
 
-static GRegex* regex_res = NULL;
-static GRegex* regex_req = NULL;
+static gboolean _xr_http_send_vectors(xr_http* http, GOutputVector* vectors, int count, GError** err);
+
+/* Send messages collected while corked in one write. */
+static gboolean _xr_http_flush_corked(xr_http* http, GError** err)
+{
+  GOutputVector vector;
+  gboolean rs;
+
+  if (http->wbuf == NULL || http->wbuf->len == 0)
+    return TRUE;
+
+  vector.buffer = http->wbuf->str;
+  vector.size = http->wbuf->len;
+  rs = _xr_http_send_vectors(http, &vector, 1, err);
+  g_string_truncate(http->wbuf, 0);
+
+  return rs;
+}
 
 void xr_http_init()
 {
-  if (G_UNLIKELY(regex_res == NULL))
-    regex_res = g_regex_new("^HTTP/([0-9]+\\.[0-9]+) ([0-9]+) (.+)$", 0, 0, NULL);
-  if (G_UNLIKELY(regex_req == NULL))
-    regex_req = g_regex_new("^([A-Z]+) ([^ ]+) HTTP/([0-9]+\\.[0-9]+)$", 0, 0, NULL);
 }
 
-static gboolean _xr_http_header_parse_first_line(xr_http* http, const char* line)
+static int _known_header(const char* name, gsize len)
 {
-  GMatchInfo *match_info = NULL;
+  int idx = -1;
 
-  xr_http_init();
-  
-  if (g_regex_match(regex_res, line, 0, &match_info))
+  switch (len)
   {
-    char* code;
+    case 4: idx = HDR_HOST; break;
+    case 10: idx = HDR_CONNECTION; break;
+    case 12: idx = (name[0] | 0x20) == 'x' ? HDR_X_SESSION_ID : HDR_CONTENT_TYPE; break;
+    case 13: idx = (name[0] | 0x20) == 'x' ? HDR_X_SESSION_USE : HDR_AUTHORIZATION; break;
+    case 14: idx = HDR_CONTENT_LENGTH; break;
+    case 17: idx = HDR_TRANSFER_ENCODING; break;
+    default: return -1;
+  }
 
-    code = g_match_info_fetch(match_info, 2);
-    http->res_code = atoi(code);
-    g_free(code);
-    g_free(http->res_reason);
-    http->res_reason = g_match_info_fetch(match_info, 3);
-    http->msg_type = XR_HTTP_RESPONSE;
+  return g_ascii_strcasecmp(name, known_header_names[idx]) ? -1 : idx;
+}
+
+static guint _header_hash(const char* name)
+{
+  guint h = 5381;
 
-    g_match_info_free(match_info);
+  for (; *name; name++)
+    h = h * 33 + g_ascii_tolower(*name);
+
+  return h;
+}
+
+static __inline__ gboolean _is_digit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+/* parse "1.1" style version, returns pointer after it or NULL */
+static char* _xr_http_parse_version(char* p)
+{
+  if (!_is_digit(*p))
+    return NULL;
+  while (_is_digit(*p))
+    p++;
+  if (*p++ != '.' || !_is_digit(*p))
+    return NULL;
+  while (_is_digit(*p))
+    p++;
+  return p;
+}
+
+static gboolean _xr_http_header_parse_first_line(xr_http* http, char* line)
+{
+  char* p;
+
+  if (!strncmp(line, "HTTP/", 5))
+  {
+    /* HTTP/1.1 200 OK */
+    p = _xr_http_parse_version(line + 5);
+    if (p == NULL || *p != ' ' || !_is_digit(p[1]))
+      return FALSE;
+
+    http->res_code = atoi(p + 1);
+    p++;
+    while (_is_digit(*p))
+      p++;
+    if (*p != ' ' || p[1] == '\0')
+      return FALSE;
+
+    http->res_reason = p + 1;
+    http->msg_type = XR_HTTP_RESPONSE;
     return TRUE;
   }
 
-  g_match_info_free(match_info);
-  
-  if (g_regex_match(regex_req, line, 0, &match_info))
+  /* POST /resource HTTP/1.1 */
+  for (p = line; *p >= 'A' && *p <= 'Z'; p++);
+  if (p == line || *p != ' ')
+    return FALSE;
+  *p++ = '\0';
+  http->req_method = line;
+
+  http->req_resource = p;
+  while (*p != ' ' && *p != '\0')
+    p++;
+  if (p == http->req_resource || *p != ' ' || strncmp(p + 1, "HTTP/", 5))
+    return FALSE;
+  *p = '\0';
+
+  http->req_version = p + 6;
+  p = _xr_http_parse_version(p + 6);
+  if (p == NULL || *p != '\0')
+    return FALSE;
+
+  http->msg_type = XR_HTTP_REQUEST;
+  return TRUE;
+}
+
+/* Find the end of the header block (empty line). Scanning resumes where the
+ * previous call stopped, so that each byte is examined once. Returns offset
+ * just past the empty line or 0 if more data is needed. */
+static gsize _xr_http_find_header_end(xr_http* http, gsize* scan)
+{
+  char* end = http->rbuf + http->rbuf_len;
+  char* p = http->rbuf + *scan;
+
+  while ((p = memchr(p, '\n', end - p)))
   {
-    g_free(http->req_method);
-    g_free(http->req_resource);
-    g_free(http->req_version);
-    http->req_method = g_match_info_fetch(match_info, 1);
-    http->req_resource = g_match_info_fetch(match_info, 2);
-    http->req_version = g_match_info_fetch(match_info, 3);
-    http->msg_type = XR_HTTP_REQUEST;
+    if (p + 1 < end && p[1] == '\n')
+      return p + 2 - http->rbuf;
+    if (p + 2 < end && p[1] == '\r' && p[2] == '\n')
+      return p + 3 - http->rbuf;
+    if (p + 2 >= end)
+      break;
+    p++;
+  }
 
-    g_match_info_free(match_info);
-    return TRUE;
+  *scan = (p ? p : end) - http->rbuf;
+  return 0;
+}
+
+static char* _strip(char* s, char* e)
+{
+  while (s < e && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r'))
+    e--;
+  *e = '\0';
+  return s;
+}
+
+/* Double the read buffer, strings of the incomming header are moved along
+ * with it. */
+static void _xr_http_grow_rbuf(xr_http* http)
+{
+  const char** ptrs[HDR_KNOWN_COUNT + 4];
+  gssize offsets[G_N_ELEMENTS(ptrs)];
+  guint i;
+
+  for (i = 0; i < HDR_KNOWN_COUNT; i++)
+    ptrs[i] = &http->in_known[i];
+  ptrs[i++] = &http->req_method;
+  ptrs[i++] = &http->req_resource;
+  ptrs[i++] = &http->req_version;
+  ptrs[i++] = &http->res_reason;
+
+  /* response reason may be a static string */
+  for (i = 0; i < G_N_ELEMENTS(ptrs); i++)
+    offsets[i] = *ptrs[i] >= http->rbuf && *ptrs[i] < http->rbuf + http->rbuf_len ? *ptrs[i] - http->rbuf : -1;
+
+  http->rbuf_size *= 2;
+  http->rbuf = g_realloc(http->rbuf, http->rbuf_size + 1);
+
+  for (i = 0; i < G_N_ELEMENTS(ptrs); i++)
+    if (offsets[i] >= 0)
+      *ptrs[i] = http->rbuf + offsets[i];
+}
+
+/* move unconsumed input of the next message to the start of the buffer */
+static void _xr_http_compact_rbuf(xr_http* http)
+{
+  if (http->rbuf_pos > 0)
+  {
+    memmove(http->rbuf, http->rbuf + http->rbuf_pos, http->rbuf_len - http->rbuf_pos);
+    http->rbuf_len -= http->rbuf_pos;
+    http->rbuf_pos = 0;
   }
+}
+
+static gboolean _xr_http_parse_header_block(xr_http* http, gsize start, gsize end, GError** err)
+{
+  char* line = http->rbuf + start;
+  char* block_end = http->rbuf + end;
+  char* eol;
+  gboolean first_line = TRUE;
+  struct header_slice* h;
+  int known;
 
-  g_match_info_free(match_info);
+  memset(http->in_known, 0, sizeof(http->in_known));
+  http->in_headers_count = 0;
 
-  return FALSE;
+  for (; line < block_end; line = eol + 1)
+  {
+    char* colon;
+    char* name;
+    char* value;
+
+    eol = memchr(line, '\n', block_end - line);
+    _strip(line, eol);
+
+    if (first_line)
+    {
+      if (!_xr_http_header_parse_first_line(http, line))
+      {
+        g_set_error(err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "Invalid HTTP first line.");
+        return FALSE;
+      }
+      first_line = FALSE;
+      continue;
+    }
+
+    colon = memchr(line, ':', eol - line);
+    if (colon == NULL)
+      continue;
+
+    for (name = line; name < colon && (*name == ' ' || *name == '\t'); name++);
+    value = colon + 1;
+    _strip(name, colon);
+    while (*value == ' ' || *value == '\t')
+      value++;
+
+    known = _known_header(name, strlen(name));
+    if (known >= 0)
+    {
+      http->in_known[known] = value;
+      continue;
+    }
+
+    if (http->in_headers_count == HTTP_MAX_HEADERS)
+    {
+      g_set_error(err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "Too many HTTP headers.");
+      return FALSE;
+    }
+
+    h = http->in_headers + http->in_headers_count++;
+    h->name = name - http->rbuf;
+    h->name_len = strlen(name);
+    h->value = value - http->rbuf;
+    h->hash = _header_hash(name);
+  }
+
+  return TRUE;
+}
+
+static void _xr_http_reset_out_headers(xr_http* http)
+{
+  int i;
+
+  for (i = 0; i < http->out_headers->len; i++)
+    g_free(g_array_index(http->out_headers, struct out_header, i).copy);
+
+  g_array_set_size(http->out_headers, 0);
+  memset(http->out_known, -1, sizeof(http->out_known));
+}
+
+static void _xr_http_set_out_header(xr_http* http, const char* name, const char* value, gboolean copy)
+{
+  struct out_header* h = NULL;
+  char* new_copy = NULL;
+  int known = _known_header(name, strlen(name));
+  int i;
+
+  /* find existing header to replace */
+  if (known >= 0)
+  {
+    if (http->out_known[known] >= 0)
+      h = &g_array_index(http->out_headers, struct out_header, http->out_known[known]);
+    name = known_header_names[known];
+  }
+  else
+  {
+    for (i = 0; i < http->out_headers->len; i++)
+    {
+      struct out_header* e = &g_array_index(http->out_headers, struct out_header, i);
+      if (!g_ascii_strcasecmp(e->name, name))
+      {
+        h = e;
+        break;
+      }
+    }
+  }
+
+  if (h == NULL)
+  {
+    if (known >= 0)
+      http->out_known[known] = http->out_headers->len;
+    g_array_set_size(http->out_headers, http->out_headers->len + 1);
+    h = &g_array_index(http->out_headers, struct out_header, http->out_headers->len - 1);
+  }
+
+  if (copy)
+  {
+    gsize name_len = known >= 0 ? 0 : strlen(name) + 1;
+    gsize value_len = strlen(value) + 1;
+
+    new_copy = g_malloc(name_len + value_len);
+    if (known < 0)
+    {
+      memcpy(new_copy, name, name_len);
+      name = new_copy;
+    }
+    memcpy(new_copy + name_len, value, value_len);
+    value = new_copy + name_len;
+  }
+
+  g_free(h->copy);
+  h->copy = new_copy;
+  h->name = name;
+  h->value = value;
+}
+
+/* Read more data into the buffer while reading the message body. Header
+ * strings before body_start are preserved. Returns number of bytes read, 0
+ * on EOF or -1 on error. */
+static gssize _xr_http_fill(xr_http* http, GError** err)
+{
+  gssize n;
+
+  if (http->rbuf_pos == http->rbuf_len)
+    http->rbuf_pos = http->rbuf_len = http->body_start;
+  else if (http->rbuf_len == http->rbuf_size && http->rbuf_pos > http->body_start)
+  {
+    memmove(http->rbuf + http->body_start, http->rbuf + http->rbuf_pos, http->rbuf_len - http->rbuf_pos);
+    http->rbuf_len -= http->rbuf_pos - http->body_start;
+    http->rbuf_pos = http->body_start;
+  }
+
+  if (http->rbuf_len == http->rbuf_size)
+  {
+    if (http->rbuf_size >= 2 * HTTP_MAX_HEADER_SIZE)
+    {
+      g_set_error(err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "Line is too long.");
+      return -1;
+    }
+
+    _xr_http_grow_rbuf(http);
+  }
+
+  /* peer may be waiting for our responses before it sends more */
+  if (!_xr_http_flush_corked(http, err))
+    return -1;
+
+  n = g_input_stream_read(http->in, http->rbuf + http->rbuf_len, http->rbuf_size - http->rbuf_len, NULL, err);
+  if (n > 0)
+    http->rbuf_len += n;
+
+  return n;
+}
+
+/* Read one line from the message body, returned string is valid until the
+ * next read. */
+static char* _xr_http_read_line(xr_http* http, GError** err)
+{
+  char* line;
+  char* eol;
+  gssize n;
+
+  while (!(eol = memchr(http->rbuf + http->rbuf_pos, '\n', http->rbuf_len - http->rbuf_pos)))
+  {
+    n = _xr_http_fill(http, err);
+    if (n <= 0)
+    {
+      if (n == 0)
+        g_set_error(err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "Unexpected end of stream.");
+      return NULL;
+    }
+  }
+
+  line = http->rbuf + http->rbuf_pos;
+  http->rbuf_pos = eol + 1 - http->rbuf;
+  _strip(line, eol);
+
+  return line;
+}
+
+/* Read up to length bytes of the raw message body, buffered data first. */
+static gssize _xr_http_read_body(xr_http* http, char* buffer, gsize length, GError** err)
+{
+  gsize bytes_read;
+
+  bytes_read = MIN(length, http->rbuf_len - http->rbuf_pos);
+  memcpy(buffer, http->rbuf + http->rbuf_pos, bytes_read);
+  http->rbuf_pos += bytes_read;
+
+  if (bytes_read < length)
+  {
+    gsize stream_read = 0;
+    if (!_xr_http_flush_corked(http, err))
+      return -1;
+    if (!g_input_stream_read_all(http->in, buffer + bytes_read, length - bytes_read, &stream_read, NULL, err))
+      return -1;
+    bytes_read += stream_read;
+  }
+
+  return bytes_read;
+}
+
+/* Decode chunked message body. Returns number of bytes stored to the buffer,
+ * 0 if the last chunk was read or -1 on error. */
+static gssize _xr_http_read_chunked(xr_http* http, char* buffer, gsize length, GError** err)
+{
+  gsize total = 0;
+  char* line;
+  char* end;
+
+  while (total < length)
+  {
+    gssize n, wanted;
+
+    if (http->chunk_remaining == 0)
+    {
+      /* CRLF after previous chunk data */
+      if (http->chunk_started)
+      {
+        line = _xr_http_read_line(http, err);
+        if (line == NULL)
+          return -1;
+        if (*line != '\0')
+        {
+          g_set_error(err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "Invalid chunk terminator.");
+          return -1;
+        }
+      }
+
+      line = _xr_http_read_line(http, err);
+      if (line == NULL)
+        return -1;
+
+      http->chunk_remaining = g_ascii_strtoull(line, &end, 16);
+      if (end == line)
+      {
+        g_set_error(err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "Invalid chunk size.");
+        return -1;
+      }
+
+      http->chunk_started = TRUE;
+
+      /* last chunk, skip trailer */
+      if (http->chunk_remaining == 0)
+      {
+        do
+          line = _xr_http_read_line(http, err);
+        while (line && *line);
+
+        if (line == NULL)
+          return -1;
+
+        http->chunked_in = FALSE;
+        break;
+      }
+    }
+
+    wanted = MIN(length - total, http->chunk_remaining);
+    n = _xr_http_read_body(http, buffer + total, wanted, err);
+    if (n < 0)
+      return -1;
+    if (n < wanted)
+    {
+      g_set_error(err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "Incomplete chunk.");
+      return -1;
+    }
+
+    total += n;
+    http->chunk_remaining -= n;
+  }
+
+  return total;
 }
 
 /* public methods */
@@ -115,10 +629,16 @@ xr_http* xr_http_new(GIOStream* stream)
   g_return_val_if_fail(stream != NULL, NULL);
 
   xr_http* http = g_new0(xr_http, 1);
-  http->in = g_data_input_stream_new(g_io_stream_get_input_stream(stream));
-  g_data_input_stream_set_newline_type(http->in, G_DATA_STREAM_NEWLINE_TYPE_ANY);
-  http->out = g_buffered_output_stream_new_sized(g_io_stream_get_output_stream(stream), 16*1024);
-  http->headers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  http->in = g_object_ref(g_io_stream_get_input_stream(stream));
+  http->out = g_buffered_output_stream_new_sized(g_io_stream_get_output_stream(stream), HTTP_WRITE_BUFFER_SIZE);
+  if (G_IS_SOCKET_CONNECTION(stream))
+    http->socket = g_object_ref(g_socket_connection_get_socket(G_SOCKET_CONNECTION(stream)));
+  http->out_headers = g_array_sized_new(FALSE, TRUE, sizeof(struct out_header), 16);
+  memset(http->out_known, -1, sizeof(http->out_known));
+  http->tls = G_IS_TLS_CONNECTION(stream);
+  http->out_length = -1;
+  http->rbuf_size = HTTP_READ_BUFFER_SIZE;
+  http->rbuf = g_malloc(http->rbuf_size + 1);
 
   xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
 
@@ -134,11 +654,15 @@ void xr_http_free(xr_http* http)
 
   g_object_unref(http->in);
   g_object_unref(http->out);
-  g_hash_table_destroy(http->headers);
-  g_free(http->req_method);
-  g_free(http->req_resource);
-  g_free(http->req_version);
-  g_free(http->res_reason);
+  if (http->socket)
+    g_object_unref(http->socket);
+  _xr_http_reset_out_headers(http);
+  g_array_free(http->out_headers, TRUE);
+  g_free(http->rbuf);
+  if (http->wbuf)
+    g_string_free(http->wbuf, TRUE);
+  g_free(http->out_method);
+  g_free(http->out_resource);
   memset(http, 0, sizeof(*http));
   g_free(http);
 }
@@ -146,8 +670,7 @@ void xr_http_free(xr_http* http)
 gboolean xr_http_read_header(xr_http* http, GError** err)
 {
   GError* local_err = NULL;
-  char* header;
-  gboolean first_line = TRUE;
+  gsize scan, header_end;
   const char* clen;
 
   g_return_val_if_fail(http != NULL, FALSE);
@@ -156,77 +679,97 @@ gboolean xr_http_read_header(xr_http* http, GError** err)
 
   xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
 
-  g_hash_table_remove_all(http->headers);
+  http->in_headers_count = 0;
+  http->req_method = http->req_resource = http->req_version = NULL;
+  http->res_reason = NULL;
 
-  if (xr_debug_enabled & XR_DEBUG_HTTP)
-    g_print("<<<<< HTTP RECEIVE START <<<<<\n");
+  /* previous message is gone, move unconsumed input to the start */
+  _xr_http_compact_rbuf(http);
 
-  /* read first line */
-  header = g_data_input_stream_read_line(http->in, NULL, NULL, &local_err);
-  if (local_err)
+  scan = 0;
+  while (TRUE)
   {
-    g_propagate_prefixed_error(err, local_err, "HTTP read_line failed: ");
-    goto err;
-  }
+    gssize n;
 
-  if (header == NULL)
-    return FALSE;
+    /* skip empty lines in front of the message */
+    if (scan == http->rbuf_pos)
+    {
+      while (scan < http->rbuf_len && (http->rbuf[scan] == '\r' || http->rbuf[scan] == '\n'))
+        scan++;
+      http->rbuf_pos = scan;
+    }
 
-  if (xr_debug_enabled & XR_DEBUG_HTTP)
-    g_print("%s\n", header);
+    if (scan < http->rbuf_len)
+    {
+      header_end = _xr_http_find_header_end(http, &scan);
+      if (header_end > 0)
+        break;
+    }
 
-  if (!_xr_http_header_parse_first_line(http, header))
-  {
-    g_set_error(err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "Invalid HTTP first line.");
-    goto err;
-  }
+    if (http->rbuf_len == http->rbuf_size)
+    {
+      if (http->rbuf_size >= HTTP_MAX_HEADER_SIZE)
+      {
+        g_set_error(err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "HTTP header is too large.");
+        goto err;
+      }
 
-  g_free(header);
+      _xr_http_grow_rbuf(http);
+    }
 
-  while (TRUE)
-  {
-    header = g_data_input_stream_read_line(http->in, NULL, NULL, &local_err);
-    if (local_err)
+    if (!_xr_http_flush_corked(http, &local_err))
     {
-      g_propagate_prefixed_error(err, local_err, "HTTP read_line failed: ");
+      g_propagate_prefixed_error(err, local_err, "HTTP write failed: ");
       goto err;
     }
 
-    if (xr_debug_enabled & XR_DEBUG_HTTP)
-      g_print("%s\n", header);
+    n = g_input_stream_read(http->in, http->rbuf + http->rbuf_len, http->rbuf_size - http->rbuf_len, NULL, &local_err);
+    if (local_err)
+    {
+      g_propagate_prefixed_error(err, local_err, "HTTP read failed: ");
+      goto err;
+    }
 
-    /* end of header */
-    if (!header || *header == '\0')
+    if (n == 0)
     {
-      g_free(header);
+      /* connection closed between messages */
+      if (http->rbuf_pos == http->rbuf_len)
+        return FALSE;
 
-      clen = g_hash_table_lookup(http->headers, "content-length");
-      http->content_length = clen ? atoi(clen) : -1;
+      g_set_error(err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "HTTP read failed: incomplete header.");
+      goto err;
+    }
 
-      if (http->msg_type == XR_HTTP_REQUEST && !strcmp(http->req_method, "GET"))
-      {
-        http->state = STATE_INIT;
-        if (xr_debug_enabled & XR_DEBUG_HTTP)
-          g_print(">>>>> HTTP RECEIVE END >>>>>>>\n");
-      }
-      else
-        http->state = STATE_HEADER_READ;
+    http->rbuf_len += n;
+  }
 
-      return TRUE;
-    }
+  if (xr_debug_enabled & XR_DEBUG_HTTP)
+  {
+    g_print("<<<<< HTTP RECEIVE START <<<<<\n");
+    g_print("%.*s", (int)(header_end - http->rbuf_pos), http->rbuf + http->rbuf_pos);
+  }
 
-    char* colon = strchr(header, ':');
+  if (!_xr_http_parse_header_block(http, http->rbuf_pos, header_end, err))
+    goto err;
 
-    if (colon)
-    {
-      *colon = '\0';
-      char* key = g_ascii_strdown(g_strstrip(header), -1);
-      char* value = g_strdup(g_strstrip(colon + 1));
-      g_hash_table_replace(http->headers, key, value);
-    }
+  http->rbuf_pos = http->body_start = header_end;
+
+  clen = http->in_known[HDR_CONTENT_LENGTH];
+  http->content_length = clen ? atoi(clen) : -1;
+  http->chunked_in = http->in_known[HDR_TRANSFER_ENCODING] && !g_ascii_strcasecmp(http->in_known[HDR_TRANSFER_ENCODING], "chunked");
+  if (http->chunked_in)
+    http->content_length = -1;
 
-    g_free(header);
+  if (http->msg_type == XR_HTTP_REQUEST && !strcmp(http->req_method, "GET"))
+  {
+    http->state = STATE_INIT;
+    if (xr_debug_enabled & XR_DEBUG_HTTP)
+      g_print(">>>>> HTTP RECEIVE END >>>>>>>\n");
   }
+  else
+    http->state = STATE_HEADER_READ;
+
+  return TRUE;
 
 err:
   if (xr_debug_enabled & XR_DEBUG_HTTP)
@@ -238,19 +781,31 @@ err:
 
 const char* xr_http_get_header(xr_http* http, const char* name)
 {
-  const char* value;
-  char* _name;
+  gsize name_len;
+  guint hash;
+  int i;
 
   g_return_val_if_fail(http != NULL, NULL);
   g_return_val_if_fail(name != NULL, NULL);
 
   xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
 
-  _name = g_ascii_strdown(name, -1);
-  value = g_hash_table_lookup(http->headers, _name);
-  g_free(_name);
+  name_len = strlen(name);
+  i = _known_header(name, name_len);
+  if (i >= 0)
+    return http->in_known[i];
 
-  return value;
+  hash = _header_hash(name);
+
+  /* last occurrence wins */
+  for (i = http->in_headers_count - 1; i >= 0; i--)
+  {
+    struct header_slice* h = http->in_headers + i;
+    if (h->hash == hash && h->name_len == name_len && !g_ascii_strcasecmp(http->rbuf + h->name, name))
+      return http->rbuf + h->value;
+  }
+
+  return NULL;
 }
 
 void xr_http_set_basic_auth(xr_http* http, const char* username, const char* password)
@@ -385,10 +940,23 @@ gssize xr_http_read(xr_http* http, char* buffer, gsize length, GError** err)
   {
     http->state = STATE_READING_BODY;
     http->bytes_read = 0;
+    http->chunk_started = FALSE;
+    http->chunk_remaining = 0;
+  }
+
+  if (http->chunked_in)
+  {
+    bytes_read = _xr_http_read_chunked(http, buffer, length, &local_err);
+  }
+  else
+  {
+    bytes_remaining = http->content_length - http->bytes_read;
+    if (http->content_length >= 0)
+      length = MIN(length, (gsize)bytes_remaining);
+
+    bytes_read = _xr_http_read_body(http, buffer, length, &local_err);
   }
 
-  bytes_remaining = http->content_length - http->bytes_read;
-  g_input_stream_read_all(G_INPUT_STREAM(http->in), buffer, MIN(length, bytes_remaining), &bytes_read, NULL, &local_err);
   if (local_err)
   {
     g_propagate_prefixed_error(err, local_err, "HTTP read failed: ");
@@ -401,8 +969,9 @@ gssize xr_http_read(xr_http* http, char* buffer, gsize length, GError** err)
 
   http->bytes_read += bytes_read;
 
-  /* check if we are done XXX: is this right? */
-  if ((http->content_length < 0 && bytes_read == 0) ||
+  /* check if we are done XXX: is this right? (chunked body is complete
+     when chunked_in was cleared by the last chunk) */
+  if ((http->content_length < 0 && !http->chunked_in && (bytes_read == 0 || http->chunk_started)) ||
       (http->content_length >= 0 && http->bytes_read >= http->content_length))
   {
     http->state = STATE_INIT;
@@ -413,18 +982,99 @@ gssize xr_http_read(xr_http* http, char* buffer, gsize length, GError** err)
   return bytes_read;
 }
 
-GString* xr_http_read_all(xr_http* http, GError** err)
+gboolean xr_http_has_pending_input(xr_http* http)
 {
-  GString* str;
-  gssize bytes_read;
+  g_return_val_if_fail(http != NULL, FALSE);
 
-  g_return_val_if_fail(http != NULL, NULL);
+  if (http->rbuf_len > http->rbuf_pos)
+    return TRUE;
+
+  /* TLS layer may hold already decrypted records that the socket will not
+     report as readable anymore */
+  if (!http->tls)
+    return FALSE;
+
+  if (G_IS_POLLABLE_INPUT_STREAM(http->in))
+    return g_pollable_input_stream_is_readable(G_POLLABLE_INPUT_STREAM(http->in));
+
+  return FALSE;
+}
+
+gssize xr_http_read_nonblocking(xr_http* http, GError** err)
+{
+  gssize n;
+
+  g_return_val_if_fail(http != NULL, -1);
+  g_return_val_if_fail(err == NULL || *err == NULL, -1);
+  g_return_val_if_fail(http->state == STATE_INIT, -1);
+  g_return_val_if_fail(G_IS_POLLABLE_INPUT_STREAM(http->in), -1);
+
+  xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
+
+  _xr_http_compact_rbuf(http);
+  if (http->rbuf_len == http->rbuf_size)
+    _xr_http_grow_rbuf(http);
+
+  n = g_pollable_input_stream_read_nonblocking(G_POLLABLE_INPUT_STREAM(http->in),
+    http->rbuf + http->rbuf_len, http->rbuf_size - http->rbuf_len, NULL, err);
+  if (n > 0)
+    http->rbuf_len += n;
+
+  return n;
+}
+
+const char* xr_http_get_buffered_input(xr_http* http, gsize* length)
+{
+  g_return_val_if_fail(http != NULL, NULL);
+  g_return_val_if_fail(length != NULL, NULL);
+
+  *length = http->rbuf_len - http->rbuf_pos;
+  return http->rbuf + http->rbuf_pos;
+}
+
+GString* xr_http_read_all(xr_http* http, GError** err)
+{
+  GString* str;
+  gssize bytes_read;
+
+  g_return_val_if_fail(http != NULL, NULL);
   g_return_val_if_fail(err == NULL || *err == NULL, NULL);
   g_return_val_if_fail(http->state == STATE_HEADER_READ, NULL);
-  g_return_val_if_fail(http->content_length > 0, NULL);
 
   xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
 
+  /* empty body, requests without length have no body */
+  if (http->content_length == 0 || (http->content_length < 0 && !http->chunked_in && http->msg_type == XR_HTTP_REQUEST))
+  {
+    http->state = STATE_INIT;
+    if (xr_debug_enabled & XR_DEBUG_HTTP)
+      g_print(">>>>> HTTP RECEIVE END >>>>>>>\n");
+    return g_string_new("");
+  }
+
+  /* chunked body or response body that ends with EOF */
+  if (http->content_length < 0)
+  {
+    str = g_string_sized_new(16*1024);
+
+    while (http->state != STATE_INIT)
+    {
+      gsize len = str->len;
+
+      g_string_set_size(str, len + 16*1024);
+      bytes_read = xr_http_read(http, str->str + len, 16*1024, err);
+      if (bytes_read < 0)
+      {
+        g_string_free(str, TRUE);
+        return NULL;
+      }
+
+      g_string_set_size(str, len + bytes_read);
+    }
+
+    return str;
+  }
+
   str = g_string_sized_new(http->content_length);
   g_string_set_size(str, http->content_length);
 
@@ -433,7 +1083,7 @@ GString* xr_http_read_all(xr_http* http, GError** err)
   {
     g_string_free(str, TRUE);
     http->state = STATE_ERROR;
-    if (bytes_read > 0)
+    if (bytes_read >= 0)
       g_set_error(err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "HTTP read failed: incomplete message.");
     return NULL;
   }
@@ -452,7 +1102,19 @@ void xr_http_set_header(xr_http* http, const char* name, const char* value)
 
   xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
 
-  g_hash_table_replace(http->headers, g_strdup(name), g_strdup(value));
+  _xr_http_set_out_header(http, name, value, TRUE);
+}
+
+void xr_http_set_header_static(xr_http* http, const char* name, const char* value)
+{
+  g_return_if_fail(http != NULL);
+  g_return_if_fail(name != NULL);
+  g_return_if_fail(value != NULL);
+  g_return_if_fail(http->state == STATE_INIT);
+
+  xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
+
+  _xr_http_set_out_header(http, name, value, FALSE);
 }
 
 void xr_http_set_message_type(xr_http* http, xr_http_message_type type)
@@ -473,8 +1135,9 @@ void xr_http_set_message_length(xr_http* http, gsize length)
 
   xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
 
-  http->content_length = length;
-  g_hash_table_replace(http->headers, g_strdup("Content-Length"), g_strdup_printf("%" G_GSIZE_FORMAT, length));
+  http->out_length = length;
+  g_snprintf(http->out_content_length, sizeof(http->out_content_length), "%" G_GSIZE_FORMAT, length);
+  _xr_http_set_out_header(http, "Content-Length", http->out_content_length, FALSE);
 }
 
 void xr_http_setup_request(xr_http* http, const char* method, const char* resource, const char* host)
@@ -489,14 +1152,15 @@ void xr_http_setup_request(xr_http* http, const char* method, const char* resour
 
   http->msg_type = XR_HTTP_REQUEST;
 
-  g_hash_table_remove_all(http->headers);
-  xr_http_set_header(http, "Host", host);
-  xr_http_set_header(http, "Connection", "keep-alive");
+  _xr_http_reset_out_headers(http);
+  http->out_length = -1;
+  _xr_http_set_out_header(http, "Host", host, TRUE);
+  _xr_http_set_out_header(http, "Connection", "keep-alive", FALSE);
 
-  g_free(http->req_method);
-  g_free(http->req_resource);
-  http->req_method = g_strdup(method);
-  http->req_resource = g_strdup(resource);
+  g_free(http->out_method);
+  g_free(http->out_resource);
+  http->out_method = g_strdup(method);
+  http->out_resource = g_strdup(resource);
 }
 
 void xr_http_setup_response(xr_http* http, int code)
@@ -508,83 +1172,79 @@ void xr_http_setup_response(xr_http* http, int code)
 
   http->msg_type = XR_HTTP_RESPONSE;
 
-  g_hash_table_remove_all(http->headers);
+  _xr_http_reset_out_headers(http);
+  http->out_length = -1;
   if (xr_http_get_version(http) == 1)
-    xr_http_set_header(http, "Connection", "keep-alive");
-  xr_http_set_header(http, "Content-Type", "text/xml");
+    _xr_http_set_out_header(http, "Connection", "keep-alive", FALSE);
+  _xr_http_set_out_header(http, "Content-Type", "text/xml", FALSE);
 
   http->res_code = code;
 
-  g_free(http->res_reason);
-  http->res_reason = NULL;
-
   switch (code)
   {
     // HTTP 1.1 Status Codes
-    case 100: http->res_reason = g_strdup("Continue"); break;
-    case 101: http->res_reason = g_strdup("Switching Protocols"); break;
-    case 200: http->res_reason = g_strdup("OK"); break;
-    case 201: http->res_reason = g_strdup("Created"); break;
-    case 202: http->res_reason = g_strdup("Accepted"); break;
-    case 203: http->res_reason = g_strdup("Non-Authoritative Information"); break;
-    case 204: http->res_reason = g_strdup("No Content"); break;
-    case 205: http->res_reason = g_strdup("Reset Content"); break;
-    case 206: http->res_reason = g_strdup("Partial Content"); break;
-    case 300: http->res_reason = g_strdup("Multiple Choices"); break;
-    case 301: http->res_reason = g_strdup("Moved Permanently"); break;
-    case 302: http->res_reason = g_strdup("Found"); break;
-    case 303: http->res_reason = g_strdup("See Other"); break;
-    case 304: http->res_reason = g_strdup("Not Modified"); break;
-    case 305: http->res_reason = g_strdup("Use Proxy"); break;
-    case 306: http->res_reason = g_strdup("(Unused)"); break;
-    case 307: http->res_reason = g_strdup("Temporary Redirect"); break;
-    case 400: http->res_reason = g_strdup("Bad Request"); break;
-    case 401: http->res_reason = g_strdup("Unauthorized"); break;
-    case 402: http->res_reason = g_strdup("Payment Required"); break;
-    case 403: http->res_reason = g_strdup("Forbidden"); break;
-    case 404: http->res_reason = g_strdup("Not Found"); break;
-    case 405: http->res_reason = g_strdup("Method Not Allowed"); break;
-    case 406: http->res_reason = g_strdup("Not Acceptable"); break;
-    case 407: http->res_reason = g_strdup("Proxy Authentication Required"); break;
-    case 408: http->res_reason = g_strdup("Request Timeout"); break;
-    case 409: http->res_reason = g_strdup("Conflict"); break;
-    case 410: http->res_reason = g_strdup("Gone"); break;
-    case 411: http->res_reason = g_strdup("Length Required"); break;
-    case 412: http->res_reason = g_strdup("Precondition Failed"); break;
-    case 413: http->res_reason = g_strdup("Request Entity Too Large"); break;
-    case 414: http->res_reason = g_strdup("Request-URI Too Long"); break;
-    case 415: http->res_reason = g_strdup("Unsupported Media Type"); break;
-    case 416: http->res_reason = g_strdup("Requested Range Not Satisfiable"); break;
-    case 417: http->res_reason = g_strdup("Expectation Failed"); break;
-    case 500: http->res_reason = g_strdup("Internal Server Error"); break;
-    case 501: http->res_reason = g_strdup("Not Implemented"); break;
-    case 502: http->res_reason = g_strdup("Bad Gateway"); break;
-    case 503: http->res_reason = g_strdup("Service Unavailable"); break;
-    case 504: http->res_reason = g_strdup("Gateway Timeout"); break;
-    case 505: http->res_reason = g_strdup("HTTP Version Not Supported"); break;
-    default:  http->res_reason = g_strdup("Unknown Status"); break;
-  }
-}
-
-static void add_header(const char* key, const char* value, GString* header)
-{
-  g_string_append_printf(header, "%s: %s\r\n", key, value);
+    case 100: http->res_reason = "Continue"; break;
+    case 101: http->res_reason = "Switching Protocols"; break;
+    case 200: http->res_reason = "OK"; break;
+    case 201: http->res_reason = "Created"; break;
+    case 202: http->res_reason = "Accepted"; break;
+    case 203: http->res_reason = "Non-Authoritative Information"; break;
+    case 204: http->res_reason = "No Content"; break;
+    case 205: http->res_reason = "Reset Content"; break;
+    case 206: http->res_reason = "Partial Content"; break;
+    case 300: http->res_reason = "Multiple Choices"; break;
+    case 301: http->res_reason = "Moved Permanently"; break;
+    case 302: http->res_reason = "Found"; break;
+    case 303: http->res_reason = "See Other"; break;
+    case 304: http->res_reason = "Not Modified"; break;
+    case 305: http->res_reason = "Use Proxy"; break;
+    case 306: http->res_reason = "(Unused)"; break;
+    case 307: http->res_reason = "Temporary Redirect"; break;
+    case 400: http->res_reason = "Bad Request"; break;
+    case 401: http->res_reason = "Unauthorized"; break;
+    case 402: http->res_reason = "Payment Required"; break;
+    case 403: http->res_reason = "Forbidden"; break;
+    case 404: http->res_reason = "Not Found"; break;
+    case 405: http->res_reason = "Method Not Allowed"; break;
+    case 406: http->res_reason = "Not Acceptable"; break;
+    case 407: http->res_reason = "Proxy Authentication Required"; break;
+    case 408: http->res_reason = "Request Timeout"; break;
+    case 409: http->res_reason = "Conflict"; break;
+    case 410: http->res_reason = "Gone"; break;
+    case 411: http->res_reason = "Length Required"; break;
+    case 412: http->res_reason = "Precondition Failed"; break;
+    case 413: http->res_reason = "Request Entity Too Large"; break;
+    case 414: http->res_reason = "Request-URI Too Long"; break;
+    case 415: http->res_reason = "Unsupported Media Type"; break;
+    case 416: http->res_reason = "Requested Range Not Satisfiable"; break;
+    case 417: http->res_reason = "Expectation Failed"; break;
+    case 500: http->res_reason = "Internal Server Error"; break;
+    case 501: http->res_reason = "Not Implemented"; break;
+    case 502: http->res_reason = "Bad Gateway"; break;
+    case 503: http->res_reason = "Service Unavailable"; break;
+    case 504: http->res_reason = "Gateway Timeout"; break;
+    case 505: http->res_reason = "HTTP Version Not Supported"; break;
+    default:  http->res_reason = "Unknown Status"; break;
+  }
 }
 
-gboolean xr_http_write_header(xr_http* http, GError** err)
+static GString* _xr_http_build_header(xr_http* http, GError** err)
 {
-  GError* local_err = NULL;
   GString* header;
+  int i;
 
-  g_return_val_if_fail(http != NULL, FALSE);
-  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
-  g_return_val_if_fail(http->state == STATE_INIT, FALSE);
+  /* body of unknown length is sent in chunks, if the peer understands it */
+  if (http->msg_type == XR_HTTP_REQUEST)
+    http->chunked_out = http->out_length < 0 && http->out_method && strcmp(http->out_method, "GET");
+  else
+    http->chunked_out = http->out_length < 0 && xr_http_get_version(http) == 1;
 
-  xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
+  if (http->chunked_out)
+    _xr_http_set_out_header(http, "Transfer-Encoding", "chunked", FALSE);
 
   header = g_string_sized_new(256);
   if (http->msg_type == XR_HTTP_REQUEST)
-    g_string_append_printf(header, "%s %s HTTP/1.1\r\n", http->req_method, http->req_resource);
+    g_string_append_printf(header, "%s %s HTTP/1.1\r\n", http->out_method, http->out_resource);
   else if (http->msg_type == XR_HTTP_RESPONSE)
     g_string_append_printf(header, "HTTP/1.%d %d %s\r\n", xr_http_get_version(http), http->res_code, http->res_reason);
   else
@@ -592,10 +1252,17 @@ gboolean xr_http_write_header(xr_http* http, GError** err)
     g_set_error(err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "Undefined message type: %d.", http->msg_type);
     g_string_free(header, TRUE);
     http->state = STATE_ERROR;
-    return FALSE;
+    return NULL;
   }
 
-  g_hash_table_foreach(http->headers, (GHFunc)add_header, header);
+  for (i = 0; i < http->out_headers->len; i++)
+  {
+    struct out_header* h = &g_array_index(http->out_headers, struct out_header, i);
+    g_string_append(header, h->name);
+    g_string_append_len(header, ": ", 2);
+    g_string_append(header, h->value);
+    g_string_append_len(header, "\r\n", 2);
+  }
   g_string_append(header, "\r\n");
 
   if (xr_debug_enabled & XR_DEBUG_HTTP)
@@ -604,6 +1271,90 @@ gboolean xr_http_write_header(xr_http* http, GError** err)
     g_print("%s", header->str);
   }
 
+  return header;
+}
+
+/* Send buffers at once. Plain sockets get a single sendmsg() per message,
+ * bypassing the buffered stream. Otherwise (TLS) small messages are
+ * coalesced in the buffered stream and large bodies are written directly
+ * to the underlying stream. */
+static gboolean _xr_http_send_vectors(xr_http* http, GOutputVector* vectors, int count, GError** err)
+{
+  gsize total = 0;
+  int i;
+
+  for (i = 0; i < count; i++)
+    total += vectors[i].size;
+
+  if (http->socket)
+  {
+    while (count > 0)
+    {
+      gssize n = g_socket_send_message(http->socket, NULL, vectors, count, NULL, 0, 0, NULL, err);
+      if (n < 0)
+        return FALSE;
+
+      /* skip what was sent */
+      while (count > 0 && n >= vectors->size)
+      {
+        n -= vectors->size;
+        vectors++;
+        count--;
+      }
+
+      if (count > 0)
+      {
+        vectors->buffer = (const char*)vectors->buffer + n;
+        vectors->size -= n;
+      }
+    }
+
+    return TRUE;
+  }
+
+  if (total <= HTTP_WRITE_BUFFER_SIZE)
+  {
+    for (i = 0; i < count; i++)
+      if (!g_output_stream_write_all(http->out, vectors[i].buffer, vectors[i].size, NULL, NULL, err))
+        return FALSE;
+
+    return g_output_stream_flush(http->out, NULL, err);
+  }
+
+  if (!g_output_stream_write_all(http->out, vectors[0].buffer, vectors[0].size, NULL, NULL, err) ||
+      !g_output_stream_flush(http->out, NULL, err))
+    return FALSE;
+
+  for (i = 1; i < count; i++)
+    if (!g_output_stream_write_all(g_filter_output_stream_get_base_stream(G_FILTER_OUTPUT_STREAM(http->out)), vectors[i].buffer, vectors[i].size, NULL, NULL, err))
+      return FALSE;
+
+  return TRUE;
+}
+
+gboolean xr_http_write_header(xr_http* http, GError** err)
+{
+  GError* local_err = NULL;
+  GString* header;
+
+  g_return_val_if_fail(http != NULL, FALSE);
+  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+  g_return_val_if_fail(http->state == STATE_INIT, FALSE);
+
+  xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
+
+  /* streamed message must not overtake the corked ones */
+  if (!_xr_http_flush_corked(http, &local_err))
+  {
+    g_propagate_prefixed_error(err, local_err, "HTTP write failed: ");
+    http->state = STATE_ERROR;
+    return FALSE;
+  }
+
+  header = _xr_http_build_header(http, err);
+  if (header == NULL)
+    return FALSE;
+
   if (!g_output_stream_write_all(http->out, header->str, header->len, NULL, NULL, &local_err))
   {
     g_propagate_prefixed_error(err, local_err, "HTTP write failed: ");
@@ -632,7 +1383,21 @@ gboolean xr_http_write(xr_http* http, const char* buffer, gsize length, GError**
 
   http->state = STATE_WRITING_BODY;
 
-  if (!g_output_stream_write_all(http->out, buffer, length, NULL, NULL, &local_err))
+  if (http->chunked_out)
+  {
+    char size[32];
+    int size_len = g_snprintf(size, sizeof(size), "%" G_GSIZE_MODIFIER "x\r\n", length);
+
+    if (!g_output_stream_write_all(http->out, size, size_len, NULL, NULL, &local_err) ||
+        !g_output_stream_write_all(http->out, buffer, length, NULL, NULL, &local_err) ||
+        !g_output_stream_write_all(http->out, "\r\n", 2, NULL, NULL, &local_err))
+    {
+      g_propagate_prefixed_error(err, local_err, "HTTP write failed: ");
+      http->state = STATE_ERROR;
+      return FALSE;
+    }
+  }
+  else if (!g_output_stream_write_all(http->out, buffer, length, NULL, NULL, &local_err))
   {
     g_propagate_prefixed_error(err, local_err, "HTTP write failed: ");
     http->state = STATE_ERROR;
@@ -655,6 +1420,13 @@ gboolean xr_http_write_complete(xr_http* http, GError** err)
 
   xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
 
+  if (http->chunked_out && !g_output_stream_write_all(http->out, "0\r\n\r\n", 5, NULL, NULL, &local_err))
+  {
+    g_propagate_prefixed_error(err, local_err, "HTTP write failed: ");
+    http->state = STATE_ERROR;
+    return FALSE;
+  }
+
   if (!g_output_stream_flush(http->out, NULL, &local_err))
   {
     g_propagate_prefixed_error(err, local_err, "HTTP flush failed: ");
@@ -672,6 +1444,10 @@ gboolean xr_http_write_complete(xr_http* http, GError** err)
 
 gboolean xr_http_write_all(xr_http* http, const char* buffer, gssize length, GError** err)
 {
+  GError* local_err = NULL;
+  GOutputVector vectors[2];
+  GString* header;
+
   g_return_val_if_fail(http != NULL, FALSE);
   g_return_val_if_fail(buffer != NULL, FALSE);
   g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
@@ -684,18 +1460,434 @@ gboolean xr_http_write_all(xr_http* http, const char* buffer, gssize length, GEr
 
   xr_http_set_message_length(http, length);
 
-  if (!xr_http_write_header(http, err))
+  header = _xr_http_build_header(http, err);
+  if (header == NULL)
     return FALSE;
 
-  if (!xr_http_write(http, buffer, length, err))
+  if (xr_debug_enabled & XR_DEBUG_HTTP)
+  {
+    g_print("%.*s", (int)length, buffer);
+    g_print("<<<<< HTTP SEND END <<<<<<<\n");
+  }
+
+  if (http->corked)
+  {
+    if (http->wbuf == NULL)
+      http->wbuf = g_string_sized_new(HTTP_WRITE_BUFFER_SIZE);
+    g_string_append_len(http->wbuf, header->str, header->len);
+    g_string_append_len(http->wbuf, buffer, length);
+    g_string_free(header, TRUE);
+    http->state = STATE_INIT;
+
+    if (http->wbuf->len < HTTP_CORK_LIMIT)
+      return TRUE;
+
+    if (!_xr_http_flush_corked(http, &local_err))
+    {
+      g_propagate_prefixed_error(err, local_err, "HTTP write failed: ");
+      http->state = STATE_ERROR;
+      return FALSE;
+    }
+
+    return TRUE;
+  }
+
+  vectors[0].buffer = header->str;
+  vectors[0].size = header->len;
+  vectors[1].buffer = buffer;
+  vectors[1].size = length;
+
+  if (!_xr_http_send_vectors(http, vectors, length > 0 ? 2 : 1, &local_err))
+  {
+    g_propagate_prefixed_error(err, local_err, "HTTP write failed: ");
+    http->state = STATE_ERROR;
+    g_string_free(header, TRUE);
     return FALSE;
+  }
+
+  http->state = STATE_INIT;
+
+  g_string_free(header, TRUE);
+  return TRUE;
+}
+
+void xr_http_cork(xr_http* http)
+{
+  g_return_if_fail(http != NULL);
+
+  xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
+
+  http->corked = TRUE;
+}
 
-  if (!xr_http_write_complete(http, err))
+gboolean xr_http_uncork(xr_http* http, GError** err)
+{
+  GError* local_err = NULL;
+
+  g_return_val_if_fail(http != NULL, FALSE);
+  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+  xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
+
+  http->corked = FALSE;
+
+  if (!_xr_http_flush_corked(http, &local_err))
+  {
+    g_propagate_prefixed_error(err, local_err, "HTTP write failed: ");
+    http->state = STATE_ERROR;
     return FALSE;
+  }
 
   return TRUE;
 }
 
+/* asynchronous API */
+
+/* Check if the whole header of the next message is in the read buffer, so
+ * that xr_http_read_header() will not block. */
+static gboolean _xr_http_header_buffered(xr_http* http)
+{
+  gsize scan = http->rbuf_pos;
+
+  if (http->eof)
+    return TRUE;
+
+  while (scan < http->rbuf_len && (http->rbuf[scan] == '\r' || http->rbuf[scan] == '\n'))
+    scan++;
+  if (scan == http->rbuf_len)
+    return FALSE;
+
+  return _xr_http_find_header_end(http, &scan) > 0;
+}
+
+/* Check if the body of the message, whose header was just read, is in the
+ * read buffer, so that xr_http_read_all() will not block. */
+static gboolean _xr_http_body_buffered(xr_http* http)
+{
+  char* end = http->rbuf + http->rbuf_len;
+  char* p = http->rbuf + http->rbuf_pos;
+
+  if (http->eof || xr_http_is_ready(http))
+    return TRUE;
+
+  if (http->chunked_in)
+  {
+    /* walk the chunks up to the empty line after the last one */
+    while (TRUE)
+    {
+      char* eol = memchr(p, '\n', end - p);
+      guint64 size;
+
+      if (eol == NULL)
+        return FALSE;
+
+      size = g_ascii_strtoull(p, NULL, 16);
+      p = eol + 1;
+
+      if (size == 0)
+      {
+        while ((eol = memchr(p, '\n', end - p)))
+        {
+          if (eol == p || (eol == p + 1 && *p == '\r'))
+            return TRUE;
+          p = eol + 1;
+        }
+
+        return FALSE;
+      }
+
+      if (size + 2 > (guint64)(end - p))
+        return FALSE;
+      p += size + 2;
+    }
+  }
+
+  if (http->content_length >= 0)
+    return end - p >= http->content_length;
+
+  /* requests without length have no body, response body ends with EOF */
+  return http->msg_type == XR_HTTP_REQUEST;
+}
+
+static struct http_async* _xr_http_async_new(xr_http* http, GCancellable* cancellable, GSimpleAsyncResult* result)
+{
+  struct http_async* op = g_new0(struct http_async, 1);
+
+  op->http = http;
+  op->cancellable = cancellable ? g_object_ref(cancellable) : NULL;
+  op->result = result;
+  http->state = STATE_ASYNC;
+
+  return op;
+}
+
+/* finish operation and call the callback, takes ownership of the error */
+static void _xr_http_async_done(struct http_async* op, GError* err)
+{
+  if (err)
+  {
+    op->http->state = STATE_ERROR;
+    g_simple_async_result_take_error(op->result, err);
+  }
+
+  g_simple_async_result_complete(op->result);
+  g_object_unref(op->result);
+  if (op->cancellable)
+    g_object_unref(op->cancellable);
+  g_free(op);
+}
+
+static void _xr_http_write_async_next(struct http_async* op);
+
+static void _xr_http_write_async_cb(GObject* stream, GAsyncResult* res, struct http_async* op)
+{
+  GError* err = NULL;
+  gssize n;
+
+  n = g_output_stream_write_finish(G_OUTPUT_STREAM(stream), res, &err);
+  if (n < 0)
+  {
+    g_prefix_error(&err, "HTTP write failed: ");
+    _xr_http_async_done(op, err);
+    return;
+  }
+
+  op->written += n;
+  _xr_http_write_async_next(op);
+}
+
+static void _xr_http_write_async_next(struct http_async* op)
+{
+  xr_http* http = op->http;
+  GOutputStream* out = g_filter_output_stream_get_base_stream(G_FILTER_OUTPUT_STREAM(http->out));
+
+  if (op->written == http->wbuf->len)
+  {
+    g_string_truncate(http->wbuf, 0);
+    http->state = STATE_INIT;
+    _xr_http_async_done(op, NULL);
+    return;
+  }
+
+  g_output_stream_write_async(out, http->wbuf->str + op->written, http->wbuf->len - op->written,
+    G_PRIORITY_DEFAULT, op->cancellable, (GAsyncReadyCallback)_xr_http_write_async_cb, op);
+}
+
+void xr_http_write_all_async(xr_http* http, const char* buffer, gssize length, GCancellable* cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+  GError* local_err = NULL;
+  GSimpleAsyncResult* result;
+  GString* header;
+
+  g_return_if_fail(http != NULL);
+  g_return_if_fail(buffer != NULL);
+  g_return_if_fail(http->state == STATE_INIT);
+
+  xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
+
+  result = g_simple_async_result_new(NULL, callback, user_data, xr_http_write_all_async);
+
+  if (length < 0)
+    length = strlen(buffer);
+
+  xr_http_set_message_length(http, length);
+
+  header = _xr_http_build_header(http, &local_err);
+  if (header == NULL)
+  {
+    g_simple_async_result_take_error(result, local_err);
+    g_simple_async_result_complete_in_idle(result);
+    g_object_unref(result);
+    return;
+  }
+
+  if (xr_debug_enabled & XR_DEBUG_HTTP)
+  {
+    g_print("%.*s", (int)length, buffer);
+    g_print("<<<<< HTTP SEND END <<<<<<<\n");
+  }
+
+  /* message is sent after the corked ones */
+  if (http->wbuf == NULL)
+    http->wbuf = g_string_sized_new(HTTP_WRITE_BUFFER_SIZE);
+  g_string_append_len(http->wbuf, header->str, header->len);
+  g_string_append_len(http->wbuf, buffer, length);
+  g_string_free(header, TRUE);
+
+  _xr_http_write_async_next(_xr_http_async_new(http, cancellable, result));
+}
+
+gboolean xr_http_write_all_finish(xr_http* http, GAsyncResult* result, GError** err)
+{
+  g_return_val_if_fail(http != NULL, FALSE);
+  g_return_val_if_fail(g_simple_async_result_is_valid(result, NULL, xr_http_write_all_async), FALSE);
+
+  return !g_simple_async_result_propagate_error(G_SIMPLE_ASYNC_RESULT(result), err);
+}
+
+/* result holds the body until xr_http_read_message_finish() takes it */
+static void _free_body_holder(GString** holder)
+{
+  if (*holder)
+    g_string_free(*holder, TRUE);
+  g_free(holder);
+}
+
+/* whole header is buffered, parse it */
+static void _xr_http_read_async_header(struct http_async* op)
+{
+  xr_http* http = op->http;
+  GError* err = NULL;
+
+  http->state = STATE_INIT;
+
+  if (!xr_http_read_header(http, &err))
+  {
+    if (err == NULL)
+      g_set_error(&err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "HTTP read failed: connection closed.");
+    _xr_http_async_done(op, err);
+    return;
+  }
+
+  op->header_read = TRUE;
+  op->header_state = http->state;
+}
+
+/* whole body is buffered, read it */
+static void _xr_http_read_async_body(struct http_async* op)
+{
+  xr_http* http = op->http;
+  GError* err = NULL;
+  GString* body;
+  GString** holder;
+
+  if (xr_http_is_ready(http))
+    body = g_string_new("");
+  else
+  {
+    body = xr_http_read_all(http, &err);
+    if (body == NULL)
+    {
+      if (err == NULL)
+        g_set_error(&err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "HTTP read failed: can't read message body.");
+      _xr_http_async_done(op, err);
+      return;
+    }
+  }
+
+  holder = g_new(GString*, 1);
+  *holder = body;
+  g_simple_async_result_set_op_res_gpointer(op->result, holder, (GDestroyNotify)_free_body_holder);
+  _xr_http_async_done(op, NULL);
+}
+
+static void _xr_http_read_async_next(struct http_async* op);
+
+static void _xr_http_read_async_cb(GObject* stream, GAsyncResult* res, struct http_async* op)
+{
+  GError* err = NULL;
+  gssize n;
+
+  n = g_input_stream_read_finish(G_INPUT_STREAM(stream), res, &err);
+  if (n < 0)
+  {
+    g_prefix_error(&err, "HTTP read failed: ");
+    _xr_http_async_done(op, err);
+    return;
+  }
+
+  if (n == 0)
+    op->http->eof = TRUE;
+  else
+    op->http->rbuf_len += n;
+
+  _xr_http_read_async_next(op);
+}
+
+static void _xr_http_read_async_next(struct http_async* op)
+{
+  xr_http* http = op->http;
+
+  if (!op->header_read && _xr_http_header_buffered(http))
+  {
+    _xr_http_read_async_header(op);
+    if (!op->header_read)
+      return;
+  }
+
+  if (op->header_read)
+  {
+    http->state = op->header_state;
+    if (_xr_http_body_buffered(http))
+    {
+      _xr_http_read_async_body(op);
+      return;
+    }
+  }
+
+  /* message must fit into the buffer, header is limited as in the
+   * synchronous read */
+  if (http->rbuf_len == http->rbuf_size)
+  {
+    if (!op->header_read && http->rbuf_size >= HTTP_MAX_HEADER_SIZE)
+    {
+      GError* err = NULL;
+
+      g_set_error(&err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "HTTP header is too large.");
+      _xr_http_async_done(op, err);
+      return;
+    }
+
+    _xr_http_grow_rbuf(http);
+  }
+
+  http->state = STATE_ASYNC;
+  g_input_stream_read_async(http->in, http->rbuf + http->rbuf_len, http->rbuf_size - http->rbuf_len,
+    G_PRIORITY_DEFAULT, op->cancellable, (GAsyncReadyCallback)_xr_http_read_async_cb, op);
+}
+
+void xr_http_read_message_async(xr_http* http, GCancellable* cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+  GSimpleAsyncResult* result;
+
+  g_return_if_fail(http != NULL);
+  g_return_if_fail(http->state == STATE_INIT);
+
+  xr_trace(XR_DEBUG_HTTP_TRACE, "(http=%p)", http);
+
+  result = g_simple_async_result_new(NULL, callback, user_data, xr_http_read_message_async);
+
+  /* previous message is gone, move unconsumed input to the start */
+  _xr_http_compact_rbuf(http);
+
+  _xr_http_read_async_next(_xr_http_async_new(http, cancellable, result));
+}
+
+GString* xr_http_read_message_finish(xr_http* http, GAsyncResult* result, GError** err)
+{
+  GSimpleAsyncResult* simple = G_SIMPLE_ASYNC_RESULT(result);
+  GString** holder;
+  GString* body;
+
+  g_return_val_if_fail(http != NULL, NULL);
+  g_return_val_if_fail(g_simple_async_result_is_valid(result, NULL, xr_http_read_message_async), NULL);
+
+  if (g_simple_async_result_propagate_error(simple, err))
+    return NULL;
+
+  holder = g_simple_async_result_get_op_res_gpointer(simple);
+  if (holder == NULL || *holder == NULL)
+  {
+    g_set_error(err, XR_HTTP_ERROR, XR_HTTP_ERROR_FAILED, "HTTP read failed: no message body.");
+    return NULL;
+  }
+
+  body = *holder;
+  *holder = NULL;
+
+  return body;
+}
+
 gboolean xr_http_is_ready(xr_http* http)
 {
   g_return_val_if_fail(http != NULL, FALSE);
@@ -22,6 +22,7 @@
 
 #include "xr-lib.h"
 #include "xr-http.h"
+#include "xr-base64.h"
 
 int xr_debug_enabled = 0;
 
@@ -53,6 +54,7 @@ void xr_init()
   G_LOCK(init);
 
   xr_http_init();
+  xr_base64_init(XR_BASE64_AUTO);
 
   G_UNLOCK(init);
 }
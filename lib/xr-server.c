@@ -17,27 +17,97 @@
  * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <config.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <errno.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 #include "xr-server.h"
 #include "xr-http.h"
 #include "xr-utils.h"
+#include "xr-value-priv.h"
 
 /* server */
 
+/* max. idle instances kept for reuse per servlet type */
+#define XR_SERVLET_POOL_MAX 64
+
+/* instances initialized when the pooled servlet type is registered */
+#define XR_SERVLET_POOL_PREFILL 4
+
+typedef struct _xr_servlet_type xr_servlet_type;
+struct _xr_servlet_type
+{
+  xr_servlet_def* def;
+  GMutex* lock;
+  GQueue pool;             /* idle instances (if def->reset is set) */
+  GPrivate* instance;      /* per thread instance of stateless servlet */
+  GSList* instances;       /* all stateless instances */
+};
+
+/* session table is split into shards with independent locks */
+#define XR_SESSION_SHARDS 32
+
+/* idle sessions are kept in a timer wheel with one second slots, sessions
+ * with longer TTL stay in the wheel for more rounds */
+#define XR_SESSION_WHEEL_SLOTS 64
+
+#define XR_SESSION_TTL_DEFAULT 60
+
+/* time limit for receiving the whole request by the evented server */
+#define XR_REQUEST_TIMEOUT_DEFAULT 30
+
+/* threads running multicall sub-calls of stateless servlets in parallel */
+#define XR_MULTICALL_THREADS 8
+
+typedef struct _xr_session_shard xr_session_shard;
+struct _xr_session_shard
+{
+  GMutex* lock;
+  GHashTable* sessions;    /* session ID -> xr_servlet */
+  GQueue wheel[XR_SESSION_WHEEL_SLOTS]; /* idle servlets by expiry time */
+  gint64 wheel_time;       /* last expired second */
+};
+
+typedef struct _xr_server_reactor xr_server_reactor;
+struct _xr_server_reactor
+{
+  xr_server* server;
+  int epfd;
+  GThread* thread;
+  GQueue partial;          /* connections with incomplete request, oldest first */
+};
+
 struct _xr_server
 {
   GSocketService* service;
   gboolean secure;
   GTlsCertificate *cert;
-  GSList* servlet_types;
-  GHashTable* sessions;
-  GStaticRWLock sessions_lock;
+  GSList* servlet_types;     /* xr_servlet_type */
+  GHashTable* servlet_index; /* case insensitive name -> xr_servlet_type */
+  xr_session_shard sessions[XR_SESSION_SHARDS];
   GThread* sessions_cleaner;
+  volatile gint session_ttl;
+  GThreadPool* multicall_pool;
+  volatile gint request_arena;
+  GPrivate* arena;         /* per thread xr_arena */
   GMainLoop* loop;
-  time_t current_time;
+
+  /* evented mode */
+  xr_server_reactor* reactors;
+  int reactors_count;
+  guint next_reactor;
+  GThreadPool* workers;
+  GHashTable* conns;       /* connections owned by reactors */
+  GMutex* conns_mutex;
+  volatile gint stopping;
+  volatile gint request_timeout;
 };
 
 /* servlet API */
@@ -45,21 +115,58 @@ struct _xr_server
 typedef struct _xr_server_conn xr_server_conn;
 struct _xr_server_conn
 {
+  xr_server* server;
   GSocketConnection* conn;
   GIOStream* tls_conn;
   xr_http* http;
   GPtrArray* servlets;
   gboolean running;
+  int fd;
+  xr_server_reactor* reactor;
+  xr_pending_call* pending; /* deferred call the response is waiting for */
+  const char* msgpack_ctype; /* MessagePack content type used by the client */
+  GList* partial_link;     /* link in the partial queue of the reactor */
+  gint64 request_start;    /* time the incomplete request started to arrive */
+};
+
+struct _xr_pending_call
+{
+  xr_server* server;
+  xr_server_conn* conn;
+  xr_call* call;
+  xr_servlet* servlet;     /* session servlet locked for the call */
+  GPtrArray* servlets;     /* servlets of the freed connection, released on completion */
+  GMutex* lock;
+  GCond* cond;
+  gboolean completed;      /* xr_pending_call_complete() was called */
+  gboolean detached;       /* serving thread returned, completion resumes the connection */
+  gboolean orphaned;       /* connection was freed before completion */
+  xr_arena* arena;         /* request arena taken over from the serving thread */
 };
 
 struct _xr_servlet
 {
   void* priv;
   xr_servlet_def* def;
+  xr_servlet_type* type;
   xr_call* call;
   xr_server_conn* conn;
-  time_t last_used;
-  GMutex* call_mutex; /* held during call */
+  xr_pending_call* pending; /* current call was deferred */
+
+  /* session mode, protected by the shard lock */
+  xr_session_shard* shard;
+  char* session_id;   /* key in the shard table */
+  gboolean busy;      /* call in progress */
+  GQueue waiters;     /* calls waiting for this servlet (xr_session_waiter) */
+  gint64 expires;     /* when idle, in seconds of monotonic time */
+  GList wheel_link;   /* link in the shard wheel slot, data is NULL if idle */
+};
+
+typedef struct _xr_session_waiter xr_session_waiter;
+struct _xr_session_waiter
+{
+  GCond* cond;
+  gboolean ready;     /* servlet was handed over to this call */
 };
 
 static void xr_servlet_free(xr_servlet* servlet)
@@ -68,7 +175,7 @@ static void xr_servlet_free(xr_servlet* servlet)
     return;
 
   g_free(servlet->priv);
-  g_mutex_free(servlet->call_mutex);
+  g_free(servlet->session_id);
   memset(servlet, 0, sizeof(*servlet));
   g_free(servlet);
 }
@@ -81,14 +188,14 @@ static void xr_servlet_free_fini(xr_servlet* servlet)
   xr_servlet_free(servlet);
 }
 
-static xr_servlet* xr_servlet_new(xr_servlet_def* def, xr_server_conn* conn)
+static xr_servlet* xr_servlet_new(xr_servlet_type* type, xr_server_conn* conn)
 {
   xr_servlet* s = g_new0(xr_servlet, 1);
-  if (def->size > 0)
-    s->priv = g_malloc0(def->size);
-  s->def = def;
+  if (type->def->size > 0)
+    s->priv = g_malloc0(type->def->size);
+  s->def = type->def;
+  s->type = type;
   s->conn = conn;
-  s->call_mutex = g_mutex_new();
 
   if (s->def->init && !s->def->init(s))
   {
@@ -99,20 +206,153 @@ static xr_servlet* xr_servlet_new(xr_servlet_def* def, xr_server_conn* conn)
   return s;
 }
 
-static xr_servlet* xr_server_conn_find_servlet(xr_server_conn* conn, const char* name)
+/* servlet instances are pooled if the servlet type has reset hook, stateless
+ * servlets have one instance per thread */
+
+static xr_servlet_type* _xr_servlet_type_new(xr_servlet_def* def)
+{
+  xr_servlet_type* type = g_new0(xr_servlet_type, 1);
+  int i;
+
+  type->def = def;
+  type->lock = g_mutex_new();
+  if (def->stateless)
+    type->instance = g_private_new(NULL);
+  else if (def->reset)
+  {
+    /* connections take initialized instances right away */
+    for (i = 0; i < XR_SERVLET_POOL_PREFILL; i++)
+    {
+      xr_servlet* servlet = xr_servlet_new(type, NULL);
+      if (servlet == NULL)
+        break;
+      g_queue_push_tail(&type->pool, servlet);
+    }
+  }
+
+  return type;
+}
+
+static void _xr_servlet_type_free(xr_servlet_type* type)
+{
+  xr_servlet* servlet;
+
+  while ((servlet = g_queue_pop_head(&type->pool)))
+    xr_servlet_free_fini(servlet);
+
+  g_slist_foreach(type->instances, (GFunc)xr_servlet_free_fini, NULL);
+  g_slist_free(type->instances);
+  g_mutex_free(type->lock);
+  g_free(type);
+}
+
+static xr_servlet* _xr_servlet_acquire(xr_servlet_type* type, xr_server_conn* conn)
+{
+  xr_servlet* servlet = NULL;
+
+  if (type->def->stateless)
+  {
+    servlet = g_private_get(type->instance);
+    if (servlet == NULL)
+    {
+      servlet = xr_servlet_new(type, conn);
+      if (servlet == NULL)
+        return NULL;
+
+      g_private_set(type->instance, servlet);
+      g_mutex_lock(type->lock);
+      type->instances = g_slist_prepend(type->instances, servlet);
+      g_mutex_unlock(type->lock);
+    }
+
+    servlet->conn = conn;
+    return servlet;
+  }
+
+  if (type->def->reset)
+  {
+    g_mutex_lock(type->lock);
+    servlet = g_queue_pop_head(&type->pool);
+    g_mutex_unlock(type->lock);
+
+    if (servlet)
+    {
+      servlet->conn = conn;
+      return servlet;
+    }
+  }
+
+  return xr_servlet_new(type, conn);
+}
+
+/* return instance to the pool or destroy it */
+static void _xr_servlet_release(xr_servlet* servlet)
+{
+  xr_servlet_type* type = servlet->type;
+
+  /* owned by the servlet type */
+  if (type->def->stateless)
+    return;
+
+  if (type->def->reset && type->pool.length < XR_SERVLET_POOL_MAX && type->def->reset(servlet))
+  {
+    /* pooled instance must look like a new one to the session code */
+    servlet->conn = NULL;
+    servlet->call = NULL;
+    servlet->pending = NULL;
+    g_free(servlet->session_id);
+    servlet->session_id = NULL;
+    servlet->shard = NULL;
+    servlet->busy = FALSE;
+    g_queue_init(&servlet->waiters);
+    servlet->expires = 0;
+    memset(&servlet->wheel_link, 0, sizeof(servlet->wheel_link));
+
+    g_mutex_lock(type->lock);
+    if (type->pool.length < XR_SERVLET_POOL_MAX)
+    {
+      g_queue_push_head(&type->pool, servlet);
+      servlet = NULL;
+    }
+    g_mutex_unlock(type->lock);
+  }
+
+  xr_servlet_free_fini(servlet);
+}
+
+static xr_servlet* xr_server_conn_find_servlet(xr_server_conn* conn, xr_servlet_type* type)
 {
   int i;
 
   for (i = 0; i < conn->servlets->len; i++)
   {
     xr_servlet* servlet = conn->servlets->pdata[i];
-    if (!strcmp(servlet->def->name, name))
+    if (servlet->type == type)
       return servlet;
   }
 
   return NULL;
 }
 
+/* get servlet instance of given type for the connection */
+static xr_servlet* _xr_server_conn_get_servlet(xr_server_conn* conn, xr_servlet_type* type)
+{
+  xr_servlet* servlet;
+
+  if (type->def->stateless)
+    return _xr_servlet_acquire(type, conn);
+
+  servlet = xr_server_conn_find_servlet(conn, type);
+  if (servlet == NULL)
+  {
+    servlet = _xr_servlet_acquire(type, conn);
+    if (servlet)
+      g_ptr_array_add(conn->servlets, servlet);
+  }
+
+  return servlet;
+}
+
 void* xr_servlet_get_priv(xr_servlet* servlet)
 {
   g_return_val_if_fail(servlet != NULL, NULL);
@@ -123,8 +363,10 @@ void* xr_servlet_get_priv(xr_servlet* servlet)
 xr_http* xr_servlet_get_http(xr_servlet* servlet)
 {
   g_return_val_if_fail(servlet != NULL, NULL);
-  g_return_val_if_fail(servlet->conn != NULL, NULL);
-  g_return_val_if_fail(servlet->conn->http != NULL, NULL);
+
+  /* connection was closed while a deferred call was in progress */
+  if (servlet->conn == NULL)
+    return NULL;
 
   return servlet->conn->http;
 }
@@ -132,7 +374,9 @@ xr_http* xr_servlet_get_http(xr_servlet* servlet)
 char* xr_servlet_get_client_ip(xr_servlet* servlet)
 {
   g_return_val_if_fail(servlet != NULL, NULL);
-  g_return_val_if_fail(servlet->conn != NULL, NULL);
+
+  if (servlet->conn == NULL)
+    return NULL;
 
   GSocketAddress* addr = g_socket_connection_get_remote_address(servlet->conn->conn, NULL);
   if (addr)
@@ -149,18 +393,86 @@ char* xr_servlet_get_client_ip(xr_servlet* servlet)
   return  NULL;
 }
 
-static xr_servlet_def* _find_servlet_def(xr_server* server, char* name)
+/* servlet names are case insensitive */
+static guint _servlet_name_hash(gconstpointer key)
+{
+  const char* p;
+  guint h = 5381;
+
+  for (p = key; *p; p++)
+    h = h * 33 + g_ascii_tolower(*p);
+
+  return h;
+}
+
+static gboolean _servlet_name_equal(gconstpointer a, gconstpointer b)
+{
+  return !g_ascii_strcasecmp(a, b);
+}
+
+static xr_servlet_type* _find_servlet_type(xr_server* server, const char* name)
 {
-  GSList* i;
+  return g_hash_table_lookup(server->servlet_index, name);
+}
 
-  for (i = server->servlet_types; i; i = i->next)
+/* find servlet type for the call, name is taken from the method name
+ * (Servlet.method) or from the resource; sets error on failure */
+static xr_servlet_type* _find_call_servlet_type(xr_server* server, xr_server_conn* conn, xr_call* call)
+{
+  const char* method = xr_call_get_method_full(call);
+  const char* name = xr_http_get_resource(conn->http);
+  const char* dot = method ? strchr(method, '.') : NULL;
+  xr_servlet_type* type;
+  char buf[128];
+  char* tmp;
+  gsize len;
+
+  if (dot)
   {
-    xr_servlet_def* def = i->data;
-    if (!g_ascii_strcasecmp(def->name, name))
-      return def;
+    /* copy the prefix to avoid allocation for usual names */
+    len = dot - method;
+    if (len < sizeof(buf))
+    {
+      memcpy(buf, method, len);
+      buf[len] = '\0';
+      name = buf;
+    }
+    else
+    {
+      tmp = g_strndup(method, len);
+      type = _find_servlet_type(server, tmp);
+      if (type == NULL)
+        xr_call_set_error(call, -1, "Unknown servlet %s.", tmp);
+      g_free(tmp);
+      return type;
+    }
+  }
+  else if (name == NULL)
+  {
+    xr_call_set_error(call, -1, "Undefined servlet name.");
+    return NULL;
   }
+  else
+    name++;
 
-  return NULL;
+  type = _find_servlet_type(server, name);
+  if (type == NULL)
+    xr_call_set_error(call, -1, "Unknown servlet %s.", name);
+
+  return type;
+}
+
+/* servlet of the resource reads params of the requests on its own */
+static gboolean _xr_server_direct_params(xr_server* server, xr_server_conn* conn)
+{
+  const char* name = xr_http_get_resource(conn->http);
+  xr_servlet_type* type;
+
+  if (name == NULL)
+    return FALSE;
+
+  type = _find_servlet_type(server, name + 1);
+  return type && type->def->direct_params;
 }
 
 static xr_servlet_method_def* _find_servlet_method_def(xr_servlet* servlet, const char* name)
@@ -170,6 +482,12 @@ static xr_servlet_method_def* _find_servlet_method_def(xr_servlet* servlet, cons
   g_return_val_if_fail(servlet != NULL, NULL);
   g_return_val_if_fail(servlet->def != NULL, NULL);
 
+  if (name == NULL)
+    return NULL;
+
+  if (servlet->def->method_lookup)
+    return servlet->def->method_lookup(name);
+
   for (i = 0; i < servlet->def->methods_count; i++)
     if (!strcmp(servlet->def->methods[i].name, name))
       return servlet->def->methods + i;
@@ -177,10 +495,11 @@ static xr_servlet_method_def* _find_servlet_method_def(xr_servlet* servlet, cons
   return NULL;
 }
 
-static gboolean _xr_servlet_do_call(xr_servlet* servlet, xr_call* call)
+/* returns completion handle if the method deferred the call */
+static xr_pending_call* _xr_servlet_do_call(xr_servlet* servlet, xr_call* call)
 {
   xr_servlet_method_def* method;
-  gboolean retval = FALSE;
+  xr_pending_call* pending;
 
   servlet->call = call;
 
@@ -199,7 +518,7 @@ static gboolean _xr_servlet_do_call(xr_servlet* servlet, xr_call* call)
       }
     }
 
-    retval = method->cb(servlet, call);
+    method->cb(servlet, call);
 
     if (servlet->def->post_call)
       servlet->def->post_call(servlet, call);
@@ -219,251 +538,655 @@ static gboolean _xr_servlet_do_call(xr_servlet* servlet, xr_call* call)
     xr_call_set_error(call, -1, "Method %s not found in %s servlet.", xr_call_get_method(call), servlet->def->name);
 
 out:
+  pending = servlet->pending;
+  servlet->pending = NULL;
   servlet->call = NULL;
-  return retval;
+  return pending;
 }
 
-static gboolean _maybe_remove_servlet(gpointer key, gpointer value, gpointer user_data)
-{
-  xr_servlet* servlet = value;
-  xr_server* server = user_data;
+/* sessions */
 
-  if (g_mutex_trylock(servlet->call_mutex))
-  {
-    g_mutex_unlock(servlet->call_mutex); /* this is ok, as nobody else is going to take this lock during remove */
-    gboolean remove = (servlet->last_used + 60 < server->current_time || servlet->last_used > server->current_time);
-    return remove;
-  }
+static xr_session_shard* _xr_server_session_shard(xr_server* server, const char* session_id)
+{
+  guint h = g_str_hash(session_id);
 
-  /* servlet is locked, can't remove */
-  return FALSE;
+  /* shard tables use the same hash function, so mix the bits */
+  h = (h ^ (h >> 16)) * 0x45d9f3b;
+  return server->sessions + ((h >> 16) % XR_SESSION_SHARDS);
 }
 
-static gpointer sessions_cleaner_func(xr_server* server)
+static gint64 _xr_session_now()
 {
-  while (g_socket_service_is_active(G_SOCKET_SERVICE(server->service)))
-  {
-    server->current_time = time(NULL);
-    g_static_rw_lock_writer_lock(&server->sessions_lock);
-    g_hash_table_foreach_remove(server->sessions, _maybe_remove_servlet, server);
-    g_static_rw_lock_writer_unlock(&server->sessions_lock);
+  return g_get_monotonic_time() / G_USEC_PER_SEC;
+}
 
-    g_usleep(1000000);
-  }
+static int _xr_server_session_ttl(xr_server* server, xr_servlet_def* def)
+{
+  if (def->session_ttl > 0)
+    return def->session_ttl;
 
-  return NULL;
+  return g_atomic_int_get(&server->session_ttl);
 }
 
-static gboolean _xr_server_servlet_method_call(xr_server* server, xr_server_conn* conn, xr_call* call)
+/* shard lock must be held for wheel operations */
+static void _xr_session_wheel_add(xr_servlet* servlet, int ttl)
 {
-  xr_servlet* servlet = NULL;
-  xr_servlet* cur_servlet;
-  char *servlet_name;
-
-  g_return_val_if_fail(server != NULL, FALSE);
-  g_return_val_if_fail(conn != NULL, FALSE);
-  g_return_val_if_fail(call != NULL, FALSE);
+  xr_session_shard* shard = servlet->shard;
 
-  /* session mode */
-  const char* session_id = xr_http_get_header(conn->http, "X-SESSION-ID");
-  if (session_id && xr_http_get_header(conn->http, "X-SESSION-USE"))
-  {
-    /* lookup servlet in session and try to lock it for call, if call is in
-       progress try again later (1ms) */
-again:
-    g_static_rw_lock_reader_lock(&server->sessions_lock);
-    servlet = g_hash_table_lookup(server->sessions, session_id);
-    if (servlet)
-    {
-      if (!g_mutex_trylock(servlet->call_mutex))
-      {
-        g_static_rw_lock_reader_unlock(&server->sessions_lock);
-        g_usleep(10000);
-        goto again;
-      }
-    }
-    g_static_rw_lock_reader_unlock(&server->sessions_lock);
+  /* slots up to wheel_time were already expired */
+  servlet->expires = MAX(_xr_session_now() + ttl, shard->wheel_time + 1);
+  servlet->wheel_link.data = servlet;
+  g_queue_push_tail_link(shard->wheel + servlet->expires % XR_SESSION_WHEEL_SLOTS, &servlet->wheel_link);
+}
 
-    /* if servlet does not exist */
-    if (servlet == NULL)
-    {
-      xr_servlet_def* def;
-      servlet_name = xr_call_get_servlet_name(call, xr_http_get_resource(conn->http) + 1);
-      if (servlet_name == NULL)
-      {
-        xr_call_set_error(call, -1, "Undefined servlet name.");
-        return FALSE;
-      }
+static void _xr_session_wheel_remove(xr_servlet* servlet)
+{
+  if (servlet->wheel_link.data == NULL)
+    return;
 
-      def = _find_servlet_def(server, servlet_name);
-      if (def == NULL)
-      {
-        xr_call_set_error(call, -1, "Unknown servlet %s.", servlet_name);
-        g_free(servlet_name);
-        return FALSE;
-      }
-      g_free(servlet_name);
+  g_queue_unlink(servlet->shard->wheel + servlet->expires % XR_SESSION_WHEEL_SLOTS, &servlet->wheel_link);
+  servlet->wheel_link.data = NULL;
+}
 
-      servlet = xr_servlet_new(def, conn);
-      if (servlet == NULL)
-      {
-        xr_call_set_error(call, -1, "Servlet initialization failed.");
-        return FALSE;
-      }
+/* take the servlet for a call, calls waiting for the same session are
+ * served in FIFO order; shard lock must be held */
+static void _xr_session_servlet_lock(xr_servlet* servlet)
+{
+  xr_session_waiter w;
 
-      g_static_rw_lock_writer_lock(&server->sessions_lock);
+  if (!servlet->busy)
+  {
+    /* busy servlets never expire */
+    _xr_session_wheel_remove(servlet);
+    servlet->busy = TRUE;
+    return;
+  }
 
-      /* user might have used same session ID to create servlet in other thread, check for
-         this situation */
-      cur_servlet = g_hash_table_lookup(server->sessions, session_id); 
-      if (cur_servlet)
-      {
-        xr_servlet_free_fini(servlet);
-        servlet = cur_servlet;
-      }
-      else
-      {
-        g_hash_table_replace(server->sessions, g_strdup(session_id), servlet);
-      }
+  w.cond = g_cond_new();
+  w.ready = FALSE;
+  g_queue_push_tail(&servlet->waiters, &w);
 
-      /* this will block sessions ht access until servlet call completes, if
-         servlet was found in other thread, which should be rare occurrance */
-      if (!g_mutex_trylock(servlet->call_mutex))
-      {
-        g_static_rw_lock_writer_unlock(&server->sessions_lock);
-        g_usleep(10000);
-        goto again;
-      }
+  while (!w.ready)
+    g_cond_wait(w.cond, servlet->shard->lock);
 
-      g_static_rw_lock_writer_unlock(&server->sessions_lock);
-    }
+  g_cond_free(w.cond);
+}
 
-    servlet->conn = conn;
-    servlet->last_used = time(NULL);
-    gboolean rs = _xr_servlet_do_call(servlet, call);
+/* hand the servlet over to the next waiting call, or let it expire after
+ * ttl seconds */
+static void _xr_session_servlet_unlock(xr_servlet* servlet, int ttl)
+{
+  xr_session_shard* shard = servlet->shard;
+  xr_session_waiter* w;
 
-    g_mutex_unlock(servlet->call_mutex);
+  g_mutex_lock(shard->lock);
 
-    return rs;
+  w = g_queue_pop_head(&servlet->waiters);
+  if (w)
+  {
+    w->ready = TRUE;
+    g_cond_signal(w->cond);
   }
-
-  /* persistent mode */
-
-  /* get xr_servlet object for current connection and given servlet name */
-  servlet_name = xr_call_get_servlet_name(call, xr_http_get_resource(conn->http) + 1);
-  if (servlet_name == NULL)
+  else
   {
-    xr_call_set_error(call, -1, "Undefined servlet name.");
-    return FALSE;
+    servlet->busy = FALSE;
+    _xr_session_wheel_add(servlet, ttl);
   }
 
-  servlet = xr_server_conn_find_servlet(conn, servlet_name);
-  if (servlet == NULL)
-  {
-    xr_servlet_def* def = _find_servlet_def(server, servlet_name);
-    if (def == NULL)
-    {
-      xr_call_set_error(call, -1, "Unknown servlet %s.", servlet_name);
-      g_free(servlet_name);
-      return FALSE;
-    }
+  g_mutex_unlock(shard->lock);
+}
 
-    servlet = xr_servlet_new(def, conn);
-    if (servlet == NULL)
-    {
-      xr_call_set_error(call, -1, "Servlet initialization failed.");
-      g_free(servlet_name);
-      return FALSE;
-    }
+static void _xr_server_sessions_init(xr_server* server)
+{
+  int i;
 
-    g_ptr_array_add(conn->servlets, servlet);
+  for (i = 0; i < XR_SESSION_SHARDS; i++)
+  {
+    server->sessions[i].lock = g_mutex_new();
+    /* keys are owned by the servlets */
+    server->sessions[i].sessions = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)_xr_servlet_release);
+    server->sessions[i].wheel_time = _xr_session_now();
   }
+}
 
-  g_free(servlet_name);
-  
-  return _xr_servlet_do_call(servlet, call);
+static void _xr_server_sessions_free(xr_server* server)
+{
+  int i;
+
+  for (i = 0; i < XR_SESSION_SHARDS; i++)
+  {
+    g_hash_table_destroy(server->sessions[i].sessions);
+    g_mutex_free(server->sessions[i].lock);
+  }
 }
 
-static gboolean _xr_server_serve_download(xr_server* server, xr_server_conn* conn)
+/* remove servlets that expired since the last run, returns list of
+ * removed servlets */
+static GSList* _xr_session_shard_expire(xr_session_shard* shard, gint64 now)
 {
-  guint i;
-  GSList* iter;
+  GSList* expired = NULL;
+  gint64 t;
 
-  /* for each available servlet type, check if it has download hook */
-  for (iter = server->servlet_types; iter; iter = iter->next)
+  g_mutex_lock(shard->lock);
+
+  for (t = MAX(shard->wheel_time + 1, now - XR_SESSION_WHEEL_SLOTS + 1); t <= now; t++)
   {
-    xr_servlet_def* def = iter->data;
+    GQueue* slot = shard->wheel + t % XR_SESSION_WHEEL_SLOTS;
+    GList* link = slot->head;
 
-    if (def->download)
+    while (link)
     {
-      xr_servlet* servlet = NULL;
-
-      /* check if servlet is instantiated */
-      for (i = 0; i < conn->servlets->len; i++)
-      {
-        xr_servlet* existing_servlet = g_ptr_array_index(conn->servlets, i);
-        if (existing_servlet->def == def)
-          servlet = existing_servlet;
-      }
+      xr_servlet* servlet = link->data;
+      link = link->next;
 
-      /* it's not, instantiate it now */
-      if (servlet == NULL)
-      {
-        servlet = xr_servlet_new(def, conn);
-        g_ptr_array_add(conn->servlets, servlet);
-      }
+      /* servlets due in later rounds stay */
+      if (servlet->expires > now)
+        continue;
 
-      if (def->download(servlet))
-        return xr_http_is_ready(conn->http);
+      _xr_session_wheel_remove(servlet);
+      g_hash_table_steal(shard->sessions, servlet->session_id);
+      expired = g_slist_prepend(expired, servlet);
     }
   }
 
-  xr_http_setup_response(conn->http, 501);
-  xr_http_set_header(conn->http, "Content-Type", "text/plain");
-  if (!xr_http_write_all(conn->http, "Download hook is not implemented.", -1, NULL))
-    return FALSE;
+  shard->wheel_time = now;
 
-  return TRUE;
+  g_mutex_unlock(shard->lock);
+
+  return expired;
 }
 
-static gboolean _xr_server_serve_upload(xr_server* server, xr_server_conn* conn)
+static gpointer sessions_cleaner_func(xr_server* server)
 {
-  guint i;
-  GSList* iter;
-
-  /* for each available servlet type, check if it has upload hook */
-  for (iter = server->servlet_types; iter; iter = iter->next)
+  while (g_socket_service_is_active(G_SOCKET_SERVICE(server->service)))
   {
-    xr_servlet_def* def = iter->data;
+    gint64 now = _xr_session_now();
+    int i;
 
-    if (def->upload)
+    for (i = 0; i < XR_SESSION_SHARDS; i++)
     {
-      xr_servlet* servlet = NULL;
-
-      /* check if servlet is instantiated */
-      for (i = 0; i < conn->servlets->len; i++)
-      {
-        xr_servlet* existing_servlet = g_ptr_array_index(conn->servlets, i);
-        if (existing_servlet->def == def)
-          servlet = existing_servlet;
-      }
-
-      /* it's not, instantiate it now */
-      if (servlet == NULL)
-      {
-        servlet = xr_servlet_new(def, conn);
-        g_ptr_array_add(conn->servlets, servlet);
-      }
+      GSList* expired = _xr_session_shard_expire(server->sessions + i, now);
 
-      if (def->upload(servlet))
-        return xr_http_is_ready(conn->http);
+      /* run reset/fini hooks outside of the lock */
+      g_slist_foreach(expired, (GFunc)_xr_servlet_release, NULL);
+      g_slist_free(expired);
     }
-  }
+
+    g_usleep(1000000);
+  }
+
+  return NULL;
+}
+
+/* deferred calls */
+
+xr_pending_call* xr_servlet_defer_call(xr_servlet* servlet)
+{
+  xr_pending_call* pending;
+
+  xr_trace(XR_DEBUG_SERVER_TRACE, "(servlet=%p)", servlet);
+
+  g_return_val_if_fail(servlet != NULL, NULL);
+  g_return_val_if_fail(servlet->call != NULL, NULL);
+  g_return_val_if_fail(servlet->conn != NULL, NULL);
+  /* instance serves other connections while the call is deferred */
+  g_return_val_if_fail(!servlet->def->stateless, NULL);
+
+  if (servlet->pending)
+    return servlet->pending;
+
+  pending = g_new0(xr_pending_call, 1);
+  pending->server = servlet->conn->server;
+  pending->conn = servlet->conn;
+  pending->call = servlet->call;
+  pending->lock = g_mutex_new();
+  pending->cond = g_cond_new();
+  servlet->pending = pending;
+
+  return pending;
+}
+
+xr_call* xr_pending_call_get_call(xr_pending_call* pending)
+{
+  g_return_val_if_fail(pending != NULL, NULL);
+
+  return pending->call;
+}
+
+static void _xr_pending_call_free(xr_pending_call* pending)
+{
+  g_mutex_free(pending->lock);
+  g_cond_free(pending->cond);
+  g_free(pending);
+}
+
+/* free call whose connection is gone, the servlets it used are released
+ * only now, because the servlet may have used them until completion */
+static void _xr_pending_call_free_orphaned(xr_pending_call* pending)
+{
+  xr_server* server = pending->server;
+
+  if (pending->servlet)
+    _xr_session_servlet_unlock(pending->servlet, _xr_server_session_ttl(server, pending->servlet->def));
+
+  if (pending->servlets)
+  {
+    g_ptr_array_foreach(pending->servlets, (GFunc)_xr_servlet_release, NULL);
+    g_ptr_array_free(pending->servlets, TRUE);
+  }
+
+  xr_call_free(pending->call);
+  xr_arena_free(pending->arena);
+  _xr_pending_call_free(pending);
+}
+
+void xr_pending_call_complete(xr_pending_call* pending)
+{
+  gboolean detached, orphaned;
+
+  xr_trace(XR_DEBUG_SERVER_TRACE, "(pending=%p)", pending);
+
+  g_return_if_fail(pending != NULL);
+
+  g_mutex_lock(pending->lock);
+  pending->completed = TRUE;
+  detached = pending->detached;
+  orphaned = pending->orphaned;
+  g_cond_signal(pending->cond);
+  g_mutex_unlock(pending->lock);
+
+  /* unless the serving thread is waiting, pending is now owned by us */
+  if (orphaned)
+    _xr_pending_call_free_orphaned(pending);
+#ifdef HAVE_SYS_EPOLL_H
+  else if (detached)
+  {
+    xr_server* server = pending->conn->server;
+
+    /* calls waiting for the session servlet may occupy all workers, hand
+       it over right away */
+    if (pending->servlet)
+    {
+      _xr_session_servlet_unlock(pending->servlet, _xr_server_session_ttl(server, pending->servlet->def));
+      pending->servlet = NULL;
+    }
+
+    g_thread_pool_push(server->workers, pending->conn, NULL);
+  }
+#endif
+}
+
+/* Wait for the deferred call. Unless @a block is set, returns FALSE if the
+ * call was not completed yet and the connection will be resumed by the
+ * worker once it is. */
+static gboolean _xr_server_pending_wait(xr_pending_call* pending, gboolean block)
+{
+  gboolean completed;
+
+  g_mutex_lock(pending->lock);
+  if (block)
+  {
+    while (!pending->completed)
+      g_cond_wait(pending->cond, pending->lock);
+  }
+  completed = pending->completed;
+  pending->detached = !completed;
+  g_mutex_unlock(pending->lock);
+
+  return completed;
+}
+
+/* returns completion handle if the call was deferred by the servlet */
+static xr_pending_call* _xr_server_servlet_method_call(xr_server* server, xr_server_conn* conn, xr_call* call)
+{
+  xr_servlet* servlet = NULL;
+  xr_servlet* cur_servlet;
+  xr_pending_call* pending;
+
+  g_return_val_if_fail(server != NULL, NULL);
+  g_return_val_if_fail(conn != NULL, NULL);
+  g_return_val_if_fail(call != NULL, NULL);
+
+  /* session mode */
+  const char* session_id = xr_http_get_header(conn->http, "X-SESSION-ID");
+  if (session_id && xr_http_get_header(conn->http, "X-SESSION-USE"))
+  {
+    xr_session_shard* shard = _xr_server_session_shard(server, session_id);
+    xr_servlet* unused = NULL;
+
+    /* lookup servlet in session and take it for the call, if call is in
+       progress wait in line */
+    g_mutex_lock(shard->lock);
+    servlet = g_hash_table_lookup(shard->sessions, session_id);
+    if (servlet)
+      _xr_session_servlet_lock(servlet);
+    g_mutex_unlock(shard->lock);
+
+    /* if servlet does not exist */
+    if (servlet == NULL)
+    {
+      xr_servlet_type* type = _find_call_servlet_type(server, conn, call);
+      if (type == NULL)
+        return NULL;
+
+      servlet = _xr_servlet_acquire(type, conn);
+      if (servlet == NULL)
+      {
+        xr_call_set_error(call, -1, "Servlet initialization failed.");
+        return NULL;
+      }
+
+      /* stateless servlets keep no session */
+      if (type->def->stateless)
+        return _xr_servlet_do_call(servlet, call);
+
+      g_mutex_lock(shard->lock);
+
+      /* user might have used same session ID to create servlet in other thread, check for
+         this situation */
+      cur_servlet = g_hash_table_lookup(shard->sessions, session_id);
+      if (cur_servlet)
+      {
+        unused = servlet;
+        servlet = cur_servlet;
+      }
+      else
+      {
+        servlet->shard = shard;
+        servlet->session_id = g_strdup(session_id);
+        g_hash_table_replace(shard->sessions, servlet->session_id, servlet);
+      }
+
+      _xr_session_servlet_lock(servlet);
+      g_mutex_unlock(shard->lock);
+
+      if (unused)
+        _xr_servlet_release(unused);
+    }
+
+    servlet->conn = conn;
+    pending = _xr_servlet_do_call(servlet, call);
+
+    /* deferred call keeps the servlet until it is completed */
+    if (pending)
+      pending->servlet = servlet;
+    else
+      _xr_session_servlet_unlock(servlet, _xr_server_session_ttl(server, servlet->def));
+
+    return pending;
+  }
+
+  /* persistent mode */
+
+  /* get xr_servlet object for current connection and given servlet name */
+  xr_servlet_type* type = _find_call_servlet_type(server, conn, call);
+  if (type == NULL)
+    return NULL;
+
+  servlet = _xr_server_conn_get_servlet(conn, type);
+  if (servlet == NULL)
+  {
+    xr_call_set_error(call, -1, "Servlet initialization failed.");
+    return NULL;
+  }
+
+  return _xr_servlet_do_call(servlet, call);
+}
+
+/* multicall */
+
+typedef struct _xr_multicall xr_multicall;
+struct _xr_multicall
+{
+  xr_server_conn* conn;
+  GMutex* lock;
+  GCond* cond;
+  int running;             /* sub-calls running in the pool */
+};
+
+typedef struct _xr_multicall_task xr_multicall_task;
+struct _xr_multicall_task
+{
+  xr_multicall* multicall;
+  xr_call* call;
+  xr_value* params;        /* params of the sub-call from the request */
+  xr_servlet_type* type;   /* stateless servlet type, may run in parallel */
+  gboolean done;           /* call failed before dispatch */
+};
+
+/* run sub-call and wait for it, if it was deferred */
+static void _xr_server_subcall(xr_server* server, xr_server_conn* conn, xr_servlet_type* type, xr_call* call)
+{
+  xr_pending_call* pending;
+
+  if (type)
+  {
+    xr_servlet* servlet = _xr_servlet_acquire(type, conn);
+    if (servlet == NULL)
+    {
+      xr_call_set_error(call, -1, "Servlet initialization failed.");
+      return;
+    }
+
+    pending = _xr_servlet_do_call(servlet, call);
+  }
+  else
+    pending = _xr_server_servlet_method_call(server, conn, call);
+
+  /* multicall response needs all sub-call results, deferred sub-calls are
+     waited for here and occupy the thread until they are completed */
+  if (pending)
+  {
+    _xr_server_pending_wait(pending, TRUE);
+    if (pending->servlet)
+      _xr_session_servlet_unlock(pending->servlet, _xr_server_session_ttl(server, pending->servlet->def));
+    _xr_pending_call_free(pending);
+  }
+}
+
+static void _xr_server_multicall_func(xr_multicall_task* task, xr_server* server)
+{
+  xr_multicall* multicall = task->multicall;
+
+  _xr_server_subcall(server, multicall->conn, task->type, task->call);
+
+  g_mutex_lock(multicall->lock);
+  if (--multicall->running == 0)
+    g_cond_signal(multicall->cond);
+  g_mutex_unlock(multicall->lock);
+}
+
+/* Unpack sub-calls of the system.multicall, dispatch them and store results
+ * as the return value. Calls to stateless servlets run in parallel. */
+static void _xr_server_multicall(xr_server* server, xr_server_conn* conn, xr_call* call)
+{
+  xr_value* descs = xr_call_get_param(call, 0);
+  xr_value* results;
+  xr_multicall multicall;
+  xr_multicall_task* tasks;
+  int i, count, parallel = 0;
+  guint j;
+
+  if (descs == NULL || xr_value_get_type(descs) != XRV_ARRAY)
+  {
+    xr_call_set_error(call, -1, "Invalid multicall parameters.");
+    return;
+  }
+
+  memset(&multicall, 0, sizeof(multicall));
+  multicall.conn = conn;
+  count = xr_value_array_length(descs);
+  tasks = g_new0(xr_multicall_task, count);
+
+  for (i = 0; i < count; i++)
+  {
+    xr_multicall_task* task = tasks + i;
+    xr_value* desc = xr_value_array_get(descs, i);
+    xr_value* params = NULL;
+    char* method = NULL;
+
+    task->multicall = &multicall;
+
+    if (xr_value_get_type(desc) == XRV_STRUCT)
+    {
+      params = xr_value_get_member(desc, "params");
+      xr_value_to_string(xr_value_get_member(desc, "methodName"), &method);
+    }
+
+    task->call = xr_call_new(method);
+
+    if (method == NULL || (params && xr_value_get_type(params) != XRV_ARRAY))
+    {
+      xr_call_set_error(task->call, -1, "Invalid multicall request %d.", i);
+      task->done = TRUE;
+      g_free(method);
+      continue;
+    }
+
+    g_free(method);
+    task->params = params;
+
+    if (xr_call_is_multicall(task->call))
+    {
+      xr_call_set_error(task->call, -1, "Nested multicall is not allowed.");
+      task->done = TRUE;
+      continue;
+    }
+
+    task->type = _find_call_servlet_type(server, conn, task->call);
+    if (task->type == NULL)
+      task->done = TRUE;
+    else if (task->type->def->stateless)
+      parallel++;
+    else
+      task->type = NULL;
+  }
+
+  /* request values may be allocated from the arena of this thread, that
+     can't be used from the pool threads, calls running there get copies */
+  for (i = 0; i < count; i++)
+  {
+    xr_multicall_task* task = tasks + i;
+    gboolean pooled = parallel > 1 && task->type;
+
+    if (task->done)
+      continue;
+
+    for (j = 0; task->params && j < xr_value_array_length(task->params); j++)
+    {
+      xr_value* param = xr_value_array_get(task->params, j);
+      xr_call_add_param(task->call, pooled ? xr_value_promote(param) : _xr_value_share(param));
+    }
+  }
+
+  /* stateless servlets are thread safe, run their calls in the pool while
+     the rest is called here in order */
+  if (parallel > 1)
+  {
+    multicall.lock = g_mutex_new();
+    multicall.cond = g_cond_new();
+    multicall.running = parallel;
+
+    for (i = 0; i < count; i++)
+      if (!tasks[i].done && tasks[i].type)
+        g_thread_pool_push(server->multicall_pool, tasks + i, NULL);
+  }
+
+  for (i = 0; i < count; i++)
+    if (!tasks[i].done && !(parallel > 1 && tasks[i].type))
+      _xr_server_subcall(server, conn, tasks[i].type, tasks[i].call);
+
+  if (parallel > 1)
+  {
+    g_mutex_lock(multicall.lock);
+    while (multicall.running > 0)
+      g_cond_wait(multicall.cond, multicall.lock);
+    g_mutex_unlock(multicall.lock);
+    g_mutex_free(multicall.lock);
+    g_cond_free(multicall.cond);
+  }
+
+  /* results are [value] or fault struct */
+  results = xr_value_array_new();
+  for (i = 0; i < count; i++)
+  {
+    xr_call* sub = tasks[i].call;
+    xr_value* retval = xr_call_get_retval(sub);
+
+    if (xr_call_get_error_message(sub) == NULL && retval == NULL)
+      xr_call_set_error(sub, -1, "Method %s did not return value.", xr_call_get_method_full(sub));
+
+    if (xr_call_get_error_message(sub))
+    {
+      xr_value* fault = xr_value_struct_new();
+      xr_value_struct_set_member(fault, "faultCode", xr_value_int_new(xr_call_get_error_code(sub)));
+      xr_value_struct_set_member(fault, "faultString", xr_value_string_new(xr_call_get_error_message(sub)));
+      xr_value_array_append(results, fault);
+    }
+    else
+    {
+      xr_value* result = xr_value_array_new();
+      xr_value_array_append(result, _xr_value_share(retval));
+      xr_value_array_append(results, result);
+    }
+
+    xr_call_free(sub);
+  }
+
+  xr_call_set_retval(call, results);
+  g_free(tasks);
+}
+
+static gboolean _xr_server_serve_download(xr_server* server, xr_server_conn* conn)
+{
+  GSList* iter;
+
+  /* for each available servlet type, check if it has download hook */
+  for (iter = server->servlet_types; iter; iter = iter->next)
+  {
+    xr_servlet_type* type = iter->data;
+    xr_servlet_def* def = type->def;
+
+    if (def->download)
+    {
+      xr_servlet* servlet = _xr_server_conn_get_servlet(conn, type);
+
+      if (servlet && def->download(servlet))
+        return xr_http_is_ready(conn->http);
+    }
+  }
+
+  xr_http_setup_response(conn->http, 501);
+  xr_http_set_header_static(conn->http, "Content-Type", "text/plain");
+  if (!xr_http_write_all(conn->http, "Download hook is not implemented.", -1, NULL))
+    return FALSE;
+
+  return TRUE;
+}
+
+static gboolean _xr_server_serve_upload(xr_server* server, xr_server_conn* conn)
+{
+  GSList* iter;
+
+  /* for each available servlet type, check if it has upload hook */
+  for (iter = server->servlet_types; iter; iter = iter->next)
+  {
+    xr_servlet_type* type = iter->data;
+    xr_servlet_def* def = type->def;
+
+    if (def->upload)
+    {
+      xr_servlet* servlet = _xr_server_conn_get_servlet(conn, type);
+
+      if (servlet && def->upload(servlet))
+        return xr_http_is_ready(conn->http);
+    }
+  }
 
   char buf[4096];
   while (xr_http_read(conn->http, buf, sizeof(buf), NULL) > 0);
   xr_http_setup_response(conn->http, 501);
-  xr_http_set_header(conn->http, "Content-Type", "text/plain");
+  xr_http_set_header_static(conn->http, "Content-Type", "text/plain");
   if (!xr_http_write_all(conn->http, "Upload hook is not implemented.", -1, NULL))
     return FALSE;
 
@@ -480,9 +1203,91 @@ static int _ctype_to_transport(const char* ctype)
   if (!g_ascii_strncasecmp(ctype, "text/json", 9))
     return XR_CALL_JSON_RPC;
 #endif
+  if (!g_ascii_strncasecmp(ctype, "application/x-msgpack", 21) || !g_ascii_strncasecmp(ctype, "application/msgpack", 19))
+    return XR_CALL_MSGPACK;
+  if (!g_ascii_strncasecmp(ctype, "application/x-xr-binary", 23))
+    return XR_CALL_BINARY;
   return -1;
 }
 
+/* send response to the call and free it, responses to pipelined requests
+ * are held back and sent together with the last one */
+static gboolean _xr_server_send_response(xr_server_conn* conn, xr_call* call)
+{
+  int version = xr_http_get_version(conn->http);
+  gboolean pipelined = version == 1 && xr_http_has_pending_input(conn->http);
+  char* buffer;
+  int length;
+  gboolean rs;
+
+  /* generate response data from xr_call */
+  xr_call_serialize_response(call, &buffer, &length);
+  if (xr_debug_enabled & XR_DEBUG_CALL)
+    xr_call_dump(call, 0);
+
+  /* send HTTP response */
+  xr_http_setup_response(conn->http, 200);
+  if (xr_call_get_transport(call) == XR_CALL_MSGPACK)
+    xr_http_set_header_static(conn->http, "Content-Type", conn->msgpack_ctype);
+  else if (xr_call_get_transport(call) == XR_CALL_BINARY)
+    xr_http_set_header_static(conn->http, "Content-Type", "application/x-xr-binary");
+  xr_http_set_message_length(conn->http, length);
+  xr_http_cork(conn->http);
+  rs = xr_http_write_all(conn->http, buffer, length, NULL);
+  if (rs && !pipelined)
+    rs = xr_http_uncork(conn->http, NULL);
+  xr_call_free_buffer(call, buffer);
+  xr_call_free(call);
+
+  return rs && (version == 1);
+}
+
+/* send response to the completed deferred call */
+static gboolean _xr_server_finish_pending(xr_server* server, xr_server_conn* conn)
+{
+  xr_pending_call* pending = conn->pending;
+  xr_call* call = pending->call;
+  xr_arena* arena = pending->arena;
+  xr_arena* prev = NULL;
+  gboolean rs;
+
+  conn->pending = NULL;
+  if (pending->servlet)
+    _xr_session_servlet_unlock(pending->servlet, _xr_server_session_ttl(server, pending->servlet->def));
+  _xr_pending_call_free(pending);
+
+  if (arena)
+    prev = xr_arena_bind(arena);
+
+  rs = _xr_server_send_response(conn, call);
+
+  if (arena)
+  {
+    xr_arena_bind(prev);
+    xr_arena_free(arena);
+  }
+
+  return rs;
+}
+
+/* get arena of the serving thread, if enabled */
+static xr_arena* _xr_server_request_arena(xr_server* server)
+{
+  xr_arena* arena;
+
+  if (!g_atomic_int_get(&server->request_arena))
+    return NULL;
+
+  arena = g_private_get(server->arena);
+  if (arena == NULL)
+  {
+    arena = xr_arena_new(0);
+    g_private_set(server->arena, arena);
+  }
+
+  return arena;
+}
+
 static gboolean _xr_server_serve_request(xr_server* server, xr_server_conn* conn)
 {
   const char* method;
@@ -507,27 +1312,40 @@ static gboolean _xr_server_serve_request(xr_server* server, xr_server_conn* conn
 
   version = xr_http_get_version(conn->http);
 
+  /* hooks write responses on their own, send held back responses first */
   if (!strcmp(method, "GET"))
-    return _xr_server_serve_download(server, conn) && (version == 1);
+    return xr_http_uncork(conn->http, NULL) && _xr_server_serve_download(server, conn) && (version == 1);
   else if (!strcmp(method, "POST"))
   {
-    int transport = _ctype_to_transport(xr_http_get_header(conn->http, "Content-Type"));
+    const char* ctype = xr_http_get_header(conn->http, "Content-Type");
+    int transport = _ctype_to_transport(ctype);
 
     if (transport >= 0)
     {
       xr_call* call;
       GString* request;
-      char* buffer;
-      int length;
       gboolean rs;
+      xr_arena* arena;
+      xr_arena* prev = NULL;
+
+      /* respond with the same MessagePack content type variant */
+      if (transport == XR_CALL_MSGPACK)
+        conn->msgpack_ctype = g_ascii_strncasecmp(ctype, "application/msgpack", 19) ? "application/x-msgpack" : "application/msgpack";
 
       request = xr_http_read_all(conn->http, NULL);
       if (request == NULL)
         return FALSE;
 
+      /* values of the call live until the response is sent */
+      arena = _xr_server_request_arena(server);
+      if (arena)
+        prev = xr_arena_bind(arena);
+
       /* parse request data into xr_call */
       call = xr_call_new(NULL);
       xr_call_set_transport(call, transport);
+      if (_xr_server_direct_params(server, conn))
+        xr_call_set_defer_params(call, TRUE);
 
       rs = xr_call_unserialize_request(call, request->str, request->len);
       g_string_free(request, TRUE);
@@ -535,25 +1353,44 @@ static gboolean _xr_server_serve_request(xr_server* server, xr_server_conn* conn
       /* run call */
       if (!rs)
         xr_call_set_error(call, -1, "Unserialize request failure.");
+      else if (xr_call_is_multicall(call))
+        _xr_server_multicall(server, conn, call);
       else
-        _xr_server_servlet_method_call(server, conn, call);
+        conn->pending = _xr_server_servlet_method_call(server, conn, call);
 
-      /* generate response data from xr_call */
-      xr_call_serialize_response(call, &buffer, &length);
-      if (xr_debug_enabled & XR_DEBUG_CALL)
-        xr_call_dump(call, 0);
+      /* method deferred the call, response is sent once it is completed */
+      if (conn->pending)
+      {
+        /* do not hold back earlier responses while waiting */
+        rs = xr_http_uncork(conn->http, NULL);
+        if (!rs || !_xr_server_pending_wait(conn->pending, conn->reactor == NULL))
+        {
+          /* values of the call may still be in use, arena is freed with
+             the pending call */
+          if (arena)
+          {
+            conn->pending->arena = arena;
+            g_private_set(server->arena, NULL);
+            xr_arena_bind(prev);
+          }
+          return rs;
+        }
+
+        rs = _xr_server_finish_pending(server, conn);
+      }
+      else
+        rs = _xr_server_send_response(conn, call);
 
-      /* send HTTP response */
-      xr_http_setup_response(conn->http, 200);
-      xr_http_set_message_length(conn->http, length);
-      rs = xr_http_write_all(conn->http, buffer, length, NULL);
-      xr_call_free_buffer(call, buffer);
-      xr_call_free(call);
+      if (arena)
+      {
+        xr_arena_bind(prev);
+        xr_arena_reset(arena);
+      }
 
-      return rs && (version == 1);
+      return rs;
     }
     else
-      return _xr_server_serve_upload(server, conn) && (version == 1);
+      return xr_http_uncork(conn->http, NULL) && _xr_server_serve_upload(server, conn) && (version == 1);
   }
   else
     return FALSE;
@@ -567,24 +1404,24 @@ void xr_server_stop(xr_server* server)
 
   g_return_if_fail(server != NULL);
 
+  g_atomic_int_set(&server->stopping, 1);
   g_socket_service_stop(G_SOCKET_SERVICE(server->service));
   g_main_loop_quit(server->loop);
 }
 
-gboolean _xr_server_service_run(GThreadedSocketService *service, GSocketConnection *connection, GObject *source_object, gpointer user_data)
+static xr_server_conn* _xr_server_conn_new(xr_server* server, GSocketConnection* connection)
 {
   GError* local_err = NULL;
-  xr_server* server = user_data;
   xr_server_conn* conn;
 
-  //xr_trace(XR_DEBUG_SERVER_TRACE, "(conn=%p, server=%p)", conn, server);
-
   xr_set_nodelay(g_socket_connection_get_socket(connection));
 
   // new connection accepted
   conn = g_new0(xr_server_conn, 1);
+  conn->server = server;
   conn->servlets = g_ptr_array_sized_new(3);
   conn->running = TRUE;
+  conn->fd = g_socket_get_fd(g_socket_connection_get_socket(connection));
 
   // setup TLS
   if (server->secure)
@@ -593,7 +1430,9 @@ gboolean _xr_server_service_run(GThreadedSocketService *service, GSocketConnecti
     if (local_err)
     {
       g_error_free(local_err);
-      goto out;
+      g_ptr_array_free(conn->servlets, TRUE);
+      g_free(conn);
+      return NULL;
     }
 
     //g_object_set(conn->conn, "authentication-mode", test->auth_mode, NULL);
@@ -606,26 +1445,398 @@ gboolean _xr_server_service_run(GThreadedSocketService *service, GSocketConnecti
     conn->http = xr_http_new(G_IO_STREAM(connection));
   }
 
-  conn->conn = connection;
+  conn->conn = g_object_ref(connection);
 
-  while (conn->running)
+  return conn;
+}
+
+static void _xr_server_conn_free(xr_server_conn* conn)
+{
+  /* deferred call that was not completed yet is freed on completion, it
+     keeps the servlets of the connection until then */
+  if (conn->pending)
   {
-    if (!_xr_server_serve_request(server, conn))
-      break;
+    xr_pending_call* pending = conn->pending;
+    gboolean completed;
+    int i;
+
+    for (i = 0; i < conn->servlets->len; i++)
+      ((xr_servlet*)conn->servlets->pdata[i])->conn = NULL;
+    if (pending->servlet)
+      pending->servlet->conn = NULL;
+    pending->conn = NULL;
+
+    g_mutex_lock(pending->lock);
+    completed = pending->completed;
+    if (!completed)
+    {
+      pending->servlets = conn->servlets;
+      conn->servlets = NULL;
+    }
+    pending->orphaned = TRUE;
+    g_mutex_unlock(pending->lock);
+
+    if (completed)
+      _xr_pending_call_free_orphaned(pending);
   }
 
-out:
   xr_http_free(conn->http);
   if (conn->tls_conn)
     g_object_unref(conn->tls_conn);
-  g_ptr_array_foreach(conn->servlets, (GFunc)xr_servlet_free_fini, NULL);
-  g_ptr_array_free(conn->servlets, TRUE);
+  g_object_unref(conn->conn);
+  if (conn->servlets)
+  {
+    g_ptr_array_foreach(conn->servlets, (GFunc)_xr_servlet_release, NULL);
+    g_ptr_array_free(conn->servlets, TRUE);
+  }
   memset(conn, 0, sizeof(*conn));
   g_free(conn);
+}
+
+gboolean _xr_server_service_run(GThreadedSocketService *service, GSocketConnection *connection, GObject *source_object, gpointer user_data)
+{
+  xr_server* server = user_data;
+  xr_server_conn* conn;
+
+  conn = _xr_server_conn_new(server, connection);
+  if (conn == NULL)
+    return FALSE;
+
+  while (conn->running)
+  {
+    if (!_xr_server_serve_request(server, conn))
+      break;
+  }
+
+  _xr_server_conn_free(conn);
 
   return FALSE;
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+
+/* evented mode: reactor threads wait for readable connections and push
+ * connections with a complete request to the worker pool */
+
+/* requests are buffered by the reactor up to this size, the rest of larger
+ * requests is read by the worker */
+#define REACTOR_BUFFER_SIZE (4*1024*1024)
+#define REACTOR_MAX_HEADER_SIZE (64*1024)
+
+/* Find value of the header @name (lowercase, with colon) in the header block
+ * [buf, end). Returns NULL if the header is not present. */
+static const char* _xr_server_find_header(const char* buf, const char* end, const char* name)
+{
+  const char* p;
+  gsize name_len = strlen(name);
+
+  for (p = buf; p < end; p++)
+  {
+    if (*p == '\n' && (gsize)(end - p) > name_len && !g_ascii_strncasecmp(p + 1, name, name_len))
+    {
+      p += name_len + 1;
+      while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+      return p;
+    }
+  }
+
+  return NULL;
+}
+
+/* Check if the whole chunked body starting at @p is present in the buffer,
+ * including the last chunk and the (possibly empty) trailer. Malformed
+ * chunk size lines are reported as complete so that the worker reads the
+ * request and fails on it. */
+static gboolean _xr_server_chunked_complete(const char* p, const char* end)
+{
+  while (TRUE)
+  {
+    const char* eol;
+    guint64 size = 0;
+    int digits = 0;
+
+    eol = g_strstr_len(p, end - p, "\r\n");
+    if (eol == NULL)
+      return FALSE;
+
+    for (; p < eol && g_ascii_isxdigit(*p); p++, digits++)
+    {
+      if (digits >= 15)
+        return TRUE;
+      size = size * 16 + g_ascii_xdigit_value(*p);
+    }
+    if (digits == 0 || (p < eol && *p != ';' && *p != ' ' && *p != '\t'))
+      return TRUE;
+
+    p = eol + 2;
+
+    if (size == 0)
+    {
+      /* empty trailer, or trailer headers terminated by an empty line */
+      if (end - p >= 2 && p[0] == '\r' && p[1] == '\n')
+        return TRUE;
+      return g_strstr_len(p, end - p, "\r\n\r\n") != NULL;
+    }
+
+    if ((guint64)(end - p) < size + 2)
+      return FALSE;
+    p += size + 2;
+  }
+}
+
+/* Check if the whole request (header and Content-Length worth of body, or
+ * all chunks of a chunked body) is present in the buffer. Returns TRUE also
+ * if the request is too large to be buffered, the worker reads the rest or
+ * rejects the request. */
+static gboolean _xr_server_request_complete(const char* buf, gssize len)
+{
+  const char* end;
+  const char* value;
+  gssize header_len;
+
+  if (len >= REACTOR_BUFFER_SIZE)
+    return TRUE;
+
+  end = g_strstr_len(buf, len, "\r\n\r\n");
+  if (end == NULL)
+    return len >= REACTOR_MAX_HEADER_SIZE;
+
+  header_len = end - buf + 4;
+
+  value = _xr_server_find_header(buf, end, "transfer-encoding:");
+  if (value && end - value >= 7 && !g_ascii_strncasecmp(value, "chunked", 7))
+    return _xr_server_chunked_complete(buf + header_len, buf + len);
+
+  value = _xr_server_find_header(buf, end, "content-length:");
+  if (value)
+    return len >= header_len + atoi(value);
+
+  return TRUE;
+}
+
+/* get buffered input of the next request without leading empty lines */
+static const char* _xr_server_conn_buffered(xr_server_conn* conn, gsize* len)
+{
+  const char* buf = xr_http_get_buffered_input(conn->http, len);
+
+  while (*len > 0 && (*buf == '\r' || *buf == '\n'))
+  {
+    buf++;
+    (*len)--;
+  }
+
+  return buf;
+}
+
+/* Read input available on the plaintext connection into its read buffer.
+ * Returns TRUE if the worker should take over, because the request is
+ * complete or too large, or the connection failed. */
+static gboolean _xr_server_conn_buffer(xr_server_conn* conn)
+{
+  GError* err = NULL;
+  const char* buf;
+  gsize len;
+  gssize n;
+
+  while (TRUE)
+  {
+    buf = _xr_server_conn_buffered(conn, &len);
+    if (_xr_server_request_complete(buf, len))
+      return TRUE;
+
+    n = xr_http_read_nonblocking(conn->http, &err);
+    if (n <= 0)
+    {
+      gboolean would_block = n < 0 && g_error_matches(err, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
+
+      g_clear_error(&err);
+      return !would_block;
+    }
+  }
+}
+
+/* check if the worker can serve the next request without waiting */
+static gboolean _xr_server_conn_has_request(xr_server_conn* conn)
+{
+  const char* buf;
+  gsize len;
+
+  /* TLS records are read and decrypted by the worker */
+  if (conn->tls_conn)
+    return xr_http_has_pending_input(conn->http);
+
+  buf = _xr_server_conn_buffered(conn, &len);
+  return _xr_server_request_complete(buf, len);
+}
+
+static gboolean _xr_server_conn_arm(xr_server_conn* conn, int op)
+{
+  struct epoll_event ev;
+  gsize len = 0;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+  ev.data.ptr = conn;
+
+  /* worker left part of the next request in the buffer, the socket is
+     writable so the reactor picks the connection up right away and starts
+     timing the request */
+  if (!conn->tls_conn && op == EPOLL_CTL_MOD && conn->partial_link == NULL)
+  {
+    _xr_server_conn_buffered(conn, &len);
+    if (len > 0)
+      ev.events |= EPOLLOUT;
+  }
+
+  return epoll_ctl(conn->reactor->epfd, op, conn->fd, &ev) == 0;
+}
+
+static void _xr_server_conn_close(xr_server* server, xr_server_conn* conn)
+{
+  epoll_ctl(conn->reactor->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+
+  g_mutex_lock(server->conns_mutex);
+  g_hash_table_remove(server->conns, conn);
+  g_mutex_unlock(server->conns_mutex);
+
+  _xr_server_conn_free(conn);
+}
+
+static void _xr_server_worker_func(xr_server_conn* conn, xr_server* server)
+{
+  xr_trace(XR_DEBUG_SERVER_TRACE, "(conn=%p, server=%p)", conn, server);
+
+  /* send response to the completed deferred call */
+  if (conn->pending)
+  {
+    if (g_atomic_int_get(&server->stopping) || !_xr_server_finish_pending(server, conn))
+    {
+      _xr_server_conn_close(server, conn);
+      return;
+    }
+  }
+
+  /* serve requests while they are buffered in userspace, the kernel will
+     report the rest once the connection is re-armed */
+  do
+  {
+    if (g_atomic_int_get(&server->stopping) || !_xr_server_serve_request(server, conn))
+    {
+      _xr_server_conn_close(server, conn);
+      return;
+    }
+
+    /* connection is resumed when the deferred call is completed */
+    if (conn->pending)
+      return;
+  }
+  while (_xr_server_conn_has_request(conn));
+
+  /* responses held back for the incomplete request that follows must be
+     sent before waiting for it */
+  if (!xr_http_uncork(conn->http, NULL) || !_xr_server_conn_arm(conn, EPOLL_CTL_MOD))
+    _xr_server_conn_close(server, conn);
+}
+
+/* stop timing the request of the connection */
+static void _xr_server_reactor_untrack(xr_server_reactor* reactor, xr_server_conn* conn)
+{
+  if (conn->partial_link)
+  {
+    g_queue_delete_link(&reactor->partial, conn->partial_link);
+    conn->partial_link = NULL;
+  }
+}
+
+/* close connections that did not send the whole request in time, they are
+ * owned by the reactor while they wait for input */
+static void _xr_server_reactor_expire(xr_server_reactor* reactor, gint64 now)
+{
+  xr_server* server = reactor->server;
+  gint64 timeout = g_atomic_int_get(&server->request_timeout);
+  xr_server_conn* conn;
+
+  while ((conn = g_queue_peek_head(&reactor->partial)) && now - conn->request_start >= timeout)
+  {
+    _xr_server_reactor_untrack(reactor, conn);
+    _xr_server_conn_close(server, conn);
+  }
+}
+
+static gpointer _xr_server_reactor_func(xr_server_reactor* reactor)
+{
+  xr_server* server = reactor->server;
+  struct epoll_event events[64];
+  int i, n;
+
+  while (!g_atomic_int_get(&server->stopping))
+  {
+    gint64 now;
+
+    n = epoll_wait(reactor->epfd, events, G_N_ELEMENTS(events), 500);
+    if (n < 0 && errno != EINTR)
+      break;
+
+    now = g_get_monotonic_time() / G_USEC_PER_SEC;
+
+    for (i = 0; i < n; i++)
+    {
+      xr_server_conn* conn = events[i].data.ptr;
+
+      /* plaintext requests are read into the buffer of the connection
+         until they arrived completely, so that slow clients do not occupy
+         workers */
+      if (!conn->tls_conn && !(events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && !_xr_server_conn_buffer(conn))
+      {
+        gsize len;
+
+        _xr_server_conn_buffered(conn, &len);
+        if (len > 0 && conn->partial_link == NULL)
+        {
+          conn->request_start = now;
+          g_queue_push_tail(&reactor->partial, conn);
+          conn->partial_link = reactor->partial.tail;
+        }
+
+        if (_xr_server_conn_arm(conn, EPOLL_CTL_MOD))
+          continue;
+      }
+
+      _xr_server_reactor_untrack(reactor, conn);
+      g_thread_pool_push(server->workers, conn, NULL);
+    }
+
+    _xr_server_reactor_expire(reactor, now);
+  }
+
+  g_queue_clear(&reactor->partial);
+  return NULL;
+}
+
+static gboolean _xr_server_service_incoming(GSocketService *service, GSocketConnection *connection, GObject *source_object, gpointer user_data)
+{
+  xr_server* server = user_data;
+  xr_server_conn* conn;
+
+  conn = _xr_server_conn_new(server, connection);
+  if (conn == NULL)
+    return TRUE;
+
+  conn->reactor = server->reactors + (server->next_reactor++ % server->reactors_count);
+
+  g_mutex_lock(server->conns_mutex);
+  g_hash_table_insert(server->conns, conn, conn);
+  g_mutex_unlock(server->conns_mutex);
+
+  if (!_xr_server_conn_arm(conn, EPOLL_CTL_ADD))
+    _xr_server_conn_close(server, conn);
+
+  return TRUE;
+}
+
+#endif
+
 gboolean xr_server_run(xr_server* server, GError** err)
 {
   GError* local_err = NULL;
@@ -650,27 +1861,53 @@ gboolean xr_server_register_servlet(xr_server* server, xr_servlet_def* servlet)
   g_return_val_if_fail(server != NULL, FALSE);
   g_return_val_if_fail(servlet != NULL, FALSE);
 
-  if (_find_servlet_def(server, servlet->name))
+  if (_find_servlet_type(server, servlet->name))
     return FALSE;
 
-  server->servlet_types = g_slist_append(server->servlet_types, servlet);
+  xr_servlet_type* type = _xr_servlet_type_new(servlet);
+  server->servlet_types = g_slist_append(server->servlet_types, type);
+  g_hash_table_insert(server->servlet_index, servlet->name, type);
   return TRUE;
 }
 
-xr_server* xr_server_new(const char* cert, int threads, GError** err)
+void xr_server_set_session_ttl(xr_server* server, int ttl)
 {
-  xr_trace(XR_DEBUG_SERVER_TRACE, "(cert=%s, threads=%d, err=%p)", cert, threads, err);
-  GError* local_err = NULL;
+  xr_trace(XR_DEBUG_SERVER_TRACE, "(server=%p, ttl=%d)", server, ttl);
 
-  g_return_val_if_fail(threads > 0 && threads < 1000, NULL);
-  g_return_val_if_fail (err == NULL || *err == NULL, NULL);
+  g_return_if_fail(server != NULL);
+  g_return_if_fail(ttl > 0);
+
+  g_atomic_int_set(&server->session_ttl, ttl);
+}
+
+void xr_server_set_request_timeout(xr_server* server, int timeout)
+{
+  xr_trace(XR_DEBUG_SERVER_TRACE, "(server=%p, timeout=%d)", server, timeout);
+
+  g_return_if_fail(server != NULL);
+  g_return_if_fail(timeout > 0);
+
+  g_atomic_int_set(&server->request_timeout, timeout);
+}
+
+void xr_server_set_request_arena(xr_server* server, gboolean enabled)
+{
+  xr_trace(XR_DEBUG_SERVER_TRACE, "(server=%p, enabled=%d)", server, enabled);
+
+  g_return_if_fail(server != NULL);
+
+  g_atomic_int_set(&server->request_arena, !!enabled);
+}
+
+static xr_server* _xr_server_new(const char* cert, GSocketService* service, GError** err)
+{
+  GError* local_err = NULL;
 
   xr_init();
 
   xr_server* server = g_new0(xr_server, 1);
   server->secure = !!cert;
-  server->service = g_threaded_socket_service_new(threads);
-  g_signal_connect(server->service, "run", (GCallback)_xr_server_service_run, server);
+  server->service = service;
 
   if (cert)
   {
@@ -682,17 +1919,22 @@ xr_server* xr_server_new(const char* cert, int threads, GError** err)
     }
   }
 
-  server->sessions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)xr_servlet_free_fini);
-  g_static_rw_lock_init(&server->sessions_lock);
+  server->servlet_index = g_hash_table_new(_servlet_name_hash, _servlet_name_equal);
+  _xr_server_sessions_init(server);
+  server->session_ttl = XR_SESSION_TTL_DEFAULT;
+  server->request_timeout = XR_REQUEST_TIMEOUT_DEFAULT;
+  server->arena = g_private_new((GDestroyNotify)xr_arena_free);
   server->sessions_cleaner = g_thread_create((GThreadFunc)sessions_cleaner_func, server, TRUE, NULL);
   if (server->sessions_cleaner == NULL)
     goto err1;
 
+  server->multicall_pool = g_thread_pool_new((GFunc)_xr_server_multicall_func, server, XR_MULTICALL_THREADS, FALSE, NULL);
+
   return server;
 
 err1:
-  g_hash_table_destroy(server->sessions);
-  g_static_rw_lock_free(&server->sessions_lock);
+  _xr_server_sessions_free(server);
+  g_hash_table_destroy(server->servlet_index);
   if (server->cert)
     g_object_unref(server->cert);
 err0:
@@ -701,6 +1943,86 @@ err0:
   return NULL;
 }
 
+xr_server* xr_server_new(const char* cert, int threads, GError** err)
+{
+  xr_trace(XR_DEBUG_SERVER_TRACE, "(cert=%s, threads=%d, err=%p)", cert, threads, err);
+  xr_server* server;
+
+  g_return_val_if_fail(threads > 0 && threads < 1000, NULL);
+  g_return_val_if_fail (err == NULL || *err == NULL, NULL);
+
+  server = _xr_server_new(cert, g_threaded_socket_service_new(threads), err);
+  if (server == NULL)
+    return NULL;
+
+  g_signal_connect(server->service, "run", (GCallback)_xr_server_service_run, server);
+
+  return server;
+}
+
+xr_server* xr_server_new_evented(const char* cert, int reactors, int workers, GError** err)
+{
+  xr_trace(XR_DEBUG_SERVER_TRACE, "(cert=%s, reactors=%d, workers=%d, err=%p)", cert, reactors, workers, err);
+#ifdef HAVE_SYS_EPOLL_H
+  GError* local_err = NULL;
+  xr_server* server;
+  int i;
+
+  g_return_val_if_fail(reactors > 0, NULL);
+  g_return_val_if_fail(workers > 0, NULL);
+  g_return_val_if_fail (err == NULL || *err == NULL, NULL);
+
+  server = _xr_server_new(cert, g_socket_service_new(), err);
+  if (server == NULL)
+    return NULL;
+
+  server->conns = g_hash_table_new(g_direct_hash, g_direct_equal);
+  server->conns_mutex = g_mutex_new();
+
+  server->workers = g_thread_pool_new((GFunc)_xr_server_worker_func, server, workers, FALSE, &local_err);
+  if (local_err)
+  {
+    g_propagate_prefixed_error(err, local_err, "Worker pool setup failed: ");
+    goto err;
+  }
+
+  server->reactors = g_new0(xr_server_reactor, reactors);
+  for (i = 0; i < reactors; i++)
+  {
+    xr_server_reactor* reactor = server->reactors + i;
+
+    reactor->server = server;
+    reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epfd < 0)
+    {
+      g_set_error(err, XR_SERVER_ERROR, XR_SERVER_ERROR_FAILED, "epoll_create1 failed: %s", g_strerror(errno));
+      goto err;
+    }
+
+    server->reactors_count++;
+
+    reactor->thread = g_thread_create((GThreadFunc)_xr_server_reactor_func, reactor, TRUE, &local_err);
+    if (local_err)
+    {
+      g_propagate_prefixed_error(err, local_err, "Reactor thread setup failed: ");
+      goto err;
+    }
+  }
+
+  g_signal_connect(server->service, "incoming", (GCallback)_xr_server_service_incoming, server);
+
+  return server;
+
+err:
+  g_atomic_int_set(&server->stopping, 1);
+  g_socket_service_stop(server->service);
+  xr_server_free(server);
+  return NULL;
+#else
+  return xr_server_new(cert, CLAMP(workers, 1, 999), err);
+#endif
+}
+
 static gboolean _parse_addr(const char* str, char** addr, int* port)
 {
   gboolean retval = FALSE;
@@ -774,14 +2096,54 @@ void xr_server_free(xr_server* server)
   if (server == NULL)
     return;
 
+#ifdef HAVE_SYS_EPOLL_H
+  if (server->reactors)
+  {
+    GHashTableIter iter;
+    xr_server_conn* conn;
+    int i;
+
+    g_atomic_int_set(&server->stopping, 1);
+    for (i = 0; i < server->reactors_count; i++)
+      if (server->reactors[i].thread)
+        g_thread_join(server->reactors[i].thread);
+
+    /* wait for the workers to finish their requests */
+    if (server->workers)
+      g_thread_pool_free(server->workers, FALSE, TRUE);
+
+    g_hash_table_iter_init(&iter, server->conns);
+    while (g_hash_table_iter_next(&iter, (gpointer*)&conn, NULL))
+      _xr_server_conn_free(conn);
+
+    for (i = 0; i < server->reactors_count; i++)
+      close(server->reactors[i].epfd);
+
+    g_free(server->reactors);
+  }
+  else if (server->workers)
+    g_thread_pool_free(server->workers, FALSE, TRUE);
+
+  if (server->conns)
+  {
+    g_hash_table_destroy(server->conns);
+    g_mutex_free(server->conns_mutex);
+  }
+#endif
+
+  g_thread_pool_free(server->multicall_pool, FALSE, TRUE);
+
+  /* cleaner checks the service, stop it first */
+  g_thread_join(server->sessions_cleaner);
+  _xr_server_sessions_free(server);
   if (server->cert)
     g_object_unref(server->cert);
   g_object_unref(server->service);
+  g_hash_table_destroy(server->servlet_index);
+  g_slist_foreach(server->servlet_types, (GFunc)_xr_servlet_type_free, NULL);
   g_slist_free(server->servlet_types);
-  g_thread_join(server->sessions_cleaner);
-  g_hash_table_destroy(server->sessions);
-  g_static_rw_lock_free(&server->sessions_lock);
-  g_main_loop_unref(server->loop);
+  if (server->loop)
+    g_main_loop_unref(server->loop);
   g_free(server);
 }
 
@@ -0,0 +1,30 @@
+/* 
+ * Copyright 2006-2008 Ondrej Jirman <ondrej.jirman@zonio.net>
+ * 
+ * This file is part of libxr.
+ *
+ * Libxr is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * Libxr is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __XR_VALUE_PRIV_H__
+#define __XR_VALUE_PRIV_H__
+
+#include "xr-value.h"
+
+/* Take reference to the node without copying arena nodes. Use only when the
+ * reference is dropped before the arena is reset, e.g. when values of one
+ * request are moved between calls. */
+xr_value* _xr_value_share(xr_value* val);
+
+#endif
@@ -22,6 +22,7 @@
 
 #include <string.h>
 #include "xr-value-utils.h"
+#include "xr-value-priv.h"
 
 /* xr_value_build */
 
@@ -152,13 +153,13 @@ static xr_value* xr_value_fmt_build_value(const char** const fmt, va_list* args,
      case 'S':
        value = va_arg(*args, xr_value*);
        xr_value_check_type(value, XRV_STRUCT, 'S', NULL);
-       xr_value_ref(value);
+       _xr_value_share(value);
        break;
 
      case 'A':
        value = va_arg(*args, xr_value*);
        xr_value_check_type(value, XRV_ARRAY, 'A', NULL);
-       xr_value_ref(value);
+       _xr_value_share(value);
        break;
 
      case '{':
@@ -296,13 +297,11 @@ static gboolean xr_value_fmt_parse_struct(xr_value* value, const char** fmt, va_
 
 static gboolean xr_value_fmt_parse_array(xr_value* value, const char** fmt, va_list* args, const char** tail)
 {
-  GSList *array = NULL;
   guint length = 0;
   guint index;
 
   xr_value_check_type(value, XRV_ARRAY, '(', FALSE);
-  array = xr_value_get_items(value);
-  length = g_slist_length(array);
+  length = xr_value_array_length(value);
 
   for (index = 0; index < length; index++)
   {
@@ -326,7 +325,7 @@ static gboolean xr_value_fmt_parse_array(xr_value* value, const char** fmt, va_l
       return FALSE;
     }
 
-    item = (xr_value*)g_slist_nth_data(array, index);
+    item = xr_value_array_get(value, index);
     if (!xr_value_fmt_parse_value(item, fmt, args, tail))
       return FALSE;
   }
@@ -401,8 +400,7 @@ static gboolean xr_value_fmt_parse_value(xr_value* value, const char** const fmt
        if (val == NULL)
          return FALSE;
        xr_value_check_type(value, XRV_STRUCT, 'S', FALSE);
-       *val = value;
-       xr_value_ref(value);
+       *val = xr_value_ref(value);
      }
        break;
 
@@ -413,8 +411,7 @@ static gboolean xr_value_fmt_parse_value(xr_value* value, const char** const fmt
        if (val == NULL)
          return FALSE;
        xr_value_check_type(value, XRV_ARRAY, 'A', FALSE);
-       *val = value;
-       xr_value_ref(value);
+       *val = xr_value_ref(value);
      }
        break;
 
@@ -21,11 +21,55 @@
 #include <stdio.h>
 
 #include "xr-value.h"
+#include "xr-value-priv.h"
+
+/* structs with more members than this get a hash index */
+#define XR_STRUCT_INDEX_MIN 8
+
+#define XR_ARENA_CHUNK_SIZE (16*1024)
+#define XR_ARENA_ALIGN(size) (((size) + 15) & ~(gsize)15)
+
+typedef struct _xr_arena_chunk xr_arena_chunk;
+struct _xr_arena_chunk
+{
+  xr_arena_chunk* next;
+  gsize size;
+  gsize pos;
+  /* data follows */
+};
+
+#define XR_ARENA_CHUNK_DATA(c) ((char*)(c) + XR_ARENA_ALIGN(sizeof(xr_arena_chunk)))
+
+typedef struct _xr_arena_cleanup xr_arena_cleanup;
+struct _xr_arena_cleanup
+{
+  GDestroyNotify func;
+  gpointer data;
+};
+
+struct _xr_arena
+{
+  gsize chunk_size;
+  xr_arena_chunk* chunks; /* current chunk first */
+  xr_arena_chunk* spare;  /* chunk kept by the last reset */
+  GArray* cleanups;       /* xr_arena_cleanup */
+};
+
+/* vector of struct members or array items */
+typedef struct _xr_children xr_children;
+struct _xr_children
+{
+  guint len;
+  guint size;
+  GSList* list_tail;   /* last link of the list of arena values */
+  xr_value* items[];
+};
 
 struct _xr_value
 {
   int type;                      /**< Type of the value. */
   volatile guint ref;
+  xr_arena* arena;        /**< Arena the node was allocated from or NULL. */
 
   // values
   char* str_val;
@@ -34,19 +78,203 @@ struct _xr_value
   xr_blob* blob_val;
 
   // array
-  GSList* children;       /**< Members or array items list. */
+  xr_children* children;  /**< Members or array items. */
+  GSList* children_list;  /**< Cached list for xr_value_get_items/members(). */
+  GHashTable* member_index; /**< Member name to member map for large structs. */
 
   // struct member fields
   char* member_name;             /**< Struct member name. */
+  GQuark member_quark;    /**< Quark of the member name, 0 if not interned. */
   xr_value* member_value; /**< Struct member value. */
 };
 
-static xr_value* _xr_value_new()
+/* arena */
+
+static GStaticPrivate _xr_arena_key = G_STATIC_PRIVATE_INIT;
+static volatile gint _xr_arena_bound = 0; /* threads with an arena bound */
+
+xr_arena* xr_arena_new(gsize chunk_size)
+{
+  xr_arena* arena = g_new0(xr_arena, 1);
+  arena->chunk_size = chunk_size > 0 ? chunk_size : XR_ARENA_CHUNK_SIZE;
+  arena->cleanups = g_array_new(FALSE, FALSE, sizeof(xr_arena_cleanup));
+  return arena;
+}
+
+static xr_arena_chunk* _xr_arena_chunk_new(gsize size)
+{
+  xr_arena_chunk* c = g_malloc(XR_ARENA_ALIGN(sizeof(xr_arena_chunk)) + size);
+  c->next = NULL;
+  c->size = size;
+  c->pos = 0;
+  return c;
+}
+
+static gpointer xr_arena_alloc(xr_arena* arena, gsize size)
+{
+  xr_arena_chunk* c = arena->chunks;
+  gpointer mem;
+
+  size = XR_ARENA_ALIGN(size);
+
+  if (G_UNLIKELY(c == NULL || c->pos + size > c->size))
+  {
+    /* big blocks get their own chunk, the current one is kept */
+    if (size > arena->chunk_size / 4)
+    {
+      c = _xr_arena_chunk_new(size);
+      c->pos = size;
+      if (arena->chunks)
+      {
+        c->next = arena->chunks->next;
+        arena->chunks->next = c;
+      }
+      else
+        arena->chunks = c;
+      return XR_ARENA_CHUNK_DATA(c);
+    }
+
+    if (arena->spare)
+    {
+      c = arena->spare;
+      arena->spare = NULL;
+    }
+    else
+      c = _xr_arena_chunk_new(arena->chunk_size);
+
+    c->next = arena->chunks;
+    arena->chunks = c;
+  }
+
+  mem = XR_ARENA_CHUNK_DATA(c) + c->pos;
+  c->pos += size;
+  return mem;
+}
+
+gpointer xr_arena_alloc0(xr_arena* arena, gsize size)
+{
+  g_return_val_if_fail(arena != NULL, NULL);
+
+  return memset(xr_arena_alloc(arena, size), 0, size);
+}
+
+char* xr_arena_strdup(xr_arena* arena, const char* str)
+{
+  gsize len;
+
+  g_return_val_if_fail(arena != NULL, NULL);
+
+  if (str == NULL)
+    return NULL;
+
+  len = strlen(str) + 1;
+  return memcpy(xr_arena_alloc(arena, len), str, len);
+}
+
+void xr_arena_add_cleanup(xr_arena* arena, GDestroyNotify func, gpointer data)
+{
+  xr_arena_cleanup cleanup = { func, data };
+
+  g_return_if_fail(arena != NULL);
+  g_return_if_fail(func != NULL);
+
+  g_array_append_val(arena->cleanups, cleanup);
+}
+
+void xr_arena_reset(xr_arena* arena)
+{
+  xr_arena_chunk *c, *next;
+  guint i;
+
+  g_return_if_fail(arena != NULL);
+
+  /* cleanups may unref values that reference each other, keep order */
+  for (i = arena->cleanups->len; i > 0; i--)
+  {
+    xr_arena_cleanup* cleanup = &g_array_index(arena->cleanups, xr_arena_cleanup, i - 1);
+    cleanup->func(cleanup->data);
+  }
+  g_array_set_size(arena->cleanups, 0);
+
+  for (c = arena->chunks; c; c = next)
+  {
+    next = c->next;
+    if (arena->spare == NULL && c->size == arena->chunk_size)
+    {
+      c->pos = 0;
+      c->next = NULL;
+      arena->spare = c;
+    }
+    else
+      g_free(c);
+  }
+  arena->chunks = NULL;
+}
+
+void xr_arena_free(xr_arena* arena)
 {
-  xr_value* v = g_slice_new0(xr_value);
+  if (arena == NULL)
+    return;
+
+  xr_arena_reset(arena);
+  g_free(arena->spare);
+  g_array_free(arena->cleanups, TRUE);
+  g_free(arena);
+}
+
+xr_arena* xr_arena_bind(xr_arena* arena)
+{
+  xr_arena* prev = g_static_private_get(&_xr_arena_key);
+
+  if (prev == arena)
+    return prev;
+
+  g_static_private_set(&_xr_arena_key, arena, NULL);
+
+  /* lets _xr_value_new() skip the TLS lookup when no arena is used */
+  if (prev == NULL)
+    g_atomic_int_inc(&_xr_arena_bound);
+  else if (arena == NULL)
+    g_atomic_int_add(&_xr_arena_bound, -1);
+
+  return prev;
+}
+
+static inline xr_arena* _xr_arena_current()
+{
+  if (G_LIKELY(g_atomic_int_get(&_xr_arena_bound) == 0))
+    return NULL;
+
+  return g_static_private_get(&_xr_arena_key);
+}
+
+/* values */
+
+static xr_value* _xr_value_new_in(xr_arena* arena)
+{
+  xr_value* v;
+
+  if (arena)
+  {
+    v = xr_arena_alloc0(arena, sizeof(xr_value));
+    v->arena = arena;
+    return v;
+  }
+
+  v = g_slice_new0(xr_value);
   return xr_value_ref(v);
 }
 
+static xr_value* _xr_value_new()
+{
+  return _xr_value_new_in(_xr_arena_current());
+}
+
+static char* _xr_value_strdup(xr_value* v, const char* str)
+{
+  return v->arena ? xr_arena_strdup(v->arena, str) : g_strdup(str);
+}
+
 xr_blob* xr_blob_new(char* buf, int len)
 {
   if (buf == NULL)
@@ -85,6 +313,19 @@ xr_value* xr_value_ref(xr_value* val)
   if (val == NULL)
     return NULL;
 
+  /* arena node is gone with the arena, the caller gets its own copy */
+  if (val->arena)
+    return xr_value_promote(val);
+
+  g_atomic_int_inc(&val->ref);
+  return val;
+}
+
+xr_value* _xr_value_share(xr_value* val)
+{
+  if (val == NULL || val->arena)
+    return val;
+
   g_atomic_int_inc(&val->ref);
   return val;
 }
@@ -92,21 +333,30 @@ xr_value* xr_value_ref(xr_value* val)
 /*XXX: this is probably not a thread-safe way of doing unref */
 void xr_value_unref(xr_value* val)
 {
-  if (val == NULL)
+  /* arena values are released by xr_arena_reset() */
+  if (val == NULL || val->arena)
     return;
 
   if (g_atomic_int_dec_and_test(&val->ref))
   {
-    GSList* i;
-
     if (val->type == XRV_BLOB)
       xr_blob_unref(val->blob_val);
 
     g_free(val->str_val);
-    g_free(val->member_name);
+    /* interned names are owned by the quark table */
+    if (val->member_quark == 0)
+      g_free(val->member_name);
     xr_value_unref(val->member_value);
-    g_slist_foreach(val->children, (GFunc)xr_value_unref, NULL);
-    g_slist_free(val->children);
+    if (val->children)
+    {
+      guint i;
+      for (i = 0; i < val->children->len; i++)
+        xr_value_unref(val->children->items[i]);
+      g_free(val->children);
+    }
+    g_slist_free(val->children_list);
+    if (val->member_index)
+      g_hash_table_destroy(val->member_index);
     g_slice_free(xr_value, val);
   }
 }
@@ -116,7 +366,7 @@ xr_value* xr_value_string_new(const char* val)
 {
   xr_value* v = _xr_value_new();
   v->type = XRV_STRING;
-  v->str_val = g_strdup(val != NULL ? val : "");
+  v->str_val = _xr_value_strdup(v, val != NULL ? val : "");
   return v;
 }
 
@@ -148,7 +398,7 @@ xr_value* xr_value_time_new(const char* val)
 {
   xr_value* v = _xr_value_new();
   v->type = XRV_TIME;
-  v->str_val = g_strdup(val != NULL ? val : "");
+  v->str_val = _xr_value_strdup(v, val != NULL ? val : "");
   return v;
 }
 
@@ -160,6 +410,8 @@ xr_value* xr_value_blob_new(xr_blob* val)
   xr_value* v = _xr_value_new();
   v->type = XRV_BLOB;
   v->blob_val = xr_blob_ref(val);
+  if (v->arena)
+    xr_arena_add_cleanup(v->arena, (GDestroyNotify)xr_blob_unref, v->blob_val);
   return v;
 }
 
@@ -236,7 +488,7 @@ gboolean xr_value_to_value(xr_value* val, xr_value** nval)
   if (val == NULL)
     return FALSE;
 
-  *nval = xr_value_ref(val);
+  *nval = xr_value_promote(val);
   return TRUE;
 }
 
@@ -247,12 +499,129 @@ int xr_value_get_type(xr_value* val)
   return val->type;
 }
 
+/* build list of children for the GSList based API, the list is kept until
+ * the value is modified */
+static GSList* _xr_value_children_list(xr_value* val)
+{
+  GSList* list = g_atomic_pointer_get(&val->children_list);
+  guint i;
+
+  /* arena values build the list as children are added */
+  if (list != NULL || val->children == NULL || val->arena)
+    return list;
+
+  for (i = val->children->len; i > 0; i--)
+    list = g_slist_prepend(list, val->children->items[i - 1]);
+
+  /* another thread may have built the list meanwhile */
+  if (!g_atomic_pointer_compare_and_exchange(&val->children_list, NULL, list))
+  {
+    g_slist_free(list);
+    list = g_atomic_pointer_get(&val->children_list);
+  }
+
+  return list;
+}
+
+static void _xr_value_children_append(xr_value* val, xr_value* child)
+{
+  xr_children* c = val->children;
+
+  if (c == NULL || c->len == c->size)
+  {
+    guint size = c ? c->size * 2 : 4;
+    gsize bytes = sizeof(xr_children) + size * sizeof(xr_value*);
+
+    if (val->arena)
+    {
+      /* old vector stays in the arena */
+      xr_children* n = xr_arena_alloc(val->arena, bytes);
+      if (c)
+        memcpy(n, c, sizeof(xr_children) + c->len * sizeof(xr_value*));
+      else
+      {
+        n->len = 0;
+        n->list_tail = NULL;
+      }
+      c = n;
+    }
+    else
+    {
+      c = g_realloc(c, bytes);
+      if (val->children == NULL)
+      {
+        c->len = 0;
+        c->list_tail = NULL;
+      }
+    }
+
+    c->size = size;
+    val->children = c;
+  }
+
+  c->items[c->len++] = child;
+
+  if (val->arena)
+  {
+    /* readers may run in other threads, that can't allocate from the arena */
+    GSList* link = xr_arena_alloc(val->arena, sizeof(GSList));
+    link->data = child;
+    link->next = NULL;
+    if (c->list_tail)
+      c->list_tail->next = link;
+    else
+      val->children_list = link;
+    c->list_tail = link;
+  }
+  else if (val->children_list)
+  {
+    g_slist_free(val->children_list);
+    val->children_list = NULL;
+  }
+}
+
+/* Take ownership of @a child being stored in @a container. Arena values
+ * are copied into heap containers and other arenas, heap values stored in
+ * arena containers are unrefed when the arena is reset. */
+static xr_value* _xr_value_adopt(xr_value* container, xr_value* child)
+{
+  if (child->arena == container->arena)
+    return child;
+
+  if (child->arena)
+    child = xr_value_promote(child);
+
+  if (container->arena)
+    xr_arena_add_cleanup(container->arena, (GDestroyNotify)xr_value_unref, child);
+
+  return child;
+}
+
 GSList* xr_value_get_members(xr_value* val)
 {
   g_return_val_if_fail(val != NULL, NULL);
   g_return_val_if_fail(val->type == XRV_STRUCT, NULL);
 
-  return val->children;
+  return _xr_value_children_list(val);
+}
+
+guint xr_value_struct_length(xr_value* val)
+{
+  g_return_val_if_fail(val != NULL, 0);
+  g_return_val_if_fail(val->type == XRV_STRUCT, 0);
+
+  return val->children ? val->children->len : 0;
+}
+
+xr_value* xr_value_struct_get_nth(xr_value* val, guint index)
+{
+  g_return_val_if_fail(val != NULL, NULL);
+  g_return_val_if_fail(val->type == XRV_STRUCT, NULL);
+
+  if (val->children == NULL || index >= val->children->len)
+    return NULL;
+
+  return val->children->items[index];
 }
 
 const char* xr_value_get_member_name(xr_value* val)
@@ -271,29 +640,142 @@ xr_value* xr_value_get_member_value(xr_value* val)
   return val->member_value;
 }
 
-xr_value* xr_value_get_member(xr_value* val, const char* name)
+/* interned names are compared by pointer first */
+static gboolean _xr_member_name_equal(gconstpointer a, gconstpointer b)
 {
-  GSList* i;
+  return a == b || !strcmp(a, b);
+}
 
-  g_return_val_if_fail(val != NULL, NULL);
-  g_return_val_if_fail(val->type == XRV_STRUCT, NULL);
+/* Share the member name with the quark table if the program registered it
+ * (e.g. generated code). Done only for indexed structs, because quark
+ * lookups take a global lock. */
+static void _xr_value_intern_member(xr_value* m)
+{
+  GQuark key;
+
+  if (m->member_quark)
+    return;
+
+  key = g_quark_try_string(m->member_name);
+  if (key == 0)
+    return;
+
+  if (m->arena == NULL)
+    g_free(m->member_name);
+  m->member_quark = key;
+  m->member_name = (char*)g_quark_to_string(key);
+}
+
+static void _xr_value_index_member(xr_value* str, xr_value* m)
+{
+  guint i;
 
-  for (i = val->children; i; i = i->next)
+  if (str->member_index == NULL)
   {
-    xr_value* m = i->data;
-    if (!strcmp(xr_value_get_member_name(m), name))
-      return xr_value_get_member_value(m);
+    if (str->children->len <= XR_STRUCT_INDEX_MIN)
+      return;
+
+    str->member_index = g_hash_table_new(g_str_hash, _xr_member_name_equal);
+    if (str->arena)
+      xr_arena_add_cleanup(str->arena, (GDestroyNotify)g_hash_table_destroy, str->member_index);
+    for (i = 0; i < str->children->len; i++)
+    {
+      xr_value* c = str->children->items[i];
+      _xr_value_intern_member(c);
+      g_hash_table_insert(str->member_index, c->member_name, c);
+    }
+    return;
+  }
+
+  _xr_value_intern_member(m);
+  g_hash_table_insert(str->member_index, m->member_name, m);
+}
+
+static xr_value* _xr_value_find_member(xr_value* str, const char* name)
+{
+  guint i;
+
+  if (str->member_index)
+    return g_hash_table_lookup(str->member_index, name);
+
+  for (i = 0; str->children && i < str->children->len; i++)
+  {
+    xr_value* m = str->children->items[i];
+    if (_xr_member_name_equal(m->member_name, name))
+      return m;
   }
 
   return NULL;
 }
 
+static xr_value* _xr_value_find_member_quark(xr_value* str, GQuark key)
+{
+  const char* name = g_quark_to_string(key);
+  guint i;
+
+  if (str->member_index)
+    return g_hash_table_lookup(str->member_index, name);
+
+  /* members added before the quark was registered have no quark */
+  for (i = 0; str->children && i < str->children->len; i++)
+  {
+    xr_value* m = str->children->items[i];
+    if (m->member_quark == key || (m->member_quark == 0 && !strcmp(m->member_name, name)))
+      return m;
+  }
+
+  return NULL;
+}
+
+xr_value* xr_value_get_member(xr_value* val, const char* name)
+{
+  xr_value* m;
+
+  g_return_val_if_fail(val != NULL, NULL);
+  g_return_val_if_fail(val->type == XRV_STRUCT, NULL);
+  g_return_val_if_fail(name != NULL, NULL);
+
+  m = _xr_value_find_member(val, name);
+  return m ? m->member_value : NULL;
+}
+
+xr_value* xr_value_get_member_quark(xr_value* val, GQuark key)
+{
+  xr_value* m;
+
+  g_return_val_if_fail(val != NULL, NULL);
+  g_return_val_if_fail(val->type == XRV_STRUCT, NULL);
+  g_return_val_if_fail(key != 0, NULL);
+
+  m = _xr_value_find_member_quark(val, key);
+  return m ? m->member_value : NULL;
+}
+
 GSList* xr_value_get_items(xr_value* val)
 {
   g_return_val_if_fail(val != NULL, NULL);
   g_return_val_if_fail(val->type == XRV_ARRAY, NULL);
 
-  return val->children;
+  return _xr_value_children_list(val);
+}
+
+guint xr_value_array_length(xr_value* val)
+{
+  g_return_val_if_fail(val != NULL, 0);
+  g_return_val_if_fail(val->type == XRV_ARRAY, 0);
+
+  return val->children ? val->children->len : 0;
+}
+
+xr_value* xr_value_array_get(xr_value* val, guint index)
+{
+  g_return_val_if_fail(val != NULL, NULL);
+  g_return_val_if_fail(val->type == XRV_ARRAY, NULL);
+
+  if (val->children == NULL || index >= val->children->len)
+    return NULL;
+
+  return val->children->items[index];
 }
 
 /* composite types */
@@ -312,30 +794,58 @@ xr_value* xr_value_array_new()
   return v;
 }
 
+static void _xr_value_add_member(xr_value* str, const char* name, GQuark key, xr_value* val)
+{
+  xr_value* v = _xr_value_new_in(str->arena);
+  v->type = XRV_MEMBER;
+  v->member_quark = key;
+  v->member_name = key ? (char*)g_quark_to_string(key) : _xr_value_strdup(v, name);
+  v->member_value = _xr_value_adopt(str, val);
+  _xr_value_children_append(str, v);
+  _xr_value_index_member(str, v);
+}
+
 void xr_value_struct_set_member(xr_value* str, const char* name, xr_value* val)
 {
-  GSList* i;
+  xr_value* m;
 
   g_return_if_fail(str != NULL);
   g_return_if_fail(str->type == XRV_STRUCT);
+  g_return_if_fail(name != NULL);
   g_return_if_fail(val != NULL);
 
-  for (i=str->children; i; i=i->next)
+  m = _xr_value_find_member(str, name);
+  if (m)
   {
-    xr_value* m = i->data;
-    if (!strcmp(m->member_name, name))
-    {
+    /* previous value of arena struct member is released by the arena */
+    if (str->arena == NULL)
       xr_value_unref(m->member_value);
-      m->member_value = val;
-      return;
-    }
+    m->member_value = _xr_value_adopt(str, val);
+    return;
   }
 
-  xr_value* v = _xr_value_new();
-  v->type = XRV_MEMBER;
-  v->member_name = g_strdup(name);
-  v->member_value = val;
-  str->children = g_slist_append(str->children, v);
+  _xr_value_add_member(str, name, 0, val);
+}
+
+void xr_value_struct_set_member_quark(xr_value* str, GQuark key, xr_value* val)
+{
+  xr_value* m;
+
+  g_return_if_fail(str != NULL);
+  g_return_if_fail(str->type == XRV_STRUCT);
+  g_return_if_fail(key != 0);
+  g_return_if_fail(val != NULL);
+
+  m = _xr_value_find_member_quark(str, key);
+  if (m)
+  {
+    if (str->arena == NULL)
+      xr_value_unref(m->member_value);
+    m->member_value = _xr_value_adopt(str, val);
+    return;
+  }
+
+  _xr_value_add_member(str, NULL, key, val);
 }
 
 void xr_value_array_append(xr_value* arr, xr_value* val)
@@ -344,7 +854,55 @@ void xr_value_array_append(xr_value* arr, xr_value* val)
   g_return_if_fail(arr->type == XRV_ARRAY);
   g_return_if_fail(val != NULL);
 
-  arr->children = g_slist_append(arr->children, val);
+  _xr_value_children_append(arr, _xr_value_adopt(arr, val));
+}
+
+xr_value* xr_value_promote(xr_value* val)
+{
+  xr_value* v;
+  guint i;
+
+  if (val == NULL || val->arena == NULL)
+    return xr_value_ref(val);
+
+  v = _xr_value_new_in(NULL);
+  v->type = val->type;
+
+  switch (val->type)
+  {
+    case XRV_STRING:
+    case XRV_TIME:
+      v->str_val = g_strdup(val->str_val);
+      break;
+    case XRV_INT:
+    case XRV_BOOLEAN:
+      v->int_val = val->int_val;
+      break;
+    case XRV_DOUBLE:
+      v->dbl_val = val->dbl_val;
+      break;
+    case XRV_BLOB:
+      v->blob_val = xr_blob_ref(val->blob_val);
+      break;
+    case XRV_ARRAY:
+      for (i = 0; val->children && i < val->children->len; i++)
+        _xr_value_children_append(v, xr_value_promote(val->children->items[i]));
+      break;
+    case XRV_STRUCT:
+      for (i = 0; val->children && i < val->children->len; i++)
+      {
+        xr_value* m = val->children->items[i];
+        _xr_value_add_member(v, m->member_name, m->member_quark, xr_value_promote(m->member_value));
+      }
+      break;
+    case XRV_MEMBER:
+      v->member_quark = val->member_quark;
+      v->member_name = val->member_quark ? val->member_name : g_strdup(val->member_name);
+      v->member_value = xr_value_promote(val->member_value);
+      break;
+  }
+
+  return v;
 }
 
 gboolean xr_value_is_error_retval(xr_value* v, int* errcode, char** errmsg)
@@ -365,37 +923,44 @@ gboolean xr_value_is_error_retval(xr_value* v, int* errcode, char** errmsg)
 
 gboolean __xr_value_is_complicated(xr_value* v, int max_strlen)
 {
-  return (xr_value_get_type(v) == XRV_STRUCT && xr_value_get_members(v))
-      || (xr_value_get_type(v) == XRV_ARRAY && xr_value_get_items(v))
-      || (xr_value_get_type(v) == XRV_STRING && v->str_val && strlen(v->str_val) > max_strlen);
+  return ((v->type == XRV_STRUCT || v->type == XRV_ARRAY) && v->children && v->children->len > 0)
+      || (v->type == XRV_STRING && v->str_val && strlen(v->str_val) > max_strlen);
+}
+
+const char* __xr_value_get_str(xr_value* v)
+{
+  if (v == NULL || (v->type != XRV_STRING && v->type != XRV_TIME))
+    return NULL;
+
+  return v->str_val;
 }
 
 static gboolean __xr_value_list_is_complicated(xr_value* v)
 {
-  GSList* i;
+  guint i;
 
-  if (v == NULL)
+  if (v == NULL || v->children == NULL)
     return FALSE;
 
   if (v->type == XRV_ARRAY)
   {
-    if (g_slist_length(xr_value_get_items(v)) > 8)
+    if (v->children->len > 8)
       return TRUE;
     else
     {
-      for (i = xr_value_get_items(v); i; i = i->next)
-        if (__xr_value_is_complicated(i->data, 35))
+      for (i = 0; i < v->children->len; i++)
+        if (__xr_value_is_complicated(v->children->items[i], 35))
           return TRUE;
     }
   }
   else if (v->type == XRV_STRUCT)
   {
-    if (g_slist_length(xr_value_get_members(v)) > 5)
+    if (v->children->len > 5)
       return TRUE;
     else
     {
-      for (i = xr_value_get_members(v); i; i = i->next)
-        if (__xr_value_is_complicated(xr_value_get_member_value(i->data), 25))
+      for (i = 0; i < v->children->len; i++)
+        if (__xr_value_is_complicated(xr_value_get_member_value(v->children->items[i]), 25))
           return TRUE;
     }
   }
@@ -405,40 +970,41 @@ static gboolean __xr_value_list_is_complicated(xr_value* v)
 
 void xr_value_dump(xr_value* v, GString* string, int indent)
 {
-  GSList* i;
+  guint i, len;
   char buf[256];
 
   g_return_if_fail(v != NULL);
 
   memset(buf, 0, sizeof(buf));
   memset(buf, ' ', MIN(indent * 2, sizeof(buf) - 1));
+  len = v->children ? v->children->len : 0;
 
   switch (xr_value_get_type(v))
   {
     case XRV_ARRAY:
     {
-      if (xr_value_get_items(v) == NULL)
+      if (len == 0)
       {
         g_string_append(string, "[]");
       }
       else if (!__xr_value_list_is_complicated(v))
       {
         g_string_append(string, "[ ");
-        for (i = xr_value_get_items(v); i; i = i->next)
+        for (i = 0; i < len; i++)
         {
-          xr_value_dump(i->data, string, indent+1);
-          g_string_append_printf(string, "%s ", i->next ? "," : "");
+          xr_value_dump(v->children->items[i], string, indent+1);
+          g_string_append_printf(string, "%s ", i + 1 < len ? "," : "");
         }
         g_string_append(string, "]");
       }
       else
       {
         g_string_append_printf(string, "[");
-        for (i = xr_value_get_items(v); i; i = i->next)
+        for (i = 0; i < len; i++)
         {
           g_string_append_printf(string, "\n%s  ", buf);
-          xr_value_dump(i->data, string, indent + 1);
-          if (i->next)
+          xr_value_dump(v->children->items[i], string, indent + 1);
+          if (i + 1 < len)
             g_string_append(string, ",");
         }
         g_string_append_printf(string, "\n%s]", buf);
@@ -447,28 +1013,28 @@ void xr_value_dump(xr_value* v, GString* string, int indent)
     }
     case XRV_STRUCT:
     {
-      if (xr_value_get_members(v) == NULL)
+      if (len == 0)
       {
         g_string_append(string, "{}");
       }
       else if (!__xr_value_list_is_complicated(v))
       {
         g_string_append(string, "{ ");
-        for (i = xr_value_get_members(v); i; i = i->next)
+        for (i = 0; i < len; i++)
         {
-          xr_value_dump(i->data, string, indent);
-          g_string_append_printf(string, "%s ", i->next ? "," : "");
+          xr_value_dump(v->children->items[i], string, indent);
+          g_string_append_printf(string, "%s ", i + 1 < len ? "," : "");
         }
         g_string_append(string, "}");
       }
       else
       {
         g_string_append(string, "{");
-        for (i = xr_value_get_members(v); i; i = i->next)
+        for (i = 0; i < len; i++)
         {
           g_string_append_printf(string, "\n%s  ", buf);
-          xr_value_dump(i->data, string, indent);
-          if (i->next)
+          xr_value_dump(v->children->items[i], string, indent);
+          if (i + 1 < len)
             g_string_append(string, ",");
         }
         g_string_append_printf(string, "\n%s}", buf);
@@ -13,7 +13,9 @@ syn sync clear
 unlet b:current_syntax
 
 " A bunch of useful DM keywords
-syn keyword xdlKeyword          struct namespace error servlet array take
+syn keyword xdlKeyword          struct namespace error servlet array take async
+syn keyword xdlKeyword          __init__ __fini__ __attrs__ __pre_call__ __post_call__
+syn keyword xdlKeyword          __fallback__ __download__ __upload__ __reset__ __stateless__
 syn keyword xdlType             string int double boolean time blob any
 syn match   xdlOperator         contained "[<>=]"
 syn match   xdlNumber           contained "\<\d\+"
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2006-2008 Ondrej Jirman <ondrej.jirman@zonio.net>
+ *
+ * This file is part of libxr.
+ *
+ * Libxr is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * Libxr is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Value arena benchmark
+ *
+ * Parses a request with a 200-member struct, reads the params and frees
+ * the call, once with values allocated by g_slice and once from an arena
+ * that is reset after every request, as the server does with
+ * xr_server_set_request_arena().
+ *
+ * Usage: arena-bench [iterations]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "xr-lib.h"
+#include "xr-call.h"
+
+static int count = 5000;
+
+static xr_call* make_struct()
+{
+  xr_call* call = xr_call_new("Test.putStruct");
+  xr_value* st = xr_value_struct_new();
+  int i;
+
+  for (i = 0; i < 200; i++)
+  {
+    char* name = g_strdup_printf("member%d", i);
+
+    if (i % 2)
+      xr_value_struct_set_member(st, name, xr_value_int_new(i));
+    else
+      xr_value_struct_set_member(st, name, xr_value_string_new(name));
+    g_free(name);
+  }
+
+  xr_call_add_param(call, st);
+  return call;
+}
+
+static double run(const char* buf, int len, xr_arena* arena)
+{
+  GTimer* timer = g_timer_new();
+  double elapsed;
+  int i, value;
+
+  for (i = 0; i < count; i++)
+  {
+    xr_call* parsed = xr_call_new(NULL);
+
+    if (arena)
+      xr_arena_bind(arena);
+
+    if (!xr_call_unserialize_request(parsed, buf, len))
+      g_error("decoding failed: %s", xr_call_get_error_message(parsed));
+    xr_value_to_int(xr_value_get_member(xr_call_get_param(parsed, 0), "member99"), &value);
+
+    xr_call_free(parsed);
+
+    if (arena)
+    {
+      xr_arena_bind(NULL);
+      xr_arena_reset(arena);
+    }
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+  return elapsed;
+}
+
+int main(int ac, char* av[])
+{
+  xr_call* call;
+  xr_arena* arena;
+  char* buf;
+  int len;
+
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+
+  xr_init();
+
+  if (ac > 1)
+    count = MAX(1, atoi(av[1]));
+
+  call = make_struct();
+  xr_call_serialize_request(call, &buf, &len);
+  arena = xr_arena_new(0);
+
+  g_print("%d iterations, %d bytes per request\n", count, len);
+  g_print("  g_slice %7.3f s\n", run(buf, len, NULL));
+  g_print("  arena   %7.3f s\n", run(buf, len, arena));
+
+  xr_arena_free(arena);
+  xr_call_free_buffer(call, buf);
+  xr_call_free(call);
+  xr_fini();
+  return 0;
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2006-2008 Ondrej Jirman <ondrej.jirman@zonio.net>
+ *
+ * This file is part of libxr.
+ *
+ * Libxr is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * Libxr is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Base64 codec throughput benchmark
+ *
+ * Compares g_base64_encode()/g_base64_decode() with all xr_base64
+ * implementations supported by this CPU for blobs from 1 KB to 64 MB.
+ * Output of each implementation is checked against glib.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "xr-lib.h"
+#include "xr-base64.h"
+
+#define MIN_SIZE (1 << 10)
+#define MAX_SIZE (64 << 20)
+
+/* amount of data processed for each size */
+#define TOTAL (64 << 20)
+
+static const char* impl_names[] = { "glib", "scalar", "ssse3", "avx2" };
+
+static double bench_encode(int impl, const guchar* data, gsize size, char* out)
+{
+  GTimer* timer = g_timer_new();
+  int i, n = MAX(1, TOTAL / size);
+  double t;
+
+  for (i = 0; i < n; i++)
+  {
+    if (impl == 0)
+      g_free(g_base64_encode(data, size));
+    else
+      xr_base64_encode(data, size, out);
+  }
+
+  t = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+  return (double)size * n / t / (1 << 20);
+}
+
+static double bench_decode(int impl, const char* text, gsize len, guchar* out)
+{
+  GTimer* timer = g_timer_new();
+  int i, n = MAX(1, TOTAL / len);
+  double t;
+
+  for (i = 0; i < n; i++)
+  {
+    if (impl == 0)
+    {
+      /* g_base64_decode() needs NUL terminated copy of the text */
+      gsize size;
+      char* copy = g_strndup(text, len);
+      g_free(g_base64_decode(copy, &size));
+      g_free(copy);
+    }
+    else
+      xr_base64_decode(text, len, out);
+  }
+
+  t = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+  return (double)len * n / t / (1 << 20);
+}
+
+static void check(const guchar* data, gsize size, const char* ref)
+{
+  char* text = g_malloc(XR_BASE64_ENCODED_SIZE(size) + 1);
+  guchar* back = g_malloc(XR_BASE64_DECODED_SIZE(strlen(ref)));
+  gsize len = xr_base64_encode(data, size, text);
+
+  if (len != strlen(ref) || memcmp(text, ref, len))
+    g_error("encoder output differs from glib for %" G_GSIZE_FORMAT " bytes", size);
+
+  if (xr_base64_decode(ref, len, back) != size || memcmp(back, data, size))
+    g_error("decoder output differs for %" G_GSIZE_FORMAT " bytes", size);
+
+  g_free(text);
+  g_free(back);
+}
+
+int main(int ac, char* av[])
+{
+  guchar* data = g_malloc(MAX_SIZE);
+  char* text = g_malloc(XR_BASE64_ENCODED_SIZE(MAX_SIZE) + 1);
+  guchar* out = g_malloc(MAX_SIZE + 3);
+  gsize size, i;
+  int impl;
+
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+
+  xr_init();
+
+  for (i = 0; i < MAX_SIZE; i++)
+    data[i] = rand();
+
+  /* odd sizes to exercise tails of the vector loops */
+  for (impl = 1; impl < G_N_ELEMENTS(impl_names); impl++)
+  {
+    if (!xr_base64_init(impl))
+      continue;
+
+    for (size = 0; size < 300; size++)
+    {
+      char* ref = g_base64_encode(data, size);
+      check(data, size, ref);
+      g_free(ref);
+    }
+  }
+
+  g_print("%10s %8s %12s %12s\n", "size", "impl", "enc MB/s", "dec MB/s");
+
+  for (size = MIN_SIZE; size <= MAX_SIZE; size *= 4)
+  {
+    char* ref = g_base64_encode(data, size);
+    gsize len = strlen(ref);
+
+    for (impl = 0; impl < G_N_ELEMENTS(impl_names); impl++)
+    {
+      double enc, dec;
+
+      if (impl > 0)
+      {
+        if (!xr_base64_init(impl))
+          continue;
+        check(data, size, ref);
+      }
+
+      enc = bench_encode(impl, data, size, text);
+      dec = bench_decode(impl, ref, len, out);
+
+      g_print("%10" G_GSIZE_FORMAT " %8s %12.0f %12.0f\n", size, impl_names[impl], enc, dec);
+    }
+
+    g_free(ref);
+  }
+
+  xr_base64_init(XR_BASE64_AUTO);
+
+  g_free(data);
+  g_free(text);
+  g_free(out);
+  xr_fini();
+  return 0;
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright 2006-2008 Ondrej Jirman <ondrej.jirman@zonio.net>
+ *
+ * This file is part of libxr.
+ *
+ * Libxr is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * Libxr is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* HTTP header parser microbenchmark
+ *
+ * Compares xr_http_read_header() with the old GRegex/read_line based
+ * parser. Both parse the same stream of pipelined requests coming over a
+ * local socket pair.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "xr-lib.h"
+#include "xr-http.h"
+
+#define REQUEST \
+  "POST /Test1 HTTP/1.1\r\n" \
+  "Host: localhost:4444\r\n" \
+  "Connection: keep-alive\r\n" \
+  "User-Agent: libxr\r\n" \
+  "Content-Type: text/xml\r\n" \
+  "X-SESSION-ID: 5f2c8e0a9b1d4e7f\r\n" \
+  "X-SESSION-USE: 1\r\n" \
+  "Content-Length: 96\r\n" \
+  "\r\n" \
+  "<?xml version=\"1.0\"?><methodCall><methodName>Test1.getAll</methodName><params/></methodCall>\n\n\n\n"
+
+static int count = 200000;
+
+/* old parser */
+
+static GRegex* regex_res = NULL;
+static GRegex* regex_req = NULL;
+
+static gboolean old_read_request(GDataInputStream* in, GHashTable* headers, char* body, gsize body_size)
+{
+  GMatchInfo* match_info = NULL;
+  char* header;
+  char* method = NULL;
+  char* resource = NULL;
+  char* version = NULL;
+  const char* clen;
+  gsize bytes_read;
+
+  g_hash_table_remove_all(headers);
+
+  header = g_data_input_stream_read_line(in, NULL, NULL, NULL);
+  if (header == NULL)
+    return FALSE;
+
+  if (g_regex_match(regex_res, header, 0, &match_info))
+  {
+    g_match_info_free(match_info);
+    g_free(header);
+    return FALSE;
+  }
+  g_match_info_free(match_info);
+
+  if (!g_regex_match(regex_req, header, 0, &match_info))
+  {
+    g_match_info_free(match_info);
+    g_free(header);
+    return FALSE;
+  }
+
+  method = g_match_info_fetch(match_info, 1);
+  resource = g_match_info_fetch(match_info, 2);
+  version = g_match_info_fetch(match_info, 3);
+  g_match_info_free(match_info);
+  g_free(header);
+
+  while ((header = g_data_input_stream_read_line(in, NULL, NULL, NULL)) && *header)
+  {
+    char* colon = strchr(header, ':');
+    if (colon)
+    {
+      *colon = '\0';
+      g_hash_table_replace(headers, g_ascii_strdown(g_strstrip(header), -1), g_strdup(g_strstrip(colon + 1)));
+    }
+    g_free(header);
+  }
+  g_free(header);
+
+  g_free(method);
+  g_free(resource);
+  g_free(version);
+
+  clen = g_hash_table_lookup(headers, "content-length");
+  if (clen == NULL || atoi(clen) > body_size)
+    return FALSE;
+
+  return g_input_stream_read_all(G_INPUT_STREAM(in), body, atoi(clen), &bytes_read, NULL, NULL);
+}
+
+/* test driver */
+
+static gpointer writer_func(gpointer data)
+{
+  int fd = GPOINTER_TO_INT(data);
+  gsize len = strlen(REQUEST);
+  char* buf = g_malloc(len * 100);
+  int i;
+
+  for (i = 0; i < 100; i++)
+    memcpy(buf + i * len, REQUEST, len);
+
+  for (i = 0; i < count; i += 100)
+  {
+    gsize off = 0;
+    while (off < len * 100)
+    {
+      gssize n = write(fd, buf + off, len * 100 - off);
+      if (n <= 0)
+        goto out;
+      off += n;
+    }
+  }
+
+out:
+  g_free(buf);
+  close(fd);
+  return NULL;
+}
+
+static GIOStream* open_stream(GThread** writer)
+{
+  int fds[2];
+  GSocket* socket;
+  GIOStream* stream;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    g_error("socketpair failed");
+
+  socket = g_socket_new_from_fd(fds[0], NULL);
+  stream = G_IO_STREAM(g_socket_connection_factory_create_connection(socket));
+  g_object_unref(socket);
+
+  *writer = g_thread_create(writer_func, GINT_TO_POINTER(fds[1]), TRUE, NULL);
+  return stream;
+}
+
+static double bench_old()
+{
+  GThread* writer;
+  GIOStream* stream = open_stream(&writer);
+  GDataInputStream* in = g_data_input_stream_new(g_io_stream_get_input_stream(stream));
+  GHashTable* headers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  GTimer* timer = g_timer_new();
+  char body[1024];
+  int n = 0;
+  double t;
+
+  g_data_input_stream_set_newline_type(in, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+  regex_res = g_regex_new("^HTTP/([0-9]+\\.[0-9]+) ([0-9]+) (.+)$", 0, 0, NULL);
+  regex_req = g_regex_new("^([A-Z]+) ([^ ]+) HTTP/([0-9]+\\.[0-9]+)$", 0, 0, NULL);
+
+  while (old_read_request(in, headers, body, sizeof(body)))
+  {
+    g_assert(g_hash_table_lookup(headers, "x-session-id") != NULL);
+    n++;
+  }
+
+  t = g_timer_elapsed(timer, NULL);
+  g_assert(n == count);
+
+  g_thread_join(writer);
+  g_timer_destroy(timer);
+  g_hash_table_destroy(headers);
+  g_object_unref(in);
+  g_object_unref(stream);
+  g_regex_unref(regex_res);
+  g_regex_unref(regex_req);
+
+  return t;
+}
+
+static double bench_new()
+{
+  GThread* writer;
+  GIOStream* stream = open_stream(&writer);
+  xr_http* http = xr_http_new(stream);
+  GTimer* timer = g_timer_new();
+  char body[1024];
+  int n = 0;
+  double t;
+
+  while (xr_http_read_header(http, NULL))
+  {
+    g_assert(xr_http_get_header(http, "X-SESSION-ID") != NULL);
+    if (xr_http_read(http, body, sizeof(body), NULL) != xr_http_get_message_length(http))
+      break;
+    n++;
+  }
+
+  t = g_timer_elapsed(timer, NULL);
+  g_assert(n == count);
+
+  g_thread_join(writer);
+  g_timer_destroy(timer);
+  xr_http_free(http);
+  g_object_unref(stream);
+
+  return t;
+}
+
+int main(int ac, char* av[])
+{
+  double t_old, t_new;
+
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+
+  xr_init();
+
+  if (ac > 1)
+    count = MAX(100, atoi(av[1]) / 100 * 100);
+
+  t_old = bench_old();
+  t_new = bench_new();
+
+  g_print("old parser: %d requests in %.3f s (%.0f req/s)\n", count, t_old, count / t_old);
+  g_print("new parser: %d requests in %.3f s (%.0f req/s)\n", count, t_new, count / t_new);
+
+  xr_fini();
+  return 0;
+}
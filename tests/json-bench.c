@@ -0,0 +1,318 @@
+/*
+ * Copyright 2006-2008 Ondrej Jirman <ondrej.jirman@zonio.net>
+ *
+ * This file is part of libxr.
+ *
+ * Libxr is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * Libxr is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* JSON-RPC codec microbenchmark
+ *
+ * Compares the streaming JSON codec used by xr_call_serialize_request() and
+ * xr_call_unserialize_request() with the old json-c based one, which built
+ * a json_object tree for every message. Two messages are used: array of
+ * 5000 strings (as in TTest1.putBigArray) and array of records.
+ *
+ * Usage: json-bench [iterations]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#define __STRICT_ANSI__
+#include <json.h>
+#undef __STRICT_ANSI__
+
+#include "xr-lib.h"
+#include "xr-call.h"
+
+static int count = 200;
+
+/* old codec */
+
+static struct json_object* old_value_serialize(xr_value* val)
+{
+  guint i;
+
+  switch (xr_value_get_type(val))
+  {
+    case XRV_ARRAY:
+    {
+      struct json_object* array = json_object_new_array();
+      for (i = 0; i < xr_value_array_length(val); i++)
+        json_object_array_add(array, old_value_serialize(xr_value_array_get(val, i)));
+      return array;
+    }
+    case XRV_STRUCT:
+    {
+      struct json_object* obj = json_object_new_object();
+      for (i = 0; i < xr_value_struct_length(val); i++)
+      {
+        xr_value* m = xr_value_struct_get_nth(val, i);
+        json_object_object_add(obj, (char*)xr_value_get_member_name(m), old_value_serialize(xr_value_get_member_value(m)));
+      }
+      return obj;
+    }
+    case XRV_INT:
+    {
+      int int_val = -1;
+      xr_value_to_int(val, &int_val);
+      return json_object_new_int(int_val);
+    }
+    case XRV_STRING:
+    {
+      char* str_val = NULL;
+      xr_value_to_string(val, &str_val);
+      struct json_object* tmp = json_object_new_string(str_val);
+      g_free(str_val);
+      return tmp;
+    }
+    case XRV_BOOLEAN:
+    {
+      int bool_val = -1;
+      xr_value_to_bool(val, &bool_val);
+      return json_object_new_boolean(bool_val);
+    }
+    case XRV_DOUBLE:
+    {
+      double dbl_val = -1;
+      xr_value_to_double(val, &dbl_val);
+      return json_object_new_double(dbl_val);
+    }
+    default:
+      return NULL;
+  }
+}
+
+static xr_value* old_value_unserialize(struct json_object* obj)
+{
+  switch (json_object_get_type(obj))
+  {
+    case json_type_boolean:
+      return xr_value_bool_new(json_object_get_boolean(obj));
+
+    case json_type_double:
+      return xr_value_double_new(json_object_get_double(obj));
+
+    case json_type_int:
+      return xr_value_int_new(json_object_get_int(obj));
+
+    case json_type_object:
+    {
+      xr_value* str = xr_value_struct_new();
+      json_object_object_foreach(obj, key, val)
+        xr_value_struct_set_member(str, key, old_value_unserialize(val));
+      return str;
+    }
+
+    case json_type_array:
+    {
+      int i;
+      xr_value* arr = xr_value_array_new();
+      const int arr_len = json_object_array_length(obj);
+      for (i = 0; i < arr_len; i++)
+        xr_value_array_append(arr, old_value_unserialize(json_object_array_get_idx(obj, i)));
+      return arr;
+    }
+
+    case json_type_string:
+      return xr_value_string_new(json_object_get_string(obj));
+
+    default:
+      return NULL;
+  }
+}
+
+static void old_serialize_request(xr_call* call, char** buf, int* len)
+{
+  struct json_object *r, *params;
+  int i;
+
+  r = json_object_new_object();
+  json_object_object_add(r, "method", json_object_new_string(xr_call_get_method_full(call)));
+  json_object_object_add(r, "params", params = json_object_new_array());
+  json_object_object_add(r, "id", json_object_new_string("1"));
+
+  for (i = 0; xr_call_get_param(call, i); i++)
+    json_object_array_add(params, old_value_serialize(xr_call_get_param(call, i)));
+
+  *buf = g_strdup(json_object_to_json_string(r));
+  *len = strlen(*buf);
+
+  json_object_put(r);
+}
+
+static gboolean old_unserialize_request(xr_call* call, const char* buf, int len)
+{
+  struct json_tokener* t = json_tokener_new();
+  struct json_object *r, *params;
+  int i;
+
+  r = json_tokener_parse_ex(t, (char*)buf, len);
+  json_tokener_free(t);
+  if (r == NULL)
+    return FALSE;
+
+  params = json_object_object_get(r, "params");
+  for (i = 0; i < json_object_array_length(params); i++)
+    xr_call_add_param(call, old_value_unserialize(json_object_array_get_idx(params, i)));
+
+  json_object_put(r);
+  return TRUE;
+}
+
+static void old_free_buffer(xr_call* call, char* buf)
+{
+  g_free(buf);
+}
+
+/* test driver */
+
+static xr_call* make_big_array()
+{
+  xr_call* call = xr_call_new("TTest1.putBigArray");
+  xr_value* arr = xr_value_array_new();
+  int i;
+
+  for (i = 0; i < 5000; i++)
+  {
+    char* str = g_strdup_printf("user.bob%d@zonio.net", i);
+    xr_value_array_append(arr, xr_value_string_new(str));
+    g_free(str);
+  }
+
+  xr_call_add_param(call, arr);
+  xr_call_set_transport(call, XR_CALL_JSON_RPC);
+  return call;
+}
+
+static xr_call* make_records()
+{
+  xr_call* call = xr_call_new("TTest1.putRecords");
+  int i, j, k;
+
+  for (i = 0; i < 20; i++)
+  {
+    xr_value* recs = xr_value_array_new();
+
+    for (j = 0; j < 100; j++)
+    {
+      xr_value* rec = xr_value_struct_new();
+      xr_value* tags = xr_value_array_new();
+
+      for (k = 0; k < 10; k++)
+      {
+        char* str = g_strdup_printf("tag%d", k);
+        xr_value_array_append(tags, xr_value_string_new(str));
+        g_free(str);
+      }
+
+      xr_value_struct_set_member(rec, "id", xr_value_int_new(i * 100 + j));
+      xr_value_struct_set_member(rec, "name", xr_value_string_new("Some \"quoted\" name"));
+      xr_value_struct_set_member(rec, "active", xr_value_bool_new(j % 2));
+      xr_value_struct_set_member(rec, "score", xr_value_double_new(j / 3.0));
+      xr_value_struct_set_member(rec, "note", xr_value_string_new("Lorem ipsum dolor sit amet, consectetur adipiscing elit"));
+      xr_value_struct_set_member(rec, "tags", tags);
+      xr_value_array_append(recs, rec);
+    }
+
+    xr_call_add_param(call, recs);
+  }
+
+  xr_call_set_transport(call, XR_CALL_JSON_RPC);
+  return call;
+}
+
+typedef void (*serialize_func)(xr_call* call, char** buf, int* len);
+typedef void (*free_buffer_func)(xr_call* call, char* buf);
+typedef gboolean (*unserialize_func)(xr_call* call, const char* buf, int len);
+
+static double bench_encode(serialize_func func, free_buffer_func free_func, xr_call* call, int* len)
+{
+  GTimer* timer = g_timer_new();
+  double t;
+  char* buf;
+  int i;
+
+  for (i = 0; i < count; i++)
+  {
+    func(call, &buf, len);
+    free_func(call, buf);
+  }
+
+  t = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+  return t;
+}
+
+static double bench_decode(unserialize_func func, const char* buf, int len)
+{
+  GTimer* timer = g_timer_new();
+  double t;
+  int i;
+
+  for (i = 0; i < count; i++)
+  {
+    xr_call* call = xr_call_new(NULL);
+
+    xr_call_set_transport(call, XR_CALL_JSON_RPC);
+    if (!func(call, buf, len) || xr_call_get_param(call, 0) == NULL)
+      g_error("decoding failed");
+
+    xr_call_free(call);
+  }
+
+  t = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+  return t;
+}
+
+static void run(const char* name, xr_call* call)
+{
+  double t_old, t_new;
+  char* buf;
+  int len;
+
+  g_print("%s:\n", name);
+
+  t_old = bench_encode(old_serialize_request, old_free_buffer, call, &len);
+  t_new = bench_encode(xr_call_serialize_request, xr_call_free_buffer, call, &len);
+  g_print("  encode: json-c %.3f s, streaming %.3f s (%.1fx), %d bytes\n", t_old, t_new, t_old / t_new, len);
+
+  xr_call_serialize_request(call, &buf, &len);
+  t_old = bench_decode(old_unserialize_request, buf, len);
+  t_new = bench_decode(xr_call_unserialize_request, buf, len);
+  g_print("  decode: json-c %.3f s, streaming %.3f s (%.1fx)\n", t_old, t_new, t_old / t_new);
+  xr_call_free_buffer(call, buf);
+
+  xr_call_free(call);
+}
+
+int main(int ac, char* av[])
+{
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+
+  xr_init();
+
+  if (ac > 1)
+    count = MAX(1, atoi(av[1]));
+
+  g_print("%d iterations\n", count);
+  run("big array", make_big_array());
+  run("records", make_records());
+
+  xr_fini();
+  return 0;
+}
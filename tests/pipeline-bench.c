@@ -0,0 +1,348 @@
+/*
+ * Copyright 2006-2008 Ondrej Jirman <ondrej.jirman@zonio.net>
+ *
+ * This file is part of libxr.
+ *
+ * Libxr is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * Libxr is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* HTTP pipelining benchmark
+ *
+ * Runs a server on localhost behind a local proxy that delays data in both
+ * directions to simulate network latency. One client connection performs
+ * the same calls serially with xr_client_call() and then pipelined with
+ * xr_client_call_send()/xr_client_call_receive() keeping a window of
+ * outstanding calls.
+ *
+ * Usage: pipeline-bench [calls] [window] [one-way delay ms] [port]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "xr-lib.h"
+#include "xr-server.h"
+#include "xr-client.h"
+
+static int calls = 200;
+static int window = 16;
+static int delay = 5;
+
+/* servlet */
+
+static gboolean echo(xr_servlet* servlet, xr_call* call)
+{
+  int value;
+
+  if (!xr_value_to_int(xr_call_get_param(call, 0), &value))
+  {
+    xr_call_set_error(call, -1, "Expected int parameter.");
+    return FALSE;
+  }
+
+  xr_call_set_retval(call, xr_value_int_new(value));
+  return TRUE;
+}
+
+static xr_servlet_method_def bench_methods[] = {
+  {
+    .name = "echo",
+    .cb = echo
+  }
+};
+
+static xr_servlet_def bench_servlet = {
+  .name = "Bench",
+  .methods_count = G_N_ELEMENTS(bench_methods),
+  .methods = bench_methods
+};
+
+static gpointer server_func(xr_server* server)
+{
+  GError* err = NULL;
+
+  if (!xr_server_run(server, &err))
+    g_error("server failed: %s", err->message);
+
+  return NULL;
+}
+
+/* delay proxy: every chunk of data is forwarded after the delay */
+
+struct chunk
+{
+  gint64 due;
+  gssize len;
+  char data[16 * 1024];
+};
+
+struct pump
+{
+  int from;
+  int to;
+  GAsyncQueue* queue;
+};
+
+static gpointer pump_reader(struct pump* p)
+{
+  while (TRUE)
+  {
+    struct chunk* c = g_new(struct chunk, 1);
+
+    c->len = read(p->from, c->data, sizeof(c->data));
+    c->due = g_get_monotonic_time() + delay * 1000;
+    g_async_queue_push(p->queue, c);
+
+    if (c->len <= 0)
+      return NULL;
+  }
+}
+
+static gpointer pump_writer(struct pump* p)
+{
+  while (TRUE)
+  {
+    struct chunk* c = g_async_queue_pop(p->queue);
+    gint64 now = g_get_monotonic_time();
+    gssize off = 0;
+
+    if (c->len <= 0)
+    {
+      shutdown(p->to, SHUT_WR);
+      g_free(c);
+      return NULL;
+    }
+
+    if (c->due > now)
+      g_usleep(c->due - now);
+
+    while (off < c->len)
+    {
+      gssize n = write(p->to, c->data + off, c->len - off);
+      if (n <= 0)
+        break;
+      off += n;
+    }
+
+    g_free(c);
+  }
+}
+
+static int tcp_listen(int port)
+{
+  struct sockaddr_in addr;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0)
+    g_error("proxy bind failed");
+
+  return fd;
+}
+
+static int tcp_connect(int port)
+{
+  struct sockaddr_in addr;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    g_error("proxy connect failed");
+
+  return fd;
+}
+
+static gpointer proxy_func(gpointer data)
+{
+  int port = GPOINTER_TO_INT(data);
+  int lfd = tcp_listen(port + 1);
+
+  while (TRUE)
+  {
+    int client = accept(lfd, NULL, NULL);
+    int server;
+    struct pump* p;
+
+    if (client < 0)
+      continue;
+
+    server = tcp_connect(port);
+    p = g_new0(struct pump, 2);
+    p[0].from = client;
+    p[0].to = server;
+    p[0].queue = g_async_queue_new();
+    p[1].from = server;
+    p[1].to = client;
+    p[1].queue = g_async_queue_new();
+
+    g_thread_create((GThreadFunc)pump_reader, p, FALSE, NULL);
+    g_thread_create((GThreadFunc)pump_writer, p, FALSE, NULL);
+    g_thread_create((GThreadFunc)pump_reader, p + 1, FALSE, NULL);
+    g_thread_create((GThreadFunc)pump_writer, p + 1, FALSE, NULL);
+  }
+
+  return NULL;
+}
+
+/* clients */
+
+static xr_call* echo_call(int i)
+{
+  xr_call* call = xr_call_new("Bench.echo");
+  xr_call_add_param(call, xr_value_int_new(i));
+  return call;
+}
+
+static void check_result(xr_call* call, int i, GError* err)
+{
+  int value;
+
+  if (err)
+    g_error("call failed: %s", err->message);
+
+  if (!xr_value_to_int(xr_call_get_retval(call), &value) || value != i)
+    g_error("response %d matched to wrong call", i);
+}
+
+static double run_serial(const char* uri)
+{
+  GError* err = NULL;
+  xr_client_conn* conn = xr_client_new(&err);
+  GTimer* timer;
+  double t;
+  int i;
+
+  if (!xr_client_open(conn, uri, &err))
+    g_error("connect failed: %s", err->message);
+
+  timer = g_timer_new();
+  for (i = 0; i < calls; i++)
+  {
+    xr_call* call = echo_call(i);
+
+    xr_client_call(conn, call, &err);
+    check_result(call, i, err);
+    xr_call_free(call);
+  }
+  t = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  xr_client_free(conn);
+  return t;
+}
+
+static double run_pipelined(const char* uri)
+{
+  GError* err = NULL;
+  xr_client_conn* conn = xr_client_new(&err);
+  GTimer* timer;
+  double t;
+  int sent = 0, received = 0;
+
+  if (!xr_client_open(conn, uri, &err))
+    g_error("connect failed: %s", err->message);
+
+  timer = g_timer_new();
+  while (received < calls)
+  {
+    xr_call* call;
+
+    while (sent < calls && sent - received < window)
+    {
+      if (!xr_client_call_send(conn, echo_call(sent), &err))
+        g_error("send failed: %s", err->message);
+      sent++;
+    }
+
+    xr_client_call_receive(conn, &call, &err);
+    check_result(call, received, err);
+    xr_call_free(call);
+    received++;
+  }
+  t = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  xr_client_free(conn);
+  return t;
+}
+
+int main(int ac, char* av[])
+{
+  GError* err = NULL;
+  xr_server* server;
+  GThread* server_thread;
+  int port = 4450;
+  char* bind_addr;
+  char* uri;
+  double serial, pipelined;
+
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+
+  xr_init();
+
+  if (ac > 1)
+    calls = MAX(1, atoi(av[1]));
+  if (ac > 2)
+    window = MAX(1, atoi(av[2]));
+  if (ac > 3)
+    delay = MAX(0, atoi(av[3]));
+  if (ac > 4)
+    port = atoi(av[4]);
+
+  server = xr_server_new(NULL, 4, &err);
+  if (server == NULL)
+    g_error("%s", err->message);
+
+  bind_addr = g_strdup_printf("127.0.0.1:%d", port);
+  if (!xr_server_bind(server, bind_addr, &err))
+    g_error("%s", err->message);
+  g_free(bind_addr);
+
+  xr_server_register_servlet(server, &bench_servlet);
+  server_thread = g_thread_create((GThreadFunc)server_func, server, TRUE, NULL);
+  g_thread_create(proxy_func, GINT_TO_POINTER(port), FALSE, NULL);
+  g_usleep(100000);
+
+  uri = g_strdup_printf("http://127.0.0.1:%d/Bench", port + 1);
+
+  serial = run_serial(uri);
+  pipelined = run_pipelined(uri);
+
+  g_print("%d calls, %d ms one-way delay\n", calls, delay);
+  g_print("serial:    %8.3f s (%6.0f calls/s)\n", serial, calls / serial);
+  g_print("pipelined: %8.3f s (%6.0f calls/s), window %d, speedup %.1fx\n", pipelined, calls / pipelined, window, serial / pipelined);
+
+  xr_server_stop(server);
+  g_thread_join(server_thread);
+  xr_server_free(server);
+
+  g_free(uri);
+  xr_fini();
+  return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2006-2008 Ondrej Jirman <ondrej.jirman@zonio.net>
+ *
+ * This file is part of libxr.
+ *
+ * Libxr is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * Libxr is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Session mode contention benchmark
+ *
+ * Runs a server on localhost and many client threads calling it in session
+ * mode. Every session is shared by two clients, so calls on the same
+ * session regularly have to wait for each other. Call latency percentiles
+ * are printed.
+ *
+ * Usage: session-bench [sessions] [calls per client] [port]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "xr-lib.h"
+#include "xr-server.h"
+#include "xr-client.h"
+
+#define CLIENTS_PER_SESSION 2
+
+static int sessions = 64;
+static int calls = 200;
+static char* uri;
+
+/* servlet */
+
+static gboolean ping(xr_servlet* servlet, xr_call* call)
+{
+  int* counter = xr_servlet_get_priv(servlet);
+
+  /* simulate some work */
+  g_usleep(200);
+
+  xr_call_set_retval(call, xr_value_int_new(++*counter));
+  return TRUE;
+}
+
+static xr_servlet_method_def bench_methods[] = {
+  {
+    .name = "ping",
+    .cb = ping
+  }
+};
+
+static xr_servlet_def bench_servlet = {
+  .name = "Bench",
+  .size = sizeof(int),
+  .methods_count = G_N_ELEMENTS(bench_methods),
+  .methods = bench_methods
+};
+
+static gpointer server_func(xr_server* server)
+{
+  GError* err = NULL;
+
+  if (!xr_server_run(server, &err))
+    g_error("server failed: %s", err->message);
+
+  return NULL;
+}
+
+/* clients */
+
+struct client
+{
+  int session;
+  double* latency;
+  GThread* thread;
+};
+
+static gpointer client_func(struct client* c)
+{
+  GError* err = NULL;
+  xr_client_conn* conn = xr_client_new(&err);
+  char* session_id;
+  int i;
+
+  if (!xr_client_open(conn, uri, &err))
+    g_error("connect failed: %s", err->message);
+
+  session_id = g_strdup_printf("session-%d", c->session);
+  xr_client_set_http_header(conn, "X-SESSION-ID", session_id);
+  xr_client_set_http_header(conn, "X-SESSION-USE", "1");
+  g_free(session_id);
+
+  for (i = 0; i < calls; i++)
+  {
+    xr_call* call = xr_call_new("Bench.ping");
+    GTimer* timer = g_timer_new();
+
+    if (!xr_client_call(conn, call, &err))
+      g_error("call failed: %s", err->message);
+
+    c->latency[i] = g_timer_elapsed(timer, NULL) * 1000;
+    g_timer_destroy(timer);
+    xr_call_free(call);
+  }
+
+  xr_client_free(conn);
+  return NULL;
+}
+
+static int cmp_double(const void* a, const void* b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+int main(int ac, char* av[])
+{
+  GError* err = NULL;
+  xr_server* server;
+  GThread* server_thread;
+  struct client* clients;
+  double* latency;
+  int i, count;
+  const char* port = "4449";
+  char* bind_addr;
+  GTimer* timer;
+  double t;
+
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+
+  xr_init();
+
+  if (ac > 1)
+    sessions = MAX(1, atoi(av[1]));
+  if (ac > 2)
+    calls = MAX(1, atoi(av[2]));
+  if (ac > 3)
+    port = av[3];
+
+  count = sessions * CLIENTS_PER_SESSION;
+  uri = g_strdup_printf("http://localhost:%s/Bench", port);
+
+  /* one thread per connection, so that only session locking is measured */
+  server = xr_server_new(NULL, count + 4, &err);
+  if (server == NULL)
+    g_error("%s", err->message);
+
+  bind_addr = g_strdup_printf("127.0.0.1:%s", port);
+  if (!xr_server_bind(server, bind_addr, &err))
+    g_error("%s", err->message);
+  g_free(bind_addr);
+
+  xr_server_register_servlet(server, &bench_servlet);
+  server_thread = g_thread_create((GThreadFunc)server_func, server, TRUE, NULL);
+  g_usleep(100000);
+
+  clients = g_new0(struct client, count);
+  latency = g_new0(double, count * calls);
+
+  timer = g_timer_new();
+  for (i = 0; i < count; i++)
+  {
+    clients[i].session = i / CLIENTS_PER_SESSION;
+    clients[i].latency = latency + i * calls;
+    clients[i].thread = g_thread_create((GThreadFunc)client_func, clients + i, TRUE, NULL);
+  }
+
+  for (i = 0; i < count; i++)
+    g_thread_join(clients[i].thread);
+  t = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  qsort(latency, count * calls, sizeof(double), cmp_double);
+
+  g_print("%d sessions, %d clients, %d calls in %.3f s (%.0f calls/s)\n", sessions, count, count * calls, t, count * calls / t);
+  g_print("latency ms: p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n",
+    latency[count * calls / 2], latency[count * calls * 9 / 10], latency[count * calls * 99 / 100], latency[count * calls - 1]);
+
+  xr_server_stop(server);
+  g_thread_join(server_thread);
+  xr_server_free(server);
+
+  g_free(clients);
+  g_free(latency);
+  g_free(uri);
+  xr_fini();
+  return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2006-2008 Ondrej Jirman <ondrej.jirman@zonio.net>
+ *
+ * This file is part of libxr.
+ *
+ * Libxr is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * Libxr is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Transport benchmark
+ *
+ * Serializes and parses the same requests with every available transport
+ * and prints message sizes and encode/decode times. Payloads are an array
+ * of records, array of 5000 strings, array of numbers and a 1MB blob.
+ *
+ * Usage: transport-bench [iterations]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "xr-lib.h"
+#include "xr-call.h"
+
+static int count = 100;
+
+static const struct
+{
+  xr_call_transport transport;
+  const char* name;
+} transports[] = {
+  { XR_CALL_XML_RPC, "xml-rpc" },
+#ifdef XR_JSON_ENABLED
+  { XR_CALL_JSON_RPC, "json-rpc" },
+#endif
+  { XR_CALL_MSGPACK, "msgpack" },
+};
+
+/* payloads */
+
+static xr_call* make_records()
+{
+  xr_call* call = xr_call_new("Test.putRecords");
+  xr_value* recs = xr_value_array_new();
+  int i, k;
+
+  for (i = 0; i < 2000; i++)
+  {
+    xr_value* rec = xr_value_struct_new();
+    xr_value* tags = xr_value_array_new();
+
+    for (k = 0; k < 10; k++)
+    {
+      char* str = g_strdup_printf("tag%d", k);
+      xr_value_array_append(tags, xr_value_string_new(str));
+      g_free(str);
+    }
+
+    xr_value_struct_set_member(rec, "id", xr_value_int_new(i));
+    xr_value_struct_set_member(rec, "name", xr_value_string_new("Some name"));
+    xr_value_struct_set_member(rec, "active", xr_value_bool_new(i % 2));
+    xr_value_struct_set_member(rec, "score", xr_value_double_new(i / 3.0));
+    xr_value_struct_set_member(rec, "created", xr_value_time_new("20120406T12:00:00"));
+    xr_value_struct_set_member(rec, "tags", tags);
+    xr_value_array_append(recs, rec);
+  }
+
+  xr_call_add_param(call, recs);
+  return call;
+}
+
+static xr_call* make_strings()
+{
+  xr_call* call = xr_call_new("Test.putBigArray");
+  xr_value* arr = xr_value_array_new();
+  int i;
+
+  for (i = 0; i < 5000; i++)
+  {
+    char* str = g_strdup_printf("user.bob%d@zonio.net", i);
+    xr_value_array_append(arr, xr_value_string_new(str));
+    g_free(str);
+  }
+
+  xr_call_add_param(call, arr);
+  return call;
+}
+
+static xr_call* make_numbers()
+{
+  xr_call* call = xr_call_new("Test.putNumbers");
+  xr_value* ints = xr_value_array_new();
+  xr_value* dbls = xr_value_array_new();
+  int i;
+
+  for (i = 0; i < 10000; i++)
+  {
+    xr_value_array_append(ints, xr_value_int_new(i * 7919 - 1000000));
+    xr_value_array_append(dbls, xr_value_double_new(i * 0.125));
+  }
+
+  xr_call_add_param(call, ints);
+  xr_call_add_param(call, dbls);
+  return call;
+}
+
+static xr_call* make_blob()
+{
+  xr_call* call = xr_call_new("Test.putBlob");
+  gsize len = 1024 * 1024;
+  char* buf = g_malloc(len);
+  xr_blob* b;
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    buf[i] = i * 31 + (i >> 8);
+
+  b = xr_blob_new(buf, len);
+  xr_call_add_param(call, xr_value_blob_new(b));
+  xr_blob_unref(b);
+  return call;
+}
+
+/* test driver */
+
+static void run(const char* name, xr_call* call)
+{
+  int t, i;
+
+  g_print("%s:\n", name);
+
+  for (t = 0; t < G_N_ELEMENTS(transports); t++)
+  {
+    GTimer* timer = g_timer_new();
+    double t_enc, t_dec;
+    char* buf;
+    int len;
+
+    xr_call_set_transport(call, transports[t].transport);
+    for (i = 0; i < count; i++)
+    {
+      xr_call_serialize_request(call, &buf, &len);
+      xr_call_free_buffer(call, buf);
+    }
+    t_enc = g_timer_elapsed(timer, NULL);
+
+    xr_call_serialize_request(call, &buf, &len);
+    g_timer_start(timer);
+    for (i = 0; i < count; i++)
+    {
+      xr_call* parsed = xr_call_new(NULL);
+
+      xr_call_set_transport(parsed, transports[t].transport);
+      if (!xr_call_unserialize_request(parsed, buf, len))
+        g_error("%s: decoding failed: %s", transports[t].name, xr_call_get_error_message(parsed));
+
+      xr_call_free(parsed);
+    }
+    t_dec = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+
+    g_print("  %-9s %9d bytes, encode %7.2f ms, decode %7.2f ms\n", transports[t].name, len, t_enc * 1000 / count, t_dec * 1000 / count);
+    xr_call_free_buffer(call, buf);
+  }
+
+  xr_call_free(call);
+}
+
+int main(int ac, char* av[])
+{
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+
+  xr_init();
+
+  if (ac > 1)
+    count = MAX(1, atoi(av[1]));
+
+  g_print("%d iterations, times are per message\n", count);
+  run("records", make_records());
+  run("strings", make_strings());
+  run("numbers", make_numbers());
+  run("blob", make_blob());
+
+  xr_fini();
+  return 0;
+}
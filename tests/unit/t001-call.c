@@ -1,5 +1,9 @@
+#include <math.h>
+#include <float.h>
 #include "tests.h"
 #include "xr-call.h"
+#include "xr-binary.h"
+#include "xr-wire.h"
 
 #define REQUEST(method, params) \
   "<methodCall><methodName>" method "</methodName><params>" params "</params></methodCall>\n"
@@ -148,6 +152,666 @@ static int requestUnserialize4()
   return TRUE;
 }
 
+static int multicall()
+{
+  xr_call* calls[2];
+  xr_call* multicall;
+  xr_call* parsed;
+  xr_value* results;
+  xr_value* fault;
+  char* buf;
+  int len, val = 0;
+
+  calls[0] = xr_call_new("test.first");
+  xr_call_add_param(calls[0], xr_value_int_new(1));
+  calls[1] = xr_call_new("test.second");
+
+  /* request survives serialization */
+  multicall = xr_call_multicall_new(calls, 2);
+  TEST_ASSERT(xr_call_is_multicall(multicall));
+  xr_call_serialize_request(multicall, &buf, &len);
+  parsed = xr_call_new(0);
+  TEST_ASSERT(xr_call_unserialize_request(parsed, buf, len));
+  TEST_ASSERT(xr_call_is_multicall(parsed));
+  TEST_ASSERT(xr_value_array_length(xr_call_get_param(parsed, 0)) == 2);
+  xr_call_free_buffer(multicall, buf);
+  xr_call_free(parsed);
+
+  /* results are distributed to the calls */
+  results = xr_value_array_new();
+  xr_value_array_append(results, xr_value_array_new());
+  xr_value_array_append(xr_value_array_get(results, 0), xr_value_int_new(42));
+  fault = xr_value_struct_new();
+  xr_value_struct_set_member(fault, "faultCode", xr_value_int_new(5));
+  xr_value_struct_set_member(fault, "faultString", xr_value_string_new("failed"));
+  xr_value_array_append(results, fault);
+  xr_call_set_retval(multicall, results);
+
+  TEST_ASSERT(xr_call_multicall_get_results(multicall, calls, 2));
+  TEST_ASSERT(xr_value_to_int(xr_call_get_retval(calls[0]), &val) && val == 42);
+  TEST_ASSERT(xr_call_get_error_code(calls[1]) == 5);
+
+  xr_call_free(multicall);
+  xr_call_free(calls[0]);
+  xr_call_free(calls[1]);
+  return TRUE;
+}
+
+static int msgpackRoundtrip()
+{
+  xr_call* call = xr_call_new("test.m");
+  xr_call* parsed = xr_call_new(0);
+  xr_blob* blob = xr_blob_new(g_strdup("a\xff" "b"), 3);
+  xr_blob* parsed_blob = NULL;
+  char* buf;
+  int len, val = 0;
+
+  xr_call_set_transport(call, XR_CALL_MSGPACK);
+  xr_call_set_transport(parsed, XR_CALL_MSGPACK);
+  xr_call_add_param(call, xr_value_int_new(-100000));
+  xr_call_add_param(call, xr_value_string_new("str"));
+  xr_call_add_param(call, xr_value_blob_new(blob));
+  xr_call_add_param(call, xr_value_time_new("20120406T12:00:00"));
+  xr_blob_unref(blob);
+
+  xr_call_serialize_request(call, &buf, &len);
+  TEST_ASSERT(xr_call_unserialize_request(parsed, buf, len));
+  TEST_ASSERT(!strcmp(xr_call_get_method_full(parsed), "test.m"));
+  TEST_ASSERT(xr_value_to_int(xr_call_get_param(parsed, 0), &val) && val == -100000);
+  TEST_ASSERT(_assert_param_type(parsed, 1, XRV_STRING));
+  TEST_ASSERT(_assert_param_type(parsed, 3, XRV_TIME));
+
+  /* blobs are sent as raw bytes */
+  TEST_ASSERT(xr_value_to_blob(xr_call_get_param(parsed, 2), &parsed_blob));
+  TEST_ASSERT(parsed_blob->len == 3 && !memcmp(parsed_blob->buf, "a\xff" "b", 3));
+  xr_blob_unref(parsed_blob);
+
+  /* truncated message is rejected */
+  xr_call_free(parsed);
+  parsed = xr_call_new(0);
+  xr_call_set_transport(parsed, XR_CALL_MSGPACK);
+  TEST_ASSERT(!xr_call_unserialize_request(parsed, buf, len - 1));
+  xr_call_free_buffer(call, buf);
+
+  /* fault is passed to the caller */
+  xr_call_set_error(parsed, 5, "failed");
+  xr_call_serialize_response(parsed, &buf, &len);
+  TEST_ASSERT(!xr_call_unserialize_response(call, buf, len));
+  TEST_ASSERT(xr_call_get_error_code(call) == 5);
+  xr_call_free_buffer(parsed, buf);
+
+  xr_call_free(parsed);
+  xr_call_free(call);
+  return TRUE;
+}
+
+static int msgpackTruncatedExt()
+{
+  /* ext headers claiming more data than is present */
+  static const struct { const char* data; gsize len; } exts[] = {
+    { "\xc7", 1 },                         /* ext8 without length */
+    { "\xc7\x10\x01", 3 },                 /* ext8 without data */
+    { "\xc9\x00\x00", 3 },                 /* ext32 with partial length */
+    { "\xc9\xff\xff\xff\xff\x01", 6 },     /* ext32 length would wrap */
+    { "\xc9\xff\xff\xff\xff", 5 },         /* same without type byte */
+  };
+  xr_binary_reader r;
+  xr_value* v = NULL;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(exts); i++)
+  {
+    /* [0, 0, "m", [ext]] */
+    GString* msg = g_string_new_len("\x94\x00\x00\xa1m\x91", 6);
+    xr_call* parsed = xr_call_new(0);
+
+    g_string_append_len(msg, exts[i].data, exts[i].len);
+    xr_call_set_transport(parsed, XR_CALL_MSGPACK);
+    TEST_ASSERT(!xr_call_unserialize_request(parsed, msg->str, msg->len));
+    TEST_ASSERT(xr_call_get_param(parsed, 0) == NULL);
+    xr_call_free(parsed);
+
+    /* binary transport embeds length prefixed values using the same parser */
+    g_string_truncate(msg, 0);
+    g_string_append_c(msg, exts[i].len);
+    g_string_append_len(msg, exts[i].data, exts[i].len);
+    xr_binary_reader_init(&r, msg->str, msg->len);
+    TEST_ASSERT(!xr_binary_read_value(&r, XR_BINARY_BYTES, &v));
+    TEST_ASSERT(v == NULL);
+    g_string_free(msg, TRUE);
+  }
+
+  return TRUE;
+}
+
+static int binaryRoundtrip()
+{
+  xr_call* call = xr_call_new("test.b");
+  xr_call* parsed = xr_call_new(0);
+  GString* params = g_string_new(NULL);
+  xr_binary_reader r;
+  xr_binary_wire_type wt;
+  const char* raw;
+  char* str_val = NULL;
+  char* buf;
+  int len, val = 0;
+
+  xr_call_set_transport(call, XR_CALL_BINARY);
+  xr_call_set_transport(parsed, XR_CALL_BINARY);
+  xr_binary_write_int(params, 1, -100000);
+  xr_binary_write_string(params, 300, "str");
+  xr_call_set_raw_params(call, params);
+
+  xr_call_serialize_request(call, &buf, &len);
+  TEST_ASSERT(xr_call_unserialize_request(parsed, buf, len));
+  TEST_ASSERT(!strcmp(xr_call_get_method_full(parsed), "test.b"));
+  xr_call_free_buffer(call, buf);
+
+  /* params are passed as is */
+  raw = xr_call_get_raw_params(parsed, &len);
+  xr_binary_reader_init(&r, raw, len);
+  TEST_ASSERT(xr_binary_read_key(&r, &wt) == 1 && xr_binary_read_int(&r, wt, &val) && val == -100000);
+  TEST_ASSERT(xr_binary_read_key(&r, &wt) == 300 && xr_binary_read_string(&r, wt, &str_val) && !strcmp(str_val, "str"));
+  TEST_ASSERT(xr_binary_read_key(&r, &wt) == 0);
+  g_free(str_val);
+
+  /* truncated field is rejected */
+  xr_binary_reader_init(&r, raw, len - 1);
+  TEST_ASSERT(xr_binary_read_key(&r, &wt) == 1 && xr_binary_skip(&r, wt));
+  TEST_ASSERT(xr_binary_read_key(&r, &wt) == 300 && !xr_binary_skip(&r, wt));
+
+  /* fault is passed to the caller */
+  xr_call_set_error(parsed, 5, "failed");
+  xr_call_serialize_response(parsed, &buf, &len);
+  TEST_ASSERT(!xr_call_unserialize_response(call, buf, len));
+  TEST_ASSERT(xr_call_get_error_code(call) == 5);
+  TEST_ASSERT(!strcmp(xr_call_get_error_message(call), "failed"));
+  xr_call_free_buffer(parsed, buf);
+
+  xr_call_free(parsed);
+  xr_call_free(call);
+  return TRUE;
+}
+
+static int wireParams()
+{
+  const char* req = "<?xml version=\"1.0\"?><methodCall><methodName>test.w</methodName><params>"
+    "<param><value><i4>-7</i4></value></param>"
+    "<param><value><struct><member><name>x</name><value>a &amp; b</value></member>"
+    "<member><name>skip&#46;me</name><value><array><data><value><int>1</int></value></data></array></value></member></struct></value></param>"
+    "</params></methodCall>";
+  xr_call* call = xr_call_new(0);
+  xr_wire_reader r;
+  char* str_val = NULL;
+  double dbl_val = 0;
+  int val = 0;
+
+  xr_call_set_defer_params(call, TRUE);
+  TEST_ASSERT(xr_call_unserialize_request(call, req, strlen(req)));
+  TEST_ASSERT(!strcmp(xr_call_get_method_full(call), "test.w"));
+
+  TEST_ASSERT(xr_wire_reader_init_params(&r, call));
+  TEST_ASSERT(xr_wire_next_item(&r) == 1 && xr_wire_read_int(&r, &val) && val == -7);
+  TEST_ASSERT(xr_wire_next_item(&r) == 1 && xr_wire_begin_struct(&r));
+  TEST_ASSERT(xr_wire_next_member(&r) == 1 && xr_wire_member_is(&r, "x", 1));
+  TEST_ASSERT(xr_wire_read_string(&r, &str_val) && !strcmp(str_val, "a & b"));
+  TEST_ASSERT(xr_wire_next_member(&r) == 1 && xr_wire_member_is(&r, "skip.me", 7) && xr_wire_skip(&r));
+  TEST_ASSERT(xr_wire_next_member(&r) == 0);
+  TEST_ASSERT(xr_wire_next_item(&r) == 0);
+  g_free(str_val);
+
+  /* type mismatch */
+  TEST_ASSERT(xr_wire_reader_init_params(&r, call));
+  TEST_ASSERT(xr_wire_next_item(&r) == 1 && !xr_wire_read_double(&r, &dbl_val));
+
+  /* xr_value params are built on demand */
+  TEST_ASSERT(_assert_param_type(call, 0, XRV_INT));
+  TEST_ASSERT(_assert_param_type(call, 1, XRV_STRUCT));
+  TEST_ASSERT(!xr_wire_reader_init_params(&r, call));
+
+  xr_call_free(call);
+  return TRUE;
+}
+
+static int wireFallback()
+{
+  /* documents outside the subset read by the direct reader, value is the
+   * expected string param, NULL for other types */
+  static const struct { const char* req; const char* value; } reqs[] = {
+    /* CDATA section */
+    { "<methodCall><methodName>test.w</methodName><params>"
+      "<param><value><string><![CDATA[a<b]]></string></value></param></params></methodCall>", "a<b" },
+    /* comments */
+    { "<methodCall><methodName>test.w</methodName><!-- c --><params>"
+      "<param><value><string>a<!-- c -->b</string></value></param></params></methodCall>", "ab" },
+    /* DOCTYPE */
+    { "<?xml version=\"1.0\"?><!DOCTYPE methodCall><methodCall><methodName>test.w</methodName><params>"
+      "<param><value><int>1</int></value></param></params></methodCall>", NULL },
+    /* attributes */
+    { "<methodCall><methodName>test.w</methodName><params>"
+      "<param><value a=\"1\"><string xml:space=\"preserve\"> a </string></value></param></params></methodCall>", " a " },
+    /* non-UTF-8 encoding */
+    { "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?><methodCall><methodName>test.w</methodName><params>"
+      "<param><value><string>\xe9</string></value></param></params></methodCall>", "\xc3\xa9" },
+  };
+  /* ]]> is not allowed in text, both decoders must reject it */
+  const char* bad = "<methodCall><methodName>test.w</methodName><params>"
+    "<param><value><string>a]]>b</string></value></param></params></methodCall>";
+  xr_call* call;
+  xr_wire_reader r;
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS(reqs); i++)
+  {
+    xr_call* eager = xr_call_new(0);
+    xr_call* deferred = xr_call_new(0);
+    char *eager_buf, *deferred_buf;
+    int eager_len, deferred_len;
+    char* str_val = NULL;
+
+    xr_call_set_defer_params(deferred, TRUE);
+    TEST_ASSERT(xr_call_unserialize_request(eager, reqs[i].req, strlen(reqs[i].req)));
+    TEST_ASSERT(xr_call_unserialize_request(deferred, reqs[i].req, strlen(reqs[i].req)));
+
+    /* deferred call was decoded by the eager decoder */
+    TEST_ASSERT(!xr_wire_reader_init_params(&r, deferred));
+    if (reqs[i].value)
+    {
+      TEST_ASSERT(xr_value_to_string(xr_call_get_param(deferred, 0), &str_val) && !strcmp(str_val, reqs[i].value));
+      g_free(str_val);
+    }
+
+    /* same params as eager decoding */
+    xr_call_serialize_request(eager, &eager_buf, &eager_len);
+    xr_call_serialize_request(deferred, &deferred_buf, &deferred_len);
+    TEST_ASSERT(eager_len == deferred_len && !memcmp(eager_buf, deferred_buf, eager_len));
+    xr_call_free_buffer(eager, eager_buf);
+    xr_call_free_buffer(deferred, deferred_buf);
+
+    xr_call_free(eager);
+    xr_call_free(deferred);
+  }
+
+  call = xr_call_new(0);
+  xr_call_set_defer_params(call, TRUE);
+  TEST_ASSERT(!xr_call_unserialize_request(call, bad, strlen(bad)));
+  xr_call_free(call);
+
+  call = xr_call_new(0);
+  TEST_ASSERT(!xr_call_unserialize_request(call, bad, strlen(bad)));
+  xr_call_free(call);
+
+  return TRUE;
+}
+
+static int wireRetval()
+{
+  xr_call* call = xr_call_new("test.w");
+  xr_call* ref = xr_call_new("test.w");
+  xr_value* v = xr_value_struct_new();
+  xr_wire_writer w;
+  char *buf, *ref_buf;
+  int len, ref_len;
+
+  xr_value_struct_set_member(v, "a", xr_value_string_new("x<y"));
+  xr_value_struct_set_member(v, "b", xr_value_array_new());
+  xr_call_set_retval(ref, v);
+
+  /* only calls received by the generated servlets */
+  TEST_ASSERT(!xr_wire_writer_init_retval(&w, call));
+  xr_call_set_defer_params(call, TRUE);
+  TEST_ASSERT(xr_wire_writer_init_retval(&w, call));
+
+  xr_wire_write_struct_begin(&w);
+  xr_wire_write_member(&w, "<member><name>a</name>", 22, "\"a\":", 4);
+  TEST_ASSERT(xr_wire_write_string(&w, "x<y"));
+  xr_wire_write_member(&w, "</member><member><name>b</name>", 31, ",\"b\":", 5);
+  xr_wire_write_array_begin(&w);
+  xr_wire_write_array_end(&w);
+  xr_wire_write_struct_end(&w);
+  xr_wire_writer_finish_retval(&w, call);
+
+  xr_call_serialize_response(call, &buf, &len);
+  xr_call_serialize_response(ref, &ref_buf, &ref_len);
+  TEST_ASSERT(len == ref_len && !memcmp(buf, ref_buf, len));
+  xr_call_free_buffer(call, buf);
+  xr_call_free_buffer(ref, ref_buf);
+
+  /* xr_value retval is built on demand */
+  TEST_ASSERT(xr_value_get_type(xr_call_get_retval(call)) == XRV_STRUCT);
+  TEST_ASSERT(xr_value_get_type(xr_value_get_member(xr_call_get_retval(call), "b")) == XRV_ARRAY);
+
+  xr_call_free(call);
+  xr_call_free(ref);
+  return TRUE;
+}
+
+static int arenaAlloc()
+{
+  xr_arena* arena = xr_arena_new(256);
+  xr_call* call = xr_call_new(0);
+  char* str = NULL;
+  xr_value* st;
+  int i, value = 0;
+  char* call_value =
+  REQUEST("test",
+    PARAM(VALUE(string, "s1"))
+    PARAM("<value><struct>" MEMBER(a, VALUE(int, "1")) MEMBER(b, VALUE(int, "2")) "</struct></value>")
+  );
+
+  TEST_ASSERT(xr_arena_bind(arena) == NULL);
+  TEST_ASSERT(xr_call_unserialize_request(call, call_value, -1));
+
+  /* more nodes than fit into one chunk */
+  st = xr_value_struct_new();
+  for (i = 0; i < 100; i++)
+  {
+    char* name = g_strdup_printf("m%d", i);
+    xr_value_struct_set_member(st, name, xr_value_int_new(i));
+    g_free(name);
+  }
+
+  TEST_ASSERT(xr_arena_bind(NULL) == arena);
+
+  TEST_ASSERT(xr_value_to_string(xr_call_get_param(call, 0), &str) && !strcmp(str, "s1"));
+  g_free(str);
+  TEST_ASSERT(xr_value_to_int(xr_value_get_member(xr_call_get_param(call, 1), "b"), &value) && value == 2);
+  TEST_ASSERT(xr_value_to_int(xr_value_get_member(st, "m77"), &value) && value == 77);
+  TEST_ASSERT(xr_value_struct_length(st) == 100);
+
+  /* unref has no effect on arena nodes */
+  xr_value_unref(st);
+  TEST_ASSERT(xr_value_to_int(xr_value_get_member(st, "m99"), &value) && value == 99);
+
+  xr_call_free(call);
+  xr_arena_reset(arena);
+
+  /* arena is usable after reset */
+  xr_arena_bind(arena);
+  st = xr_value_string_new("again");
+  xr_arena_bind(NULL);
+  TEST_ASSERT(xr_value_to_string(st, &str) && !strcmp(str, "again"));
+  g_free(str);
+
+  xr_arena_free(arena);
+  return TRUE;
+}
+
+static int arenaPromote()
+{
+  xr_arena* arena = xr_arena_new(0);
+  xr_value *arr, *st, *copy, *ref;
+  char* str = NULL;
+  int value = 0;
+
+  xr_arena_bind(arena);
+  arr = xr_value_array_new();
+  st = xr_value_struct_new();
+  xr_value_struct_set_member(st, "a", xr_value_int_new(2));
+  xr_value_array_append(arr, xr_value_string_new("s"));
+  xr_value_array_append(arr, xr_value_int_new(1));
+  xr_value_array_append(arr, st);
+  copy = xr_value_promote(arr);
+  ref = xr_value_ref(arr);
+  xr_arena_bind(NULL);
+
+  /* both are heap copies of the arena tree */
+  TEST_ASSERT(copy != arr && ref != arr && ref != copy);
+
+  xr_arena_reset(arena);
+
+  TEST_ASSERT(xr_value_array_length(copy) == 3);
+  TEST_ASSERT(xr_value_to_string(xr_value_array_get(copy, 0), &str) && !strcmp(str, "s"));
+  g_free(str);
+  TEST_ASSERT(xr_value_to_int(xr_value_get_member(xr_value_array_get(ref, 2), "a"), &value) && value == 2);
+
+  /* heap node is refed, not copied */
+  TEST_ASSERT(xr_value_ref(copy) == copy);
+  xr_value_unref(copy);
+
+  xr_value_unref(copy);
+  xr_value_unref(ref);
+  xr_arena_free(arena);
+  return TRUE;
+}
+
+static int arenaAdopt()
+{
+  xr_arena* arena = xr_arena_new(0);
+  xr_arena* other = xr_arena_new(0);
+  xr_value* heap_arr = xr_value_array_new();
+  xr_value* heap_str = xr_value_string_new("heap");
+  xr_value *arena_arr, *arena_str, *other_arr;
+  char* str = NULL;
+
+  xr_arena_bind(arena);
+  arena_arr = xr_value_array_new();
+  arena_str = xr_value_string_new("arena");
+  /* heap node stored in arena container is unrefed on reset */
+  xr_value_array_append(arena_arr, xr_value_ref(heap_str));
+  xr_value_array_append(arena_arr, arena_str);
+  xr_arena_bind(other);
+  /* node from another arena is copied */
+  other_arr = xr_value_array_new();
+  xr_value_array_append(other_arr, arena_str);
+  xr_arena_bind(NULL);
+
+  /* arena node stored in heap container is copied */
+  xr_value_array_append(heap_arr, arena_str);
+  TEST_ASSERT(xr_value_array_get(heap_arr, 0) != arena_str);
+  TEST_ASSERT(xr_value_array_get(other_arr, 0) != arena_str);
+  TEST_ASSERT(xr_value_array_get(arena_arr, 0) == heap_str);
+
+  xr_arena_reset(arena);
+
+  TEST_ASSERT(xr_value_to_string(xr_value_array_get(heap_arr, 0), &str) && !strcmp(str, "arena"));
+  g_free(str);
+  TEST_ASSERT(xr_value_to_string(xr_value_array_get(other_arr, 0), &str) && !strcmp(str, "arena"));
+  g_free(str);
+  TEST_ASSERT(xr_value_to_string(heap_str, &str) && !strcmp(str, "heap"));
+  g_free(str);
+
+  xr_value_unref(heap_str);
+  xr_value_unref(heap_arr);
+  xr_arena_free(other);
+  xr_arena_free(arena);
+  return TRUE;
+}
+
+#ifdef XR_JSON_ENABLED
+
+static int jsonRequest()
+{
+  const char* req = "{\"jsonrpc\":\"2.0\",\"method\":\"test.m\",\"params\":[1,2.5,\"a\\\"\\u00e9\",{\"k\":[true]}],\"id\":\"x1\"}";
+  const char* resp = "{\"jsonrpc\":\"2.0\",\"result\":7,\"id\":\"x1\"}";
+  xr_call* call = xr_call_new(0);
+  char* str_val = NULL;
+  char* buf;
+  int len;
+
+  xr_call_set_transport(call, XR_CALL_JSON_RPC);
+  TEST_ASSERT(xr_call_unserialize_request(call, req, strlen(req)));
+  TEST_ASSERT(!strcmp(xr_call_get_method_full(call), "test.m"));
+  TEST_ASSERT(_assert_param_type(call, 0, XRV_INT));
+  TEST_ASSERT(_assert_param_type(call, 1, XRV_DOUBLE));
+  TEST_ASSERT(_assert_param_type(call, 3, XRV_STRUCT));
+  TEST_ASSERT(xr_value_to_string(xr_call_get_param(call, 2), &str_val) && !strcmp(str_val, "a\"\xc3\xa9"));
+  g_free(str_val);
+
+  /* response echoes the request id */
+  xr_call_set_retval(call, xr_value_int_new(7));
+  xr_call_serialize_response(call, &buf, &len);
+  TEST_ASSERT(len == strlen(resp) && !memcmp(buf, resp, len));
+  xr_call_free_buffer(call, buf);
+  xr_call_free(call);
+
+  /* invalid JSON is rejected */
+  call = xr_call_new(0);
+  xr_call_set_transport(call, XR_CALL_JSON_RPC);
+  TEST_ASSERT(!xr_call_unserialize_request(call, req, strlen(req) - 1));
+  xr_call_free(call);
+
+  return TRUE;
+}
+
+/* serialize JSON-RPC response to the request */
+static char* json_respond(const char* req, gboolean parsed)
+{
+  xr_call* call = xr_call_new(0);
+  char* buf;
+  char* resp;
+  int len;
+
+  xr_call_set_transport(call, XR_CALL_JSON_RPC);
+  if (xr_call_unserialize_request(call, req, strlen(req)) != parsed)
+  {
+    xr_call_free(call);
+    return NULL;
+  }
+
+  /* server runs the multicall, results are [value] or fault struct */
+  if (xr_call_is_multicall(call))
+  {
+    xr_value* results = xr_value_array_new();
+    guint i;
+
+    for (i = 0; i < xr_value_array_length(xr_call_get_param(call, 0)); i++)
+    {
+      xr_value* result = xr_value_array_new();
+      xr_value_array_append(result, xr_value_int_new(i));
+      xr_value_array_append(results, result);
+    }
+    xr_call_set_retval(call, results);
+  }
+  else if (parsed)
+    xr_call_set_retval(call, xr_value_int_new(7));
+
+  xr_call_serialize_response(call, &buf, &len);
+  resp = g_strndup(buf, len);
+  xr_call_free_buffer(call, buf);
+  xr_call_free(call);
+  return resp;
+}
+
+static int jsonNotification()
+{
+  char* resp;
+
+  /* JSON-RPC 2.0 request without id gets no response */
+  resp = json_respond("{\"jsonrpc\":\"2.0\",\"method\":\"m\",\"params\":[]}", TRUE);
+  TEST_ASSERT(resp != NULL && !strcmp(resp, ""));
+  g_free(resp);
+
+  /* null id is not a notification */
+  resp = json_respond("{\"jsonrpc\":\"2.0\",\"method\":\"m\",\"params\":[],\"id\":null}", TRUE);
+  TEST_ASSERT(resp != NULL && !strcmp(resp, "{\"jsonrpc\":\"2.0\",\"result\":7,\"id\":null}"));
+  g_free(resp);
+
+  /* JSON-RPC 1.0 request without id is answered */
+  resp = json_respond("{\"method\":\"m\",\"params\":[]}", TRUE);
+  TEST_ASSERT(resp != NULL && !strcmp(resp, "{\"result\":7,\"error\":null,\"id\":null}"));
+  g_free(resp);
+
+  /* invalid request is answered even without id */
+  resp = json_respond("{\"jsonrpc\":\"2.0\",\"params\":[]}", FALSE);
+  TEST_ASSERT(resp != NULL && strstr(resp, "\"error\":") && strstr(resp, "\"id\":null"));
+  g_free(resp);
+
+  /* notifications are left out of the batch response */
+  resp = json_respond("[{\"jsonrpc\":\"2.0\",\"method\":\"a\",\"params\":[]},"
+    "{\"jsonrpc\":\"2.0\",\"method\":\"b\",\"params\":[],\"id\":2},"
+    "{\"jsonrpc\":\"2.0\",\"method\":\"c\",\"params\":[]}]", TRUE);
+  TEST_ASSERT(resp != NULL && !strcmp(resp, "[{\"jsonrpc\":\"2.0\",\"result\":1,\"id\":2}]"));
+  g_free(resp);
+
+  /* batch of notifications gets no response, not an empty array */
+  resp = json_respond("[{\"jsonrpc\":\"2.0\",\"method\":\"a\",\"params\":[]},"
+    "{\"jsonrpc\":\"2.0\",\"method\":\"b\",\"params\":[]}]", TRUE);
+  TEST_ASSERT(resp != NULL && !strcmp(resp, ""));
+  g_free(resp);
+
+  /* empty batch is invalid */
+  resp = json_respond("[]", FALSE);
+  TEST_ASSERT(resp != NULL && strstr(resp, "\"error\":") && strstr(resp, "\"id\":null"));
+  g_free(resp);
+
+  return TRUE;
+}
+
+static int jsonDouble()
+{
+  const char* expected = "{\"jsonrpc\":\"2.0\",\"result\":[0.1,0.3333333333333333,1.0,-2.5e-300,"
+    "1.7976931348623157e+308,123456.789,null,null,null],\"id\":1}";
+  const char* req = "{\"jsonrpc\":\"2.0\",\"method\":\"m\",\"params\":[],\"id\":1}";
+  double values[] = { 0.1, 1.0 / 3, 1.0, -2.5e-300, DBL_MAX, 123456.789, NAN, INFINITY, -INFINITY };
+  xr_call* call = xr_call_new(0);
+  xr_value* arr = xr_value_array_new();
+  double value = 0;
+  char* buf;
+  int len, i;
+
+  xr_call_set_transport(call, XR_CALL_JSON_RPC);
+  TEST_ASSERT(xr_call_unserialize_request(call, req, strlen(req)));
+  for (i = 0; i < G_N_ELEMENTS(values); i++)
+    xr_value_array_append(arr, xr_value_double_new(values[i]));
+  xr_call_set_retval(call, arr);
+
+  /* shortest form that reads back as the same value, NaN and infinities
+     are not valid JSON */
+  xr_call_serialize_response(call, &buf, &len);
+  TEST_ASSERT(len == strlen(expected) && !memcmp(buf, expected, len));
+  xr_call_free_buffer(call, buf);
+  xr_call_free(call);
+
+  /* values read back unchanged */
+  req = "{\"method\":\"m\",\"params\":[0.1,0.3333333333333333,1.0,-2.5e-300,1.7976931348623157e+308,123456.789]}";
+  call = xr_call_new(0);
+  xr_call_set_transport(call, XR_CALL_JSON_RPC);
+  TEST_ASSERT(xr_call_unserialize_request(call, req, strlen(req)));
+  for (i = 0; i < 6; i++)
+  {
+    TEST_ASSERT(xr_value_to_double(xr_call_get_param(call, i), &value));
+    TEST_ASSERT(value == values[i]);
+  }
+  xr_call_free(call);
+
+  return TRUE;
+}
+
+static int jsonBatchResponse()
+{
+  xr_call* calls[2];
+  xr_call* multicall;
+  char* buf;
+  char* resp;
+  int len, id, val = 0;
+
+  calls[0] = xr_call_new("test.first");
+  calls[1] = xr_call_new("test.second");
+  multicall = xr_call_multicall_new(calls, 2);
+  xr_call_set_transport(multicall, XR_CALL_JSON_RPC);
+  xr_call_serialize_request(multicall, &buf, &len);
+  TEST_ASSERT(buf[0] == '[' && strstr(buf, "\"id\":") != NULL);
+  id = g_ascii_strtoll(strstr(buf, "\"id\":") + 5, NULL, 10);
+  xr_call_free_buffer(multicall, buf);
+
+  /* responses are matched by id, not by position */
+  resp = g_strdup_printf("[{\"jsonrpc\":\"2.0\",\"error\":{\"code\":5,\"message\":\"failed\"},\"id\":%d},"
+    "{\"jsonrpc\":\"2.0\",\"result\":42,\"id\":%d}]", id + 1, id);
+  TEST_ASSERT(xr_call_unserialize_response(multicall, resp, strlen(resp)));
+  TEST_ASSERT(xr_call_multicall_get_results(multicall, calls, 2));
+  TEST_ASSERT(xr_value_to_int(xr_call_get_retval(calls[0]), &val) && val == 42);
+  TEST_ASSERT(xr_call_get_error_code(calls[1]) == 5);
+
+  g_free(resp);
+  xr_call_free(multicall);
+  xr_call_free(calls[0]);
+  xr_call_free(calls[1]);
+  return TRUE;
+}
+
+#endif
+
 /* testsuite */
 
 int main()
@@ -160,5 +824,21 @@ int main()
   RUN_TEST(requestUnserialize2);
   RUN_TEST(requestUnserialize3);
   RUN_TEST(requestUnserialize4);
+  RUN_TEST(multicall);
+  RUN_TEST(msgpackRoundtrip);
+  RUN_TEST(msgpackTruncatedExt);
+  RUN_TEST(binaryRoundtrip);
+  RUN_TEST(wireParams);
+  RUN_TEST(wireFallback);
+  RUN_TEST(wireRetval);
+  RUN_TEST(arenaAlloc);
+  RUN_TEST(arenaPromote);
+  RUN_TEST(arenaAdopt);
+#ifdef XR_JSON_ENABLED
+  RUN_TEST(jsonRequest);
+  RUN_TEST(jsonBatchResponse);
+  RUN_TEST(jsonNotification);
+  RUN_TEST(jsonDouble);
+#endif
   return failed ? 1 : 0;
 }
@@ -0,0 +1,1066 @@
+#include <config.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "tests.h"
+#include "xr-lib.h"
+#include "xr-server.h"
+#include "xr-client.h"
+
+#define PING_REQUEST \
+  "<methodCall><methodName>ping</methodName><params></params></methodCall>\n"
+#define LATER_REQUEST \
+  "<methodCall><methodName>later</methodName><params><param><value><int>41</int></value></param></params></methodCall>\n"
+
+/* test servlet */
+
+static gboolean ping(xr_servlet* servlet, xr_call* call)
+{
+  int* counter = xr_servlet_get_priv(servlet);
+
+  xr_call_set_retval(call, xr_value_int_new(++*counter));
+  return TRUE;
+}
+
+static gboolean echo(xr_servlet* servlet, xr_call* call)
+{
+  xr_value* val = xr_call_get_param(call, 0);
+
+  if (val == NULL)
+  {
+    xr_call_set_error(call, -1, "Missing parameter.");
+    return FALSE;
+  }
+
+  xr_call_set_retval(call, xr_value_ref(val));
+  return TRUE;
+}
+
+static xr_servlet_method_def test_methods[] = {
+  {
+    .name = "ping",
+    .cb = ping
+  },
+  {
+    .name = "echo",
+    .cb = echo
+  }
+};
+
+static xr_servlet_def test_servlet = {
+  .name = "Test",
+  .size = sizeof(int),
+  .methods_count = G_N_ELEMENTS(test_methods),
+  .methods = test_methods
+};
+
+static xr_servlet_def stateless_servlet = {
+  .name = "Test",
+  .size = sizeof(int),
+  .stateless = TRUE,
+  .methods_count = G_N_ELEMENTS(test_methods),
+  .methods = test_methods
+};
+
+/* servlet with deferred method, calls are completed by the test through
+ * deferred_calls queue */
+
+static GAsyncQueue* deferred_calls;
+static GAsyncQueue* later_resume; /* if set, later waits for an item before returning */
+static int later_finis;
+
+static gboolean later(xr_servlet* servlet, xr_call* call)
+{
+  g_async_queue_push(deferred_calls, xr_servlet_defer_call(servlet));
+
+  if (later_resume)
+    g_async_queue_pop(later_resume);
+
+  return TRUE;
+}
+
+static void later_fini(xr_servlet* servlet)
+{
+  g_atomic_int_inc(&later_finis);
+}
+
+static xr_servlet_method_def later_methods[] = {
+  {
+    .name = "ping",
+    .cb = ping
+  },
+  {
+    .name = "later",
+    .cb = later
+  }
+};
+
+static xr_servlet_def later_servlet = {
+  .name = "Test",
+  .size = sizeof(int),
+  .fini = later_fini,
+  .methods_count = G_N_ELEMENTS(later_methods),
+  .methods = later_methods
+};
+
+/* complete deferred call with its int param + 1 */
+static void complete_later(xr_pending_call* pending)
+{
+  xr_call* call = xr_pending_call_get_call(pending);
+  int value = 0;
+
+  xr_value_to_int(xr_call_get_param(call, 0), &value);
+  xr_call_set_retval(call, xr_value_int_new(value + 1));
+  xr_pending_call_complete(pending);
+}
+
+static gpointer completer_func(gpointer count)
+{
+  int i;
+
+  for (i = 0; i < GPOINTER_TO_INT(count); i++)
+  {
+    g_usleep(20000);
+    complete_later(g_async_queue_pop(deferred_calls));
+  }
+
+  return NULL;
+}
+
+/* pooled servlet */
+
+static int pool_inits;
+static int pool_resets;
+
+static gboolean pool_init(xr_servlet* servlet)
+{
+  g_atomic_int_inc(&pool_inits);
+  return TRUE;
+}
+
+static gboolean pool_reset(xr_servlet* servlet)
+{
+  int* counter = xr_servlet_get_priv(servlet);
+
+  *counter = 0;
+  g_atomic_int_inc(&pool_resets);
+  return TRUE;
+}
+
+static xr_servlet_def pool_servlet = {
+  .name = "Test",
+  .size = sizeof(int),
+  .init = pool_init,
+  .reset = pool_reset,
+  .methods_count = G_N_ELEMENTS(test_methods),
+  .methods = test_methods,
+  .session_ttl = 1
+};
+
+/* server fixture */
+
+static xr_server* server;
+static GThread* server_thread;
+static char* server_uri;
+static int server_port = 14460;
+
+static gpointer server_func(xr_server* server)
+{
+  xr_server_run(server, NULL);
+  return NULL;
+}
+
+static gboolean start_server(xr_server* s, xr_servlet_def* servlet)
+{
+  char* bind_addr;
+  gboolean rs;
+
+  server_port++;
+  bind_addr = g_strdup_printf("127.0.0.1:%d", server_port);
+  rs = xr_server_bind(s, bind_addr, NULL);
+  g_free(bind_addr);
+  if (!rs)
+    return FALSE;
+
+  xr_server_register_servlet(s, servlet);
+  server = s;
+  server_uri = g_strdup_printf("http://127.0.0.1:%d/%s", server_port, servlet->name);
+  server_thread = g_thread_create((GThreadFunc)server_func, server, TRUE, NULL);
+  g_usleep(100000);
+  return TRUE;
+}
+
+static void stop_server()
+{
+  xr_server_stop(server);
+  g_thread_join(server_thread);
+  xr_server_free(server);
+  g_free(server_uri);
+  server = NULL;
+}
+
+/* raw connections, so that the tests control how requests hit the wire */
+
+static GSocketConnection* raw_connect()
+{
+  GSocketClient* client = g_socket_client_new();
+  GSocketConnection* conn;
+
+  conn = g_socket_client_connect_to_host(client, "127.0.0.1", server_port, NULL, NULL);
+  g_object_unref(client);
+  if (conn)
+    g_socket_set_timeout(g_socket_connection_get_socket(conn), 5);
+
+  return conn;
+}
+
+static gboolean raw_send(GSocketConnection* conn, const char* data)
+{
+  return g_socket_send(g_socket_connection_get_socket(conn), data, strlen(data), NULL, NULL) == strlen(data);
+}
+
+/* Read one response with Content-Length body. Returns HTTP code or -1. */
+static int raw_response(GSocketConnection* conn, GString* buf, char** body)
+{
+  GSocket* sock = g_socket_connection_get_socket(conn);
+  char* end;
+  char* clen;
+  int code;
+  gsize header_len, body_len;
+
+  while (TRUE)
+  {
+    char tmp[4096];
+    gssize len;
+
+    end = strstr(buf->str, "\r\n\r\n");
+    if (end)
+    {
+      header_len = end - buf->str + 4;
+      clen = strstr(buf->str, "Content-Length: ");
+      body_len = clen && clen < end ? atoi(clen + 16) : 0;
+      if (buf->len >= header_len + body_len)
+        break;
+    }
+
+    len = g_socket_receive(sock, tmp, sizeof(tmp), NULL, NULL);
+    if (len <= 0)
+      return -1;
+    g_string_append_len(buf, tmp, len);
+  }
+
+  if (sscanf(buf->str, "HTTP/1.%*d %d", &code) != 1)
+    return -1;
+
+  if (body)
+    *body = g_strndup(buf->str + header_len, body_len);
+  g_string_erase(buf, 0, header_len + body_len);
+  return code;
+}
+
+/* POST @request to /Test and read the response. */
+static int raw_call(GSocketConnection* conn, const char* request, char** body)
+{
+  GString* buf = g_string_new("");
+  char* msg;
+  int code = -1;
+
+  msg = g_strdup_printf("POST /Test HTTP/1.1\r\nContent-Type: text/xml\r\nContent-Length: %d\r\n\r\n%s", (int)strlen(request), request);
+  if (raw_send(conn, msg))
+    code = raw_response(conn, buf, body);
+
+  g_free(msg);
+  g_string_free(buf, TRUE);
+  return code;
+}
+
+/* Call ping and return the counter, -1 on error. */
+static int client_ping(xr_client_conn* conn)
+{
+  xr_call* call = xr_call_new("ping");
+  int counter = -1;
+
+  if (xr_client_call(conn, call, NULL))
+    xr_value_to_int(xr_call_get_retval(call), &counter);
+
+  xr_call_free(call);
+  return counter;
+}
+
+static xr_client_conn* client_connect(const char* session_id)
+{
+  xr_client_conn* conn = xr_client_new(NULL);
+
+  if (!xr_client_open(conn, server_uri, NULL))
+  {
+    xr_client_free(conn);
+    return NULL;
+  }
+
+  if (session_id)
+  {
+    xr_client_set_http_header(conn, "X-SESSION-ID", session_id);
+    xr_client_set_http_header(conn, "X-SESSION-USE", "1");
+  }
+
+  return conn;
+}
+
+static int client_later(xr_client_conn* conn, int value)
+{
+  xr_call* call = xr_call_new("later");
+  int result = -1;
+
+  xr_call_add_param(call, xr_value_int_new(value));
+  if (xr_client_call(conn, call, NULL))
+    xr_value_to_int(xr_call_get_retval(call), &result);
+
+  xr_call_free(call);
+  return result;
+}
+
+/* tests */
+
+static int deferredCall(xr_server* s)
+{
+  GThread* completer;
+  xr_client_conn* conn;
+  xr_call* calls[3];
+  int i;
+
+  TEST_ASSERT(s != NULL);
+  TEST_ASSERT(start_server(s, &later_servlet));
+
+  completer = g_thread_create(completer_func, GINT_TO_POINTER(5), TRUE, NULL);
+
+  conn = client_connect(NULL);
+  TEST_ASSERT(conn != NULL);
+  TEST_ASSERT(client_later(conn, 1) == 2);
+  TEST_ASSERT(client_ping(conn) == 1);
+  TEST_ASSERT(client_later(conn, 10) == 11);
+
+  /* deferred sub-calls of multicall are waited for */
+  for (i = 0; i < G_N_ELEMENTS(calls); i++)
+  {
+    calls[i] = xr_call_new(i == 1 ? "ping" : "later");
+    xr_call_add_param(calls[i], xr_value_int_new(i * 100));
+  }
+  TEST_ASSERT(xr_client_call_batch(conn, calls, G_N_ELEMENTS(calls), NULL));
+  for (i = 0; i < G_N_ELEMENTS(calls); i++)
+  {
+    int value = -1;
+    xr_value_to_int(xr_call_get_retval(calls[i]), &value);
+    TEST_ASSERT(value == (i == 1 ? 2 : i * 100 + 1));
+    xr_call_free(calls[i]);
+  }
+  xr_client_free(conn);
+
+  /* session servlet is locked until the call is completed */
+  conn = client_connect("session-a");
+  TEST_ASSERT(client_later(conn, 20) == 21);
+  TEST_ASSERT(client_ping(conn) == 1);
+  xr_client_free(conn);
+
+  g_thread_join(completer);
+  stop_server();
+  return TRUE;
+}
+
+static int deferredCallThreaded()
+{
+  return deferredCall(xr_server_new(NULL, 4, NULL));
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static int deferredCallEvented()
+{
+  return deferredCall(xr_server_new_evented(NULL, 1, 2, NULL));
+}
+#endif
+
+/* response uses the MessagePack content type variant of the request */
+static int msgpackContentType()
+{
+  static const char* const ctypes[] = { "application/msgpack", "application/x-msgpack", "application/msgpack" };
+  /* [0, 1, "ping", []] */
+  static const char request[] = "\x94\x00\x01\xa4ping\x90";
+  GSocketConnection* conn;
+  GSocket* sock;
+  GString* buf = g_string_new("");
+  int i;
+  xr_server* s = xr_server_new(NULL, 4, NULL);
+
+  TEST_ASSERT(s != NULL);
+  TEST_ASSERT(start_server(s, &test_servlet));
+  TEST_ASSERT((conn = raw_connect()) != NULL);
+  sock = g_socket_connection_get_socket(conn);
+
+  for (i = 0; i < G_N_ELEMENTS(ctypes); i++)
+  {
+    char* header = g_strdup_printf("POST /Test HTTP/1.1\r\nContent-Type: %s\r\nContent-Length: %d\r\n\r\n", ctypes[i], (int)sizeof(request) - 1);
+    char* expected = g_strdup_printf("\r\nContent-Type: %s\r\n", ctypes[i]);
+
+    TEST_ASSERT(raw_send(conn, header));
+    TEST_ASSERT(g_socket_send(sock, request, sizeof(request) - 1, NULL, NULL) == sizeof(request) - 1);
+
+    while (strstr(buf->str, "\r\n\r\n") == NULL)
+    {
+      char tmp[4096];
+      gssize len = g_socket_receive(sock, tmp, sizeof(tmp), NULL, NULL);
+
+      TEST_ASSERT(len > 0);
+      g_string_append_len(buf, tmp, len);
+    }
+
+    TEST_ASSERT(strstr(buf->str, expected) != NULL);
+    TEST_ASSERT(raw_response(conn, buf, NULL) == 200);
+    g_free(header);
+    g_free(expected);
+  }
+
+  g_object_unref(conn);
+  g_string_free(buf, TRUE);
+  stop_server();
+  return TRUE;
+}
+
+/* requests sent in one write are answered in order, also if one of them is
+ * deferred */
+static int pipelinedRequests(xr_server* s)
+{
+  GSocketConnection* conn;
+  GThread* completer;
+  GString* buf = g_string_new("");
+  GString* msg = g_string_new("");
+  const char* requests[] = { PING_REQUEST, PING_REQUEST, LATER_REQUEST, PING_REQUEST };
+  const char* results[] = { "<int>1</int>", "<int>2</int>", "<int>42</int>", "<int>3</int>" };
+  char* body;
+  int i;
+
+  TEST_ASSERT(s != NULL);
+  TEST_ASSERT(start_server(s, &later_servlet));
+
+  completer = g_thread_create(completer_func, GINT_TO_POINTER(1), TRUE, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS(requests); i++)
+    g_string_append_printf(msg, "POST /Test HTTP/1.1\r\nContent-Type: text/xml\r\nContent-Length: %d\r\n\r\n%s",
+      (int)strlen(requests[i]), requests[i]);
+
+  conn = raw_connect();
+  TEST_ASSERT(conn != NULL);
+  TEST_ASSERT(raw_send(conn, msg->str));
+
+  for (i = 0; i < G_N_ELEMENTS(requests); i++)
+  {
+    TEST_ASSERT(raw_response(conn, buf, &body) == 200);
+    TEST_ASSERT(strstr(body, results[i]) != NULL);
+    g_free(body);
+  }
+
+  g_thread_join(completer);
+  g_object_unref(conn);
+  g_string_free(msg, TRUE);
+  g_string_free(buf, TRUE);
+  stop_server();
+  return TRUE;
+}
+
+static int pipelinedRequestsThreaded()
+{
+  return pipelinedRequests(xr_server_new(NULL, 4, NULL));
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static int pipelinedRequestsEvented()
+{
+  return pipelinedRequests(xr_server_new_evented(NULL, 1, 2, NULL));
+}
+#endif
+
+/* connection is reset while the deferred call is pending, the server fails
+ * to flush the pipelined ping response and frees the connection */
+static int deferredCallDisconnect()
+{
+  GSocketConnection* conn;
+  xr_pending_call* pending;
+  struct linger lin = { 1, 0 };
+  char* msg;
+  xr_server* s = xr_server_new(NULL, 4, NULL);
+
+  TEST_ASSERT(s != NULL);
+  TEST_ASSERT(start_server(s, &later_servlet));
+  later_finis = 0;
+  later_resume = g_async_queue_new();
+
+  conn = raw_connect();
+  TEST_ASSERT(conn != NULL);
+  msg = g_strdup_printf(
+    "POST /Test HTTP/1.1\r\nContent-Type: text/xml\r\nContent-Length: %d\r\n\r\n%s"
+    "POST /Test HTTP/1.1\r\nContent-Type: text/xml\r\nContent-Length: %d\r\n\r\n%s",
+    (int)strlen(PING_REQUEST), PING_REQUEST, (int)strlen(LATER_REQUEST), LATER_REQUEST);
+  TEST_ASSERT(raw_send(conn, msg));
+  g_free(msg);
+
+  pending = g_async_queue_pop(deferred_calls);
+
+  /* reset the connection */
+  setsockopt(g_socket_get_fd(g_socket_connection_get_socket(conn)), SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+  g_object_unref(conn);
+  g_usleep(100000);
+
+  g_async_queue_push(later_resume, GINT_TO_POINTER(1));
+  g_usleep(200000);
+
+  /* servlet is kept for the pending call */
+  TEST_ASSERT(g_atomic_int_get(&later_finis) == 0);
+  complete_later(pending);
+  TEST_ASSERT(g_atomic_int_get(&later_finis) == 1);
+
+  g_async_queue_unref(later_resume);
+  later_resume = NULL;
+  stop_server();
+  return TRUE;
+}
+
+static int clientPool()
+{
+  xr_client_pool* pool = xr_client_pool_new(2, 2, 1);
+  xr_client_conn *a, *b;
+  xr_call* call;
+  int value;
+  xr_server* s = xr_server_new(NULL, 4, NULL);
+
+  TEST_ASSERT(s != NULL);
+  TEST_ASSERT(start_server(s, &test_servlet));
+
+  /* idle connection is reused, counter of its servlet continues */
+  call = xr_call_new("ping");
+  TEST_ASSERT(xr_client_pool_call(pool, server_uri, call, NULL));
+  TEST_ASSERT(xr_value_to_int(xr_call_get_retval(call), &value) && value == 1);
+  xr_call_free(call);
+  call = xr_call_new("ping");
+  TEST_ASSERT(xr_client_pool_call(pool, server_uri, call, NULL));
+  TEST_ASSERT(xr_value_to_int(xr_call_get_retval(call), &value) && value == 2);
+  xr_call_free(call);
+
+  /* two connections checked out at once are different */
+  a = xr_client_pool_get(pool, server_uri, NULL);
+  b = xr_client_pool_get(pool, server_uri, NULL);
+  TEST_ASSERT(a != NULL && b != NULL && a != b);
+  TEST_ASSERT(client_ping(a) == 3);
+  TEST_ASSERT(client_ping(b) == 1);
+  xr_client_pool_put(pool, a);
+  xr_client_pool_put(pool, b);
+
+  /* most recently returned connection is used first */
+  a = xr_client_pool_get(pool, server_uri, NULL);
+  TEST_ASSERT(client_ping(a) == 2);
+  xr_client_pool_put(pool, a);
+
+  /* idle connections expire */
+  g_usleep(2100000);
+  a = xr_client_pool_get(pool, server_uri, NULL);
+  TEST_ASSERT(client_ping(a) == 1);
+  xr_client_pool_put(pool, a);
+
+  xr_client_pool_free(pool);
+  stop_server();
+  return TRUE;
+}
+
+/* fake server for the pool retry test: answers the first request on the
+ * first connection, closes it on the second request without answering,
+ * and answers the request on the next connection */
+
+#define FAKE_RESPONSE_BODY \
+  "<?xml version=\"1.0\"?><methodResponse><params><param><value><int>7</int></value></param></params></methodResponse>"
+
+static gboolean fake_read_request(int fd, GString* buf)
+{
+  while (TRUE)
+  {
+    char tmp[4096];
+    char* end = strstr(buf->str, "\r\n\r\n");
+    char* clen = strstr(buf->str, "Content-Length: ");
+    gssize len;
+
+    if (end && clen && clen < end && buf->len >= end - buf->str + 4 + atoi(clen + 16))
+    {
+      g_string_erase(buf, 0, end - buf->str + 4 + atoi(clen + 16));
+      return TRUE;
+    }
+
+    len = recv(fd, tmp, sizeof(tmp), 0);
+    if (len <= 0)
+      return FALSE;
+    g_string_append_len(buf, tmp, len);
+  }
+}
+
+static gboolean fake_write_response(int fd)
+{
+  char* msg = g_strdup_printf("HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\nContent-Length: %d\r\n\r\n%s",
+    (int)strlen(FAKE_RESPONSE_BODY), FAKE_RESPONSE_BODY);
+  gboolean rs = send(fd, msg, strlen(msg), 0) == strlen(msg);
+
+  g_free(msg);
+  return rs;
+}
+
+struct fake_server
+{
+  int lfd;
+  gboolean reset;          /* reset the reused connection instead of closing it */
+};
+
+static gpointer fake_server_func(struct fake_server* fake)
+{
+  GString* buf = g_string_new("");
+  int fd;
+
+  fd = accept(fake->lfd, NULL, NULL);
+  if (fake_read_request(fd, buf))
+    fake_write_response(fd);
+  fake_read_request(fd, buf);
+  if (fake->reset)
+  {
+    struct linger lin = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+  }
+  close(fd);
+
+  g_string_truncate(buf, 0);
+  fd = accept(fake->lfd, NULL, NULL);
+  if (fake_read_request(fd, buf))
+    fake_write_response(fd);
+  fake_read_request(fd, buf);
+  close(fd);
+
+  g_string_free(buf, TRUE);
+  return NULL;
+}
+
+static int pool_retry(gboolean reset)
+{
+  xr_client_pool* pool = xr_client_pool_new(2, 2, 0);
+  struct fake_server fake;
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  GThread* thread;
+  xr_call* call;
+  char* uri;
+  int value;
+
+  fake.reset = reset;
+  fake.lfd = socket(AF_INET, SOCK_STREAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT(bind(fake.lfd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+  TEST_ASSERT(listen(fake.lfd, 4) == 0);
+  getsockname(fake.lfd, (struct sockaddr*)&addr, &addr_len);
+  uri = g_strdup_printf("http://127.0.0.1:%d/Test", ntohs(addr.sin_port));
+
+  thread = g_thread_create((GThreadFunc)fake_server_func, &fake, TRUE, NULL);
+
+  call = xr_call_new("ping");
+  TEST_ASSERT(xr_client_pool_call(pool, uri, call, NULL));
+  xr_call_free(call);
+
+  /* reused connection is closed by the server, the call is repeated on a
+     new one */
+  call = xr_call_new("ping");
+  TEST_ASSERT(xr_client_pool_call(pool, uri, call, NULL));
+  TEST_ASSERT(xr_value_to_int(xr_call_get_retval(call), &value) && value == 7);
+  xr_call_free(call);
+
+  xr_client_pool_free(pool);
+  g_thread_join(thread);
+  close(fake.lfd);
+  g_free(uri);
+  return TRUE;
+}
+
+static int clientPoolRetry()
+{
+  return pool_retry(FALSE);
+}
+
+static int clientPoolRetryReset()
+{
+  return pool_retry(TRUE);
+}
+
+struct async_call
+{
+  xr_client_conn* conn;
+  GMainLoop* loop;
+  gboolean rs;
+};
+
+static void async_call_cb(GObject* source, GAsyncResult* result, struct async_call* op)
+{
+  op->rs = xr_client_call_finish(op->conn, result, NULL, NULL);
+  g_main_loop_quit(op->loop);
+}
+
+/* Perform the call asynchronously and wait for the result. Server thread
+ * runs the default main context, so the call runs in its own. */
+static gboolean async_call(xr_client_conn* conn, xr_call* call)
+{
+  GMainContext* context = g_main_context_new();
+  struct async_call op = { conn, g_main_loop_new(context, FALSE), FALSE };
+
+  g_main_context_push_thread_default(context);
+  xr_client_call_async(conn, call, NULL, (GAsyncReadyCallback)async_call_cb, &op);
+  g_main_loop_run(op.loop);
+  g_main_context_pop_thread_default(context);
+
+  g_main_loop_unref(op.loop);
+  g_main_context_unref(context);
+  return op.rs;
+}
+
+static int asyncClientCall()
+{
+  xr_client_conn* conn;
+  xr_call* call;
+  GString* big;
+  char* str = NULL;
+  int value = 0;
+  int i;
+  xr_server* s = xr_server_new(NULL, 4, NULL);
+
+  TEST_ASSERT(s != NULL);
+  TEST_ASSERT(start_server(s, &test_servlet));
+  TEST_ASSERT((conn = client_connect(NULL)) != NULL);
+
+  call = xr_call_new("ping");
+  TEST_ASSERT(async_call(conn, call));
+  TEST_ASSERT(xr_value_to_int(xr_call_get_retval(call), &value) && value == 1);
+  xr_call_free(call);
+
+  /* response is larger than the read buffer */
+  big = g_string_new("");
+  for (i = 0; i < 10000; i++)
+    g_string_append_printf(big, "%09d ", i);
+
+  call = xr_call_new("echo");
+  xr_call_add_param(call, xr_value_string_new(big->str));
+  TEST_ASSERT(async_call(conn, call));
+  TEST_ASSERT(xr_value_to_string(xr_call_get_retval(call), &str));
+  TEST_ASSERT(!strcmp(str, big->str));
+  g_free(str);
+  xr_call_free(call);
+  g_string_free(big, TRUE);
+
+  /* connection stays usable for synchronous calls */
+  TEST_ASSERT(client_ping(conn) == 2);
+
+  call = xr_call_new("echo");
+  TEST_ASSERT(!async_call(conn, call));
+  xr_call_free(call);
+
+  xr_client_free(conn);
+  stop_server();
+  return TRUE;
+}
+
+/* sub-calls of stateless servlets run in the pool threads, while the
+ * request values are allocated from the arena of the serving thread */
+static int multicallArena()
+{
+  xr_client_conn* conn;
+  xr_call* calls[8];
+  char* str;
+  int i;
+  xr_server* s = xr_server_new(NULL, 4, NULL);
+
+  TEST_ASSERT(s != NULL);
+  xr_server_set_request_arena(s, TRUE);
+  TEST_ASSERT(start_server(s, &stateless_servlet));
+  TEST_ASSERT((conn = client_connect(NULL)) != NULL);
+
+  for (i = 0; i < G_N_ELEMENTS(calls); i++)
+  {
+    xr_value* st = xr_value_struct_new();
+
+    str = g_strdup_printf("value%d", i);
+    xr_value_struct_set_member(st, "s", xr_value_string_new(str));
+    xr_value_struct_set_member(st, "i", xr_value_int_new(i));
+    g_free(str);
+
+    calls[i] = xr_call_new("echo");
+    xr_call_add_param(calls[i], st);
+  }
+
+  TEST_ASSERT(xr_client_call_batch(conn, calls, G_N_ELEMENTS(calls), NULL));
+
+  for (i = 0; i < G_N_ELEMENTS(calls); i++)
+  {
+    xr_value* st = xr_call_get_retval(calls[i]);
+    char* expected = g_strdup_printf("value%d", i);
+    int value = -1;
+
+    str = NULL;
+    TEST_ASSERT(xr_value_to_string(xr_value_get_member(st, "s"), &str) && !strcmp(str, expected));
+    TEST_ASSERT(xr_value_to_int(xr_value_get_member(st, "i"), &value) && value == i);
+    g_free(str);
+    g_free(expected);
+    xr_call_free(calls[i]);
+  }
+
+  xr_client_free(conn);
+  stop_server();
+  return TRUE;
+}
+
+static int servletPool()
+{
+  xr_client_conn* conn;
+  xr_server* s = xr_server_new(NULL, 4, NULL);
+
+  TEST_ASSERT(s != NULL);
+  TEST_ASSERT(start_server(s, &pool_servlet));
+
+  /* pool is filled when the servlet is registered */
+  TEST_ASSERT(pool_inits == 4 && pool_resets == 0);
+
+  /* persistent mode: instance is returned to the pool when the connection
+     is closed */
+  conn = client_connect(NULL);
+  TEST_ASSERT(conn != NULL);
+  TEST_ASSERT(client_ping(conn) == 1);
+  TEST_ASSERT(client_ping(conn) == 2);
+  xr_client_free(conn);
+  g_usleep(100000);
+  TEST_ASSERT(pool_inits == 4 && pool_resets == 1);
+
+  conn = client_connect(NULL);
+  TEST_ASSERT(client_ping(conn) == 1);
+  xr_client_free(conn);
+  g_usleep(100000);
+  TEST_ASSERT(pool_inits == 4 && pool_resets == 2);
+
+  /* session mode: expired session goes to the pool and the reused instance
+     must not carry the old session state */
+  conn = client_connect("session-a");
+  TEST_ASSERT(client_ping(conn) == 1);
+  TEST_ASSERT(client_ping(conn) == 2);
+  xr_client_free(conn);
+  g_usleep(3500000);
+  TEST_ASSERT(pool_inits == 4 && pool_resets == 3);
+
+  conn = client_connect("session-b");
+  TEST_ASSERT(client_ping(conn) == 1);
+  TEST_ASSERT(client_ping(conn) == 2);
+  xr_client_free(conn);
+
+  conn = client_connect("session-b");
+  TEST_ASSERT(client_ping(conn) == 3);
+  xr_client_free(conn);
+  TEST_ASSERT(pool_inits == 4);
+
+  g_usleep(3500000);
+  TEST_ASSERT(pool_resets == 4);
+
+  stop_server();
+  return TRUE;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+static int eventedChunkedRequest()
+{
+  GSocketConnection *slow, *fast;
+  GString* buf = g_string_new("");
+  char* body = NULL;
+  xr_server* s = xr_server_new_evented(NULL, 1, 1, NULL);
+
+  TEST_ASSERT(s != NULL);
+  TEST_ASSERT(start_server(s, &test_servlet));
+
+  /* incomplete chunked request must not occupy the only worker */
+  slow = raw_connect();
+  TEST_ASSERT(slow != NULL);
+  TEST_ASSERT(raw_send(slow,
+    "POST /Test HTTP/1.1\r\n"
+    "Content-Type: text/xml\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "10;ext=1\r\n"
+    "<methodCall><met\r\n"));
+  g_usleep(100000);
+
+  fast = raw_connect();
+  TEST_ASSERT(fast != NULL);
+  TEST_ASSERT(raw_call(fast, PING_REQUEST, &body) == 200);
+  TEST_ASSERT(strstr(body, "<int>1</int>") != NULL);
+  g_free(body);
+
+  /* last chunk without the trailer terminator is still incomplete */
+  TEST_ASSERT(raw_send(slow,
+    "37\r\n"
+    "hodName>ping</methodName><params></params></methodCall>\r\n"
+    "0\r\n"
+    "X-Trailer: 1\r\n"));
+  g_usleep(100000);
+  TEST_ASSERT(raw_call(fast, PING_REQUEST, NULL) == 200);
+
+  TEST_ASSERT(raw_send(slow, "\r\n"));
+  TEST_ASSERT(raw_response(slow, buf, &body) == 200);
+  TEST_ASSERT(strstr(body, "<int>1</int>") != NULL);
+  g_free(body);
+
+  g_object_unref(slow);
+  g_object_unref(fast);
+  g_string_free(buf, TRUE);
+  stop_server();
+  return TRUE;
+}
+
+/* request larger than the read buffer arrives slowly */
+static int eventedLargeRequest()
+{
+  GSocketConnection *slow, *fast;
+  GString* buf = g_string_new("");
+  GString* value = g_string_new("");
+  char* request;
+  char* msg;
+  char* body = NULL;
+  gsize half;
+  xr_server* s = xr_server_new_evented(NULL, 1, 1, NULL);
+
+  TEST_ASSERT(s != NULL);
+  TEST_ASSERT(start_server(s, &test_servlet));
+
+  while (value->len < 64 * 1024)
+    g_string_append(value, "0123456789abcdef");
+  request = g_strdup_printf("<methodCall><methodName>echo</methodName><params>"
+    "<param><value><string>%s</string></value></param></params></methodCall>", value->str);
+  msg = g_strdup_printf("POST /Test HTTP/1.1\r\nContent-Type: text/xml\r\nContent-Length: %d\r\n\r\n%s", (int)strlen(request), request);
+
+  /* half of the body must not occupy the only worker */
+  slow = raw_connect();
+  TEST_ASSERT(slow != NULL);
+  half = strlen(msg) / 2;
+  TEST_ASSERT(g_socket_send(g_socket_connection_get_socket(slow), msg, half, NULL, NULL) == half);
+  g_usleep(100000);
+
+  fast = raw_connect();
+  TEST_ASSERT(fast != NULL);
+  TEST_ASSERT(raw_call(fast, PING_REQUEST, &body) == 200);
+  TEST_ASSERT(strstr(body, "<int>1</int>") != NULL);
+  g_free(body);
+
+  TEST_ASSERT(raw_send(slow, msg + half));
+  TEST_ASSERT(raw_response(slow, buf, &body) == 200);
+  TEST_ASSERT(strstr(body, value->str) != NULL);
+  g_free(body);
+
+  g_object_unref(slow);
+  g_object_unref(fast);
+  g_free(request);
+  g_free(msg);
+  g_string_free(value, TRUE);
+  g_string_free(buf, TRUE);
+  stop_server();
+  return TRUE;
+}
+
+static double cpu_time()
+{
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/* incomplete request is waited for without spinning and dropped after the
+ * timeout */
+static int eventedRequestTimeout()
+{
+  GSocketConnection* slow;
+  GTimer* timer = g_timer_new();
+  GString* buf = g_string_new("");
+  char tmp[64];
+  char* msg;
+  double cpu;
+  xr_server* s = xr_server_new_evented(NULL, 1, 1, NULL);
+
+  TEST_ASSERT(s != NULL);
+  xr_server_set_request_timeout(s, 2);
+  TEST_ASSERT(start_server(s, &test_servlet));
+
+  slow = raw_connect();
+  TEST_ASSERT(slow != NULL);
+  TEST_ASSERT(raw_send(slow, "POST /Test HTTP/1.1\r\nContent-Type: text/xml\r\n"));
+
+  cpu = cpu_time();
+  g_usleep(1000000);
+  TEST_ASSERT(cpu_time() - cpu < 0.3);
+
+  /* server closes the connection */
+  TEST_ASSERT(g_socket_receive(g_socket_connection_get_socket(slow), tmp, sizeof(tmp), NULL, NULL) == 0);
+  TEST_ASSERT(g_timer_elapsed(timer, NULL) < 4);
+
+  g_object_unref(slow);
+
+  /* also if the incomplete request follows a complete one */
+  slow = raw_connect();
+  TEST_ASSERT(slow != NULL);
+  msg = g_strdup_printf("POST /Test HTTP/1.1\r\nContent-Type: text/xml\r\nContent-Length: %d\r\n\r\n%s"
+    "POST /Test HTTP/1.1\r\n", (int)strlen(PING_REQUEST), PING_REQUEST);
+  TEST_ASSERT(raw_send(slow, msg));
+  TEST_ASSERT(raw_response(slow, buf, NULL) == 200);
+
+  g_timer_start(timer);
+  TEST_ASSERT(g_socket_receive(g_socket_connection_get_socket(slow), tmp, sizeof(tmp), NULL, NULL) == 0);
+  TEST_ASSERT(g_timer_elapsed(timer, NULL) > 1 && g_timer_elapsed(timer, NULL) < 4);
+
+  g_object_unref(slow);
+  g_free(msg);
+  g_string_free(buf, TRUE);
+  g_timer_destroy(timer);
+  stop_server();
+  return TRUE;
+}
+
+#endif
+
+int main()
+{
+  int failed = FALSE;
+
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+
+  xr_init();
+  xr_debug_enabled = 0;
+
+  deferred_calls = g_async_queue_new();
+
+  RUN_TEST(servletPool);
+  RUN_TEST(clientPool);
+  RUN_TEST(clientPoolRetry);
+  RUN_TEST(clientPoolRetryReset);
+  RUN_TEST(asyncClientCall);
+  RUN_TEST(multicallArena);
+  RUN_TEST(msgpackContentType);
+  RUN_TEST(deferredCallThreaded);
+  RUN_TEST(deferredCallDisconnect);
+  RUN_TEST(pipelinedRequestsThreaded);
+#ifdef HAVE_SYS_EPOLL_H
+  RUN_TEST(deferredCallEvented);
+  RUN_TEST(pipelinedRequestsEvented);
+  RUN_TEST(eventedChunkedRequest);
+  RUN_TEST(eventedLargeRequest);
+  RUN_TEST(eventedRequestTimeout);
+#endif
+
+  xr_fini();
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,404 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "tests.h"
+#include "xr-lib.h"
+#include "xr-http.h"
+
+#define CHUNKED_HEADER \
+  "POST /Test HTTP/1.1\r\n" \
+  "Transfer-Encoding: chunked\r\n" \
+  "\r\n"
+
+static GSocketConnection* conn;
+
+/* Create xr_http reading from one end of a socketpair, the peer end is
+ * returned in @peer. */
+static xr_http* http_pair(int* peer)
+{
+  GSocket* sock;
+  xr_http* http;
+  int fds[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    return NULL;
+
+  sock = g_socket_new_from_fd(fds[0], NULL);
+  conn = g_socket_connection_factory_create_connection(sock);
+  http = xr_http_new(G_IO_STREAM(conn));
+  g_object_unref(sock);
+
+  *peer = fds[1];
+  return http;
+}
+
+static void http_free(xr_http* http)
+{
+  xr_http_free(http);
+  g_object_unref(conn);
+}
+
+/* Send @data to the peer, close it and read one chunked message. */
+static GString* read_chunked(const char* data, GError** err)
+{
+  GString* body = NULL;
+  int peer;
+  xr_http* http = http_pair(&peer);
+
+  if (write(peer, data, strlen(data)) == strlen(data))
+  {
+    close(peer);
+    if (xr_http_read_header(http, err))
+      body = xr_http_read_all(http, err);
+  }
+  else
+    close(peer);
+
+  http_free(http);
+  return body;
+}
+
+/* tests */
+
+static int chunkedMultiple()
+{
+  GString* body = read_chunked(CHUNKED_HEADER
+    "3\r\nabc\r\n"
+    "4\r\ndefg\r\n"
+    "a\r\n0123456789\r\n"
+    "0\r\n\r\n", NULL);
+
+  TEST_ASSERT(body != NULL);
+  TEST_ASSERT(!strcmp(body->str, "abcdefg0123456789"));
+  g_string_free(body, TRUE);
+  return TRUE;
+}
+
+static int chunkedExtensions()
+{
+  GString* body = read_chunked(CHUNKED_HEADER
+    "3;name=value\r\nabc\r\n"
+    "4 ; quoted=\"x;y\"\r\ndefg\r\n"
+    "0;last\r\n\r\n", NULL);
+
+  TEST_ASSERT(body != NULL);
+  TEST_ASSERT(!strcmp(body->str, "abcdefg"));
+  g_string_free(body, TRUE);
+  return TRUE;
+}
+
+static int chunkedTrailers()
+{
+  GError* err = NULL;
+  GString* body;
+  gssize len;
+  char buf[4];
+  int peer;
+  xr_http* http = http_pair(&peer);
+  const char* data = CHUNKED_HEADER
+    "3\r\nabc\r\n"
+    "0\r\n"
+    "X-Checksum: 1234\r\n"
+    "X-Other: b\r\n"
+    "\r\n"
+    /* trailer must be consumed, so that the next message follows */
+    "POST /Next HTTP/1.1\r\n"
+    "Content-Length: 3\r\n"
+    "\r\n"
+    "xyz";
+
+  TEST_ASSERT(write(peer, data, strlen(data)) == strlen(data));
+  close(peer);
+
+  TEST_ASSERT(xr_http_read_header(http, &err));
+  body = xr_http_read_all(http, &err);
+  TEST_ASSERT(body != NULL);
+  TEST_ASSERT(!strcmp(body->str, "abc"));
+  g_string_free(body, TRUE);
+
+  TEST_ASSERT(xr_http_read_header(http, &err));
+  TEST_ASSERT(!strcmp(xr_http_get_resource(http), "/Next"));
+  len = xr_http_read(http, buf, sizeof(buf), &err);
+  TEST_ASSERT(len == 3 && !memcmp(buf, "xyz", 3));
+
+  http_free(http);
+  return TRUE;
+}
+
+static int chunkedSmallReads()
+{
+  GError* err = NULL;
+  GString* body = g_string_new("");
+  gssize len;
+  char buf[2];
+  int peer;
+  xr_http* http = http_pair(&peer);
+  const char* data = CHUNKED_HEADER
+    "5\r\nhello\r\n"
+    "1\r\n \r\n"
+    "5\r\nworld\r\n"
+    "0\r\n\r\n";
+
+  TEST_ASSERT(write(peer, data, strlen(data)) == strlen(data));
+  close(peer);
+
+  TEST_ASSERT(xr_http_read_header(http, &err));
+  while ((len = xr_http_read(http, buf, sizeof(buf), &err)) > 0)
+    g_string_append_len(body, buf, len);
+
+  TEST_ASSERT(len == 0 && err == NULL);
+  TEST_ASSERT(!strcmp(body->str, "hello world"));
+
+  g_string_free(body, TRUE);
+  http_free(http);
+  return TRUE;
+}
+
+static int chunkedBadSize()
+{
+  GError* err = NULL;
+  GString* body = read_chunked(CHUNKED_HEADER
+    "3\r\nabc\r\n"
+    "xyz\r\nabc\r\n"
+    "0\r\n\r\n", &err);
+
+  TEST_ASSERT(body == NULL);
+  TEST_ASSERT(err != NULL);
+  TEST_ASSERT(strstr(err->message, "Invalid chunk size") != NULL);
+  g_error_free(err);
+  return TRUE;
+}
+
+static int chunkedMissingTerminator()
+{
+  GError* err = NULL;
+  GString* body = read_chunked(CHUNKED_HEADER
+    "3\r\nabcdef\r\n"
+    "0\r\n\r\n", &err);
+
+  TEST_ASSERT(body == NULL);
+  TEST_ASSERT(err != NULL);
+  TEST_ASSERT(strstr(err->message, "Invalid chunk terminator") != NULL);
+  g_error_free(err);
+  return TRUE;
+}
+
+static int chunkedTruncated()
+{
+  GError* err = NULL;
+  GString* body = read_chunked(CHUNKED_HEADER
+    "10\r\nabc", &err);
+
+  TEST_ASSERT(body == NULL);
+  TEST_ASSERT(err != NULL);
+  g_error_free(err);
+  return TRUE;
+}
+
+/* asynchronous read */
+
+struct async_read
+{
+  xr_http* http;
+  GMainLoop* loop;
+  GString* body;
+  GError* err;
+  int peer;
+  GString* data;
+};
+
+static void read_message_cb(GObject* source, GAsyncResult* result, struct async_read* r)
+{
+  r->body = xr_http_read_message_finish(r->http, result, &r->err);
+  g_main_loop_quit(r->loop);
+}
+
+/* data may not fit into the socket buffer, write it from another thread */
+static gpointer writer_func(struct async_read* r)
+{
+  gsize written = 0;
+
+  while (written < r->data->len)
+  {
+    gssize n = write(r->peer, r->data->str + written, r->data->len - written);
+    if (n <= 0)
+      break;
+    written += n;
+  }
+
+  close(r->peer);
+  return NULL;
+}
+
+/* Send @data to the peer from another thread, close it and read one message
+ * asynchronously. */
+static void read_async(struct async_read* r, GString* data)
+{
+  GThread* writer;
+
+  memset(r, 0, sizeof(*r));
+  r->http = http_pair(&r->peer);
+  r->loop = g_main_loop_new(NULL, FALSE);
+  r->data = data;
+
+  writer = g_thread_create((GThreadFunc)writer_func, r, TRUE, NULL);
+  xr_http_read_message_async(r->http, NULL, (GAsyncReadyCallback)read_message_cb, r);
+  g_main_loop_run(r->loop);
+  g_thread_join(writer);
+  g_main_loop_unref(r->loop);
+}
+
+static int asyncLargeBody()
+{
+  struct async_read r;
+  GString* data = g_string_new("");
+  GString* body = g_string_new("");
+  int i;
+
+  for (i = 0; i < 20000; i++)
+    g_string_append_printf(body, "%09d ", i);
+
+  g_string_append_printf(data,
+    "POST /Test HTTP/1.1\r\n"
+    "Content-Type: text/xml\r\n"
+    "X-Custom: value\r\n"
+    "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+    "\r\n%s", body->len, body->str);
+
+  read_async(&r, data);
+
+  TEST_ASSERT(r.err == NULL);
+  TEST_ASSERT(r.body != NULL && !strcmp(r.body->str, body->str));
+  /* header strings survive growing of the read buffer */
+  TEST_ASSERT(!strcmp(xr_http_get_resource(r.http), "/Test"));
+  TEST_ASSERT(!strcmp(xr_http_get_header(r.http, "Content-Type"), "text/xml"));
+  TEST_ASSERT(!strcmp(xr_http_get_header(r.http, "X-Custom"), "value"));
+
+  g_string_free(r.body, TRUE);
+  g_string_free(body, TRUE);
+  g_string_free(data, TRUE);
+  http_free(r.http);
+  return TRUE;
+}
+
+static int asyncChunked()
+{
+  struct async_read r;
+  GString* data = g_string_new(CHUNKED_HEADER
+    "3\r\nabc\r\n"
+    "4;ext\r\ndefg\r\n"
+    "0\r\n"
+    "X-Trailer: 1\r\n"
+    "\r\n");
+
+  read_async(&r, data);
+
+  TEST_ASSERT(r.err == NULL);
+  TEST_ASSERT(r.body != NULL && !strcmp(r.body->str, "abcdefg"));
+
+  g_string_free(r.body, TRUE);
+  g_string_free(data, TRUE);
+  http_free(r.http);
+  return TRUE;
+}
+
+static int asyncHeaderTooLarge()
+{
+  struct async_read r;
+  GString* data = g_string_new("POST /Test HTTP/1.1\r\n");
+
+  while (data->len < 128 * 1024)
+    g_string_append(data, "X-Filler: 0123456789012345678901234567890123456789\r\n");
+  g_string_append(data, "\r\n");
+
+  read_async(&r, data);
+
+  TEST_ASSERT(r.body == NULL);
+  TEST_ASSERT(r.err != NULL);
+  TEST_ASSERT(strstr(r.err->message, "too large") != NULL);
+
+  g_error_free(r.err);
+  g_string_free(data, TRUE);
+  http_free(r.http);
+  return TRUE;
+}
+
+static int asyncEmptyBody()
+{
+  struct async_read r;
+  GString* data = g_string_new(
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n");
+
+  read_async(&r, data);
+
+  TEST_ASSERT(r.err == NULL);
+  TEST_ASSERT(r.body != NULL && r.body->len == 0);
+
+  g_string_free(r.body, TRUE);
+  g_string_free(data, TRUE);
+  http_free(r.http);
+  return TRUE;
+}
+
+static int asyncEofBody()
+{
+  struct async_read r;
+  GString* data = g_string_new(
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: text/xml\r\n"
+    "\r\n"
+    "body until EOF");
+
+  read_async(&r, data);
+
+  TEST_ASSERT(r.err == NULL);
+  TEST_ASSERT(r.body != NULL && !strcmp(r.body->str, "body until EOF"));
+
+  g_string_free(r.body, TRUE);
+  g_string_free(data, TRUE);
+  http_free(r.http);
+  return TRUE;
+}
+
+static int asyncTruncatedBody()
+{
+  struct async_read r;
+  GString* data = g_string_new(
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 10\r\n"
+    "\r\n");
+
+  read_async(&r, data);
+
+  TEST_ASSERT(r.body == NULL);
+  TEST_ASSERT(r.err != NULL);
+
+  g_error_free(r.err);
+  g_string_free(data, TRUE);
+  http_free(r.http);
+  return TRUE;
+}
+
+int main()
+{
+  int failed = FALSE;
+
+  g_type_init();
+  xr_debug_enabled = 0;
+  RUN_TEST(chunkedMultiple);
+  RUN_TEST(chunkedExtensions);
+  RUN_TEST(chunkedTrailers);
+  RUN_TEST(chunkedSmallReads);
+  RUN_TEST(chunkedBadSize);
+  RUN_TEST(chunkedMissingTerminator);
+  RUN_TEST(chunkedTruncated);
+  RUN_TEST(asyncLargeBody);
+  RUN_TEST(asyncChunked);
+  RUN_TEST(asyncHeaderTooLarge);
+  RUN_TEST(asyncEmptyBody);
+  RUN_TEST(asyncEofBody);
+  RUN_TEST(asyncTruncatedBody);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Check field numbers assigned by xdl-compiler for the binary transport.
+
+XDLC=${XDLC:-../xdl-compiler/xdl-compiler}
+SRC=${srcdir:-.}/xdl
+OUT=xdl-fields.out
+
+fail()
+{
+  echo "FAIL: $*"
+  exit 1
+}
+
+# print "field:member" pairs written by the binary marchalizer of the struct
+fields()
+{
+  sed -n "/__F$1_to_binary(/,/^}/p" $OUT/FFields.xrc.c | \
+    sed -n 's/.*(_buf, \([0-9]*\), _nstruct->\([a-z]*\)).*/\1:\2/p' | tr '\n' ' '
+}
+
+check_fields()
+{
+  test "`fields $1`" = "$2" || fail "$1 has fields '`fields $1`', expected '$2'"
+}
+
+rm -rf $OUT
+mkdir -p $OUT
+
+$XDLC -i $SRC/fields.xdl -o $OUT > $OUT/log 2>&1 || fail "fields.xdl: `cat $OUT/log`"
+
+check_fields Numbered "1:a 5:b 3:c "
+check_fields Implicit "1:a 2:b 3:c "
+check_fields Mixed "1:a 10:b 11:c 2:d 3:e "
+
+$XDLC -i $SRC/fields-dup.xdl -o $OUT > $OUT/log 2>&1 && fail "fields-dup.xdl was accepted"
+grep -q "Field number 3 of Duplicate.c is already used by Duplicate.a" $OUT/log || fail "fields-dup.xdl: `cat $OUT/log`"
+
+rm -rf $OUT
+exit 0
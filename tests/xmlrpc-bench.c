@@ -0,0 +1,291 @@
+/*
+ * Copyright 2006-2008 Ondrej Jirman <ondrej.jirman@zonio.net>
+ *
+ * This file is part of libxr.
+ *
+ * Libxr is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option) any
+ * later version.
+ *
+ * Libxr is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libxr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* XML-RPC request decoder microbenchmark
+ *
+ * Compares the streaming decoder used by xr_call_unserialize_request() with
+ * the old DOM/XPath based decoder. Peak memory allocated by libxml2 during
+ * a single decode is measured using counting allocator hooks.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "xr-lib.h"
+#include "xr-call.h"
+#include "xml-priv.h"
+
+static int count = 200;
+
+/* libxml2 allocation accounting */
+
+static gsize mem_current = 0;
+static gsize mem_peak = 0;
+
+#define MEM_HDR 16
+
+static void* mem_malloc(size_t size)
+{
+  char* p = malloc(size + MEM_HDR);
+  if (p == NULL)
+    return NULL;
+  *(gsize*)p = size;
+  mem_current += size;
+  mem_peak = MAX(mem_peak, mem_current);
+  return p + MEM_HDR;
+}
+
+static void mem_free(void* ptr)
+{
+  char* p = ptr;
+  if (p == NULL)
+    return;
+  p -= MEM_HDR;
+  mem_current -= *(gsize*)p;
+  free(p);
+}
+
+static void* mem_realloc(void* ptr, size_t size)
+{
+  char* p = ptr;
+  if (p == NULL)
+    return mem_malloc(size);
+  p -= MEM_HDR;
+  mem_current -= *(gsize*)p;
+  p = realloc(p, size + MEM_HDR);
+  if (p == NULL)
+    return NULL;
+  *(gsize*)p = size;
+  mem_current += size;
+  mem_peak = MAX(mem_peak, mem_current);
+  return p + MEM_HDR;
+}
+
+static char* mem_strdup(const char* str)
+{
+  size_t len = strlen(str) + 1;
+  char* p = mem_malloc(len);
+  if (p)
+    memcpy(p, str, len);
+  return p;
+}
+
+/* old decoder */
+
+static xr_value* old_value_unserialize(xmlNode* node)
+{
+  gboolean is_string_without_element = TRUE;
+  for_each_node(node, tn)
+    if (tn->type != XML_TEXT_NODE && tn->type != XML_ENTITY_REF_NODE)
+      is_string_without_element = FALSE;
+
+    if (match_node(tn, "int") || match_node(tn, "i4"))
+      return xr_value_int_new(xml_get_cont_int(tn));
+    else if (match_node(tn, "string"))
+    {
+      char* str = xml_get_cont_str(tn);
+      xr_value* val = xr_value_string_new(str);
+      g_free(str);
+      return val;
+    }
+    else if (match_node(tn, "boolean"))
+      return xr_value_bool_new(xml_get_cont_bool(tn));
+    else if (match_node(tn, "double"))
+      return xr_value_double_new(xml_get_cont_double(tn));
+    else if (match_node(tn, "array"))
+    {
+      xr_value* arr = xr_value_array_new();
+      for_each_node(tn, d)
+        if (match_node(d, "data"))
+        {
+          for_each_node(d, v)
+            if (match_node(v, "value"))
+            {
+              xr_value* elem = old_value_unserialize(v);
+              if (elem == NULL)
+              {
+                xr_value_unref(arr);
+                return NULL;
+              }
+              xr_value_array_append(arr, elem);
+            }
+          for_each_node_end()
+          return arr;
+        }
+      for_each_node_end()
+      return arr;
+    }
+    else if (match_node(tn, "struct"))
+    {
+      xr_value* str = xr_value_struct_new();
+      for_each_node(tn, m)
+        if (match_node(m, "member"))
+        {
+          char* name = NULL;
+          xr_value* val = NULL;
+
+          for_each_node(m, me)
+            if (match_node(me, "name") && name == NULL)
+              name = xml_get_cont_str(me);
+            else if (match_node(me, "value") && val == NULL)
+              val = old_value_unserialize(me);
+          for_each_node_end()
+
+          xr_value_struct_set_member(str, name, val);
+          g_free(name);
+        }
+      for_each_node_end()
+      return str;
+    }
+  for_each_node_end()
+
+  if (is_string_without_element)
+  {
+    xmlChar* str = xmlNodeGetContent(node);
+    xr_value* val = xr_value_string_new((char*)str);
+    xmlFree(str);
+    return val;
+  }
+
+  return NULL;
+}
+
+static gboolean old_unserialize_request(xr_call* call, const char* buf, int len)
+{
+  xmlDoc* doc = xmlReadMemory(buf, len, 0, 0, XML_PARSE_NOWARNING|XML_PARSE_NOERROR|XML_PARSE_NONET);
+  xmlXPathContext* ctx;
+  struct nodeset* ns;
+  int i;
+
+  if (doc == NULL)
+    return FALSE;
+
+  ctx = xmlXPathNewContext(doc);
+  ns = xp_eval_nodes(ctx, "/methodCall/params/param/value");
+  for (i = 0; i < ns->count; i++)
+    xr_call_add_param(call, old_value_unserialize(ns->nodes[i]));
+  xp_free_nodes(ns);
+
+  xmlXPathFreeContext(ctx);
+  xmlFreeDoc(doc);
+  return TRUE;
+}
+
+/* test driver */
+
+static char* make_request(int* len)
+{
+  xr_call* call = xr_call_new("Test1.putRecords");
+  char* buf;
+  char* copy;
+  int i, j;
+
+  for (i = 0; i < 20; i++)
+  {
+    xr_value* recs = xr_value_array_new();
+
+    for (j = 0; j < 100; j++)
+    {
+      xr_value* rec = xr_value_struct_new();
+      xr_value* tags = xr_value_array_new();
+      int k;
+
+      for (k = 0; k < 10; k++)
+      {
+        char* str = g_strdup_printf("tag%d", k);
+        xr_value_array_append(tags, xr_value_string_new(str));
+        g_free(str);
+      }
+
+      xr_value_struct_set_member(rec, "id", xr_value_int_new(i * 100 + j));
+      xr_value_struct_set_member(rec, "name", xr_value_string_new("Some name"));
+      xr_value_struct_set_member(rec, "active", xr_value_bool_new(j % 2));
+      xr_value_struct_set_member(rec, "score", xr_value_double_new(j / 3.0));
+      xr_value_struct_set_member(rec, "note", xr_value_string_new("Lorem ipsum dolor sit amet"));
+      xr_value_struct_set_member(rec, "tags", tags);
+      xr_value_array_append(recs, rec);
+    }
+
+    xr_call_add_param(call, recs);
+  }
+
+  xr_call_serialize_request(call, &buf, len);
+  copy = g_strndup(buf, *len);
+  xr_call_free_buffer(call, buf);
+  xr_call_free(call);
+
+  return copy;
+}
+
+typedef gboolean (*unserialize_func)(xr_call* call, const char* buf, int len);
+
+static double bench(unserialize_func func, const char* buf, int len, gsize* peak)
+{
+  GTimer* timer = g_timer_new();
+  double t;
+  int i;
+
+  for (i = 0; i < count; i++)
+  {
+    xr_call* call = xr_call_new(NULL);
+    gsize base = mem_current;
+
+    mem_peak = base;
+    if (!func(call, buf, len) || xr_call_get_param(call, 19) == NULL)
+      g_error("decoding failed");
+    *peak = mem_peak - base;
+
+    xr_call_free(call);
+  }
+
+  t = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+  return t;
+}
+
+int main(int ac, char* av[])
+{
+  char* buf;
+  int len;
+  double t_old, t_new;
+  gsize m_old, m_new;
+
+  xmlMemSetup(mem_free, mem_malloc, mem_realloc, mem_strdup);
+
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+
+  xr_init();
+
+  if (ac > 1)
+    count = MAX(1, atoi(av[1]));
+
+  buf = make_request(&len);
+
+  t_old = bench(old_unserialize_request, buf, len, &m_old);
+  t_new = bench(xr_call_unserialize_request, buf, len, &m_new);
+
+  g_print("request size: %d bytes\n", len);
+  g_print("old decoder: %d requests in %.3f s (%.0f req/s), libxml2 peak %" G_GSIZE_FORMAT " KiB\n", count, t_old, count / t_old, m_old / 1024);
+  g_print("new decoder: %d requests in %.3f s (%.0f req/s), libxml2 peak %" G_GSIZE_FORMAT " KiB\n", count, t_new, count / t_new, m_new / 1024);
+
+  g_free(buf);
+  xr_fini();
+  return 0;
+}
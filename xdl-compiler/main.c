@@ -85,14 +85,228 @@ static void line_fprintf(FILE* f, int indent, const char* fmt, ...)
     } \
   } while(0)
 
+/* perfect hash for servlet method dispatch
+ *
+ * Method names are hashed with FNV-1a. The mixed hash selects a bucket
+ * with a displacement seed, the seed is added to the hash and mixed again
+ * to get the slot. Seeds are searched here so that no two methods share
+ * a slot. The same functions are emitted into the servlet code.
+ */
+
+#define METHOD_HASH_MAX_SEED 65535
+
+static guint32 method_hash(const char* name)
+{
+  guint32 h = 2166136261u;
+
+  for (; *name; name++)
+    h = (h ^ (guchar)*name) * 16777619u;
+
+  return h;
+}
+
+static guint32 method_hash_mix(guint32 h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+struct method_hash
+{
+  int buckets;
+  int size;         /* power of two */
+  guint16* seeds;   /* per bucket */
+  gint16* slots;    /* method index or -1 */
+};
+
+static int _bucket_size_cmp(gconstpointer a, gconstpointer b, gpointer sizes)
+{
+  return ((int*)sizes)[*(int*)b] - ((int*)sizes)[*(int*)a];
+}
+
+static gboolean _build_method_hash(guint32* hashes, int count, struct method_hash* mh)
+{
+  int* sizes = g_new0(int, mh->buckets);
+  int* order = g_new(int, mh->buckets);
+  int* keys = g_new(int, count);
+  guint32* pos = g_new(guint32, count);
+  int b, i, j, k, n;
+  guint32 seed;
+  gboolean ok = TRUE;
+
+  for (i = 0; i < mh->size; i++)
+    mh->slots[i] = -1;
+
+  for (i = 0; i < count; i++)
+    sizes[method_hash_mix(hashes[i]) % mh->buckets]++;
+
+  /* place largest buckets first */
+  for (b = 0; b < mh->buckets; b++)
+    order[b] = b;
+  g_qsort_with_data(order, mh->buckets, sizeof(int), _bucket_size_cmp, sizes);
+
+  for (b = 0; b < mh->buckets && sizes[order[b]] > 0; b++)
+  {
+    n = 0;
+    for (i = 0; i < count; i++)
+      if (method_hash_mix(hashes[i]) % mh->buckets == order[b])
+        keys[n++] = i;
+
+    for (seed = 0; seed <= METHOD_HASH_MAX_SEED; seed++)
+    {
+      for (j = 0; j < n; j++)
+      {
+        pos[j] = method_hash_mix(hashes[keys[j]] + seed) & (mh->size - 1);
+        if (mh->slots[pos[j]] >= 0)
+          break;
+        for (k = 0; k < j; k++)
+          if (pos[k] == pos[j])
+            break;
+        if (k < j)
+          break;
+      }
+
+      if (j == n)
+        break;
+    }
+
+    if (seed > METHOD_HASH_MAX_SEED)
+    {
+      ok = FALSE;
+      break;
+    }
+
+    mh->seeds[order[b]] = seed;
+    for (j = 0; j < n; j++)
+      mh->slots[pos[j]] = keys[j];
+  }
+
+  g_free(sizes);
+  g_free(order);
+  g_free(keys);
+  g_free(pos);
+
+  return ok;
+}
+
+/* emit method lookup function for the servlet, returns FALSE if no
+ * perfect hash was found (e.g. duplicate method names) */
+static gboolean gen_method_lookup(FILE* f, GSList* methods)
+{
+  int count = g_slist_length(methods);
+  guint32* hashes = g_new(guint32, count);
+  struct method_hash mh;
+  gboolean found = FALSE;
+  GSList* j;
+  int i, tries;
+
+  for (j = methods, i = 0; j; j = j->next, i++)
+    hashes[i] = method_hash(((xdl_method*)j->data)->name);
+
+  mh.buckets = count / 2 + 1;
+  for (mh.size = 1; mh.size < count + count / 4; mh.size <<= 1)
+    ;
+
+  for (tries = 0; tries < 4 && !found; tries++, mh.size <<= 1)
+  {
+    mh.seeds = g_new0(guint16, mh.buckets);
+    mh.slots = g_new(gint16, mh.size);
+
+    found = _build_method_hash(hashes, count, &mh);
+    if (found)
+      break;
+
+    g_free(mh.seeds);
+    g_free(mh.slots);
+  }
+
+  g_free(hashes);
+
+  if (!found)
+    return FALSE;
+
+  EL(0, "static const guint16 __servlet_method_seeds[%d] = {", mh.buckets);
+  for (i = 0; i < mh.buckets; i++)
+    E(i % 16 ? 0 : 1, "%u%s", mh.seeds[i], i + 1 == mh.buckets ? "\n" : i % 16 == 15 ? ",\n" : ", ");
+  EL(0, "};");
+  NL;
+
+  EL(0, "static const gint16 __servlet_method_slots[%d] = {", mh.size);
+  for (i = 0; i < mh.size; i++)
+    E(i % 16 ? 0 : 1, "%d%s", mh.slots[i], i + 1 == mh.size ? "\n" : i % 16 == 15 ? ",\n" : ", ");
+  EL(0, "};");
+  NL;
+
+  EL(0, "static __inline__ guint32 __servlet_method_mix(guint32 h)");
+  EL(0, "{");
+  EL(1, "h ^= h >> 16;");
+  EL(1, "h *= 0x85ebca6bu;");
+  EL(1, "h ^= h >> 13;");
+  EL(1, "h *= 0xc2b2ae35u;");
+  EL(1, "h ^= h >> 16;");
+  EL(1, "return h;");
+  EL(0, "}");
+  NL;
+
+  EL(0, "static xr_servlet_method_def* __servlet_method_lookup(const char* name)");
+  EL(0, "{");
+  EL(1, "guint32 h = 2166136261u;");
+  EL(1, "const char* p;");
+  EL(1, "int i;");
+  NL;
+  EL(1, "for (p = name; *p; p++)");
+  EL(2, "h = (h ^ (guchar)*p) * 16777619u;");
+  NL;
+  EL(1, "h += __servlet_method_seeds[__servlet_method_mix(h) %% %d];", mh.buckets);
+  EL(1, "i = __servlet_method_slots[__servlet_method_mix(h) & %d];", mh.size - 1);
+  EL(1, "if (i < 0 || strcmp(__servlet_methods[i].name, name))");
+  EL(2, "return NULL;");
+  NL;
+  EL(1, "return __servlet_methods + i;");
+  EL(0, "}");
+  NL;
+
+  g_free(mh.seeds);
+  g_free(mh.slots);
+  return TRUE;
+}
+
 static void gen_type_marchalizers(FILE* f, xdl_typedef* t)
 {
   GSList *i, *j, *k;
     if (t->type == TD_STRUCT)
     {
+      int n;
+
+      /* member names are interned once, marshallers then address members
+       * by quark */
+      EL(0, "G_GNUC_UNUSED static GQuark* __%s_keys(void)", t->cname);
+      EL(0, "{");
+      EL(1, "static GQuark _keys[%d];", MAX(g_slist_length(t->struct_members), 1));
+      EL(1, "static gsize _keys_init = 0;");
+      NL;
+      EL(1, "if (g_once_init_enter(&_keys_init))");
+      EL(1, "{");
+      for (k=t->struct_members, n=0; k; k=k->next, n++)
+      {
+        xdl_struct_member* m = k->data;
+        EL(2, "_keys[%d] = g_quark_from_static_string(\"%s\");", n, m->name);
+      }
+      EL(2, "g_once_init_leave(&_keys_init, 1);");
+      EL(1, "}");
+      NL;
+      EL(1, "return _keys;");
+      EL(0, "}");
+      NL;
+
       EL(0, "G_GNUC_UNUSED static xr_value* %s(%s _nstruct)", t->march_name, t->ctype);
       EL(0, "{");
       EL(1, "xr_value* _struct;");
+      EL(1, "GQuark* _keys;");
       for (k=t->struct_members; k; k=k->next)
       {
         xdl_struct_member* m = k->data;
@@ -118,11 +332,12 @@ static void gen_type_marchalizers(FILE* f, xdl_typedef* t)
       EL(2, "return NULL;");
       EL(1, "}");
       NL;
+      EL(1, "_keys = __%s_keys();", t->cname);
       EL(1, "_struct = xr_value_struct_new();");
-      for (k=t->struct_members; k; k=k->next)
+      for (k=t->struct_members, n=0; k; k=k->next, n++)
       {
         xdl_struct_member* m = k->data;
-        EL(1, "xr_value_struct_set_member(_struct, \"%s\", %s);", m->name, m->name);
+        EL(1, "xr_value_struct_set_member_quark(_struct, _keys[%d], %s);", n, m->name);
       }
       EL(1, "return _struct;");
       EL(0, "}");
@@ -131,18 +346,20 @@ static void gen_type_marchalizers(FILE* f, xdl_typedef* t)
       EL(0, "G_GNUC_UNUSED static gboolean %s(xr_value* _struct, %s* _nstruct)", t->demarch_name, t->ctype);
       EL(0, "{");
       EL(1, "%s _tmp_nstruct;", t->ctype);
+      EL(1, "GQuark* _keys;");
       NL;
       EL(1, "g_return_val_if_fail(_nstruct != NULL, FALSE);");
       NL;
       EL(1, "if (_struct == NULL || xr_value_get_type(_struct) != XRV_STRUCT)");
       EL(2, "return FALSE;");
       NL;
+      EL(1, "_keys = __%s_keys();", t->cname);
       EL(1, "_tmp_nstruct = %s_new();", t->cname);
       EL(1, "if (");
-      for (k=t->struct_members; k; k=k->next)
+      for (k=t->struct_members, n=0; k; k=k->next, n++)
       {
         xdl_struct_member* m = k->data;
-        EL(2, "!%s(xr_value_get_member(_struct, \"%s\"), &_tmp_nstruct->%s)%s", m->type->demarch_name, m->name, m->name, k->next ? " ||" : "");
+        EL(2, "!%s(xr_value_get_member_quark(_struct, _keys[%d]), &_tmp_nstruct->%s)%s", m->type->demarch_name, n, m->name, k->next ? " ||" : "");
       }
       EL(1, ")");
       EL(1, "{");
@@ -182,19 +399,20 @@ static void gen_type_marchalizers(FILE* f, xdl_typedef* t)
       EL(0, "G_GNUC_UNUSED static gboolean %s(xr_value* _array, %s* _narray)", t->demarch_name, t->ctype);
       EL(0, "{");
       EL(1, "GArray *_tmp_narray = NULL;");
-      EL(1, "GSList *_item;");
+      EL(1, "guint _i, _len;");
       NL;
       EL(1, "g_return_val_if_fail(_narray != NULL, FALSE);");
       NL;
       EL(1, "if (_array == NULL || xr_value_get_type(_array) != XRV_ARRAY)");
       EL(2, "return FALSE;");
       NL;
-      EL(1, "_tmp_narray = g_array_sized_new(FALSE, FALSE, sizeof(%s), g_slist_length(xr_value_get_items(_array)));", t->item_type->ctype);
-      EL(1, "for (_item = xr_value_get_items(_array); _item; _item = _item->next)");
+      EL(1, "_len = xr_value_array_length(_array);");
+      EL(1, "_tmp_narray = g_array_sized_new(FALSE, FALSE, sizeof(%s), _len);", t->item_type->ctype);
+      EL(1, "for (_i = 0; _i < _len; _i++)");
       EL(1, "{");
       EL(2, "%s _item_value = %s;", t->item_type->ctype, t->item_type->cnull);
       NL;
-      EL(2, "if (!%s((xr_value*)_item->data, &_item_value))", t->item_type->demarch_name);
+      EL(2, "if (!%s(xr_value_array_get(_array, _i), &_item_value))", t->item_type->demarch_name);
       EL(2, "{");
       EL(3, "%s(_tmp_narray);", t->free_func);
       EL(3, "return FALSE;");
@@ -210,6 +428,587 @@ static void gen_type_marchalizers(FILE* f, xdl_typedef* t)
     }
 }
 
+/* schema binary encoding (XR_CALL_BINARY transport), see xr-binary.h */
+
+static const char* binary_wire_type(xdl_typedef* t)
+{
+  if (t->type == TD_BASE && (!strcmp(t->name, "int") || !strcmp(t->name, "boolean")))
+    return "XR_BINARY_VARINT";
+  if (t->type == TD_BASE && !strcmp(t->name, "double"))
+    return "XR_BINARY_FIXED64";
+  return "XR_BINARY_BYTES";
+}
+
+/* params and return value are encoded as struct members */
+static GSList* binary_method_fields(xdl_method* m, const char* retval)
+{
+  GSList *k, *fields = NULL;
+  int n = 1;
+
+  if (retval)
+  {
+    xdl_struct_member* fm = g_new0(xdl_struct_member, 1);
+    fm->name = (char*)retval;
+    fm->type = m->return_type;
+    fm->field = 1;
+    return g_slist_append(NULL, fm);
+  }
+
+  for (k=m->params; k; k=k->next)
+  {
+    xdl_method_param* p = k->data;
+    xdl_struct_member* fm = g_new0(xdl_struct_member, 1);
+    fm->name = p->name;
+    fm->type = p->type;
+    fm->field = n++;
+    fields = g_slist_append(fields, fm);
+  }
+
+  return fields;
+}
+
+/* read fields from the reader, unknown fields are skipped, _field is -1
+ * if input is malformed */
+static void gen_binary_read_fields(FILE* f, int ind, const char* reader, GSList* fields, const char* prefix)
+{
+  GSList* k;
+
+  EL(ind, "while ((_field = xr_binary_read_key(%s, &_wt)) > 0)", reader);
+  EL(ind, "{");
+  EL(ind+1, "gboolean _ok;");
+  NL;
+  EL(ind+1, "switch (_field)");
+  EL(ind+1, "{");
+  for (k=fields; k; k=k->next)
+  {
+    xdl_struct_member* m = k->data;
+    EL(ind+2, "case %d:", m->field);
+    EL(ind+3, "_ok = %s(%s, _wt, &%s%s);", m->type->binary_demarch_name, reader, prefix, m->name);
+    EL(ind+3, "break;");
+  }
+  EL(ind+2, "default:");
+  EL(ind+3, "_ok = xr_binary_skip(%s, _wt);", reader);
+  EL(ind+1, "}");
+  NL;
+  EL(ind+1, "if (!_ok)");
+  EL(ind+1, "{");
+  EL(ind+2, "_field = -1;");
+  EL(ind+2, "break;");
+  EL(ind+1, "}");
+  EL(ind, "}");
+}
+
+static gboolean binary_has_default(xdl_typedef* t)
+{
+  return t->type == TD_STRUCT || t->type == TD_ARRAY || t->type == TD_BLOB || (t->type == TD_BASE && t->free_func);
+}
+
+static gboolean binary_has_defaults(GSList* fields)
+{
+  GSList* k;
+
+  for (k=fields; k; k=k->next)
+  {
+    xdl_struct_member* m = k->data;
+    if (binary_has_default(m->type))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* fields missing in the input (sent by peer with older interface) get
+ * default values, so that stubs never see NULL strings, arrays or structs */
+static void gen_binary_defaults(FILE* f, int ind, GSList* fields, const char* prefix)
+{
+  GSList* k;
+
+  for (k=fields; k; k=k->next)
+  {
+    xdl_struct_member* m = k->data;
+    xdl_typedef* t = m->type;
+
+    if (t->type == TD_STRUCT)
+    {
+      EL(ind, "if (%s%s == NULL)", prefix, m->name);
+      EL(ind+1, "%s(NULL, XR_BINARY_BYTES, &%s%s);", t->binary_demarch_name, prefix, m->name);
+    }
+    else if (t->type == TD_ARRAY)
+    {
+      EL(ind, "if (%s%s == NULL)", prefix, m->name);
+      EL(ind+1, "%s%s = %s_new();", prefix, m->name, t->cname);
+    }
+    else if (t->type == TD_BLOB)
+    {
+      EL(ind, "if (%s%s == NULL)", prefix, m->name);
+      EL(ind+1, "%s%s = xr_blob_new(g_strdup(\"\"), 0);", prefix, m->name);
+    }
+    else if (t->type == TD_BASE && t->free_func)
+    {
+      EL(ind, "if (%s%s == NULL)", prefix, m->name);
+      EL(ind+1, "%s%s = g_strdup(\"\");", prefix, m->name);
+    }
+  }
+}
+
+static void gen_type_binary_marchalizers(FILE* f, xdl_typedef* t)
+{
+  GSList* k;
+
+  if (t->type == TD_STRUCT)
+  {
+    EL(0, "G_GNUC_UNUSED static gboolean %s(GString* _buf, guint _field, %s _nstruct)", t->binary_march_name, t->ctype);
+    EL(0, "{");
+    EL(1, "gsize _mark;");
+    NL;
+    EL(1, "if (_nstruct == NULL)");
+    EL(2, "return FALSE;");
+    NL;
+    EL(1, "_mark = xr_binary_begin(_buf, _field);");
+    EL(1, "if (");
+    for (k=t->struct_members; k; k=k->next)
+    {
+      xdl_struct_member* m = k->data;
+      EL(2, "!%s(_buf, %d, _nstruct->%s)%s", m->type->binary_march_name, m->field, m->name, k->next ? " ||" : "");
+    }
+    EL(1, ")");
+    EL(2, "return FALSE;");
+    NL;
+    EL(1, "xr_binary_end(_buf, _mark);");
+    EL(1, "return TRUE;");
+    EL(0, "}");
+    NL;
+
+    /* NULL reader produces struct with default values */
+    EL(0, "G_GNUC_UNUSED static gboolean %s(xr_binary_reader* _r, xr_binary_wire_type _field_wt, %s* _nstruct)", t->binary_demarch_name, t->ctype);
+    EL(0, "{");
+    EL(1, "xr_binary_reader _body = { NULL, NULL };");
+    EL(1, "xr_binary_wire_type _wt;");
+    EL(1, "%s _tmp_nstruct;", t->ctype);
+    EL(1, "int _field;");
+    NL;
+    EL(1, "g_return_val_if_fail(_nstruct != NULL, FALSE);");
+    NL;
+    EL(1, "if (_r && !xr_binary_read_nested(_r, _field_wt, &_body))");
+    EL(2, "return FALSE;");
+    NL;
+    EL(1, "_tmp_nstruct = %s_new();", t->cname);
+    gen_binary_read_fields(f, 1, "&_body", t->struct_members, "_tmp_nstruct->");
+    NL;
+    EL(1, "if (_field < 0)");
+    EL(1, "{");
+    EL(2, "%s(_tmp_nstruct);", t->free_func);
+    EL(2, "return FALSE;");
+    EL(1, "}");
+    NL;
+    if (binary_has_defaults(t->struct_members))
+    {
+      gen_binary_defaults(f, 1, t->struct_members, "_tmp_nstruct->");
+      NL;
+    }
+    EL(1, "%s(*_nstruct);", t->free_func);
+    EL(1, "*_nstruct = _tmp_nstruct;");
+    EL(1, "return TRUE;");
+    EL(0, "}");
+    NL;
+  }
+  else if (t->type == TD_ARRAY)
+  {
+    EL(0, "G_GNUC_UNUSED static gboolean %s(GString* _buf, guint _field, %s _narray)", t->binary_march_name, t->ctype);
+    EL(0, "{");
+    EL(1, "gsize _mark = xr_binary_begin(_buf, _field);");
+    EL(1, "guint _i;");
+    NL;
+    EL(1, "for (_i = 0; _i < (_narray ? _narray->len : 0); _i++)");
+    EL(2, "if (!%s(_buf, 0, g_array_index(_narray, %s, _i)))", t->item_type->binary_march_name, t->item_type->ctype);
+    EL(3, "return FALSE;");
+    NL;
+    EL(1, "xr_binary_end(_buf, _mark);");
+    EL(1, "return TRUE;");
+    EL(0, "}");
+    NL;
+
+    /* items are encoded back to back without keys */
+    EL(0, "G_GNUC_UNUSED static gboolean %s(xr_binary_reader* _r, xr_binary_wire_type _field_wt, %s* _narray)", t->binary_demarch_name, t->ctype);
+    EL(0, "{");
+    EL(1, "xr_binary_reader _body = { NULL, NULL };");
+    EL(1, "GArray* _tmp_narray;");
+    NL;
+    EL(1, "g_return_val_if_fail(_narray != NULL, FALSE);");
+    NL;
+    EL(1, "if (_r && !xr_binary_read_nested(_r, _field_wt, &_body))");
+    EL(2, "return FALSE;");
+    NL;
+    EL(1, "_tmp_narray = %s_new();", t->cname);
+    EL(1, "while (_body.p < _body.end)");
+    EL(1, "{");
+    EL(2, "%s _item_value = %s;", t->item_type->ctype, t->item_type->cnull);
+    NL;
+    EL(2, "if (!%s(&_body, %s, &_item_value))", t->item_type->binary_demarch_name, binary_wire_type(t->item_type));
+    EL(2, "{");
+    EL(3, "%s(_tmp_narray);", t->free_func);
+    EL(3, "return FALSE;");
+    EL(2, "}");
+    NL;
+    EL(2, "g_array_append_val(_tmp_narray, _item_value);");
+    EL(1, "}");
+    NL;
+    EL(1, "%s(*_narray);", t->free_func);
+    EL(1, "*_narray = _tmp_narray;");
+    EL(1, "return TRUE;");
+    EL(0, "}");
+    NL;
+  }
+}
+
+/* direct XML-RPC/JSON-RPC writers, see xr-wire.h */
+static void gen_type_wire_marchalizers(FILE* f, xdl_typedef* t)
+{
+  GSList* k;
+
+  if (t->type == TD_STRUCT)
+  {
+    EL(0, "G_GNUC_UNUSED static gboolean %s(xr_wire_writer* _w, %s _nstruct)", t->wire_march_name, t->ctype);
+    EL(0, "{");
+    EL(1, "if (_nstruct == NULL)");
+    EL(2, "return FALSE;");
+    NL;
+    EL(1, "xr_wire_write_struct_begin(_w);");
+    /* member tags are precomputed, names are identifiers and need no
+     * escaping */
+    for (k=t->struct_members; k; k=k->next)
+    {
+      xdl_struct_member* m = k->data;
+      gboolean first = k == t->struct_members;
+      char* xml_tag = g_strdup_printf("%s<member><name>%s</name>", first ? "" : "</member>", m->name);
+      char* json_tag = g_strdup_printf("%s\"%s\":", first ? "" : ",", m->name);
+      char* json_str = g_strescape(json_tag, NULL);
+
+      EL(1, "xr_wire_write_member(_w, \"%s\", %d, \"%s\", %d);", xml_tag, (int)strlen(xml_tag), json_str, (int)strlen(json_tag));
+      EL(1, "if (!%s(_w, _nstruct->%s))", m->type->wire_march_name, m->name);
+      EL(2, "return FALSE;");
+      g_free(xml_tag);
+      g_free(json_tag);
+      g_free(json_str);
+    }
+    EL(1, "xr_wire_write_struct_end(_w);");
+    EL(1, "return TRUE;");
+    EL(0, "}");
+    NL;
+  }
+  else if (t->type == TD_ARRAY)
+  {
+    EL(0, "G_GNUC_UNUSED static gboolean %s(xr_wire_writer* _w, %s _narray)", t->wire_march_name, t->ctype);
+    EL(0, "{");
+    EL(1, "guint _i;");
+    NL;
+    EL(1, "xr_wire_write_array_begin(_w);");
+    EL(1, "for (_i = 0; _i < (_narray ? _narray->len : 0); _i++)");
+    EL(1, "{");
+    EL(2, "xr_wire_write_item(_w, _i);");
+    EL(2, "if (!%s(_w, g_array_index(_narray, %s, _i)))", t->item_type->wire_march_name, t->item_type->ctype);
+    EL(3, "return FALSE;");
+    EL(1, "}");
+    EL(1, "xr_wire_write_array_end(_w);");
+    EL(1, "return TRUE;");
+    EL(0, "}");
+    NL;
+  }
+}
+
+/* direct XML-RPC/JSON-RPC readers, see xr-wire.h */
+static void gen_type_wire_demarchalizers(FILE* f, xdl_typedef* t)
+{
+  GSList* k;
+  int n;
+
+  if (t->type == TD_STRUCT)
+  {
+    int count = g_slist_length(t->struct_members);
+
+    /* members may come in any order, repeated members are left to the
+     * xr_value demarshaller */
+    EL(0, "G_GNUC_UNUSED static gboolean %s(xr_wire_reader* _r, %s* _nstruct)", t->wire_demarch_name, t->ctype);
+    EL(0, "{");
+    EL(1, "%s _tmp_nstruct;", t->ctype);
+    if (count > 0)
+      EL(1, "guchar _seen[%d];", count);
+    EL(1, "gboolean _ok = TRUE;");
+    EL(1, "int _rs = 0;");
+    NL;
+    EL(1, "g_return_val_if_fail(_nstruct != NULL, FALSE);");
+    NL;
+    EL(1, "if (!xr_wire_begin_struct(_r))");
+    EL(2, "return FALSE;");
+    NL;
+    if (count > 0)
+      EL(1, "memset(_seen, 0, sizeof(_seen));");
+    EL(1, "_tmp_nstruct = %s_new();", t->cname);
+    EL(1, "while (_ok && (_rs = xr_wire_next_member(_r)) > 0)");
+    EL(1, "{");
+    for (k=t->struct_members, n=0; k; k=k->next, n++)
+    {
+      xdl_struct_member* m = k->data;
+      EL(2, "%sif (xr_wire_member_is(_r, \"%s\", %d))", n ? "else " : "", m->name, (int)strlen(m->name));
+      EL(3, "_ok = !_seen[%d]++ && %s(_r, &_tmp_nstruct->%s);", n, m->type->wire_demarch_name, m->name);
+    }
+    if (count > 0)
+      EL(2, "else");
+    EL(count > 0 ? 3 : 2, "_ok = xr_wire_skip(_r);");
+    EL(1, "}");
+    NL;
+    EL(1, "if (!_ok || _rs < 0%s)", count > 0 ? " || memchr(_seen, 0, sizeof(_seen))" : "");
+    EL(1, "{");
+    EL(2, "%s(_tmp_nstruct);", t->free_func);
+    EL(2, "return FALSE;");
+    EL(1, "}");
+    NL;
+    EL(1, "%s(*_nstruct);", t->free_func);
+    EL(1, "*_nstruct = _tmp_nstruct;");
+    EL(1, "return TRUE;");
+    EL(0, "}");
+    NL;
+  }
+  else if (t->type == TD_ARRAY)
+  {
+    EL(0, "G_GNUC_UNUSED static gboolean %s(xr_wire_reader* _r, %s* _narray)", t->wire_demarch_name, t->ctype);
+    EL(0, "{");
+    EL(1, "GArray* _tmp_narray;");
+    EL(1, "int _rs;");
+    NL;
+    EL(1, "g_return_val_if_fail(_narray != NULL, FALSE);");
+    NL;
+    EL(1, "if (!xr_wire_begin_array(_r))");
+    EL(2, "return FALSE;");
+    NL;
+    EL(1, "_tmp_narray = %s_new();", t->cname);
+    EL(1, "while ((_rs = xr_wire_next_item(_r)) > 0)");
+    EL(1, "{");
+    EL(2, "%s _item_value = %s;", t->item_type->ctype, t->item_type->cnull);
+    NL;
+    EL(2, "if (!%s(_r, &_item_value))", t->item_type->wire_demarch_name);
+    EL(2, "{");
+    EL(3, "_rs = -1;");
+    EL(3, "break;");
+    EL(2, "}");
+    NL;
+    EL(2, "g_array_append_val(_tmp_narray, _item_value);");
+    EL(1, "}");
+    NL;
+    EL(1, "if (_rs < 0)");
+    EL(1, "{");
+    EL(2, "%s(_tmp_narray);", t->free_func);
+    EL(2, "return FALSE;");
+    EL(1, "}");
+    NL;
+    EL(1, "%s(*_narray);", t->free_func);
+    EL(1, "*_narray = _tmp_narray;");
+    EL(1, "return TRUE;");
+    EL(0, "}");
+    NL;
+  }
+}
+
+static void gen_wire_demarchalizers(FILE* f, xdl_model* xdl, xdl_servlet* s)
+{
+  GSList *j;
+
+  for (j=xdl->types; j; j=j->next)
+    gen_type_wire_demarchalizers(f, j->data);
+  for (j=s->types; j; j=j->next)
+    gen_type_wire_demarchalizers(f, j->data);
+}
+
+/* servlet method params: binary transport carries encoded params, XML-RPC
+ * and JSON-RPC params are read directly from the request if possible and
+ * from xr_value params otherwise */
+static void gen_params_demarch(FILE* f, xdl_method* m)
+{
+  GSList *k, *fields;
+  int n = 0;
+
+  if (m->params == NULL)
+    return;
+
+  fields = binary_method_fields(m, NULL);
+
+  NL;
+  EL(1, "if (xr_call_get_transport(_call) == XR_CALL_BINARY)");
+  EL(1, "{");
+  EL(2, "xr_binary_reader _r;");
+  EL(2, "xr_binary_wire_type _wt;");
+  EL(2, "const char* _raw;");
+  EL(2, "int _len = 0;");
+  EL(2, "int _field;");
+  NL;
+  EL(2, "_raw = xr_call_get_raw_params(_call, &_len);");
+  EL(2, "xr_binary_reader_init(&_r, _raw, _len);");
+  gen_binary_read_fields(f, 2, "&_r", fields, "");
+  NL;
+  EL(2, "if (_field < 0)");
+  EL(2, "{");
+  EL(3, "xr_call_set_error(_call, -1, \"Stub parameter value demarchalization failed. (%s)\");", m->name);
+  EL(3, "goto out;");
+  EL(2, "}");
+  gen_binary_defaults(f, 2, fields, "");
+  EL(1, "}");
+  EL(1, "else");
+  EL(1, "{");
+  EL(2, "xr_wire_reader _w;");
+  NL;
+  EL(2, "if (!xr_wire_reader_init_params(&_w, _call) || !(");
+  for (k=m->params; k; k=k->next)
+  {
+    xdl_method_param* p = k->data;
+    EL(3, "xr_wire_next_item(&_w) > 0 && %s(&_w, &%s)%s", p->type->wire_demarch_name, p->name, k->next ? " &&" : "))");
+  }
+  EL(2, "{");
+  /* xr_value params report the error */
+  for (k=m->params; k; k=k->next)
+  {
+    xdl_method_param* p = k->data;
+    if (p->type->free_func)
+    {
+      EL(3, "%s(%s);", p->type->free_func, p->name);
+      EL(3, "%s = %s;", p->name, p->type->cnull);
+    }
+  }
+  for (k=m->params; k; k=k->next)
+  {
+    xdl_method_param* p = k->data;
+    EL(3, "if (!%s(xr_call_get_param(_call, %d), &%s))", p->type->demarch_name, n++, p->name);
+    EL(3, "{");
+    EL(4, "xr_call_set_error(_call, -1, \"Stub parameter value demarchalization failed. (%s:%s)\");", m->name, p->name);
+    EL(4, "goto out;");
+    EL(3, "}");
+  }
+  EL(2, "}");
+  EL(1, "}");
+
+  g_slist_foreach(fields, (GFunc)g_free, NULL);
+  g_slist_free(fields);
+}
+
+/* client stub params */
+static void gen_params_march_fail(FILE* f, int ind, int async, const char* msg)
+{
+  if (async)
+  {
+    EL(ind, "_result = g_simple_async_result_new(NULL, _callback, _user_data, xr_client_call_async);");
+    EL(ind, "g_simple_async_result_set_error(_result, XR_CLIENT_ERROR, XR_CLIENT_ERROR_MARCHALIZER, \"%s\");", msg);
+    EL(ind, "g_simple_async_result_complete_in_idle(_result);");
+    EL(ind, "g_object_unref(_result);");
+    EL(ind, "xr_call_free(_call);");
+    EL(ind, "return;");
+  }
+  else
+  {
+    EL(ind, "g_set_error(_error, XR_CLIENT_ERROR, XR_CLIENT_ERROR_MARCHALIZER, \"%s\");", msg);
+    EL(ind, "xr_call_free(_call);");
+    EL(ind, "return _retval;");
+  }
+}
+
+static void gen_params_march(FILE* f, xdl_method* m, int async)
+{
+  GSList* k;
+
+  EL(1, "if (xr_client_get_transport(_conn) == XR_CALL_BINARY)");
+  EL(1, "{");
+  EL(2, "GString* _raw_params = g_string_sized_new(128);");
+  NL;
+  if (m->params)
+  {
+    int n = 1;
+
+    EL(2, "if (");
+    for (k=m->params; k; k=k->next)
+    {
+      xdl_method_param* p = k->data;
+      EL(3, "!%s(_raw_params, %d, %s)%s", p->type->binary_march_name, n++, p->name, k->next ? " ||" : "");
+    }
+    EL(2, ")");
+    EL(2, "{");
+    EL(3, "g_string_free(_raw_params, TRUE);");
+    gen_params_march_fail(f, 3, async, "Call parameter value marchalization failed.");
+    EL(2, "}");
+  }
+  EL(2, "xr_call_set_raw_params(_call, _raw_params);");
+  EL(1, "}");
+  if (m->params)
+  {
+    EL(1, "else if (xr_wire_writer_init_params(&_w, xr_client_get_transport(_conn)))");
+    EL(1, "{");
+    EL(2, "if (");
+    for (k=m->params; k; k=k->next)
+    {
+      xdl_method_param* p = k->data;
+      EL(3, "!xr_wire_write_param(&_w) || !%s(&_w, %s)%s", p->type->wire_march_name, p->name, k->next ? " ||" : "");
+    }
+    EL(2, ")");
+    EL(2, "{");
+    EL(3, "xr_wire_writer_free(&_w);");
+    gen_params_march_fail(f, 3, async, "Call parameter value marchalization failed.");
+    EL(2, "}");
+    EL(2, "xr_wire_writer_finish_params(&_w, _call);");
+    EL(1, "}");
+    EL(1, "else");
+    EL(1, "{");
+    EL(2, "xr_value* _param_value;");
+    for (k=m->params; k; k=k->next)
+    {
+      xdl_method_param* p = k->data;
+      NL;
+      EL(2, "_param_value = %s(%s);", p->type->march_name, p->name);
+      EL(2, "if (_param_value == NULL)");
+      EL(2, "{");
+      gen_params_march_fail(f, 3, async, S("Call parameter value marchalization failed (param=%s).", p->name));
+      EL(2, "}");
+      EL(2, "xr_call_add_param(_call, _param_value);");
+    }
+    EL(1, "}");
+  }
+}
+
+/* client stub retval */
+static void gen_retval_demarch(FILE* f, xdl_method* m)
+{
+  GSList* fields = binary_method_fields(m, "_retval");
+
+  EL(2, "if (xr_call_get_transport(_call) == XR_CALL_BINARY)");
+  EL(2, "{");
+  EL(3, "xr_binary_reader _r;");
+  EL(3, "xr_binary_wire_type _wt;");
+  EL(3, "const char* _raw;");
+  EL(3, "int _len = 0;");
+  EL(3, "int _field;");
+  NL;
+  EL(3, "_raw = xr_call_get_raw_retval(_call, &_len);");
+  EL(3, "xr_binary_reader_init(&_r, _raw, _len);");
+  gen_binary_read_fields(f, 3, "&_r", fields, "");
+  NL;
+  EL(3, "if (_field < 0)");
+  EL(3, "{");
+  if (m->return_type->free_func)
+    EL(4, "%s(_retval);", m->return_type->free_func);
+  EL(4, "_retval = %s;", m->return_type->cnull);
+  EL(4, "g_set_error(_error, XR_CLIENT_ERROR, XR_CLIENT_ERROR_MARCHALIZER, \"Call return value demarchalization failed.\");");
+  EL(3, "}");
+  if (binary_has_defaults(fields))
+  {
+    EL(3, "else");
+    EL(3, "{");
+    gen_binary_defaults(f, 4, fields, "");
+    EL(3, "}");
+  }
+  EL(2, "}");
+  EL(2, "else if (!%s(xr_call_get_retval(_call), &_retval))", m->return_type->demarch_name);
+  EL(3, "g_set_error(_error, XR_CLIENT_ERROR, XR_CLIENT_ERROR_MARCHALIZER, \"Call return value demarchalization failed.\");");
+
+  g_slist_foreach(fields, (GFunc)g_free, NULL);
+  g_slist_free(fields);
+}
+
 static void gen_type_freealloc(FILE* f, xdl_typedef* t, int def)
 {
   GSList *i, *j, *k;
@@ -400,6 +1199,8 @@ static void gen_marchalizers(FILE* f, xdl_model* xdl, xdl_servlet* s)
     if (t->type == TD_ANY)
       continue;
     gen_type_marchalizers(f, t);
+    gen_type_binary_marchalizers(f, t);
+    gen_type_wire_marchalizers(f, t);
   }
   for (j=s->types; j; j=j->next)
   {
@@ -407,6 +1208,8 @@ static void gen_marchalizers(FILE* f, xdl_model* xdl, xdl_servlet* s)
     if (t->type == TD_ANY)
       continue;
     gen_type_marchalizers(f, t);
+    gen_type_binary_marchalizers(f, t);
+    gen_type_wire_marchalizers(f, t);
   }
 }
 
@@ -450,6 +1253,100 @@ static void gen_errors_impl(FILE* f, xdl_model* xdl, xdl_servlet* s)
   NL;
 }
 
+/* async method: wrapper defers the call and the stub completes it using
+ * generated _complete function, the stub owns all parameters because they
+ * are used after the wrapper returns */
+static void gen_async_method(FILE* f, xdl_model* xdl, xdl_servlet* s, xdl_method* m)
+{
+  GSList* k;
+
+  EL(0, "void %s%sServlet_%s_complete(xr_pending_call* _pending, %s _nreturn_value, GError* _error)", xdl->name, s->name, m->name, m->return_type->ctype);
+  EL(0, "{");
+  EL(1, "xr_call* _call;");
+  EL(1, "xr_value* _return_value;");
+  EL(1, "xr_wire_writer _w;");
+  NL;
+  EL(1, "g_return_if_fail(_pending != NULL);");
+  NL;
+  EL(1, "_call = xr_pending_call_get_call(_pending);");
+  EL(1, "if (_error)");
+  EL(1, "{");
+  EL(2, "xr_call_set_error(_call, _error->code, _error->message);");
+  EL(2, "g_error_free(_error);");
+  EL(1, "}");
+  EL(1, "else if (xr_call_get_transport(_call) == XR_CALL_BINARY)");
+  EL(1, "{");
+  EL(2, "GString* _raw_retval = g_string_sized_new(128);");
+  NL;
+  EL(2, "if (%s(_raw_retval, 1, _nreturn_value))", m->return_type->binary_march_name);
+  EL(3, "xr_call_set_raw_retval(_call, _raw_retval);");
+  EL(2, "else");
+  EL(2, "{");
+  EL(3, "g_string_free(_raw_retval, TRUE);");
+  EL(3, "xr_call_set_error(_call, -1, \"Stub return value marchalization failed. (%s)\");", m->name);
+  EL(2, "}");
+  EL(1, "}");
+  EL(1, "else if (xr_wire_writer_init_retval(&_w, _call))");
+  EL(1, "{");
+  EL(2, "if (%s(&_w, _nreturn_value))", m->return_type->wire_march_name);
+  EL(3, "xr_wire_writer_finish_retval(&_w, _call);");
+  EL(2, "else");
+  EL(2, "{");
+  EL(3, "xr_wire_writer_free(&_w);");
+  EL(3, "xr_call_set_error(_call, -1, \"Stub return value marchalization failed. (%s)\");", m->name);
+  EL(2, "}");
+  EL(1, "}");
+  EL(1, "else if ((_return_value = %s(_nreturn_value)) == NULL)", m->return_type->march_name);
+  EL(2, "xr_call_set_error(_call, -1, \"Stub return value marchalization failed. (%s)\");", m->name);
+  EL(1, "else");
+  EL(2, "xr_call_set_retval(_call, _return_value);");
+  NL;
+  if (m->return_type->free_func)
+    EL(1, "%s(_nreturn_value);", m->return_type->free_func);
+  EL(1, "xr_pending_call_complete(_pending);");
+  EL(0, "}");
+  NL;
+
+  EL(0, "static gboolean __method_%s(xr_servlet* _servlet, xr_call* _call)", m->name);
+  EL(0, "{");
+  EL(1, "gboolean _retval = FALSE;");
+  for (k=m->params; k; k=k->next)
+  {
+    xdl_method_param* p = k->data;
+    EL(1, "%s %s = %s;", p->type->ctype, p->name, p->type->cnull);
+  }
+  NL;
+  EL(1, "g_return_val_if_fail(_servlet != NULL, FALSE);");
+  EL(1, "g_return_val_if_fail(_call != NULL, FALSE);");
+  gen_params_demarch(f, m);
+
+  // call stub, it owns the call and the params from now on
+  NL;
+  E(1, "%s%sServlet_%s(_servlet, xr_servlet_defer_call(_servlet)", xdl->name, s->name, m->name);
+  for (k=m->params; k; k=k->next)
+  {
+    xdl_method_param* p = k->data;
+    E(0, ", %s", p->name);
+  }
+  EL(0, ");");
+  EL(1, "return TRUE;");
+
+  if (m->params)
+  {
+    NL;
+    EL(0, "out:");
+  }
+  for (k=m->params; k; k=k->next)
+  {
+    xdl_method_param* p = k->data;
+    if (p->type->free_func)
+      EL(1, "%s(%s);", p->type->free_func, p->name);
+  }
+  EL(1, "return _retval;");
+  EL(0, "}");
+  NL;
+}
+
 /* main() */
 
 static gchar* out_dir = NULL;
@@ -495,6 +1392,8 @@ int main(int ac, char* av[])
 
   FILE* f = NULL;
   GSList *i, *j, *k;
+  gboolean has_lookup;
+  int n;
   
   int pub_headers = !strcmp(mode, "all") || !strcmp(mode, "pub-headers");
   int pub_impl = !strcmp(mode, "all") || !strcmp(mode, "pub-impl");
@@ -657,6 +1556,39 @@ int main(int ac, char* av[])
       }
       EL(0, ", GError** _error);");
       NL;
+
+      EL(0, "/** Asynchronous version of %s%s_%s().", xdl->name, s->name, m->name);
+      EL(0, " * ");
+      EL(0, " * @param _conn Client connection object.");
+      for (k=m->params; k; k=k->next)
+      {
+        xdl_method_param* p = k->data;
+        EL(0, " * @param %s", p->name);
+      }
+      EL(0, " * @param _cancellable Optional cancellable object.");
+      EL(0, " * @param _callback Callback to call when the call is done.");
+      EL(0, " * @param _user_data Data passed to the callback.");
+      EL(0, " */ ");
+
+      E(0, "void %s%s_%s_async(xr_client_conn* _conn", xdl->name, s->name, m->name);
+      for (k=m->params; k; k=k->next)
+      {
+        xdl_method_param* p = k->data;
+        E(0, ", %s%s %s", !strcmp(p->type->ctype, "char*") ? "const " : "", p->type->ctype, p->name);
+      }
+      EL(0, ", GCancellable* _cancellable, GAsyncReadyCallback _callback, gpointer _user_data);");
+      NL;
+
+      EL(0, "/** Finish asynchronous call started by %s%s_%s_async().", xdl->name, s->name, m->name);
+      EL(0, " * ");
+      EL(0, " * @param _conn Client connection object.");
+      EL(0, " * @param _result Result passed to the callback.");
+      EL(0, " * @param _error Error variable pointer (may be NULL).");
+      EL(0, " * ");
+      EL(0, " * @return ");
+      EL(0, " */ ");
+      EL(0, "%s %s%s_%s_finish(xr_client_conn* _conn, GAsyncResult* _result, GError** _error);", m->return_type->ctype, xdl->name, s->name, m->name);
+      NL;
     }
 
     EL(0, "#endif");
@@ -672,6 +1604,8 @@ int main(int ac, char* av[])
 
     OPEN("%s/%s%s.xrc.c", out_dir, xdl->name, s->name);
 
+    EL(0, "#include <xr-binary.h>");
+    EL(0, "#include <xr-wire.h>");
     EL(0, "#include \"%s%s.xrc.h\"", xdl->name, s->name);
     NL;
 
@@ -691,31 +1625,60 @@ int main(int ac, char* av[])
       EL(0, ", GError** _error)");
       EL(0, "{");
       EL(1, "%s _retval = %s;", m->return_type->ctype, m->return_type->cnull);
-      EL(1, "xr_value* _param_value;");
       EL(1, "xr_call* _call;");
+      if (m->params)
+        EL(1, "xr_wire_writer _w;");
       NL;
       EL(1, "g_return_val_if_fail(_conn != NULL, _retval);");
       EL(1, "g_return_val_if_fail(_error == NULL || *_error == NULL, _retval);");
       NL;
       EL(1, "_call = xr_call_new(\"%s%s.%s\");", xdl->name, s->name, m->name);
+      gen_params_march(f, m, 0);
+      NL;
+      EL(1, "if (xr_client_call(_conn, _call, _error))");
+      EL(1, "{");
+      gen_retval_demarch(f, m);
+      EL(1, "}");
+      NL;
+      EL(1, "xr_call_free(_call);");
+      EL(1, "return _retval;");
+      EL(0, "}");
+      NL;
+
+      E(0, "void %s%s_%s_async(xr_client_conn* _conn", xdl->name, s->name, m->name);
       for (k=m->params; k; k=k->next)
       {
         xdl_method_param* p = k->data;
-        NL;
-        EL(1, "_param_value = %s(%s);", p->type->march_name, p->name);
-        EL(1, "if (_param_value == NULL)");
-        EL(1, "{");
-        EL(2, "g_set_error(_error, XR_CLIENT_ERROR, XR_CLIENT_ERROR_MARCHALIZER, \"Call parameter value marchalization failed (param=%s).\");", p->name);
-        EL(2, "xr_call_free(_call);");
-        EL(2, "return _retval;");
-        EL(1, "}");
-        EL(1, "xr_call_add_param(_call, _param_value);");
+        E(0, ", %s%s %s", !strcmp(p->type->ctype, "char*") ? "const " : "", p->type->ctype, p->name);
       }
+      EL(0, ", GCancellable* _cancellable, GAsyncReadyCallback _callback, gpointer _user_data)");
+      EL(0, "{");
+      if (m->params)
+        EL(1, "GSimpleAsyncResult* _result;");
+      EL(1, "xr_call* _call;");
+      if (m->params)
+        EL(1, "xr_wire_writer _w;");
       NL;
-      EL(1, "if (xr_client_call(_conn, _call, _error))");
+      EL(1, "g_return_if_fail(_conn != NULL);");
+      NL;
+      EL(1, "_call = xr_call_new(\"%s%s.%s\");", xdl->name, s->name, m->name);
+      gen_params_march(f, m, 1);
+      NL;
+      EL(1, "xr_client_call_async(_conn, _call, _cancellable, _callback, _user_data);");
+      EL(0, "}");
+      NL;
+
+      EL(0, "%s %s%s_%s_finish(xr_client_conn* _conn, GAsyncResult* _result, GError** _error)", m->return_type->ctype, xdl->name, s->name, m->name);
+      EL(0, "{");
+      EL(1, "%s _retval = %s;", m->return_type->ctype, m->return_type->cnull);
+      EL(1, "xr_call* _call = NULL;");
+      NL;
+      EL(1, "g_return_val_if_fail(_conn != NULL, _retval);");
+      EL(1, "g_return_val_if_fail(_error == NULL || *_error == NULL, _retval);");
+      NL;
+      EL(1, "if (xr_client_call_finish(_conn, _result, &_call, _error))");
       EL(1, "{");
-      EL(2, "if (!%s(xr_call_get_retval(_call), &_retval))", m->return_type->demarch_name);
-      EL(3, "g_set_error(_error, XR_CLIENT_ERROR, XR_CLIENT_ERROR_MARCHALIZER, \"Call return value demarchalization failed.\");");
+      gen_retval_demarch(f, m);
       EL(1, "}");
       NL;
       EL(1, "xr_call_free(_call);");
@@ -776,6 +1739,16 @@ int main(int ac, char* av[])
     EL(0, "void %s%sServlet_fini(xr_servlet* _servlet);", xdl->name, s->name);
     NL;
 
+    EL(0, "/** Servlet reset hook. Called before pooled servlet object is reused");
+    EL(0, " * by another connection.");
+    EL(0, " * ");
+    EL(0, " * @param _servlet Servlet object.");
+    EL(0, " * ");
+    EL(0, " * @return TRUE if servlet can be reused.");
+    EL(0, " */ ");
+    EL(0, "gboolean %s%sServlet_reset(xr_servlet* _servlet);", xdl->name, s->name);
+    NL;
+
     EL(0, "/** Pre-call hook.");
     EL(0, " * ");
     EL(0, " * @param _servlet Servlet object.");
@@ -837,24 +1810,58 @@ int main(int ac, char* av[])
         EL(0, "/** ");
         EL(0, " * ");
         EL(0, " * @param _servlet Servlet object.");
+        if (m->async)
+          EL(0, " * @param _pending Call completion handle.");
         for (k=m->params; k; k=k->next)
         {
           xdl_method_param* p = k->data;
           EL(0, " * @param %s", p->name);
         }
-        EL(0, " * ");
-        EL(0, " * @return ");
+        if (!m->async)
+        {
+          EL(0, " * ");
+          EL(0, " * @return ");
+        }
+        else if (m->params)
+        {
+          EL(0, " * ");
+          EL(0, " * Ownership of the parameters is taken.");
+        }
         EL(0, " */ ");
       }
 
-      E(0, "%s %s%sServlet_%s(xr_servlet* _servlet", m->return_type->ctype, xdl->name, s->name, m->name);
+      if (m->async)
+        E(0, "void %s%sServlet_%s(xr_servlet* _servlet, xr_pending_call* _pending", xdl->name, s->name, m->name);
+      else
+        E(0, "%s %s%sServlet_%s(xr_servlet* _servlet", m->return_type->ctype, xdl->name, s->name, m->name);
       for (k=m->params; k; k=k->next)
       {
         xdl_method_param* p = k->data;
         E(0, ", %s %s", p->type->ctype, p->name);
       }
-      EL(0, ", GError** _error);");
+      if (m->async)
+        EL(0, ");");
+      else
+        EL(0, ", GError** _error);");
       NL;
+
+      if (m->async)
+      {
+        EL(0, "/** Complete asynchronous %s call. May be called from any thread.", m->name);
+        EL(0, " * ");
+        if (m->params)
+        {
+          EL(0, " * Parameters of the call are owned by the implementation, it");
+          EL(0, " * must free them when they are no longer needed.");
+          EL(0, " * ");
+        }
+        EL(0, " * @param _pending Call completion handle.");
+        EL(0, " * @param _retval Return value (ownership is taken).");
+        EL(0, " * @param _error Error or NULL (ownership is taken).");
+        EL(0, " */ ");
+        EL(0, "void %s%sServlet_%s_complete(xr_pending_call* _pending, %s _retval, GError* _error);", xdl->name, s->name, m->name, m->return_type->ctype);
+        NL;
+      }
     }
 
     EL(0, "#endif");
@@ -901,6 +1908,14 @@ int main(int ac, char* av[])
     EL(0, "}");
     NL;
 
+    EL(0, "gboolean %s%sServlet_reset(xr_servlet* _servlet)", xdl->name, s->name);
+    EL(0, "{");
+    EL(1, "%s%sServlet* _priv = xr_servlet_get_priv(_servlet);", xdl->name, s->name);
+    STUB(s->stub_reset);
+    EL(1, "return TRUE;");
+    EL(0, "}");
+    NL;
+
     EL(0, "gboolean %s%sServlet_pre_call(xr_servlet* _servlet, xr_call* _call)", xdl->name, s->name);
     EL(0, "{");
     EL(1, "%s%sServlet* _priv = xr_servlet_get_priv(_servlet);", xdl->name, s->name);
@@ -947,6 +1962,34 @@ int main(int ac, char* av[])
     {
       xdl_method* m = j->data;
 
+      if (m->async)
+      {
+        E(0, "void %s%sServlet_%s(xr_servlet* _servlet, xr_pending_call* _pending", xdl->name, s->name, m->name);
+        for (k=m->params; k; k=k->next)
+        {
+          xdl_method_param* p = k->data;
+          E(0, ", %s %s", p->type->ctype, p->name);
+        }
+        EL(0, ")");
+        EL(0, "{");
+        EL(1, "%s%sServlet* _priv = xr_servlet_get_priv(_servlet);", xdl->name, s->name);
+        if (m->stub_impl)
+          STUB(m->stub_impl);
+        else
+        {
+          for (k=m->params; k; k=k->next)
+          {
+            xdl_method_param* p = k->data;
+            if (p->type->free_func)
+              EL(1, "%s(%s);", p->type->free_func, p->name);
+          }
+          EL(1, "%s%sServlet_%s_complete(_pending, %s, g_error_new(0, 1, \"Method is not implemented. (%s)\"));", xdl->name, s->name, m->name, m->return_type->cnull, m->name);
+        }
+        EL(0, "}");
+        NL;
+        continue;
+      }
+
       E(0, "%s %s%sServlet_%s(xr_servlet* _servlet", m->return_type->ctype, xdl->name, s->name, m->name);
       for (k=m->params; k; k=k->next)
       {
@@ -991,16 +2034,25 @@ int main(int ac, char* av[])
 
     OPEN("%s/%s%s.xrs.c", out_dir, xdl->name, s->name);
 
+    EL(0, "#include <string.h>");
+    EL(0, "#include <xr-binary.h>");
+    EL(0, "#include <xr-wire.h>");
     EL(0, "#include \"%s%s.xrs.h\"", xdl->name, s->name);
     NL;
 
     gen_marchalizers(f, xdl, s);
+    gen_wire_demarchalizers(f, xdl, s);
     NL;
 
     for (j=s->methods; j; j=j->next)
     {
       xdl_method* m = j->data;
-      int n = 0;
+
+      if (m->async)
+      {
+        gen_async_method(f, xdl, s, m);
+        continue;
+      }
 
       EL(0, "static gboolean __method_%s(xr_servlet* _servlet, xr_call* _call)", m->name);
       EL(0, "{");
@@ -1008,6 +2060,7 @@ int main(int ac, char* av[])
       EL(1, "gboolean _retval = FALSE;");
       EL(1, "%s _nreturn_value = %s;", m->return_type->ctype, m->return_type->cnull);
       EL(1, "xr_value* _return_value;");
+      EL(1, "xr_wire_writer _w;");
       EL(1, "GError* _error = NULL;");
       for (k=m->params; k; k=k->next)
       {
@@ -1018,16 +2071,7 @@ int main(int ac, char* av[])
       EL(1, "g_return_val_if_fail(_servlet != NULL, FALSE);");
       EL(1, "g_return_val_if_fail(_call != NULL, FALSE);");
       // prepare parameters
-      for (k=m->params; k; k=k->next)
-      {
-        xdl_method_param* p = k->data;
-        NL;
-        EL(1, "if (!%s(xr_call_get_param(_call, %d), &%s))", p->type->demarch_name, n++, p->name);
-        EL(1, "{");
-        EL(2, "xr_call_set_error(_call, -1, \"Stub parameter value demarchalization failed. (%s:%s)\");", m->name, p->name);
-        EL(2, "goto out;");
-        EL(1, "}");
-      }
+      gen_params_demarch(f, m);
 
       // call stub
       NL;
@@ -1049,14 +2093,38 @@ int main(int ac, char* av[])
 
       // prepare retval
       NL;
-      EL(1, "_return_value = %s(_nreturn_value);", m->return_type->march_name);
-      EL(1, "if (_return_value == NULL)");
+      EL(1, "if (xr_call_get_transport(_call) == XR_CALL_BINARY)");
       EL(1, "{");
-      EL(2, "xr_call_set_error(_call, -1, \"Stub return value marchalization failed. (%s)\");", m->name);
-      EL(2, "goto out;");
-      EL(1, "}");
+      EL(2, "GString* _raw_retval = g_string_sized_new(128);");
       NL;
-      EL(1, "xr_call_set_retval(_call, _return_value);");
+      EL(2, "if (!%s(_raw_retval, 1, _nreturn_value))", m->return_type->binary_march_name);
+      EL(2, "{");
+      EL(3, "g_string_free(_raw_retval, TRUE);");
+      EL(3, "xr_call_set_error(_call, -1, \"Stub return value marchalization failed. (%s)\");", m->name);
+      EL(3, "goto out;");
+      EL(2, "}");
+      EL(2, "xr_call_set_raw_retval(_call, _raw_retval);");
+      EL(1, "}");
+      EL(1, "else if (xr_wire_writer_init_retval(&_w, _call))");
+      EL(1, "{");
+      EL(2, "if (!%s(&_w, _nreturn_value))", m->return_type->wire_march_name);
+      EL(2, "{");
+      EL(3, "xr_wire_writer_free(&_w);");
+      EL(3, "xr_call_set_error(_call, -1, \"Stub return value marchalization failed. (%s)\");", m->name);
+      EL(3, "goto out;");
+      EL(2, "}");
+      EL(2, "xr_wire_writer_finish_retval(&_w, _call);");
+      EL(1, "}");
+      EL(1, "else");
+      EL(1, "{");
+      EL(2, "_return_value = %s(_nreturn_value);", m->return_type->march_name);
+      EL(2, "if (_return_value == NULL)");
+      EL(2, "{");
+      EL(3, "xr_call_set_error(_call, -1, \"Stub return value marchalization failed. (%s)\");", m->name);
+      EL(3, "goto out;");
+      EL(2, "}");
+      EL(2, "xr_call_set_retval(_call, _return_value);");
+      EL(1, "}");
       EL(1, "_retval = TRUE;");
 
       // free native types and return
@@ -1093,6 +2161,8 @@ int main(int ac, char* av[])
   else \
     EL(1, "." G_STRINGIFY(n) " = NULL,")
 
+    has_lookup = s->methods && gen_method_lookup(f, s->methods);
+
     EL(0, "static xr_servlet_def __servlet = {");
     EL(1, ".name = \"%s%s\",", xdl->name, s->name);
     SET_STUB(init);
@@ -1102,8 +2172,13 @@ int main(int ac, char* av[])
     SET_STUB(fallback);
     SET_STUB(download);
     SET_STUB(upload);
+    SET_STUB(reset);
+    if (s->stateless)
+      EL(1, ".stateless = TRUE,");
+    EL(1, ".direct_params = TRUE,");
     EL(1, ".methods_count = %d,", g_slist_length(s->methods));
-    EL(1, ".methods = __servlet_methods");
+    EL(1, ".methods = __servlet_methods,");
+    EL(1, ".method_lookup = %s", has_lookup ? "__servlet_method_lookup" : "NULL");
     EL(0, "};");
     NL;
 
@@ -1174,9 +2249,16 @@ int main(int ac, char* av[])
   EL(2, "public ValueType get_type();");
   EL(2, "public void array_append(Value val);");
   EL(2, "public GLib.SList<weak Value> get_items();");
+  EL(2, "public uint array_length();");
+  EL(2, "public weak Value array_get(uint index);");
   EL(2, "public void set_member(string name, Value# val);");
   EL(2, "public weak Value get_member(string name);");
+  EL(2, "[CCode (cname = \"xr_value_struct_set_member_quark\")]");
+  EL(2, "public void set_member_quark(GLib.Quark key, Value# val);");
+  EL(2, "public weak Value get_member_quark(GLib.Quark key);");
   EL(2, "public weak GLib.SList<weak Value> get_members();");
+  EL(2, "public uint struct_length();");
+  EL(2, "public weak Value struct_get_nth(uint index);");
   EL(2, "public weak string get_member_name();");
   EL(2, "public weak Value get_member_value();");
   EL(2, "public bool is_error_retval(ref int code, ref string msg);");
@@ -1295,10 +2377,14 @@ int main(int ac, char* av[])
       NL;
       EL(0, "struct %s", t->name);
       EL(0, "{");
-      for (k=t->struct_members; k; k=k->next)
+      for (k=t->struct_members, n=1; k; k=k->next)
       {
         xdl_struct_member* m = k->data;
-        EL(1, "%-24s %s;", xdl_typedef_xdl_name(m->type), m->name);
+        if (m->field == n)
+          EL(1, "%-24s %s;", xdl_typedef_xdl_name(m->type), m->name);
+        else
+          EL(1, "%-24s %s = %d;", xdl_typedef_xdl_name(m->type), m->name, m->field);
+        n = m->field + 1;
       }
       EL(0, "}");
     }
@@ -1326,10 +2412,14 @@ int main(int ac, char* av[])
       {
         EL(1, "struct %s", t->name);
         EL(1, "{");
-        for (k=t->struct_members; k; k=k->next)
+        for (k=t->struct_members, n=1; k; k=k->next)
         {
           xdl_struct_member* m = k->data;
-          EL(2, "%-20s %s;", xdl_typedef_xdl_name(m->type), m->name);
+          if (m->field == n)
+            EL(2, "%-20s %s;", xdl_typedef_xdl_name(m->type), m->name);
+          else
+            EL(2, "%-20s %s = %d;", xdl_typedef_xdl_name(m->type), m->name, m->field);
+          n = m->field + 1;
         }
         EL(1, "}");
         NL;
@@ -1342,7 +2432,7 @@ int main(int ac, char* av[])
     {
       xdl_method* m = j->data;
 
-      E(1, "%-24s %-25s(", xdl_typedef_xdl_name(m->return_type), m->name);
+      E(1, "%s%-24s %-25s(", m->async ? "async " : "", xdl_typedef_xdl_name(m->return_type), m->name);
       for (k=m->params; k; k=k->next)
       {
         xdl_method_param* p = k->data;
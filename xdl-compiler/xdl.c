@@ -19,6 +19,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "xdl.h"
 
@@ -51,6 +52,23 @@ static xdl_typedef* xdl_typedef_new(int type, char* name, char* cname, char* cty
   else
     t->march_name = g_strdup_printf("__%s_to_xr_value", t->cname);
 
+  if (type == TD_STRUCT || type == TD_ARRAY)
+  {
+    t->binary_demarch_name = g_strdup_printf("__binary_to_%s", t->cname);
+    t->binary_march_name = g_strdup_printf("__%s_to_binary", t->cname);
+    t->wire_march_name = g_strdup_printf("__%s_to_wire", t->cname);
+    t->wire_demarch_name = g_strdup_printf("__wire_to_%s", t->cname);
+  }
+  else
+  {
+    const char* n = type == TD_BLOB ? "blob" : type == TD_ANY ? "value" : !strcmp(name, "time") ? "string" : !strcmp(name, "boolean") ? "bool" : name;
+
+    t->binary_demarch_name = g_strdup_printf("xr_binary_read_%s", n);
+    t->binary_march_name = g_strdup_printf("xr_binary_write_%s", n);
+    t->wire_march_name = g_strdup_printf("xr_wire_write_%s", !strcmp(name, "time") ? "time" : n);
+    t->wire_demarch_name = g_strdup_printf("xr_wire_read_%s", !strcmp(name, "time") ? "time" : n);
+  }
+
   return t;
 }
 
@@ -136,8 +154,68 @@ gint xdl_method_compare(xdl_method* m1, xdl_method* m2)
   return strcmp(m1->name, m2->name);
 }
 
+/* number struct members that don't have field number set, members are
+ * numbered from 1 in the order of declaration, member without number gets
+ * number of the previous member + 1 */
+static void xdl_process_struct_fields(GSList* types)
+{
+  GSList *i, *j, *k;
+
+  for (i=types; i; i=i->next)
+  {
+    xdl_typedef* t = i->data;
+    int next = 1;
+
+    if (t->type != TD_STRUCT)
+      continue;
+
+    for (j=t->struct_members; j; j=j->next)
+    {
+      xdl_struct_member* m = j->data;
+
+      if (m->field == 0)
+        m->field = next;
+      if (m->field < 1 || m->field > XDL_MAX_FIELD)
+      {
+        printf("Invalid field number %d of %s.%s\n", m->field, t->name, m->name);
+        exit(1);
+      }
+      next = m->field + 1;
+
+      for (k=t->struct_members; k != j; k=k->next)
+      {
+        xdl_struct_member* o = k->data;
+        if (o->field == m->field)
+        {
+          printf("Field number %d of %s.%s is already used by %s.%s\n", m->field, t->name, m->name, t->name, o->name);
+          exit(1);
+        }
+      }
+    }
+  }
+}
+
 void xdl_process(xdl_model *xdl)
 {
+  GSList *i, *j;
+
+  xdl_process_struct_fields(xdl->types);
+  for (i=xdl->servlets; i; i=i->next)
+  {
+    xdl_servlet* s = i->data;
+    xdl_process_struct_fields(s->types);
+
+    /* instance of stateless servlet serves other calls meanwhile */
+    for (j=s->methods; j && s->stateless; j=j->next)
+    {
+      xdl_method* m = j->data;
+      if (m->async)
+      {
+        printf("Async method %s.%s can't be used in stateless servlet\n", s->name, m->name);
+        exit(1);
+      }
+    }
+  }
 }
 
 xdl_error_code* xdl_error_new(xdl_model *xdl, xdl_servlet *servlet, char* name, int code)
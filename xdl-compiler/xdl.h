@@ -27,6 +27,8 @@
 
 /* types */
 
+#define XDL_MAX_FIELD 0x1fffffff /* field number is encoded as (field << 3) */
+
 enum
 {
   TD_BASE,
@@ -55,6 +57,10 @@ struct _xdl_typedef
 
   char* march_name;
   char* demarch_name;
+  char* binary_march_name;   /* schema binary encoding (XR_CALL_BINARY) */
+  char* binary_demarch_name;
+  char* wire_march_name;     /* direct XML-RPC/JSON-RPC writer (xr-wire.h) */
+  char* wire_demarch_name;   /* direct XML-RPC/JSON-RPC reader (xr-wire.h) */
   char* free_func;
   char* copy_func;
 
@@ -67,6 +73,7 @@ struct _xdl_struct_member
 {
   char* name;
   xdl_typedef* type;
+  int field;        /* field number in the binary encoding (0 if not set) */
 };
 
 /* methods */
@@ -86,6 +93,7 @@ struct _xdl_method
   char* stub_impl;
   int stub_impl_line;
   char* doc;
+  int async;        /* stub completes the call using xr_pending_call */
 };
 
 /* servlets */
@@ -107,6 +115,7 @@ struct _xdl_servlet
   char* stub_fallback;
   char* stub_download;
   char* stub_upload;
+  char* stub_reset;
   int stub_header_line;
   int stub_init_line;
   int stub_fini_line;
@@ -116,6 +125,9 @@ struct _xdl_servlet
   int stub_fallback_line;
   int stub_download_line;
   int stub_upload_line;
+  int stub_reset_line;
+
+  gboolean stateless; /* one instance per thread serves all connections */
 
   char* doc;
 };